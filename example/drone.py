@@ -5,6 +5,7 @@ import socket
 import json
 import select
 import time
+import struct
 
 MAX_TIMEOUT = 2
 
@@ -14,6 +15,41 @@ class Drone:
         self.ip = ip
         self.port = port
         self.udp_telem = False
+        self.session = None
+
+    def openSession(self):
+        '''
+            keeps one connection open, every request is then sent as
+            u32 big-endian length + payload and answered the same way
+        '''
+        sock = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+        sock.connect((self.ip, self.port))
+        sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+        sock.sendall(bytes(json.dumps({"command": "session"}), 'utf-8'))
+        if sock.recv(256) != b'success\x00':
+            sock.close()
+            return False
+        self.session = sock
+        return True
+
+    def closeSession(self):
+        if self.session:
+            self.session.close()
+            self.session = None
+
+    def __sessionRequest(self, raw):
+        self.session.sendall(struct.pack(">I", len(raw)) + raw)
+        length = struct.unpack(">I", self.__recvAll(4))[0]
+        return self.__recvAll(length)
+
+    def __recvAll(self, size):
+        data = b''
+        while len(data) < size:
+            chunk = self.session.recv(size - len(data))
+            if not chunk:
+                raise ConnectionError("session closed")
+            data += chunk
+        return data
 
     def registerUDP(self):
         command = {
@@ -23,6 +59,14 @@ class Drone:
         self.udp_telem = True
         return self.__sendPacket(command)
 
+    def unregisterUDP(self):
+        command = {
+            "command": "remove_udp"
+        }
+
+        self.udp_telem = False
+        return self.__sendPacket(command)
+
     def getTelem(self):
         if self.udp_telem:
             udp_sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
@@ -30,6 +74,8 @@ class Drone:
             data, _ = udp_sock.recvfrom(2048)
             udp_sock.close()
             return json.loads(data)
+        elif self.session:
+            return json.loads(self.__sessionRequest(b'get'))
         else:
             sock = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
             sock.connect((self.ip, self.port))
@@ -40,6 +86,8 @@ class Drone:
 
     def __sendPacket(self, command):
         raw_command = bytes(json.dumps(command), 'utf-8')
+        if self.session:
+            return self.__sessionRequest(raw_command) == b'success\x00'
         sock = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
         sock.connect((self.ip, self.port))
         sock.setblocking(0)
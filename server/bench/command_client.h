@@ -0,0 +1,141 @@
+#pragma once
+
+#include <cstring>
+#include <string>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// Client side of the server's command protocol, for the benchmark tools.
+// A one-shot connection carries one request and its reply ends at EOF. A session,
+// opened with {"command": "session"}, carries any number of requests and replies,
+// each framed by a 4 byte big endian length.
+// The server is a tcp address or the path of its unix socket (--unix-socket).
+class CommandClient
+{
+public:
+    CommandClient() = default;
+    CommandClient(const CommandClient &) = delete;
+    CommandClient &operator=(const CommandClient &) = delete;
+    ~CommandClient() { close(); }
+
+    template <typename Address>
+    bool open_session(const Address &server)
+    {
+        if (!connect_to(server))
+            return false;
+        const char start[] = "{\"command\": \"session\"}";
+        char reply[8];
+        if (write_all(start, sizeof(start) - 1) && read_all(reply, sizeof(reply)) && !memcmp(reply, "success", 8))
+            return true;
+        close();
+        return false;
+    }
+
+    bool send(const std::string &request)
+    {
+        uint32_t len = request.size();
+        char head[4] = {(char)(len >> 24), (char)(len >> 16), (char)(len >> 8), (char)len};
+        return write_all(head, 4) && write_all(request.data(), request.size());
+    }
+
+    bool receive(std::string &reply)
+    {
+        unsigned char head[4];
+        if (!read_all((char *)head, 4))
+            return false;
+        reply.resize(((uint32_t)head[0] << 24) | ((uint32_t)head[1] << 16) | ((uint32_t)head[2] << 8) | head[3]);
+        return read_all(&reply[0], reply.size());
+    }
+
+    bool call(const std::string &request, std::string &reply) { return send(request) && receive(reply); }
+
+    // a new connection for one request, like the example scripts
+    template <typename Address>
+    static bool oneshot(const Address &server, const std::string &request, std::string &reply)
+    {
+        CommandClient client;
+        if (!client.connect_to(server) || !client.write_all(request.data(), request.size()))
+            return false;
+        ::shutdown(client.fd_, SHUT_WR);
+        reply.clear();
+        char buf[4096];
+        ssize_t n;
+        while ((n = recv(client.fd_, buf, sizeof(buf), 0)) > 0)
+            reply.append(buf, n);
+        return n == 0;
+    }
+
+    // wakes a thread blocked in receive()
+    void shutdown()
+    {
+        if (fd_ >= 0)
+            ::shutdown(fd_, SHUT_RDWR);
+    }
+
+    void close()
+    {
+        if (fd_ >= 0)
+            ::close(fd_);
+        fd_ = -1;
+    }
+
+    bool is_open() const { return fd_ >= 0; }
+
+private:
+    bool connect_to(const struct sockaddr_in &server)
+    {
+        if (!connect_to((const struct sockaddr *)&server, sizeof(server)))
+            return false;
+        int one = 1;
+        setsockopt(fd_, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        return true;
+    }
+
+    bool connect_to(const struct sockaddr_un &server)
+    {
+        return connect_to((const struct sockaddr *)&server, sizeof(server));
+    }
+
+    bool connect_to(const struct sockaddr *server, socklen_t len)
+    {
+        close();
+        fd_ = socket(server->sa_family, SOCK_STREAM, 0);
+        if (fd_ < 0 || connect(fd_, server, len) < 0)
+        {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    bool write_all(const char *buf, size_t len)
+    {
+        while (len > 0)
+        {
+            ssize_t n = ::send(fd_, buf, len, MSG_NOSIGNAL);
+            if (n <= 0)
+                return false;
+            buf += n;
+            len -= n;
+        }
+        return true;
+    }
+
+    bool read_all(char *buf, size_t len)
+    {
+        while (len > 0)
+        {
+            ssize_t n = recv(fd_, buf, len, 0);
+            if (n <= 0)
+                return false;
+            buf += n;
+            len -= n;
+        }
+        return true;
+    }
+
+    int fd_ = -1;
+};
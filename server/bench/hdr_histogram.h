@@ -0,0 +1,89 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+// 2048 linear sub-buckets per power of two, values are kept to 1/1024 (3 significant digits)
+#define HDR_SUB_BUCKET_BITS 11
+// largest value tracked, larger ones count as this
+#define HDR_MAX_VALUE (3600ull * 1000 * 1000 * 1000)
+
+// High dynamic range histogram of nanosecond values, in the layout of HdrHistogram.
+// Values below 2048 are exact, above that every power of two is split into 1024 equal
+// buckets, so any recorded value is reported within 0.1%. One thread records; histograms
+// of several threads are merged for reporting.
+class HdrHistogram
+{
+public:
+    HdrHistogram() : counts_(index(HDR_MAX_VALUE) + 1, 0) {}
+
+    void record(uint64_t value)
+    {
+        value = std::min<uint64_t>(value, HDR_MAX_VALUE);
+        counts_[index(value)]++;
+        count_++;
+        sum_ += value;
+        min_ = std::min(min_, value);
+        max_ = std::max(max_, value);
+    }
+
+    void merge(const HdrHistogram &other)
+    {
+        for (size_t i = 0; i < counts_.size(); i++)
+            counts_[i] += other.counts_[i];
+        count_ += other.count_;
+        sum_ += other.sum_;
+        min_ = std::min(min_, other.min_);
+        max_ = std::max(max_, other.max_);
+    }
+
+    uint64_t count() const { return count_; }
+    uint64_t max() const { return max_; }
+    uint64_t min() const { return count_ ? min_ : 0; }
+    double mean() const { return count_ ? (double)sum_ / count_ : 0.0; }
+
+    // highest value equivalent to the one at quantile q (0..1), 0 when empty
+    uint64_t quantile(double q) const
+    {
+        if (count_ == 0)
+            return 0;
+        uint64_t rank = std::min<uint64_t>(count_ - 1, (uint64_t)(q * count_));
+        uint64_t seen = 0;
+        for (size_t i = 0; i < counts_.size(); i++)
+        {
+            seen += counts_[i];
+            if (seen > rank)
+                return std::min(highest_equivalent(i), max_);
+        }
+        return max_;
+    }
+
+private:
+    static constexpr uint64_t SUB_BUCKETS = 1ull << HDR_SUB_BUCKET_BITS;
+    static constexpr uint64_t HALF = SUB_BUCKETS / 2;
+
+    static size_t index(uint64_t value)
+    {
+        if (value < SUB_BUCKETS)
+            return value;
+        // value >> shift lands in the upper half of the sub-buckets
+        int shift = 63 - __builtin_clzll(value) - (HDR_SUB_BUCKET_BITS - 1);
+        return SUB_BUCKETS + (shift - 1) * HALF + ((value >> shift) - HALF);
+    }
+
+    static uint64_t highest_equivalent(size_t i)
+    {
+        if (i < SUB_BUCKETS)
+            return i;
+        int shift = (int)((i - SUB_BUCKETS) / HALF) + 1;
+        uint64_t sub = (i - SUB_BUCKETS) % HALF + HALF;
+        return ((sub + 1) << shift) - 1;
+    }
+
+    std::vector<uint64_t> counts_;
+    uint64_t count_ = 0;
+    uint64_t sum_ = 0;
+    uint64_t min_ = UINT64_MAX;
+    uint64_t max_ = 0;
+};
@@ -0,0 +1,710 @@
+// Microbenchmarks of the telemetry and command hot paths, on Google Benchmark.
+//
+// Covers, next to the code each one replaced where that existed:
+//  - the json encoder (with heap allocations per call, against the nlohmann document)
+//    and the binary encoder
+//  - TelemPack snapshots and updates, alone and next to a writer (against 17 atomics)
+//  - the command parse-and-dispatch path of every command type; vehicle commands run
+//    against a backend that answers at once, so they measure the server's own overhead
+//    including the hop to the control thread
+//  - round trips of get and offboard_cmd through a loopback server, one connection per
+//    request against a session, over tcp and over the unix socket
+//  - UDP fan-out of one tick to 1-1000 loopback subscribers (sendmmsg against the
+//    sendto loop), with syscalls per tick
+//  - a frame's way to a local reader and back, through the shm ring or loopback UDP
+//
+// The bench target runs everything and writes bench.json into the build directory;
+// keep one as baseline and compare later runs with Google Benchmark's tools/compare.py.
+//
+//   hot_paths_bench [--benchmark_filter=REGEX] [--benchmark_out=FILE --benchmark_out_format=json]
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <benchmark/benchmark.h>
+#include "../src/command_handler.h"
+#include "../src/command_server.h"
+#include "../src/telem_binary.h"
+#include "../src/telem_json.h"
+#include "../src/telem_shm_writer.h"
+#include "../src/udp_fanout.h"
+#include "command_client.h"
+#include "legacy_telem.h"
+
+// every heap allocation of the process, the serializer benchmarks report them per call.
+// Not inlined, gcc would pair the inlined malloc/free with new/delete and warn.
+static std::atomic<uint64_t> allocations{0};
+
+__attribute__((noinline)) void *operator new(size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void *p = malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+__attribute__((noinline)) void operator delete(void *p) noexcept
+{
+    free(p);
+}
+
+__attribute__((noinline)) void operator delete(void *p, size_t) noexcept
+{
+    free(p);
+}
+
+static void count_allocations(benchmark::State &state, uint64_t before)
+{
+    state.counters["allocs"] = benchmark::Counter((double)(allocations.load(std::memory_order_relaxed) - before),
+                                                  benchmark::Counter::kAvgIterations);
+}
+
+static TelemData sample_data(uint32_t i)
+{
+    TelemData d;
+    d.latitude = 47.397742 + i * 1e-7;
+    d.longitude = 8.545594 + i * 1e-7;
+    d.abs_alt = 493.25f;
+    d.rel_alt = 5.25f;
+    d.vel_north = 1.5f;
+    d.vel_east = -0.25f;
+    d.vel_down = 0.1f;
+    d.airspeed = 1.52f;
+    d.climb_rate = -0.1f;
+    d.pitch_deg = -4.5f;
+    d.roll_deg = 0.75f;
+    d.yaw_deg = (float)(i % 360) - 180.0f;
+    d.batt_percentage = 0.87f;
+    d.batt_voltage = 12.3f;
+    d.isAllOk = true;
+    d.isArmed = true;
+    d.inAir = true;
+    return d;
+}
+
+// Arg: sections
+static void BM_WriteTelemJson(benchmark::State &state)
+{
+    JsonWriter w;
+    TelemData data = sample_data(1);
+    uint64_t before = allocations.load(std::memory_order_relaxed);
+    for (auto _ : state)
+    {
+        w.clear();
+        write_telem_json(w, data, (uint8_t)state.range(0));
+        benchmark::DoNotOptimize(w.str().data());
+    }
+    count_allocations(state, before);
+    state.SetBytesProcessed(state.iterations() * w.str().size());
+}
+BENCHMARK(BM_WriteTelemJson)->Arg(TELEM_SECTION_ALL)->Arg(TELEM_SECTION_POSITION);
+
+// the nlohmann tree and dump() every tick used to build
+static void BM_LegacyPackToJson(benchmark::State &state)
+{
+    TelemData data = sample_data(1);
+    size_t size = 0;
+    uint64_t before = allocations.load(std::memory_order_relaxed);
+    for (auto _ : state)
+    {
+        std::string json = legacy_pack_to_json(data);
+        size = json.size();
+        benchmark::DoNotOptimize(json.data());
+    }
+    count_allocations(state, before);
+    state.SetBytesProcessed(state.iterations() * size);
+}
+BENCHMARK(BM_LegacyPackToJson);
+
+static void BM_EncodeTelemBinary(benchmark::State &state)
+{
+    uint8_t buf[TELEM_BINARY_MAX_SIZE];
+    TelemBinaryHeader hdr;
+    TelemData data = sample_data(1);
+    for (auto _ : state)
+    {
+        hdr.seq++;
+        benchmark::DoNotOptimize(encode_telem_binary(buf, hdr, data));
+    }
+}
+BENCHMARK(BM_EncodeTelemBinary);
+
+static void BM_PackSnapshot(benchmark::State &state)
+{
+    static TelemPack pack;
+    for (auto _ : state)
+    {
+        TelemData data = pack.snapshot();
+        benchmark::DoNotOptimize(data);
+    }
+}
+BENCHMARK(BM_PackSnapshot)->ThreadRange(1, 4);
+
+// snapshots while another thread publishes updates back to back, retries included
+static void BM_PackSnapshotContended(benchmark::State &state)
+{
+    TelemPack pack;
+    std::atomic<bool> stop{false};
+    std::thread writer([&]()
+                       {
+                           uint32_t i = 0;
+                           while (!stop.load(std::memory_order_relaxed))
+                               pack.update([&](TelemData &d)
+                                           { d = sample_data(i++); }); });
+    for (auto _ : state)
+    {
+        TelemData data = pack.snapshot();
+        benchmark::DoNotOptimize(data);
+    }
+    stop.store(true, std::memory_order_relaxed);
+    writer.join();
+}
+BENCHMARK(BM_PackSnapshotContended)->UseRealTime();
+
+static void BM_PackUpdate(benchmark::State &state)
+{
+    TelemPack pack;
+    float alt = 0.0f;
+    for (auto _ : state)
+        pack.update([&](TelemData &d)
+                    { d.rel_alt = alt += 0.01f; });
+}
+BENCHMARK(BM_PackUpdate);
+
+// what the position callback writes, four fields as one update
+static void BM_PackUpdatePosition(benchmark::State &state)
+{
+    TelemPack pack;
+    uint32_t i = 0;
+    for (auto _ : state)
+        pack.update([&](TelemData &d)
+                    {
+                        d.latitude = 47.397742 + i * 1e-7;
+                        d.longitude = 8.545594 + i * 1e-7;
+                        d.abs_alt = 493.25f;
+                        d.rel_alt = 5.25f + i++ * 0.01f; });
+}
+BENCHMARK(BM_PackUpdatePosition);
+
+// the same reads and writes on the 17 separate atomics TelemPack replaced
+static void BM_LegacyPackLoad(benchmark::State &state)
+{
+    static LegacyTelemPack pack;
+    for (auto _ : state)
+    {
+        TelemData data = pack.load();
+        benchmark::DoNotOptimize(data);
+    }
+}
+BENCHMARK(BM_LegacyPackLoad)->ThreadRange(1, 4);
+
+static void BM_LegacyPackLoadContended(benchmark::State &state)
+{
+    LegacyTelemPack pack;
+    std::atomic<bool> stop{false};
+    std::thread writer([&]()
+                       {
+                           uint32_t i = 0;
+                           while (!stop.load(std::memory_order_relaxed))
+                               pack.store(sample_data(i++)); });
+    for (auto _ : state)
+    {
+        TelemData data = pack.load();
+        benchmark::DoNotOptimize(data);
+    }
+    stop.store(true, std::memory_order_relaxed);
+    writer.join();
+}
+BENCHMARK(BM_LegacyPackLoadContended)->UseRealTime();
+
+static void BM_LegacyPackUpdate(benchmark::State &state)
+{
+    LegacyTelemPack pack;
+    float alt = 0.0f;
+    for (auto _ : state)
+        pack.rel_alt = alt += 0.01f;
+}
+BENCHMARK(BM_LegacyPackUpdate);
+
+static void BM_LegacyPackUpdatePosition(benchmark::State &state)
+{
+    LegacyTelemPack pack;
+    uint32_t i = 0;
+    for (auto _ : state)
+    {
+        pack.latitude = 47.397742 + i * 1e-7;
+        pack.longitude = 8.545594 + i * 1e-7;
+        pack.abs_alt = 493.25f;
+        pack.rel_alt = 5.25f + i++ * 0.01f;
+    }
+}
+BENCHMARK(BM_LegacyPackUpdatePosition);
+
+// Vehicle that accepts everything at once, leaves only the server's own work.
+class NullBackend : public VehicleBackend
+{
+public:
+    bool start(TelemUpdate) override { return true; }
+    bool arm() override { return true; }
+    bool set_takeoff_altitude(float) override { return true; }
+    bool takeoff() override { return true; }
+    bool land() override { return true; }
+    bool hold() override { return true; }
+    bool return_to_launch() override { return true; }
+    bool goto_location(double, double, float, float) override { return true; }
+    bool set_actuator(int, float) override { return true; }
+    bool offboard_start() override { return true; }
+    bool offboard_stop() override { return true; }
+    bool set_velocity_body(float, float, float, float) override { return true; }
+    bool in_offboard() const override { return true; }
+};
+
+#define HISTORY_BENCH_START_S 1700000000ull
+
+// the server state behind main()'s command handler
+struct CommandFixture
+{
+    ServerConfig config;
+    TelemPack pack;
+    TelemHistory history{HISTORY_MIN_SIZE * 4};
+    SubscriberRegistry subscribers;
+    PublishStats publish_stats;
+    NullBackend vehicle;
+    OffboardWatchdog watchdog{std::chrono::milliseconds(2000)};
+    ControlExecutor control;
+    MetricsRegistry metrics;
+    CommandHandler handler{config, pack, history, subscribers, publish_stats, vehicle, watchdog, control, metrics, nullptr, false};
+    struct sockaddr_in peer = {};
+
+    CommandFixture()
+    {
+        peer.sin_family = AF_INET;
+        peer.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        peer.sin_port = htons(40000);
+        // a full ring, one second at 4 kHz from HISTORY_BENCH_START_S on
+        for (uint32_t i = 0; i < history.capacity(); i++)
+            history.record(HISTORY_BENCH_START_S * 1000000ull + i * 250, pack.update([&](TelemData &d)
+                                                                                     { d = sample_data(i); }));
+    }
+};
+
+struct NullStreambuf : std::streambuf
+{
+    int overflow(int c) override { return c; }
+};
+
+// one request until its reply, also when the reply comes from the control thread
+static void run_command(benchmark::State &state, const std::string &request, const std::string &setup)
+{
+    // offboard commands log every call, a terminal would dominate the result
+    NullStreambuf null_buf;
+    auto *console = std::cout.rdbuf(&null_buf);
+    CommandFixture f;
+    std::atomic<bool> answered{false};
+    std::string response;
+    auto reply = [&](std::string r)
+    {
+        response = std::move(r);
+        answered.store(true, std::memory_order_release);
+    };
+
+    for (auto _ : state)
+    {
+        if (!setup.empty())
+        {
+            state.PauseTiming();
+            answered.store(false, std::memory_order_relaxed);
+            f.handler.handle(setup, f.peer, reply);
+            while (!answered.load(std::memory_order_acquire))
+                ;
+            state.ResumeTiming();
+        }
+        answered.store(false, std::memory_order_relaxed);
+        f.handler.handle(request, f.peer, reply);
+        while (!answered.load(std::memory_order_acquire))
+            ;
+    }
+    std::cout.rdbuf(console);
+    // a failing command measures the wrong path
+    if (response.empty() || response.compare(0, 6, "failed") == 0 || response.compare(0, 5, "[json") == 0)
+        state.SkipWithError(("unexpected reply: " + response).c_str());
+}
+
+struct CommandCase
+{
+    const char *name;
+    const char *request;
+    // runs untimed before every request
+    const char *setup;
+};
+
+static const CommandCase COMMANDS[] = {
+    {"get", "get", ""},
+    {"stats", R"({"command": "stats"})", ""},
+    {"stats_prometheus", R"({"command": "stats", "format": "prometheus"})", ""},
+    {"history_1s_step_100ms", R"({"command": "history", "from": 1700000000, "to": 1700000001, "step": 0.1})", ""},
+    {"history_10_samples_binary", R"({"command": "history", "from": 1700000001.0215, "format": "binary"})", ""},
+    {"add_udp", R"({"command": "add_udp", "port": 7000, "format": "binary", "rate": 10})", ""},
+    {"renew_udp", R"({"command": "renew_udp", "port": 7000, "lease": 5})", R"({"command": "add_udp", "port": 7000, "lease": 5})"},
+    {"remove_udp", R"({"command": "remove_udp", "port": 7000})", R"({"command": "add_udp", "port": 7000})"},
+    {"takeoff", R"({"command": "takeoff", "alt": 5})", ""},
+    {"arm_takeoff", R"({"command": "arm_takeoff", "alt": 5})", ""},
+    {"goto", R"({"command": "goto", "lat": 47.3978, "lon": 8.5456, "alt": 10, "heading": 90})", ""},
+    {"rtl", R"({"command": "rtl"})", ""},
+    {"land", R"({"command": "land"})", ""},
+    {"hold", R"({"command": "hold"})", ""},
+    {"actuator", R"({"command": "actuator", "index": 1, "value": 0.5})", ""},
+    {"offboard_start", R"({"command": "offboard_start"})", ""},
+    {"offboard_cmd", R"({"command": "offboard_cmd", "x": 1.0, "y": 0.5, "z": 0})", ""},
+    {"offboard_stop", R"({"command": "offboard_stop"})", ""},
+};
+
+// loopback sockets nobody reads standing in for subscribers, the kernel drops what does not fit
+struct UdpSinks
+{
+    std::vector<int> fds;
+    std::vector<struct sockaddr_in> addrs;
+
+    bool open(int count)
+    {
+        for (int i = 0; i < count; i++)
+        {
+            int fd = socket(AF_INET, SOCK_DGRAM, 0);
+            struct sockaddr_in addr = {};
+            addr.sin_family = AF_INET;
+            addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            socklen_t len = sizeof(addr);
+            if (fd < 0 || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || getsockname(fd, (struct sockaddr *)&addr, &len) < 0)
+                return false;
+            fds.push_back(fd);
+            addrs.push_back(addr);
+        }
+        return true;
+    }
+
+    ~UdpSinks()
+    {
+        for (int fd : fds)
+            close(fd);
+    }
+};
+
+static std::string fanout_payload(bool binary)
+{
+    if (!binary)
+    {
+        JsonWriter w;
+        write_telem_json(w, sample_data(1));
+        return w.str();
+    }
+    uint8_t buf[TELEM_BINARY_MAX_SIZE];
+    return std::string((const char *)buf, encode_telem_binary(buf, TelemBinaryHeader(), sample_data(1)));
+}
+
+#define FANOUT_SUBSCRIBERS {1, 10, 100, 1000}
+
+// one tick to every subscriber, Arg: subscribers, format 0 json / 1 binary
+static void BM_UdpFanout(benchmark::State &state)
+{
+    int send_fd = socket(AF_INET, SOCK_DGRAM, 0);
+    UdpFanout fanout(send_fd, MSG_CONFIRM);
+    UdpSinks sinks;
+    if (!sinks.open((int)state.range(0)))
+    {
+        state.SkipWithError("sink socket failed");
+        close(send_fd);
+        return;
+    }
+    for (auto &addr : sinks.addrs)
+        fanout.add(TelemDest::inet(addr));
+
+    std::string payload = fanout_payload(state.range(1) != 0);
+    size_t datagrams = 0;
+    for (auto _ : state)
+        datagrams += fanout.send(payload.data(), payload.size());
+    state.SetItemsProcessed(datagrams);
+    state.SetBytesProcessed(datagrams * payload.size());
+    state.counters["syscalls"] = (double)fanout.last_syscalls();
+    close(send_fd);
+}
+BENCHMARK(BM_UdpFanout)->ArgNames({"subscribers", "binary"})->ArgsProduct({FANOUT_SUBSCRIBERS, {0, 1}});
+
+// the loop UdpFanout replaced: parse the address string and sendto, per subscriber and tick
+static void BM_LegacySendtoFanout(benchmark::State &state)
+{
+    int send_fd = socket(AF_INET, SOCK_DGRAM, 0);
+    UdpSinks sinks;
+    if (!sinks.open((int)state.range(0)))
+    {
+        state.SkipWithError("sink socket failed");
+        close(send_fd);
+        return;
+    }
+    std::vector<std::pair<std::string, uint16_t>> ips;
+    for (auto &addr : sinks.addrs)
+        ips.emplace_back("127.0.0.1", ntohs(addr.sin_port));
+
+    std::string payload = fanout_payload(state.range(1) != 0);
+    struct sockaddr_in cliaddr = {};
+    size_t datagrams = 0;
+    for (auto _ : state)
+        for (auto &ip : ips)
+        {
+            cliaddr.sin_family = AF_INET;
+            cliaddr.sin_addr.s_addr = inet_addr(ip.first.c_str());
+            cliaddr.sin_port = htons(ip.second);
+            if (sendto(send_fd, payload.data(), payload.size(), MSG_CONFIRM, (const struct sockaddr *)&cliaddr, sizeof(cliaddr)) >= 0)
+                datagrams++;
+        }
+    state.SetItemsProcessed(datagrams);
+    state.SetBytesProcessed(datagrams * payload.size());
+    state.counters["syscalls"] = (double)ips.size();
+    close(send_fd);
+}
+BENCHMARK(BM_LegacySendtoFanout)->ArgNames({"subscribers", "binary"})->ArgsProduct({FANOUT_SUBSCRIBERS, {0, 1}});
+
+// A CommandServer on a loopback port in front of a fixture, started on first use and left
+// running for the rest of the process since run() never returns.
+struct LoopbackServer
+{
+    CommandFixture fixture;
+    CommandServer server{[this](const std::string &request, const struct sockaddr_in &peer, CommandServer::Reply reply)
+                         { fixture.handler.handle(request, peer, std::move(reply)); }};
+    struct sockaddr_in tcp = {};
+    struct sockaddr_un unix_socket = {};
+    bool ok = false;
+};
+
+static LoopbackServer &loopback_server()
+{
+    static LoopbackServer *s = []()
+    {
+        auto *s = new LoopbackServer();
+        // a port the kernel hands out as free
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        s->tcp.sin_family = AF_INET;
+        s->tcp.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t len = sizeof(s->tcp);
+        bool bound = fd >= 0 && bind(fd, (struct sockaddr *)&s->tcp, sizeof(s->tcp)) == 0 &&
+                     getsockname(fd, (struct sockaddr *)&s->tcp, &len) == 0;
+        if (fd >= 0)
+            close(fd);
+        s->unix_socket.sun_family = AF_UNIX;
+        snprintf(s->unix_socket.sun_path, sizeof(s->unix_socket.sun_path), "/tmp/hot_paths_bench_%d.sock", (int)getpid());
+        s->ok = bound && s->server.listen(ntohs(s->tcp.sin_port)) && s->server.listen_unix(s->unix_socket.sun_path, 0600);
+        if (s->ok)
+        {
+            std::thread([s]()
+                        { s->server.run(); })
+                .detach();
+            // the server lives until exit, its socket file should not outlive it
+            std::atexit([]()
+                        { unlink(loopback_server().unix_socket.sun_path); });
+        }
+        return s;
+    }();
+    return *s;
+}
+
+static const char *const ROUND_TRIP_REQUESTS[] = {"get", R"({"command": "offboard_cmd", "x": 1.0, "y": 0.5, "z": 0})"};
+
+// one request and its reply through the kernel, the way clients see it
+// Arg: 0 a connection per request / 1 a session, request 0 get / 1 offboard_cmd,
+// 0 tcp / 1 unix socket
+template <typename Address>
+static void command_round_trips(benchmark::State &state, const Address &server)
+{
+    bool session_mode = state.range(0) != 0;
+    std::string request = ROUND_TRIP_REQUESTS[state.range(1)];
+    CommandClient session;
+    std::string reply;
+
+    if (session_mode && !session.open_session(server))
+        state.SkipWithError("session refused");
+    else
+        for (auto _ : state)
+        {
+            bool ok = session_mode ? session.call(request, reply) : CommandClient::oneshot(server, request, reply);
+            if (!ok || reply.empty() || reply.compare(0, 6, "failed") == 0)
+            {
+                state.SkipWithError(("round trip failed: " + reply).c_str());
+                break;
+            }
+        }
+}
+
+static void BM_CommandRoundTrip(benchmark::State &state)
+{
+    NullStreambuf null_buf;
+    auto *console = std::cout.rdbuf(&null_buf);
+    LoopbackServer &s = loopback_server();
+    if (!s.ok)
+        state.SkipWithError("loopback server failed");
+    else if (state.range(2) != 0)
+        command_round_trips(state, s.unix_socket);
+    else
+        command_round_trips(state, s.tcp);
+    state.SetItemsProcessed(state.iterations());
+    std::cout.rdbuf(console);
+}
+BENCHMARK(BM_CommandRoundTrip)->ArgNames({"session", "request", "unix"})->ArgsProduct({{0, 1}, {0, 1}, {0, 1}})->UseRealTime();
+
+// Frames bounced between this thread and an echo thread that reads them like a local
+// consumer would: from the shm ring by polling head, or from a loopback UDP socket in
+// a blocking recv. Half the round trip is the latency from publishing a frame to a
+// reader holding it decoded.
+struct ShmEcho
+{
+    std::string ping_name = "/hot_paths_bench_ping_" + std::to_string(getpid());
+    std::string pong_name = "/hot_paths_bench_pong_" + std::to_string(getpid());
+    TelemShmWriter ping, pong;
+    TelemShmReader ping_reader, pong_reader;
+
+    bool open()
+    {
+        return ping.open(ping_name, 16) && pong.open(pong_name, 16) &&
+               ping_reader.open(ping_name.c_str()) && pong_reader.open(pong_name.c_str());
+    }
+
+    // polls until frame index arrives, false when stop was set meanwhile
+    static bool wait(const TelemShmReader &reader, uint64_t index, const std::atomic<bool> &stop)
+    {
+        while (reader.head() <= index)
+        {
+            if (stop.load(std::memory_order_relaxed))
+                return false;
+            std::this_thread::yield();
+        }
+        return true;
+    }
+};
+
+struct UdpEcho
+{
+    int fd = -1, echo_fd = -1;
+    struct sockaddr_in echo_addr = {};
+
+    bool open()
+    {
+        fd = socket(AF_INET, SOCK_DGRAM, 0);
+        echo_fd = socket(AF_INET, SOCK_DGRAM, 0);
+        struct sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        echo_addr = addr;
+        socklen_t len = sizeof(echo_addr);
+        // the echo side wakes up now and then to see whether the benchmark is done
+        struct timeval tv = {0, 100000};
+        return fd >= 0 && echo_fd >= 0 && bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0 &&
+               bind(echo_fd, (struct sockaddr *)&echo_addr, sizeof(echo_addr)) == 0 &&
+               getsockname(echo_fd, (struct sockaddr *)&echo_addr, &len) == 0 &&
+               setsockopt(echo_fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) == 0;
+    }
+
+    ~UdpEcho()
+    {
+        if (fd >= 0)
+            close(fd);
+        if (echo_fd >= 0)
+            close(echo_fd);
+    }
+};
+
+// Arg: 0 shm ring / 1 loopback udp
+static void BM_LocalTelemRoundTrip(benchmark::State &state)
+{
+    bool udp = state.range(0) != 0;
+    ShmEcho shm;
+    UdpEcho sockets;
+    if (!(udp ? sockets.open() : shm.open()))
+    {
+        state.SkipWithError("transport setup failed");
+        return;
+    }
+
+    std::atomic<bool> stop{false};
+    std::thread echo([&]()
+                     {
+                         uint8_t buf[TELEM_BINARY_MAX_SIZE];
+                         TelemBinaryHeader hdr;
+                         TelemData data;
+                         for (uint64_t i = 0; !stop.load(std::memory_order_relaxed); i++)
+                         {
+                             size_t size;
+                             if (udp)
+                             {
+                                 struct sockaddr_in from;
+                                 socklen_t len = sizeof(from);
+                                 ssize_t n = recvfrom(sockets.echo_fd, buf, sizeof(buf), 0, (struct sockaddr *)&from, &len);
+                                 if (n <= 0 || !decode_telem_binary(buf, n, hdr, data))
+                                     continue;
+                                 size = encode_telem_binary(buf, hdr, data);
+                                 sendto(sockets.echo_fd, buf, size, 0, (struct sockaddr *)&from, len);
+                             }
+                             else
+                             {
+                                 if (!ShmEcho::wait(shm.ping_reader, i, stop) || !shm.ping_reader.latest(hdr, data))
+                                     continue;
+                                 size = encode_telem_binary(buf, hdr, data);
+                                 shm.pong.write(buf, size);
+                             }
+                         } });
+
+    uint8_t frame[TELEM_BINARY_MAX_SIZE];
+    TelemBinaryHeader hdr;
+    TelemData data = sample_data(0);
+    uint64_t index = 0;
+    for (auto _ : state)
+    {
+        hdr.seq = (uint32_t)index;
+        size_t size = encode_telem_binary(frame, hdr, data);
+        TelemBinaryHeader echoed;
+        bool ok;
+        if (udp)
+        {
+            ssize_t n = -1;
+            if (sendto(sockets.fd, frame, size, 0, (struct sockaddr *)&sockets.echo_addr, sizeof(sockets.echo_addr)) == (ssize_t)size)
+                n = recv(sockets.fd, frame, sizeof(frame), 0);
+            ok = n > 0 && decode_telem_binary(frame, n, echoed, data);
+        }
+        else
+        {
+            shm.ping.write(frame, size);
+            ok = ShmEcho::wait(shm.pong_reader, index, stop) && shm.pong_reader.latest(echoed, data);
+        }
+        if (!ok || echoed.seq != (uint32_t)index)
+        {
+            state.SkipWithError("frame lost");
+            break;
+        }
+        index++;
+    }
+    stop = true;
+    echo.join();
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_LocalTelemRoundTrip)->ArgName("udp")->Arg(0)->Arg(1)->UseRealTime();
+
+int main(int argc, char **argv)
+{
+    for (auto &c : COMMANDS)
+        benchmark::RegisterBenchmark((std::string("BM_Command/") + c.name).c_str(), run_command, std::string(c.request), std::string(c.setup));
+
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv))
+        return 1;
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
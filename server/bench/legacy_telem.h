@@ -0,0 +1,115 @@
+#pragma once
+
+#include <atomic>
+#include <string>
+#include "../lib/json.hpp"
+#include "../src/telem_pack.h"
+
+// The telemetry pack as it was before TelemPack: one atomic per field, written by the
+// MAVSDK callbacks field by field and read with 17 separate loads. Kept only as the
+// baseline the benchmarks compare the current code with.
+struct LegacyTelemPack
+{
+    // position
+    std::atomic<double> latitude{0.0};
+    std::atomic<double> longitude{0.0};
+    std::atomic<float> abs_alt{0.0f};
+    std::atomic<float> rel_alt{0.0f};
+    // velocity
+    std::atomic<float> vel_north{0.0f};
+    std::atomic<float> vel_east{0.0f};
+    std::atomic<float> vel_down{0.0f};
+    // plane data
+    std::atomic<float> airspeed{0.0f};
+    std::atomic<float> climb_rate{0.0f};
+    // angle
+    std::atomic<float> roll_deg{0.0f};
+    std::atomic<float> pitch_deg{0.0f};
+    std::atomic<float> yaw_deg{0.0f};
+    // misc
+    std::atomic<bool> isAllOk{false};
+    std::atomic<bool> isArmed{false};
+    std::atomic<bool> inAir{false};
+    std::atomic<float> batt_percentage{0.0f};
+    std::atomic<float> batt_voltage{0.0f};
+
+    // what pack_to_json read, each field on its own and possibly from different updates
+    TelemData load() const
+    {
+        TelemData d;
+        d.latitude = latitude;
+        d.longitude = longitude;
+        d.abs_alt = abs_alt;
+        d.rel_alt = rel_alt;
+        d.vel_north = vel_north;
+        d.vel_east = vel_east;
+        d.vel_down = vel_down;
+        d.airspeed = airspeed;
+        d.climb_rate = climb_rate;
+        d.roll_deg = roll_deg;
+        d.pitch_deg = pitch_deg;
+        d.yaw_deg = yaw_deg;
+        d.isAllOk = isAllOk;
+        d.isArmed = isArmed;
+        d.inAir = inAir;
+        d.batt_percentage = batt_percentage;
+        d.batt_voltage = batt_voltage;
+        return d;
+    }
+
+    void store(const TelemData &d)
+    {
+        latitude = d.latitude;
+        longitude = d.longitude;
+        abs_alt = d.abs_alt;
+        rel_alt = d.rel_alt;
+        vel_north = d.vel_north;
+        vel_east = d.vel_east;
+        vel_down = d.vel_down;
+        airspeed = d.airspeed;
+        climb_rate = d.climb_rate;
+        roll_deg = d.roll_deg;
+        pitch_deg = d.pitch_deg;
+        yaw_deg = d.yaw_deg;
+        isAllOk = d.isAllOk;
+        isArmed = d.isArmed;
+        inAir = d.inAir;
+        batt_percentage = d.batt_percentage;
+        batt_voltage = d.batt_voltage;
+    }
+};
+
+// the document as pack_to_json built it, a nlohmann tree dumped on every tick
+inline nlohmann::json legacy_telem_tree(const TelemData &pack)
+{
+    nlohmann::json j;
+    j["position"] = {
+        {"lat", pack.latitude},
+        {"lon", pack.longitude},
+        {"alt_abs", pack.abs_alt},
+        {"alt_rel", pack.rel_alt}};
+    j["velocity"] = {
+        {"north", pack.vel_north},
+        {"east", pack.vel_east},
+        {"down", pack.vel_down}};
+    j["plane"] = {
+        {"airspeed", pack.airspeed},
+        {"climbrate", pack.climb_rate}};
+    j["angles"] = {
+        {"pitch", pack.pitch_deg},
+        {"roll", pack.roll_deg},
+        {"yaw", pack.yaw_deg}};
+    j["battery"] = {
+        {"percent", pack.batt_percentage},
+        {"voltage", pack.batt_voltage}};
+    j["misc"] = {
+        {"health", pack.isAllOk},
+        {"armed", pack.isArmed},
+        {"inAir", pack.inAir}};
+    return j;
+}
+
+inline std::string legacy_pack_to_json(const TelemData &pack)
+{
+    return legacy_telem_tree(pack).dump();
+}
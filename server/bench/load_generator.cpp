@@ -0,0 +1,447 @@
+// Multi-client load generator for a running server.
+//
+// Opens a mix of clients against the command port and measures what each of them sees:
+//   --pollers N      dashboards polling "get" at --poll-rate Hz
+//   --streamers N    operators streaming offboard_cmd at --cmd-rate Hz
+//   --subscribers N  UDP telemetry subscribers in --format json|binary at --sub-rate Hz
+//   --takeoffs N     operators keeping an arm_takeoff in flight back to back, which holds
+//                    the control thread for three autopilot round trips each time
+//   --stalled N      clients that stop halfway: every other one sends half a request and
+//                    goes silent, the rest pipeline requests over a session and never read
+// Every client is a thread of its own. Requests go over a command session, or a connection
+// per request like the example scripts with --oneshot. Rated clients run open loop: latency
+// counts from the time a request was due, so a stalled server shows in the tail instead of
+// just lowering the request rate. Rate 0 runs a client closed loop, back to back.
+//
+// Latencies and UDP inter-arrival times land in HDR histograms, p50/p99/p99.9/max and
+// throughput of every request type are printed after --seconds, the first --warmup seconds
+// are not counted. Loss is counted from the sequence numbers of binary frames.
+//
+// Against a server without a vehicle:
+//   server --backend mock
+//   load_generator --pollers 40 --streamers 2 --subscribers 8 --seconds 30
+
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "../src/telem_binary.h"
+#include "command_client.h"
+#include "hdr_histogram.h"
+
+using Clock = std::chrono::steady_clock;
+
+#define SUBSCRIBER_RCVBUF (1 << 20)
+#define RECONNECT_DELAY_MS 100
+
+static std::atomic<bool> stop_requested{false};
+
+static void on_signal(int)
+{
+    stop_requested.store(true, std::memory_order_relaxed);
+}
+
+struct LoadConfig
+{
+    struct sockaddr_in server = {};
+    int pollers = 10;
+    double poll_rate = 10.0;
+    int streamers = 1;
+    double cmd_rate = 50.0;
+    int subscribers = 4;
+    bool binary = true;
+    double sub_rate = 0.0;
+    int takeoffs = 0;
+    int stalled = 0;
+    bool oneshot = false;
+    double seconds = 10.0;
+    double warmup = 1.0;
+};
+
+// what one request client saw, merged over all clients of a type for the report
+struct RequestStats
+{
+    HdrHistogram latency;
+    uint64_t errors = 0;
+
+    void merge(const RequestStats &other)
+    {
+        latency.merge(other.latency);
+        errors += other.errors;
+    }
+};
+
+struct SubscriberStats
+{
+    HdrHistogram interarrival;
+    uint64_t packets = 0;
+    uint64_t bytes = 0;
+    uint64_t lost = 0;
+    uint64_t reordered = 0;
+
+    void merge(const SubscriberStats &other)
+    {
+        interarrival.merge(other.interarrival);
+        packets += other.packets;
+        bytes += other.bytes;
+        lost += other.lost;
+        reordered += other.reordered;
+    }
+};
+
+static bool is_error(const std::string &reply)
+{
+    return reply.empty() || reply.compare(0, 6, "failed") == 0 || reply.compare(0, 5, "[json") == 0;
+}
+
+// one client sending request at rate Hz until stop_requested, counting from measure_from on
+static void request_client(const LoadConfig &config, const std::string &request, double rate, double phase,
+                           Clock::time_point measure_from, RequestStats &stats)
+{
+    CommandClient session;
+    std::string reply;
+    auto period = rate > 0.0 ? std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / rate))
+                             : Clock::duration::zero();
+    // clients of a type spread over one period instead of firing in lockstep
+    auto due = Clock::now() + std::chrono::duration_cast<Clock::duration>(period * phase);
+
+    while (!stop_requested.load(std::memory_order_relaxed))
+    {
+        if (rate > 0.0)
+            std::this_thread::sleep_until(due);
+        else
+            due = Clock::now();
+
+        bool ok;
+        if (config.oneshot)
+            ok = CommandClient::oneshot(config.server, request, reply);
+        else
+        {
+            ok = session.is_open() || session.open_session(config.server);
+            ok = ok && session.call(request, reply);
+            if (!ok)
+                session.close();
+        }
+        auto done = Clock::now();
+
+        if (due >= measure_from)
+        {
+            if (!ok || is_error(reply))
+                stats.errors++;
+            else
+                stats.latency.record(std::chrono::duration_cast<std::chrono::nanoseconds>(done - due).count());
+        }
+        if (!ok)
+            std::this_thread::sleep_for(std::chrono::milliseconds(RECONNECT_DELAY_MS));
+        due += period;
+    }
+}
+
+static bool subscribe(const LoadConfig &config, const char *command, uint16_t port)
+{
+    std::string request = std::string("{\"command\": \"") + command + "\", \"port\": " + std::to_string(port);
+    if (!strcmp(command, "add_udp"))
+    {
+        request += config.binary ? ", \"format\": \"binary\"" : ", \"format\": \"json\"";
+        if (config.sub_rate > 0.0)
+            request += ", \"rate\": " + std::to_string(config.sub_rate);
+    }
+    request += "}";
+    std::string reply;
+    return CommandClient::oneshot(config.server, request, reply) && reply == std::string("success", 8);
+}
+
+static void subscriber_client(const LoadConfig &config, Clock::time_point measure_from, SubscriberStats &stats, std::atomic<int> &failed)
+{
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    struct sockaddr_in local = {};
+    local.sin_family = AF_INET;
+    local.sin_addr.s_addr = htonl(INADDR_ANY);
+    socklen_t local_len = sizeof(local);
+    struct timeval timeout = {0, 100000};
+    int rcvbuf = SUBSCRIBER_RCVBUF;
+    if (fd < 0 || bind(fd, (struct sockaddr *)&local, sizeof(local)) < 0 ||
+        getsockname(fd, (struct sockaddr *)&local, &local_len) < 0 ||
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) < 0 ||
+        setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf)) < 0 ||
+        !subscribe(config, "add_udp", ntohs(local.sin_port)))
+    {
+        failed++;
+        if (fd >= 0)
+            close(fd);
+        return;
+    }
+
+    uint8_t buf[65536];
+    bool have_seq = false;
+    uint32_t last_seq = 0;
+    Clock::time_point last;
+    while (!stop_requested.load(std::memory_order_relaxed))
+    {
+        ssize_t len = recv(fd, buf, sizeof(buf), 0);
+        auto now = Clock::now();
+        if (len <= 0 || now < measure_from)
+            continue;
+
+        if (stats.packets > 0)
+            stats.interarrival.record(std::chrono::duration_cast<std::chrono::nanoseconds>(now - last).count());
+        last = now;
+        stats.packets++;
+        stats.bytes += len;
+
+        TelemBinaryHeader hdr;
+        TelemData data;
+        if (!config.binary || !decode_telem_binary(buf, len, hdr, data))
+            continue;
+        // a whole stream shares one sequence, every gap is a datagram this subscriber missed
+        if (have_seq && hdr.seq <= last_seq)
+            stats.reordered++;
+        else
+        {
+            if (have_seq)
+                stats.lost += hdr.seq - last_seq - 1;
+            last_seq = hdr.seq;
+            have_seq = true;
+        }
+    }
+
+    subscribe(config, "remove_udp", ntohs(local.sin_port));
+    close(fd);
+}
+
+// Holds a connection the server can do nothing with until the server drops it, then
+// stalls again on a new one. Half a request is what froze the blocking server; a session
+// that never reads its replies fills the server's output buffer instead.
+static void stalled_client(const LoadConfig &config, bool half_request, std::atomic<uint64_t> &dropped)
+{
+    const char half[] = "{\"command\": \"ge";
+    const char start[] = "{\"command\": \"session\"}";
+    const char frame[] = {0, 0, 0, 3, 'g', 'e', 't'};
+
+    while (!stop_requested.load(std::memory_order_relaxed))
+    {
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd < 0 || connect(fd, (const struct sockaddr *)&config.server, sizeof(config.server)) < 0)
+        {
+            if (fd >= 0)
+                close(fd);
+            std::this_thread::sleep_for(std::chrono::milliseconds(RECONNECT_DELAY_MS));
+            continue;
+        }
+
+        bool ok;
+        if (half_request)
+            ok = send(fd, half, sizeof(half) - 1, MSG_NOSIGNAL) > 0;
+        else
+        {
+            // the session reply is the last thing read, then requests go out until the socket is full
+            char reply[8];
+            ok = send(fd, start, sizeof(start) - 1, MSG_NOSIGNAL) > 0 && recv(fd, reply, sizeof(reply), MSG_WAITALL) == sizeof(reply);
+            while (ok && !stop_requested.load(std::memory_order_relaxed) && send(fd, frame, sizeof(frame), MSG_NOSIGNAL | MSG_DONTWAIT) > 0)
+                ;
+        }
+
+        // the peer closing shows as RDHUP even with replies left unread
+        struct pollfd pfd = {fd, POLLRDHUP, 0};
+        while (ok && !stop_requested.load(std::memory_order_relaxed))
+            if (poll(&pfd, 1, 100) > 0)
+            {
+                dropped++;
+                break;
+            }
+        close(fd);
+        if (!ok)
+            std::this_thread::sleep_for(std::chrono::milliseconds(RECONNECT_DELAY_MS));
+    }
+}
+
+static void print_requests(const char *name, const RequestStats &stats, int clients, double seconds)
+{
+    if (clients == 0)
+        return;
+    const HdrHistogram &h = stats.latency;
+    printf("%-14s %5d %9lu %7lu %9.1f %9.1f %9.1f %9.1f %9.1f\n", name, clients, (unsigned long)h.count(),
+           (unsigned long)stats.errors, h.count() / seconds, h.quantile(0.5) / 1e3, h.quantile(0.99) / 1e3,
+           h.quantile(0.999) / 1e3, h.max() / 1e3);
+}
+
+static void usage(const char *prog)
+{
+    printf("usage: %s [--server HOST] [--port PORT] [--pollers N] [--poll-rate HZ] [--streamers N] [--cmd-rate HZ]\n"
+           "          [--subscribers N] [--format json|binary] [--sub-rate HZ] [--takeoffs N] [--stalled N]\n"
+           "          [--oneshot] [--seconds S] [--warmup S]\n",
+           prog);
+}
+
+int main(int argc, char **argv)
+{
+    LoadConfig config;
+    std::string host = "127.0.0.1";
+    int port = 6969;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--server" && has_value)
+            host = argv[++i];
+        else if (arg == "--port" && has_value)
+            port = atoi(argv[++i]);
+        else if (arg == "--pollers" && has_value)
+            config.pollers = atoi(argv[++i]);
+        else if (arg == "--poll-rate" && has_value)
+            config.poll_rate = atof(argv[++i]);
+        else if (arg == "--streamers" && has_value)
+            config.streamers = atoi(argv[++i]);
+        else if (arg == "--cmd-rate" && has_value)
+            config.cmd_rate = atof(argv[++i]);
+        else if (arg == "--subscribers" && has_value)
+            config.subscribers = atoi(argv[++i]);
+        else if (arg == "--format" && has_value)
+        {
+            std::string format = argv[++i];
+            if (format != "json" && format != "binary")
+            {
+                usage(argv[0]);
+                return 1;
+            }
+            config.binary = format == "binary";
+        }
+        else if (arg == "--sub-rate" && has_value)
+            config.sub_rate = atof(argv[++i]);
+        else if (arg == "--takeoffs" && has_value)
+            config.takeoffs = atoi(argv[++i]);
+        else if (arg == "--stalled" && has_value)
+            config.stalled = atoi(argv[++i]);
+        else if (arg == "--oneshot")
+            config.oneshot = true;
+        else if (arg == "--seconds" && has_value)
+            config.seconds = atof(argv[++i]);
+        else if (arg == "--warmup" && has_value)
+            config.warmup = atof(argv[++i]);
+        else
+        {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (config.pollers < 0 || config.streamers < 0 || config.subscribers < 0 || config.takeoffs < 0 || config.stalled < 0 || config.poll_rate < 0.0 ||
+        config.cmd_rate < 0.0 || config.seconds <= 0.0 || config.warmup < 0.0)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    struct addrinfo hints = {}, *resolved = nullptr;
+    hints.ai_family = AF_INET;
+    if (getaddrinfo(host.c_str(), nullptr, &hints, &resolved) != 0 || resolved == nullptr)
+    {
+        printf("cannot resolve %s\n", host.c_str());
+        return 1;
+    }
+    config.server = *(struct sockaddr_in *)resolved->ai_addr;
+    config.server.sin_port = htons(port);
+    freeaddrinfo(resolved);
+
+    std::string reply;
+    if (!CommandClient::oneshot(config.server, "get", reply))
+    {
+        printf("no server on %s:%d\n", host.c_str(), port);
+        return 1;
+    }
+    // offboard_cmd only moves a vehicle in offboard mode, the operators switch once up front
+    if (config.streamers > 0 && (!CommandClient::oneshot(config.server, "{\"command\": \"offboard_start\"}", reply) ||
+                                 reply != std::string("success", 8)))
+        printf("offboard_start refused, streaming anyway: %s\n", reply.c_str());
+
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+
+    auto measure_from = Clock::now() + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(config.warmup));
+    std::unique_ptr<RequestStats[]> pollers(new RequestStats[config.pollers]);
+    std::unique_ptr<RequestStats[]> streamers(new RequestStats[config.streamers]);
+    std::unique_ptr<RequestStats[]> takeoffs(new RequestStats[config.takeoffs]);
+    std::unique_ptr<SubscriberStats[]> subscribers(new SubscriberStats[config.subscribers]);
+    std::atomic<int> failed_subscribers{0};
+    std::atomic<uint64_t> stalled_dropped{0};
+    std::vector<std::thread> threads;
+
+    // stalled clients go first, everybody else is measured next to them
+    for (int i = 0; i < config.stalled; i++)
+        threads.emplace_back(stalled_client, std::cref(config), i % 2 == 0, std::ref(stalled_dropped));
+
+    for (int i = 0; i < config.pollers; i++)
+        threads.emplace_back(request_client, std::cref(config), std::string("get"), config.poll_rate, (double)i / config.pollers, measure_from,
+                             std::ref(pollers[i]));
+    for (int i = 0; i < config.streamers; i++)
+        threads.emplace_back(request_client, std::cref(config), std::string("{\"command\": \"offboard_cmd\", \"x\": 0.5, \"y\": 0, \"z\": 0}"),
+                             config.cmd_rate, (double)i / config.streamers, measure_from, std::ref(streamers[i]));
+    for (int i = 0; i < config.takeoffs; i++)
+        threads.emplace_back(request_client, std::cref(config), std::string("{\"command\": \"arm_takeoff\", \"alt\": 5}"), 0.0, 0.0,
+                             measure_from, std::ref(takeoffs[i]));
+    for (int i = 0; i < config.subscribers; i++)
+        threads.emplace_back(subscriber_client, std::cref(config), measure_from, std::ref(subscribers[i]), std::ref(failed_subscribers));
+
+    printf("%d pollers at %.0f Hz, %d streamers at %.0f Hz, %d %s subscribers, %d takeoffs, %d stalled, %s, %.0f s after %.0f s warmup\n",
+           config.pollers, config.poll_rate, config.streamers, config.cmd_rate, config.subscribers, config.binary ? "binary" : "json",
+           config.takeoffs, config.stalled, config.oneshot ? "connection per request" : "sessions", config.seconds, config.warmup);
+
+    auto end = measure_from + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(config.seconds));
+    while (!stop_requested.load(std::memory_order_relaxed) && Clock::now() < end)
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    double seconds = std::chrono::duration<double>(Clock::now() - measure_from).count();
+    stop_requested.store(true, std::memory_order_relaxed);
+    for (auto &t : threads)
+        t.join();
+    if (seconds <= 0.0)
+        return 0;
+
+    RequestStats get, offboard, takeoff;
+    for (int i = 0; i < config.pollers; i++)
+        get.merge(pollers[i]);
+    for (int i = 0; i < config.streamers; i++)
+        offboard.merge(streamers[i]);
+    for (int i = 0; i < config.takeoffs; i++)
+        takeoff.merge(takeoffs[i]);
+    SubscriberStats telemetry;
+    for (int i = 0; i < config.subscribers; i++)
+        telemetry.merge(subscribers[i]);
+
+    if (config.pollers + config.streamers + config.takeoffs > 0)
+        printf("\n%-14s %5s %9s %7s %9s %9s %9s %9s %9s\n", "request", "cli", "count", "errors", "req/s", "p50 us", "p99 us",
+               "p99.9 us", "max us");
+    print_requests("get", get, config.pollers, seconds);
+    print_requests("offboard_cmd", offboard, config.streamers, seconds);
+    print_requests("arm_takeoff", takeoff, config.takeoffs, seconds);
+    if (config.stalled > 0)
+        printf("%d stalled clients, dropped by the server %lu times\n", config.stalled, (unsigned long)stalled_dropped.load());
+
+    if (config.subscribers > 0)
+    {
+        const HdrHistogram &h = telemetry.interarrival;
+        printf("\n%-14s %5s %9s %7s %9s %9s %9s %9s %9s\n", "udp telemetry", "cli", "packets", "lost", "pkt/s", "p50 us", "p99 us",
+               "p99.9 us", "max us");
+        printf("%-14s %5d %9lu %7lu %9.1f %9.1f %9.1f %9.1f %9.1f\n", "inter-arrival", config.subscribers - failed_subscribers.load(),
+               (unsigned long)telemetry.packets, (unsigned long)telemetry.lost, telemetry.packets / seconds, h.quantile(0.5) / 1e3,
+               h.quantile(0.99) / 1e3, h.quantile(0.999) / 1e3, h.max() / 1e3);
+        uint64_t expected = telemetry.packets + telemetry.lost;
+        if (config.binary && expected > 0)
+            printf("loss %.3f%%, %lu reordered, %.1f kB/s\n", 100.0 * telemetry.lost / expected, (unsigned long)telemetry.reordered,
+                   telemetry.bytes / seconds / 1e3);
+        if (failed_subscribers.load() > 0)
+            printf("%d subscribers could not register\n", failed_subscribers.load());
+    }
+    return 0;
+}
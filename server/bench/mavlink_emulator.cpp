@@ -0,0 +1,922 @@
+// Synthetic PX4-like autopilot speaking MAVLink v2 over UDP, for end-to-end benchmarks.
+//
+// Sends HEARTBEAT, SYS_STATUS, EXTENDED_SYS_STATE, GPS_RAW_INT and HOME_POSITION once a
+// second and GLOBAL_POSITION_INT, LOCAL_POSITION_NED, ATTITUDE and VFR_HUD at --rate Hz
+// to the server's MAVSDK port. ACKs every COMMAND_LONG and COMMAND_INT after --ack-ms,
+// answers parameter reads and writes, and counts SET_POSITION_TARGET_* setpoints.
+// Messages are packed by hand, no MAVLink headers needed. The unmodified server runs
+// against it on one box.
+//
+// With --measure it is also the server's client. It subscribes to binary telemetry and
+// streams offboard_cmd over a command session at --cmd-rate Hz. VFR_HUD airspeed then
+// carries a sequence number and offboard_cmd x another one. It reports the latency from
+// MAVLink send to UDP publish, from command send to the setpoint MAVSDK emits, and the
+// command round trip.
+//
+//   mavlink_emulator [--port PORT] [--rate HZ] [--ack-ms MS] [--seconds S]
+//                    [--measure] [--server HOST] [--cmd-rate HZ]
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "../src/telem_binary.h"
+#include "command_client.h"
+
+using Clock = std::chrono::steady_clock;
+using namespace telem_binary;
+
+#define MAVLINK_STX 0xFD
+#define MAVLINK_STX_V1 0xFE
+#define MAVLINK_HEADER 10
+#define MAVLINK_SIGNATURE 13
+#define MAVLINK_MAX_PAYLOAD 255
+#define MAVLINK_SYSID 1
+#define MAVLINK_COMPID 1
+
+#define MSG_HEARTBEAT 0
+#define MSG_SYS_STATUS 1
+#define MSG_PARAM_REQUEST_READ 20
+#define MSG_PARAM_VALUE 22
+#define MSG_PARAM_SET 23
+#define MSG_GPS_RAW_INT 24
+#define MSG_ATTITUDE 30
+#define MSG_LOCAL_POSITION_NED 32
+#define MSG_GLOBAL_POSITION_INT 33
+#define MSG_VFR_HUD 74
+#define MSG_COMMAND_INT 75
+#define MSG_COMMAND_LONG 76
+#define MSG_COMMAND_ACK 77
+#define MSG_SET_POSITION_TARGET_LOCAL_NED 84
+#define MSG_SET_POSITION_TARGET_GLOBAL_INT 86
+#define MSG_HOME_POSITION 242
+#define MSG_EXTENDED_SYS_STATE 245
+
+#define CMD_NAV_RETURN_TO_LAUNCH 20
+#define CMD_NAV_LAND 21
+#define CMD_NAV_TAKEOFF 22
+#define CMD_DO_SET_MODE 176
+#define CMD_DO_REPOSITION 192
+#define CMD_COMPONENT_ARM_DISARM 400
+
+#define RESULT_ACCEPTED 0
+#define RESULT_DENIED 2
+
+// PX4 custom mode: main mode in bits 16..23, sub mode in 24..31
+#define PX4_MODE(main, sub) (((uint32_t)(main) << 16) | ((uint32_t)(sub) << 24))
+#define PX4_AUTO_TAKEOFF PX4_MODE(4, 2)
+#define PX4_AUTO_LOITER PX4_MODE(4, 3)
+#define PX4_AUTO_RTL PX4_MODE(4, 5)
+#define PX4_AUTO_LAND PX4_MODE(4, 6)
+
+#define LANDED_ON_GROUND 1
+#define LANDED_IN_AIR 2
+
+#define HOME_LAT 47.397742
+#define HOME_LON 8.545594
+#define HOME_ALT 488.0f
+#define CLIMB_SPEED 1.5f // m/s
+#define ORBIT_RADIUS 20.0 // m, flown while in air so every sample differs
+#define ORBIT_PERIOD_S 60.0
+
+// airspeed markers go through the binary frame as i16 cm/s
+#define TELEM_MARKERS 30000
+#define SETPOINT_MARKERS 999
+
+// fixed size and CRC_EXTRA of every message the emulator packs or reads
+struct MessageInfo
+{
+    uint32_t id;
+    uint8_t len;
+    uint8_t crc_extra;
+};
+
+static const MessageInfo MESSAGES[] = {
+    {MSG_HEARTBEAT, 9, 50},
+    {MSG_SYS_STATUS, 31, 124},
+    {MSG_PARAM_REQUEST_READ, 20, 214},
+    {MSG_PARAM_VALUE, 25, 220},
+    {MSG_PARAM_SET, 23, 168},
+    {MSG_GPS_RAW_INT, 30, 24},
+    {MSG_ATTITUDE, 28, 39},
+    {MSG_LOCAL_POSITION_NED, 28, 185},
+    {MSG_GLOBAL_POSITION_INT, 28, 104},
+    {MSG_VFR_HUD, 20, 20},
+    {MSG_COMMAND_INT, 35, 158},
+    {MSG_COMMAND_LONG, 33, 152},
+    {MSG_COMMAND_ACK, 10, 143},
+    {MSG_SET_POSITION_TARGET_LOCAL_NED, 53, 143},
+    {MSG_SET_POSITION_TARGET_GLOBAL_INT, 53, 5},
+    {MSG_HOME_POSITION, 52, 104},
+    {MSG_EXTENDED_SYS_STATE, 2, 130},
+};
+
+static const MessageInfo *message_info(uint32_t id)
+{
+    for (auto &info : MESSAGES)
+        if (info.id == id)
+            return &info;
+    return nullptr;
+}
+
+// CRC-16/MCRF4XX, the X.25 checksum of MAVLink
+static uint16_t crc_accumulate(uint8_t b, uint16_t crc)
+{
+    uint8_t tmp = b ^ (uint8_t)(crc & 0xFF);
+    tmp ^= (uint8_t)(tmp << 4);
+    return (crc >> 8) ^ ((uint16_t)tmp << 8) ^ ((uint16_t)tmp << 3) ^ (tmp >> 4);
+}
+
+static uint16_t crc_calculate(const uint8_t *buf, size_t len, uint16_t crc = 0xFFFF)
+{
+    for (size_t i = 0; i < len; i++)
+        crc = crc_accumulate(buf[i], crc);
+    return crc;
+}
+
+static uint64_t now_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count();
+}
+
+static uint64_t percentile(std::vector<uint64_t> &samples, double q)
+{
+    if (samples.empty())
+        return 0;
+    size_t rank = std::min(samples.size() - 1, (size_t)(q * samples.size()));
+    std::nth_element(samples.begin(), samples.begin() + rank, samples.end());
+    return samples[rank];
+}
+
+static void print_latency(const char *name, std::vector<uint64_t> &samples)
+{
+    uint64_t max = samples.empty() ? 0 : *std::max_element(samples.begin(), samples.end());
+    printf("%-22s %7zu samples, p50 %7.1f us, p90 %7.1f us, p99 %7.1f us, p99.9 %7.1f us, max %7.1f us\n", name,
+           samples.size(), percentile(samples, 0.5) / 1e3, percentile(samples, 0.9) / 1e3, percentile(samples, 0.99) / 1e3,
+           percentile(samples, 0.999) / 1e3, max / 1e3);
+}
+
+static std::atomic<bool> stop_requested{false};
+
+static void on_signal(int)
+{
+    stop_requested.store(true, std::memory_order_relaxed);
+}
+
+class Emulator
+{
+public:
+    Emulator(int fd, const struct sockaddr_in &target, double rate, std::chrono::milliseconds ack_latency, bool mark)
+        : fd_(fd), target_(target), rate_(rate), ack_latency_(ack_latency), mark_(mark),
+          telem_sent_ns_(new std::atomic<uint64_t>[TELEM_MARKERS]), setpoint_sent_ns_(new std::atomic<uint64_t>[SETPOINT_MARKERS])
+    {
+        for (size_t i = 0; i < TELEM_MARKERS; i++)
+            telem_sent_ns_[i].store(0, std::memory_order_relaxed);
+        for (size_t i = 0; i < SETPOINT_MARKERS; i++)
+            setpoint_sent_ns_[i].store(0, std::memory_order_relaxed);
+        params_["MIS_TAKEOFF_ALT"] = 2.5f;
+    }
+
+    // streams telemetry until stop
+    void run_sender()
+    {
+        auto period = std::chrono::nanoseconds((int64_t)(1e9 / rate_));
+        auto next = Clock::now();
+        auto next_status = next;
+        float dt = (float)(1.0 / rate_);
+        uint32_t seq = 0;
+
+        while (!stop_requested.load(std::memory_order_relaxed))
+        {
+            next += period;
+            std::this_thread::sleep_until(next);
+
+            bool status_due = next >= next_status || status_changed_.exchange(false, std::memory_order_relaxed);
+            if (next >= next_status)
+                next_status = next + std::chrono::seconds(1);
+
+            State s;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                step(dt);
+                s = state_;
+            }
+            if (status_due)
+                send_status(s);
+            send_telemetry(s, seq++);
+        }
+    }
+
+    // reads what MAVSDK sends until stop
+    void run_receiver()
+    {
+        uint8_t buf[2048];
+        while (!stop_requested.load(std::memory_order_relaxed))
+        {
+            ssize_t len = recv(fd_, buf, sizeof(buf), 0);
+            if (len <= 0)
+                continue;
+            uint64_t arrived_ns = now_ns();
+
+            size_t pos = 0;
+            while (pos < (size_t)len)
+            {
+                uint32_t id;
+                uint8_t payload[MAVLINK_MAX_PAYLOAD];
+                size_t used = parse(buf + pos, len - pos, id, payload);
+                if (used == 0)
+                {
+                    pos++;
+                    continue;
+                }
+                pos += used;
+                handle(id, payload, arrived_ns);
+            }
+        }
+    }
+
+    // sends acks once their latency passed, in order
+    void run_acker()
+    {
+        std::unique_lock<std::mutex> lock(ack_mutex_);
+        while (!stop_requested.load(std::memory_order_relaxed))
+        {
+            if (acks_.empty())
+            {
+                ack_wake_.wait_for(lock, std::chrono::milliseconds(100));
+                continue;
+            }
+            auto due = acks_.front().due;
+            if (Clock::now() < due)
+            {
+                ack_wake_.wait_until(lock, due);
+                continue;
+            }
+            PendingAck ack = acks_.front();
+            acks_.pop_front();
+            lock.unlock();
+            send_ack(ack);
+            lock.lock();
+        }
+    }
+
+    // airspeed value carrying a telemetry marker, sent at the time recorded for it
+    bool telem_latency(float airspeed, uint64_t received_ns, uint64_t &latency_ns)
+    {
+        long marker = std::lround(airspeed * 100.0f) - 1;
+        if (marker < 0 || marker >= TELEM_MARKERS)
+            return false;
+        uint64_t sent = telem_sent_ns_[marker].load(std::memory_order_relaxed);
+        if (sent == 0 || received_ns < sent)
+            return false;
+        latency_ns = received_ns - sent;
+        return true;
+    }
+
+    // forward speed carrying a setpoint marker, stamped right before the command is sent
+    static float setpoint_speed(uint32_t marker) { return (marker % SETPOINT_MARKERS + 1) * 0.001f; }
+    void stamp_setpoint(uint32_t marker) { setpoint_sent_ns_[marker % SETPOINT_MARKERS].store(now_ns(), std::memory_order_relaxed); }
+
+    std::vector<uint64_t> take_setpoint_latencies()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return std::move(setpoint_latencies_);
+    }
+
+    uint64_t telemetry_sent() const { return telemetry_sent_.load(std::memory_order_relaxed); }
+    uint64_t commands() const { return commands_.load(std::memory_order_relaxed); }
+    uint64_t setpoints() const { return setpoints_.load(std::memory_order_relaxed); }
+    uint64_t params() const { return params_handled_.load(std::memory_order_relaxed); }
+    uint64_t bad_crc() const { return bad_crc_.load(std::memory_order_relaxed); }
+
+private:
+    struct State
+    {
+        bool armed = false;
+        bool in_air = false;
+        uint32_t custom_mode = PX4_AUTO_LOITER;
+        float rel_alt = 0.0f;
+        float target_alt = 0.0f;
+        float climb = 0.0f;
+        float battery = 100.0f;
+        double orbit = 0.0; // rad
+    };
+
+    struct PendingAck
+    {
+        Clock::time_point due;
+        uint16_t command;
+        uint8_t result;
+        uint8_t sysid;
+        uint8_t compid;
+    };
+
+    void step(float dt)
+    {
+        State &s = state_;
+        float error = s.target_alt - s.rel_alt;
+        s.climb = std::fabs(error) <= CLIMB_SPEED * dt ? error / dt : std::copysign(CLIMB_SPEED, error);
+        if (!s.in_air)
+            s.climb = 0.0f;
+        s.rel_alt += s.climb * dt;
+        if (s.custom_mode == PX4_AUTO_TAKEOFF && s.rel_alt == s.target_alt)
+        {
+            s.custom_mode = PX4_AUTO_LOITER;
+            status_changed_.store(true, std::memory_order_relaxed);
+        }
+        if (s.in_air && s.target_alt <= 0.0f && s.rel_alt <= 0.0f)
+        {
+            // touchdown, PX4 disarms after landing
+            s.rel_alt = 0.0f;
+            s.in_air = false;
+            s.armed = false;
+            s.custom_mode = PX4_AUTO_LOITER;
+            status_changed_.store(true, std::memory_order_relaxed);
+        }
+        if (s.in_air)
+            s.orbit = std::fmod(s.orbit + 2.0 * M_PI * dt / ORBIT_PERIOD_S, 2.0 * M_PI);
+        if (s.armed)
+            s.battery = std::max(0.0f, s.battery - 0.02f * dt);
+    }
+
+    // packs a MAVLink v2 frame, trailing zero payload bytes are cut as the protocol asks
+    void send(uint32_t id, const uint8_t *payload)
+    {
+        const MessageInfo *info = message_info(id);
+        uint8_t len = info->len;
+        while (len > 1 && payload[len - 1] == 0)
+            len--;
+
+        uint8_t frame[MAVLINK_HEADER + MAVLINK_MAX_PAYLOAD + 2];
+        frame[0] = MAVLINK_STX;
+        frame[1] = len;
+        frame[2] = 0; // incompat flags
+        frame[3] = 0; // compat flags
+        frame[4] = tx_seq_.fetch_add(1, std::memory_order_relaxed);
+        frame[5] = MAVLINK_SYSID;
+        frame[6] = MAVLINK_COMPID;
+        frame[7] = id & 0xFF;
+        frame[8] = (id >> 8) & 0xFF;
+        frame[9] = (id >> 16) & 0xFF;
+        memcpy(frame + MAVLINK_HEADER, payload, len);
+        uint16_t crc = crc_calculate(frame + 1, MAVLINK_HEADER - 1 + len);
+        crc = crc_accumulate(info->crc_extra, crc);
+        put_u16(frame + MAVLINK_HEADER + len, crc);
+
+        sendto(fd_, frame, MAVLINK_HEADER + len + 2, 0, (const struct sockaddr *)&target_, sizeof(target_));
+    }
+
+    // one v1 or v2 frame at buf, returns its size or 0 if buf does not start with a valid known frame
+    size_t parse(const uint8_t *buf, size_t len, uint32_t &id, uint8_t *payload)
+    {
+        size_t header, size;
+        uint8_t payload_len;
+        if (len >= 8 && buf[0] == MAVLINK_STX_V1)
+        {
+            header = 6;
+            payload_len = buf[1];
+            id = buf[5];
+            size = header + payload_len + 2;
+        }
+        else if (len >= MAVLINK_HEADER + 2 && buf[0] == MAVLINK_STX)
+        {
+            header = MAVLINK_HEADER;
+            payload_len = buf[1];
+            id = buf[7] | (buf[8] << 8) | (buf[9] << 16);
+            size = header + payload_len + 2 + ((buf[2] & 0x01) ? MAVLINK_SIGNATURE : 0);
+        }
+        else
+            return 0;
+        if (size > len)
+            return 0;
+
+        const MessageInfo *info = message_info(id);
+        if (!info)
+            return size;
+        uint16_t crc = crc_accumulate(info->crc_extra, crc_calculate(buf + 1, header - 1 + payload_len));
+        if (crc != get_u16(buf + header + payload_len))
+        {
+            bad_crc_.fetch_add(1, std::memory_order_relaxed);
+            return 0;
+        }
+
+        // v2 senders cut trailing zeros, readers extend them back
+        memset(payload, 0, MAVLINK_MAX_PAYLOAD);
+        memcpy(payload, buf + header, std::min<size_t>(payload_len, info->len));
+        sender_sysid_ = buf[header == 6 ? 3 : 5];
+        sender_compid_ = buf[header == 6 ? 4 : 6];
+        return size;
+    }
+
+    void handle(uint32_t id, const uint8_t *p, uint64_t arrived_ns)
+    {
+        switch (id)
+        {
+        case MSG_COMMAND_LONG:
+            // param1..7, command, target system, target component, confirmation
+            command(get_u16(p + 28), get_f32(p), get_f32(p + 4), get_f32(p + 8), get_f32(p + 24));
+            break;
+        case MSG_COMMAND_INT:
+            // param1..4, x, y, z, command, ...
+            command(get_u16(p + 28), get_f32(p), get_f32(p + 4), get_f32(p + 8), get_f32(p + 24));
+            break;
+        case MSG_SET_POSITION_TARGET_LOCAL_NED:
+        {
+            setpoints_.fetch_add(1, std::memory_order_relaxed);
+            // time_boot_ms, x, y, z, vx, ...; MAVSDK repeats the last setpoint, only the first counts
+            long marker = std::lround(get_f32(p + 16) * 1000.0f) - 1;
+            if (marker < 0 || marker >= SETPOINT_MARKERS || marker == last_setpoint_)
+                break;
+            last_setpoint_ = marker;
+            uint64_t sent = setpoint_sent_ns_[marker].load(std::memory_order_relaxed);
+            if (sent != 0 && arrived_ns >= sent)
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                setpoint_latencies_.push_back(arrived_ns - sent);
+            }
+            break;
+        }
+        case MSG_SET_POSITION_TARGET_GLOBAL_INT:
+            setpoints_.fetch_add(1, std::memory_order_relaxed);
+            break;
+        case MSG_PARAM_SET:
+        {
+            // value, target system, target component, id[16], type
+            std::string name((const char *)p + 6, strnlen((const char *)p + 6, 16));
+            float value = get_f32(p);
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                params_[name] = value;
+            }
+            send_param(name, value);
+            break;
+        }
+        case MSG_PARAM_REQUEST_READ:
+        {
+            // index, target system, target component, id[16]
+            std::string name((const char *)p + 4, strnlen((const char *)p + 4, 16));
+            float value = 0.0f;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                auto it = params_.find(name);
+                if (it != params_.end())
+                    value = it->second;
+            }
+            send_param(name, value);
+            break;
+        }
+        }
+    }
+
+    // applies a command like PX4 would and queues its ack
+    void command(uint16_t cmd, float param1, float param2, float param3, float z)
+    {
+        commands_.fetch_add(1, std::memory_order_relaxed);
+        uint8_t result = RESULT_ACCEPTED;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            State &s = state_;
+            switch (cmd)
+            {
+            case CMD_COMPONENT_ARM_DISARM:
+                if (param1 < 0.5f && s.in_air)
+                    result = RESULT_DENIED;
+                else
+                    s.armed = param1 >= 0.5f;
+                break;
+            case CMD_NAV_TAKEOFF:
+                if (!s.armed)
+                {
+                    result = RESULT_DENIED;
+                    break;
+                }
+                s.in_air = true;
+                s.target_alt = params_["MIS_TAKEOFF_ALT"];
+                s.custom_mode = PX4_AUTO_TAKEOFF;
+                break;
+            case CMD_NAV_LAND:
+                s.target_alt = 0.0f;
+                s.custom_mode = PX4_AUTO_LAND;
+                break;
+            case CMD_NAV_RETURN_TO_LAUNCH:
+                s.target_alt = 0.0f;
+                s.custom_mode = PX4_AUTO_RTL;
+                break;
+            case CMD_DO_SET_MODE:
+                s.custom_mode = PX4_MODE((uint8_t)param2, (uint8_t)param3);
+                if (s.custom_mode == PX4_AUTO_LOITER)
+                    s.target_alt = s.rel_alt;
+                break;
+            case CMD_DO_REPOSITION:
+                if (!s.in_air)
+                {
+                    result = RESULT_DENIED;
+                    break;
+                }
+                if (std::isfinite(z))
+                    s.target_alt = z - HOME_ALT;
+                s.custom_mode = PX4_AUTO_LOITER;
+                break;
+            }
+        }
+        // mode and arming show up in the next heartbeat, not a second later
+        status_changed_.store(true, std::memory_order_relaxed);
+
+        std::lock_guard<std::mutex> lock(ack_mutex_);
+        acks_.push_back(PendingAck{Clock::now() + ack_latency_, cmd, result, sender_sysid_, sender_compid_});
+        ack_wake_.notify_one();
+    }
+
+    void send_ack(const PendingAck &ack)
+    {
+        uint8_t p[10] = {};
+        // command, result, progress, result_param2, target system, target component
+        put_u16(p, ack.command);
+        p[2] = ack.result;
+        p[8] = ack.sysid;
+        p[9] = ack.compid;
+        send(MSG_COMMAND_ACK, p);
+    }
+
+    void send_param(const std::string &name, float value)
+    {
+        params_handled_.fetch_add(1, std::memory_order_relaxed);
+        uint8_t p[25] = {};
+        // value, count, index, id[16], type
+        put_f32(p, value);
+        put_u16(p + 4, 1);
+        put_u16(p + 6, 0xFFFF);
+        memcpy(p + 8, name.data(), std::min<size_t>(name.size(), 16));
+        p[24] = 9; // MAV_PARAM_TYPE_REAL32
+        send(MSG_PARAM_VALUE, p);
+    }
+
+    uint32_t time_boot_ms() const
+    {
+        return (uint32_t)std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - boot_).count();
+    }
+
+    void position(const State &s, double &lat, double &lon) const
+    {
+        lat = HOME_LAT + ORBIT_RADIUS * std::sin(s.orbit) / 111320.0;
+        lon = HOME_LON + ORBIT_RADIUS * (1.0 - std::cos(s.orbit)) / (111320.0 * std::cos(HOME_LAT * M_PI / 180.0));
+    }
+
+    void send_status(const State &s)
+    {
+        uint8_t p[52] = {};
+        double lat, lon;
+        position(s, lat, lon);
+
+        // custom mode, type quadrotor, autopilot PX4, base mode, state, version
+        put_u32(p, s.custom_mode);
+        p[4] = 2;
+        p[5] = 12;
+        p[6] = 1 | (s.armed ? 128 : 0); // custom mode enabled, safety armed
+        p[7] = s.armed ? 4 : 3;         // MAV_STATE_ACTIVE or STANDBY
+        p[8] = 3;
+        send(MSG_HEARTBEAT, p);
+
+        // present, enabled, health, load, voltage mV, current cA, drop, errors, count1..4, remaining
+        memset(p, 0, sizeof(p));
+        put_u32(p, 0x0020FFFF);
+        put_u32(p + 4, 0x0020FFFF);
+        put_u32(p + 8, 0x0020FFFF);
+        put_u16(p + 12, 200);
+        put_u16(p + 14, (uint16_t)((12.6f - (100.0f - s.battery) * 0.024f) * 1000.0f));
+        put_u16(p + 16, (uint16_t)(int16_t)(s.armed ? 1000 : 50));
+        p[30] = (uint8_t)(int8_t)s.battery;
+        send(MSG_SYS_STATUS, p);
+
+        memset(p, 0, sizeof(p));
+        p[1] = s.in_air ? LANDED_IN_AIR : LANDED_ON_GROUND;
+        send(MSG_EXTENDED_SYS_STATE, p);
+
+        // time us, lat, lon, alt, eph, epv, vel, cog, fix type 3d, satellites
+        memset(p, 0, sizeof(p));
+        put_u64(p, (uint64_t)time_boot_ms() * 1000);
+        put_u32(p + 8, (uint32_t)(int32_t)std::lround(lat * 1e7));
+        put_u32(p + 12, (uint32_t)(int32_t)std::lround(lon * 1e7));
+        put_u32(p + 16, (uint32_t)(int32_t)std::lround((HOME_ALT + s.rel_alt) * 1000.0f));
+        put_u16(p + 20, 80);
+        put_u16(p + 22, 120);
+        put_u16(p + 24, 0xFFFF);
+        put_u16(p + 26, 0xFFFF);
+        p[28] = 3;
+        p[29] = 12;
+        send(MSG_GPS_RAW_INT, p);
+
+        // lat, lon, alt, local x y z, q, approach
+        memset(p, 0, sizeof(p));
+        put_u32(p, (uint32_t)(int32_t)std::lround(HOME_LAT * 1e7));
+        put_u32(p + 4, (uint32_t)(int32_t)std::lround(HOME_LON * 1e7));
+        put_u32(p + 8, (uint32_t)(int32_t)std::lround(HOME_ALT * 1000.0f));
+        put_f32(p + 24, 1.0f);
+        send(MSG_HOME_POSITION, p);
+    }
+
+    void send_telemetry(const State &s, uint32_t seq)
+    {
+        uint8_t p[28] = {};
+        uint32_t boot_ms = time_boot_ms();
+        double lat, lon;
+        position(s, lat, lon);
+        double speed = s.in_air ? 2.0 * M_PI * ORBIT_RADIUS / ORBIT_PERIOD_S : 0.0;
+        float vn = (float)(speed * std::cos(s.orbit));
+        float ve = (float)(speed * std::sin(s.orbit));
+        float yaw = (float)std::atan2(ve, vn);
+
+        // time, lat, lon, alt mm, relative alt mm, vx vy vz cm/s, heading cdeg
+        put_u32(p, boot_ms);
+        put_u32(p + 4, (uint32_t)(int32_t)std::lround(lat * 1e7));
+        put_u32(p + 8, (uint32_t)(int32_t)std::lround(lon * 1e7));
+        put_u32(p + 12, (uint32_t)(int32_t)std::lround((HOME_ALT + s.rel_alt) * 1000.0f));
+        put_u32(p + 16, (uint32_t)(int32_t)std::lround(s.rel_alt * 1000.0f));
+        put_u16(p + 20, (uint16_t)(int16_t)std::lround(vn * 100.0f));
+        put_u16(p + 22, (uint16_t)(int16_t)std::lround(ve * 100.0f));
+        put_u16(p + 24, (uint16_t)(int16_t)std::lround(-s.climb * 100.0f));
+        put_u16(p + 26, (uint16_t)std::lround(std::fmod(yaw * 180.0f / M_PI + 360.0f, 360.0f) * 100.0f));
+        send(MSG_GLOBAL_POSITION_INT, p);
+
+        // time, x y z, vx vy vz
+        memset(p, 0, sizeof(p));
+        put_u32(p, boot_ms);
+        put_f32(p + 4, (float)(ORBIT_RADIUS * std::sin(s.orbit)));
+        put_f32(p + 8, (float)(ORBIT_RADIUS * (1.0 - std::cos(s.orbit))));
+        put_f32(p + 12, -s.rel_alt);
+        put_f32(p + 16, vn);
+        put_f32(p + 20, ve);
+        put_f32(p + 24, -s.climb);
+        send(MSG_LOCAL_POSITION_NED, p);
+
+        // time, roll pitch yaw rad, rates; banked into the orbit
+        memset(p, 0, sizeof(p));
+        put_u32(p, boot_ms);
+        put_f32(p + 4, s.in_air ? 0.05f : 0.0f);
+        put_f32(p + 8, s.in_air ? -0.03f : 0.0f);
+        put_f32(p + 12, yaw);
+        put_f32(p + 24, (float)(s.in_air ? 2.0 * M_PI / ORBIT_PERIOD_S : 0.0));
+        send(MSG_ATTITUDE, p);
+
+        // airspeed, groundspeed, alt, climb, heading, throttle
+        float airspeed = (float)speed;
+        if (mark_)
+        {
+            uint32_t marker = seq % TELEM_MARKERS;
+            airspeed = (marker + 1) / 100.0f;
+            telem_sent_ns_[marker].store(now_ns(), std::memory_order_relaxed);
+        }
+        memset(p, 0, sizeof(p));
+        put_f32(p, airspeed);
+        put_f32(p + 4, (float)speed);
+        put_f32(p + 8, HOME_ALT + s.rel_alt);
+        put_f32(p + 12, s.climb);
+        put_u16(p + 16, (uint16_t)std::lround(std::fmod(yaw * 180.0f / M_PI + 360.0f, 360.0f)));
+        put_u16(p + 18, s.armed ? 50 : 0);
+        send(MSG_VFR_HUD, p);
+
+        telemetry_sent_.fetch_add(4, std::memory_order_relaxed);
+    }
+
+    int fd_;
+    struct sockaddr_in target_;
+    double rate_;
+    std::chrono::milliseconds ack_latency_;
+    bool mark_;
+    Clock::time_point boot_ = Clock::now();
+
+    std::mutex mutex_;
+    State state_;
+    std::map<std::string, float> params_;
+    std::vector<uint64_t> setpoint_latencies_;
+    std::atomic<bool> status_changed_{false};
+    std::atomic<uint8_t> tx_seq_{0};
+    // only the receiver thread touches these
+    uint8_t sender_sysid_ = 0;
+    uint8_t sender_compid_ = 0;
+    long last_setpoint_ = -1;
+
+    std::mutex ack_mutex_;
+    std::condition_variable ack_wake_;
+    std::deque<PendingAck> acks_;
+
+    std::unique_ptr<std::atomic<uint64_t>[]> telem_sent_ns_;
+    std::unique_ptr<std::atomic<uint64_t>[]> setpoint_sent_ns_;
+    std::atomic<uint64_t> telemetry_sent_{0};
+    std::atomic<uint64_t> commands_{0};
+    std::atomic<uint64_t> setpoints_{0};
+    std::atomic<uint64_t> params_handled_{0};
+    std::atomic<uint64_t> bad_crc_{0};
+};
+
+// the client side of --measure: telemetry subscriber and offboard command stream
+static void measure(Emulator &emulator, const struct sockaddr_in &server, double cmd_rate, std::vector<uint64_t> &telem_latencies,
+                    std::vector<uint64_t> &rtt_latencies, uint64_t &failed)
+{
+    // the command port only opens once MAVSDK discovered the emulator
+    CommandClient session;
+    while (!session.open_session(server))
+    {
+        if (stop_requested.load(std::memory_order_relaxed))
+            return;
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    }
+
+    int telem_fd = socket(AF_INET, SOCK_DGRAM, 0);
+    struct sockaddr_in local = {};
+    local.sin_family = AF_INET;
+    local.sin_addr.s_addr = htonl(INADDR_ANY);
+    socklen_t local_len = sizeof(local);
+    struct timeval timeout = {0, 100000};
+    if (telem_fd < 0 || bind(telem_fd, (struct sockaddr *)&local, sizeof(local)) < 0 ||
+        getsockname(telem_fd, (struct sockaddr *)&local, &local_len) < 0 ||
+        setsockopt(telem_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) < 0)
+    {
+        printf("telemetry socket setup failed\n");
+        return;
+    }
+
+    std::string reply;
+    std::string subscribe = "{\"command\": \"add_udp\", \"port\": " + std::to_string(ntohs(local.sin_port)) +
+                            ", \"format\": \"binary\", \"fields\": [\"plane\"]}";
+    if (!session.call(subscribe, reply) || reply != std::string("success", 8) ||
+        !session.call("{\"command\": \"offboard_start\"}", reply) || reply != std::string("success", 8))
+    {
+        printf("server refused telemetry or offboard: %s\n", reply.c_str());
+        stop_requested.store(true, std::memory_order_relaxed);
+        return;
+    }
+
+    std::thread telem_thread([&]()
+                             {
+                                 uint8_t buf[TELEM_BINARY_MAX_SIZE];
+                                 float last = -1.0f;
+                                 while (!stop_requested.load(std::memory_order_relaxed))
+                                 {
+                                     ssize_t len = recv(telem_fd, buf, sizeof(buf), 0);
+                                     uint64_t received = now_ns();
+                                     TelemBinaryHeader hdr;
+                                     TelemData data;
+                                     if (len <= 0 || !decode_telem_binary(buf, len, hdr, data))
+                                         continue;
+                                     // periodic publishing repeats a sample until a newer one came
+                                     uint64_t latency;
+                                     if (data.airspeed != last && emulator.telem_latency(data.airspeed, received, latency))
+                                         telem_latencies.push_back(latency);
+                                     last = data.airspeed;
+                                 } });
+
+    // replies come in request order, so a queue of send times gives every round trip
+    std::mutex sent_mutex;
+    std::deque<uint64_t> sent;
+    std::thread reply_thread([&]()
+                             {
+                                 std::string msg;
+                                 while (session.receive(msg))
+                                 {
+                                     uint64_t received = now_ns();
+                                     std::lock_guard<std::mutex> lock(sent_mutex);
+                                     if (sent.empty())
+                                         continue;
+                                     rtt_latencies.push_back(received - sent.front());
+                                     sent.pop_front();
+                                     if (msg != std::string("success", 8))
+                                         failed++;
+                                 } });
+
+    auto period = std::chrono::nanoseconds((int64_t)(1e9 / cmd_rate));
+    auto next = Clock::now();
+    char msg[128];
+    for (uint32_t marker = 0; !stop_requested.load(std::memory_order_relaxed); marker++)
+    {
+        next += period;
+        std::this_thread::sleep_until(next);
+        snprintf(msg, sizeof(msg), "{\"command\": \"offboard_cmd\", \"x\": %.3f, \"y\": 0, \"z\": 0}", Emulator::setpoint_speed(marker));
+        {
+            std::lock_guard<std::mutex> lock(sent_mutex);
+            sent.push_back(now_ns());
+        }
+        emulator.stamp_setpoint(marker);
+        if (!session.send(msg))
+            break;
+    }
+
+    session.shutdown();
+    reply_thread.join();
+    telem_thread.join();
+    close(telem_fd);
+}
+
+int main(int argc, char **argv)
+{
+    int port = 14540;
+    double rate = 50.0;
+    int ack_ms = 0;
+    double seconds = 0.0;
+    bool measure_latency = false;
+    std::string server_host = "127.0.0.1";
+    double cmd_rate = 20.0;
+    for (int i = 1; i < argc; i++)
+    {
+        bool has_value = i + 1 < argc;
+        if (!strcmp(argv[i], "--measure"))
+            measure_latency = true;
+        else if (!strcmp(argv[i], "--port") && has_value)
+            port = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--rate") && has_value)
+            rate = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--ack-ms") && has_value)
+            ack_ms = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--seconds") && has_value)
+            seconds = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--server") && has_value)
+            server_host = argv[++i];
+        else if (!strcmp(argv[i], "--cmd-rate") && has_value)
+            cmd_rate = atof(argv[++i]);
+        else
+            port = -1;
+    }
+    struct sockaddr_in target = {};
+    target.sin_family = AF_INET;
+    target.sin_port = htons(port);
+    struct sockaddr_in server = {};
+    server.sin_family = AF_INET;
+    server.sin_port = htons(6969);
+    if (port <= 0 || port > 65535 || rate <= 0.0 || rate > 20000.0 || ack_ms < 0 || seconds < 0.0 || cmd_rate <= 0.0 ||
+        inet_pton(AF_INET, "127.0.0.1", &target.sin_addr) != 1 || inet_pton(AF_INET, server_host.c_str(), &server.sin_addr) != 1)
+    {
+        printf("usage: %s [--port PORT] [--rate HZ] [--ack-ms MS] [--seconds S] [--measure] [--server HOST] [--cmd-rate HZ]\n", argv[0]);
+        return 1;
+    }
+    if (measure_latency)
+        target.sin_addr = server.sin_addr;
+
+    // MAVSDK answers to whatever address the heartbeats come from
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    struct timeval timeout = {0, 100000};
+    if (fd < 0 || setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) < 0)
+    {
+        printf("socket setup failed\n");
+        return 1;
+    }
+
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+
+    Emulator emulator(fd, target, rate, std::chrono::milliseconds(ack_ms), measure_latency);
+    std::thread sender([&emulator]()
+                       { emulator.run_sender(); });
+    std::thread receiver([&emulator]()
+                         { emulator.run_receiver(); });
+    std::thread acker([&emulator]()
+                      { emulator.run_acker(); });
+    std::thread timer([seconds]()
+                      {
+                          auto end = Clock::now() + std::chrono::nanoseconds((int64_t)(seconds * 1e9));
+                          while (!stop_requested.load(std::memory_order_relaxed) && (seconds == 0.0 || Clock::now() < end))
+                              std::this_thread::sleep_for(std::chrono::milliseconds(50));
+                          stop_requested.store(true, std::memory_order_relaxed); });
+
+    printf("emulating an autopilot on udp port %d: telemetry at %.0f Hz, acks after %d ms\n", port, rate, ack_ms);
+
+    std::vector<uint64_t> telem_latencies, rtt_latencies;
+    uint64_t failed = 0;
+    if (measure_latency)
+        measure(emulator, server, cmd_rate, telem_latencies, rtt_latencies, failed);
+
+    timer.join();
+    sender.join();
+    receiver.join();
+    acker.join();
+    close(fd);
+
+    printf("sent %llu telemetry messages, acked %llu commands, %llu parameter replies, received %llu setpoints, %llu bad crc\n",
+           (unsigned long long)emulator.telemetry_sent(), (unsigned long long)emulator.commands(),
+           (unsigned long long)emulator.params(), (unsigned long long)emulator.setpoints(), (unsigned long long)emulator.bad_crc());
+    if (measure_latency)
+    {
+        auto setpoint_latencies = emulator.take_setpoint_latencies();
+        print_latency("mavlink -> udp publish", telem_latencies);
+        print_latency("command -> setpoint", setpoint_latencies);
+        print_latency("command round trip", rtt_latencies);
+        if (failed > 0)
+            printf("%llu commands failed\n", (unsigned long long)failed);
+    }
+    return 0;
+}
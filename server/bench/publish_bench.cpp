@@ -0,0 +1,407 @@
+// Bytes on the wire and sender CPU of the telemetry publisher, per subscriber population.
+//
+// Replays a flight log (telem_log.h) in real time into a TelemPack, runs a TelemPublisher
+// on it for --seconds per phase and reports datagrams and bytes per second and the CPU
+// time the publisher thread used per second of wall clock. The phases compare
+//   - the 90 Hz loop the server had before profiles, nlohmann json sent with one sendto
+//     per subscriber, with the same subscribers on per-subscriber rates and fields
+//   - periodic with event driven publishing on an armed vehicle standing on the ground,
+//     with and without subscribers
+//   - full frames with delta frames and a keyframe every second, binary and json, over a flight
+// --replay takes a log written by `server --record` and plays it in every phase. Without
+// it two synthetic logs are written first, a vehicle idling armed on the ground and a
+// short flight.
+//
+//   publish_bench [--replay DIR] [--seconds S] [--subscribers N] [--dir DIR]
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include "../src/flight_recorder.h"
+#include "../src/telem_publisher.h"
+#include "../src/telem_replay.h"
+#include "legacy_telem.h"
+
+using Clock = std::chrono::steady_clock;
+
+// synthetic logs: mavsdk callback groups at 50 Hz, status once a second
+#define SYNTH_RATE 50
+#define SYNTH_IDLE_S 60
+#define SYNTH_FLIGHT_S 60
+
+struct Phase
+{
+    const char *name;
+    // flight log to replay
+    std::string log;
+    PublishMode mode;
+    std::vector<TelemProfile> profiles;
+    // the loop from before TelemPublisher instead of the publisher
+    bool legacy;
+};
+
+struct PhaseResult
+{
+    double datagrams_s;
+    double bytes_s;
+    double cpu_ms_s;
+    double ticks_s;
+    double updates_s;
+};
+
+static TelemProfile profile(TelemFormat format, float rate, uint8_t sections = TELEM_SECTION_ALL, float keyframe = 0.0f)
+{
+    TelemProfile p;
+    p.format = format;
+    p.rate = rate;
+    p.sections = sections;
+    p.keyframe = keyframe;
+    return p;
+}
+
+// n subscribers with the same profile
+static std::vector<TelemProfile> uniform(int n, const TelemProfile &p)
+{
+    return std::vector<TelemProfile>(n, p);
+}
+
+// dashboards on a cellular link, onboard loggers of the attitude, ground stations
+// on the full document and a map on position only, in equal parts
+static std::vector<TelemProfile> mixed(int n)
+{
+    const TelemProfile kinds[] = {
+        profile(TelemFormat::Json, 5.0f, TELEM_SECTION_POSITION | TELEM_SECTION_BATTERY),
+        profile(TelemFormat::Binary, 0.0f, TELEM_SECTION_ANGLES),
+        profile(TelemFormat::Json, 10.0f),
+        profile(TelemFormat::Binary, 20.0f, TELEM_SECTION_POSITION),
+    };
+    std::vector<TelemProfile> profiles;
+    for (int i = 0; i < n; i++)
+        profiles.push_back(kinds[i % 4]);
+    return profiles;
+}
+
+static uint64_t thread_cpu_ns(pthread_t thread)
+{
+    clockid_t clock;
+    struct timespec ts;
+    if (pthread_getcpuclockid(thread, &clock) != 0 || clock_gettime(clock, &ts) != 0)
+        return 0;
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// writes a log of `seconds` of telemetry, flying or standing armed on the ground,
+// with sensor noise of a real vehicle on every value
+static bool write_synthetic_log(const std::string &dir, double seconds, bool flying)
+{
+    FlightRecorder recorder;
+    if (!recorder.open(dir))
+        return false;
+    std::thread recorder_thread([&recorder]()
+                                { recorder.run(); });
+
+    std::mt19937 rng(flying ? 2 : 1);
+    std::normal_distribution<float> noise(0.0f, 1.0f);
+    TelemData d;
+    d.latitude = 47.397742;
+    d.longitude = 8.545594;
+    d.abs_alt = 488.0f;
+    d.batt_percentage = 0.95f;
+    d.batt_voltage = 12.5f;
+    d.isAllOk = true;
+    d.isArmed = true;
+
+    uint64_t time_us = std::chrono::duration_cast<std::chrono::microseconds>(
+                           std::chrono::system_clock::now().time_since_epoch())
+                           .count();
+    float dt = 1.0f / SYNTH_RATE;
+    float rel_alt = 0.0f;
+    for (int i = 0; i < seconds * SYNTH_RATE; i++)
+    {
+        float t = i * dt;
+        // climb to 15 m, cruise north, hover, descend
+        float north = 0.0f, down = 0.0f;
+        if (flying && t >= 5.0f && t < 15.0f)
+            down = -1.5f;
+        else if (flying && t >= 15.0f && t < 40.0f)
+            north = 5.0f;
+        else if (flying && t >= 50.0f && rel_alt > 0.0f)
+            down = 1.5f;
+        rel_alt = std::max(0.0f, rel_alt - down * dt);
+        d.latitude += north * dt / 111320.0;
+        d.inAir = rel_alt > 0.0f;
+
+        d.rel_alt = rel_alt + 0.02f * noise(rng);
+        d.abs_alt = 488.0f + d.rel_alt;
+        d.latitude += 2e-8 * noise(rng);
+        d.longitude += 2e-8 * noise(rng);
+        time_us += 1000000 / SYNTH_RATE / 4;
+        recorder.record_telem(time_us, d);
+
+        d.vel_north = north + 0.05f * noise(rng);
+        d.vel_east = 0.05f * noise(rng);
+        d.vel_down = down + 0.05f * noise(rng);
+        time_us += 1000000 / SYNTH_RATE / 4;
+        recorder.record_telem(time_us, d);
+
+        d.airspeed = std::fabs(north) + 0.1f * noise(rng);
+        d.climb_rate = -down + 0.05f * noise(rng);
+        time_us += 1000000 / SYNTH_RATE / 4;
+        recorder.record_telem(time_us, d);
+
+        d.roll_deg = 0.1f * noise(rng);
+        d.pitch_deg = -north * 3.0f + 0.1f * noise(rng);
+        d.yaw_deg = 0.2f * noise(rng);
+        time_us += 1000000 / SYNTH_RATE / 4;
+        recorder.record_telem(time_us, d);
+
+        if (i % SYNTH_RATE == 0)
+        {
+            d.batt_percentage -= 0.0002f;
+            d.batt_voltage = 12.6f - (1.0f - d.batt_percentage) * 2.4f;
+            recorder.record_telem(time_us, d);
+        }
+    }
+    recorder.stop();
+    recorder_thread.join();
+    return recorder.dropped() == 0;
+}
+
+// the send thread of the server before TelemPublisher: every ~11 ms a nlohmann
+// document of the whole pack, sent with one sendto per subscriber
+static void legacy_loop(int sockfd, const LegacyTelemPack &pack, const std::vector<uint16_t> &ports,
+                        const std::atomic<bool> &stop, std::atomic<uint64_t> &datagrams, std::atomic<uint64_t> &bytes)
+{
+    int period_ms = (1.0f / REFRESH_TELEM) * 1000.0f;
+    struct sockaddr_in cliaddr = {};
+    cliaddr.sin_family = AF_INET;
+    while (!stop.load(std::memory_order_relaxed))
+    {
+        auto t1 = std::chrono::high_resolution_clock::now();
+        auto json_pack = legacy_pack_to_json(pack.load());
+        for (auto port : ports)
+        {
+            cliaddr.sin_addr.s_addr = inet_addr("127.0.0.1");
+            cliaddr.sin_port = htons(port);
+            if (sendto(sockfd, (const char *)json_pack.c_str(), json_pack.length(),
+                       MSG_CONFIRM, (const struct sockaddr *)&cliaddr, sizeof(cliaddr)) >= 0)
+            {
+                datagrams.fetch_add(1, std::memory_order_relaxed);
+                bytes.fetch_add(json_pack.length(), std::memory_order_relaxed);
+            }
+        }
+        auto t2 = std::chrono::high_resolution_clock::now();
+        auto sending_time = std::chrono::duration_cast<std::chrono::milliseconds>(t2 - t1);
+        std::this_thread::sleep_for(std::chrono::milliseconds(period_ms - sending_time.count()));
+    }
+}
+
+// one bound socket per subscriber that nobody reads, the kernel drops what overflows
+struct Sinks
+{
+    std::vector<int> fds;
+    std::vector<struct sockaddr_in> addrs;
+
+    bool open(size_t count)
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            int fd = socket(AF_INET, SOCK_DGRAM, 0);
+            if (fd < 0)
+                return false;
+            fds.push_back(fd);
+            struct sockaddr_in addr = {};
+            addr.sin_family = AF_INET;
+            addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            socklen_t len = sizeof(addr);
+            if (bind(fd, (struct sockaddr *)&addr, len) < 0 || getsockname(fd, (struct sockaddr *)&addr, &len) < 0)
+                return false;
+            addrs.push_back(addr);
+        }
+        return true;
+    }
+
+    ~Sinks()
+    {
+        for (int fd : fds)
+            close(fd);
+    }
+};
+
+static bool run_phase(const Phase &phase, double seconds, PhaseResult &result)
+{
+    Sinks sinks;
+    int send_fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (send_fd < 0 || !sinks.open(phase.profiles.size()))
+    {
+        if (send_fd >= 0)
+            close(send_fd);
+        return false;
+    }
+
+    TelemReplay replay;
+    if (!replay.open(phase.log))
+    {
+        close(send_fd);
+        return false;
+    }
+
+    TelemPack pack;
+    LegacyTelemPack legacy_pack;
+    SubscriberRegistry registry;
+    PublishStats stats;
+    PublishConfig config;
+    config.mode = phase.mode;
+    for (size_t i = 0; i < phase.profiles.size(); i++)
+        registry.add(TelemDest::inet(sinks.addrs[i]), phase.profiles[i], std::chrono::milliseconds(0));
+
+    bool legacy = phase.legacy;
+    std::thread feeder([&replay, &pack, &legacy_pack, legacy]()
+                       { replay.run(1.0, 0, [&](const TelemData &data)
+                                    {
+                                        if (legacy)
+                                            legacy_pack.store(data);
+                                        else
+                                            pack.update([&data](TelemData &d)
+                                                        { d = data; }); }); });
+
+    TelemPublisher publisher(send_fd, -1, pack, registry, stats, config);
+    std::atomic<bool> stop{false};
+    std::atomic<uint64_t> legacy_datagrams{0}, legacy_bytes{0};
+    std::vector<uint16_t> ports;
+    for (auto &addr : sinks.addrs)
+        ports.push_back(ntohs(addr.sin_port));
+    std::thread sender([&]()
+                       {
+                           if (legacy)
+                               legacy_loop(send_fd, legacy_pack, ports, stop, legacy_datagrams, legacy_bytes);
+                           else
+                               publisher.run(); });
+
+    // the first second fills the pack and builds the streams
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+    auto counted = [&](uint64_t &datagrams, uint64_t &bytes)
+    {
+        datagrams = legacy_datagrams.load();
+        bytes = legacy_bytes.load();
+        for (auto &sub : *registry.snapshot())
+        {
+            datagrams += sub.counters->packets.load(std::memory_order_relaxed);
+            bytes += sub.counters->bytes.load(std::memory_order_relaxed);
+        }
+    };
+    uint64_t datagrams0, bytes0, datagrams1, bytes1;
+    counted(datagrams0, bytes0);
+    uint64_t ticks0 = stats.ticks.load();
+    uint64_t samples0 = replay.samples();
+    uint64_t cpu0 = thread_cpu_ns(sender.native_handle());
+    auto start = Clock::now();
+
+    std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+
+    uint64_t cpu1 = thread_cpu_ns(sender.native_handle());
+    double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+    counted(datagrams1, bytes1);
+    uint64_t ticks1 = stats.ticks.load();
+    uint64_t samples1 = replay.samples();
+
+    stop = true;
+    publisher.stop();
+    sender.join();
+    replay.stop();
+    feeder.join();
+    close(send_fd);
+
+    result.datagrams_s = (datagrams1 - datagrams0) / elapsed;
+    result.bytes_s = (bytes1 - bytes0) / elapsed;
+    result.cpu_ms_s = (cpu1 - cpu0) / 1e6 / elapsed;
+    result.ticks_s = legacy ? 0.0 : (ticks1 - ticks0) / elapsed;
+    result.updates_s = (samples1 - samples0) / elapsed;
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    std::string replay_dir;
+    std::string dir = "/tmp/publish_bench";
+    double seconds = 5.0;
+    int subscribers = 8;
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        if (!strcmp(argv[i], "--replay"))
+            replay_dir = argv[i + 1];
+        else if (!strcmp(argv[i], "--dir"))
+            dir = argv[i + 1];
+        else if (!strcmp(argv[i], "--seconds"))
+            seconds = atof(argv[i + 1]);
+        else if (!strcmp(argv[i], "--subscribers"))
+            subscribers = atoi(argv[i + 1]);
+    }
+    if (seconds <= 0.0 || subscribers <= 0)
+    {
+        printf("usage: %s [--replay DIR] [--seconds S] [--subscribers N] [--dir DIR]\n", argv[0]);
+        return 1;
+    }
+
+    std::string idle_log = replay_dir, flight_log = replay_dir;
+    if (replay_dir.empty())
+    {
+        // fresh logs every run, the recorder appends to what a directory already has
+        mkdir(dir.c_str(), 0755);
+        idle_log = dir + "/idle-" + std::to_string(getpid());
+        flight_log = dir + "/flight-" + std::to_string(getpid());
+        if (!write_synthetic_log(idle_log, SYNTH_IDLE_S, false) || !write_synthetic_log(flight_log, SYNTH_FLIGHT_S, true))
+        {
+            printf("writing synthetic logs to %s failed\n", dir.c_str());
+            return 1;
+        }
+        printf("synthetic logs in %s, %s\n", idle_log.c_str(), flight_log.c_str());
+    }
+
+    auto full_json = profile(TelemFormat::Json, 0.0f);
+    auto full_binary = profile(TelemFormat::Binary, 0.0f);
+    std::vector<Phase> phases = {
+        {"legacy 90 Hz json", flight_log, PublishMode::Periodic, uniform(subscribers, full_json), true},
+        {"periodic full json", flight_log, PublishMode::Periodic, uniform(subscribers, full_json), false},
+        {"periodic mixed", flight_log, PublishMode::Periodic, mixed(subscribers), false},
+        {"event mixed", flight_log, PublishMode::Event, mixed(subscribers), false},
+        {"idle periodic full json", idle_log, PublishMode::Periodic, uniform(subscribers, full_json), false},
+        {"idle event full json", idle_log, PublishMode::Event, uniform(subscribers, full_json), false},
+        {"idle periodic no subscribers", idle_log, PublishMode::Periodic, {}, false},
+        {"idle event no subscribers", idle_log, PublishMode::Event, {}, false},
+        {"full binary", flight_log, PublishMode::Periodic, uniform(subscribers, full_binary), false},
+        {"delta binary", flight_log, PublishMode::Periodic, uniform(subscribers, profile(TelemFormat::Binary, 0.0f, TELEM_SECTION_ALL, 1.0f)), false},
+        {"full json", flight_log, PublishMode::Periodic, uniform(subscribers, full_json), false},
+        {"delta json", flight_log, PublishMode::Periodic, uniform(subscribers, profile(TelemFormat::Json, 0.0f, TELEM_SECTION_ALL, 1.0f)), false},
+    };
+
+    printf("%d subscribers, %.1f s per phase, replayed in real time\n\n", subscribers, seconds);
+    printf("%-30s %12s %12s %14s %10s %10s\n", "phase", "updates/s", "datagrams/s", "bytes/s", "ticks/s", "cpu ms/s");
+    for (auto &phase : phases)
+    {
+        PhaseResult r;
+        if (!run_phase(phase, seconds, r))
+        {
+            printf("%-30s failed, is %s a flight log?\n", phase.name, phase.log.c_str());
+            return 1;
+        }
+        printf("%-30s %12.0f %12.0f %14.0f %10.1f %10.2f\n", phase.name, r.updates_s, r.datagrams_s, r.bytes_s, r.ticks_s, r.cpu_ms_s);
+    }
+    return 0;
+}
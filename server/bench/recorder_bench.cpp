@@ -0,0 +1,194 @@
+// Flight recorder write cost next to a running 90 Hz publish loop.
+//
+// Feeds telemetry updates at --rate Hz into a TelemPack that a TelemPublisher sends to
+// local UDP subscribers, first without and then with every update appended to a
+// FlightRecorder. Prints the recorder's cost per sample and the publish loop jitter
+// of both phases, so the recorder's effect on the loop is visible.
+//
+//   recorder_bench [--dir DIR] [--seconds S] [--rate HZ] [--subscribers N]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "../src/flight_recorder.h"
+#include "../src/telem_publisher.h"
+
+using Clock = std::chrono::steady_clock;
+
+struct HistogramSnapshot
+{
+    uint64_t buckets[JITTER_BUCKETS];
+
+    explicit HistogramSnapshot(const JitterHistogram &h)
+    {
+        for (size_t i = 0; i < JITTER_BUCKETS; i++)
+            buckets[i] = h.bucket(i);
+    }
+};
+
+// bucket bound of quantile q over the samples recorded between two snapshots
+static uint64_t quantile_between(const HistogramSnapshot &from, const HistogramSnapshot &to, double q)
+{
+    uint64_t n = 0;
+    for (size_t i = 0; i < JITTER_BUCKETS; i++)
+        n += to.buckets[i] - from.buckets[i];
+    uint64_t rank = (uint64_t)(q * n);
+    uint64_t seen = 0;
+    for (size_t i = 0; i < JITTER_BUCKETS; i++)
+    {
+        seen += to.buckets[i] - from.buckets[i];
+        if (seen > rank)
+            return JitterHistogram::bucket_limit_us(i);
+    }
+    return 0;
+}
+
+static uint64_t percentile(std::vector<uint64_t> &samples, double q)
+{
+    if (samples.empty())
+        return 0;
+    size_t rank = std::min(samples.size() - 1, (size_t)(q * samples.size()));
+    std::nth_element(samples.begin(), samples.begin() + rank, samples.end());
+    return samples[rank];
+}
+
+// one phase of feeding updates, returns ns spent per recorder append (empty without recorder)
+static std::vector<uint64_t> feed(TelemPack &pack, FlightRecorder *recorder, double seconds, double rate)
+{
+    std::vector<uint64_t> costs;
+    auto period = std::chrono::nanoseconds((int64_t)(1e9 / rate));
+    auto end = Clock::now() + std::chrono::nanoseconds((int64_t)(seconds * 1e9));
+    auto next = Clock::now();
+    uint32_t i = 0;
+    while (next < end)
+    {
+        std::this_thread::sleep_until(next);
+        next += period;
+        i++;
+
+        auto data = pack.update([&](TelemData &d)
+                                {
+                                    d.latitude = 50.0 + i * 1e-6;
+                                    d.longitude = 19.0 + i * 1e-6;
+                                    d.rel_alt = (float)(i % 100);
+                                    d.yaw_deg = (float)(i % 360); });
+        if (!recorder)
+            continue;
+
+        uint64_t time_us = std::chrono::duration_cast<std::chrono::microseconds>(
+                               std::chrono::system_clock::now().time_since_epoch())
+                               .count();
+        auto start = Clock::now();
+        recorder->record_telem(time_us, data);
+        costs.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count());
+    }
+    return costs;
+}
+
+int main(int argc, char **argv)
+{
+    std::string dir = "/tmp/recorder_bench";
+    double seconds = 10.0;
+    double rate = 250.0;
+    int subscribers = 4;
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        if (!strcmp(argv[i], "--dir"))
+            dir = argv[i + 1];
+        else if (!strcmp(argv[i], "--seconds"))
+            seconds = atof(argv[i + 1]);
+        else if (!strcmp(argv[i], "--rate"))
+            rate = atof(argv[i + 1]);
+        else if (!strcmp(argv[i], "--subscribers"))
+            subscribers = atoi(argv[i + 1]);
+    }
+    if (seconds <= 0.0 || rate <= 0.0 || subscribers < 0)
+    {
+        printf("usage: %s [--dir DIR] [--seconds S] [--rate HZ] [--subscribers N]\n", argv[0]);
+        return 1;
+    }
+
+    // every subscriber is a local sink socket of its own nobody reads, the kernel drops overflow
+    int send_fd = socket(AF_INET, SOCK_DGRAM, 0);
+    std::vector<int> sink_fds;
+    std::vector<struct sockaddr_in> sinks;
+    bool sockets_ok = send_fd >= 0;
+    for (int i = 0; i < subscribers && sockets_ok; i++)
+    {
+        int fd = socket(AF_INET, SOCK_DGRAM, 0);
+        struct sockaddr_in sink = {};
+        sink.sin_family = AF_INET;
+        sink.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t sink_len = sizeof(sink);
+        sockets_ok = fd >= 0 && bind(fd, (struct sockaddr *)&sink, sizeof(sink)) == 0 &&
+                     getsockname(fd, (struct sockaddr *)&sink, &sink_len) == 0;
+        if (fd >= 0)
+            sink_fds.push_back(fd);
+        sinks.push_back(sink);
+    }
+    if (!sockets_ok)
+    {
+        printf("socket setup failed\n");
+        return 1;
+    }
+
+    FlightRecorder recorder;
+    if (!recorder.open(dir))
+    {
+        printf("opening a flight log in %s failed\n", dir.c_str());
+        return 1;
+    }
+    std::thread recorder_thread([&recorder]()
+                                { recorder.run(); });
+
+    TelemPack pack;
+    SubscriberRegistry registry;
+    PublishStats stats;
+    TelemProfile profile;
+    profile.format = TelemFormat::Binary;
+    for (auto &sink : sinks)
+        registry.add(TelemDest::inet(sink), profile, std::chrono::milliseconds(0));
+
+    TelemPublisher publisher(send_fd, -1, pack, registry, stats);
+    std::thread publisher_thread([&publisher]()
+                                 { publisher.run(); });
+
+    printf("feeding %.0f Hz for %.1f s per phase, %zu subscribers at %.0f Hz\n", rate, seconds, registry.snapshot()->size(),
+           REFRESH_TELEM);
+
+    HistogramSnapshot start(stats.jitter);
+    feed(pack, nullptr, seconds, rate);
+    HistogramSnapshot middle(stats.jitter);
+    auto costs = feed(pack, &recorder, seconds, rate);
+    HistogramSnapshot end(stats.jitter);
+
+    printf("publish jitter without recorder: p50 %llu us, p99 %llu us\n",
+           (unsigned long long)quantile_between(start, middle, 0.5), (unsigned long long)quantile_between(start, middle, 0.99));
+    printf("publish jitter with recorder:    p50 %llu us, p99 %llu us\n",
+           (unsigned long long)quantile_between(middle, end, 0.5), (unsigned long long)quantile_between(middle, end, 0.99));
+
+    uint64_t max = costs.empty() ? 0 : *std::max_element(costs.begin(), costs.end());
+    printf("record_telem: %zu samples, p50 %llu ns, p99 %llu ns, p99.9 %llu ns, max %llu ns\n", costs.size(),
+           (unsigned long long)percentile(costs, 0.5), (unsigned long long)percentile(costs, 0.99),
+           (unsigned long long)percentile(costs, 0.999), (unsigned long long)max);
+    printf("recorder: %llu records, %llu bytes, %llu dropped\n", (unsigned long long)recorder.records(),
+           (unsigned long long)recorder.bytes(), (unsigned long long)recorder.dropped());
+
+    publisher.stop();
+    publisher_thread.join();
+    recorder.stop();
+    recorder_thread.join();
+    for (int fd : sink_fds)
+        close(fd);
+    close(send_fd);
+    return 0;
+}
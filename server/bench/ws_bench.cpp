@@ -0,0 +1,469 @@
+// Concurrent websocket viewers one server thread keeps up with, at 10 and 50 Hz.
+//
+// Runs a WebSocketServer in process on a TelemPack updated at 50 Hz and connects headless
+// viewers to it over loopback: they do the upgrade handshake with ?rate=R and then only
+// read and count the telemetry messages. For every rate the viewers double from --start
+// until they get less than 95% of rate * viewers, then the count is bisected between the
+// last step that kept up and the first that did not. That range is the measured
+// saturation point. Each step reports the messages the viewers got per second, the
+// samples the server dropped for backpressure, and the CPU time of the server thread
+// per second of wall clock.
+// The viewers run on one thread of their own, their CPU is printed next to the server's.
+// When the viewers' thread is the one near 1000 ms/s, they limit the result and not the
+// server; on a machine with few cores both compete for it.
+//
+//   ws_bench [--seconds S] [--rates 10,50] [--start N] [--max-viewers N] [--fields position,angles]
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#include "../src/websocket_server.h"
+
+using Clock = std::chrono::steady_clock;
+
+#define FEED_RATE 50
+#define SUSTAINED 0.95
+#define VIEWER_EVENTS 64
+// the search stops once the saturation point is known to within 1/SATURATION_STEPS
+#define SATURATION_STEPS 8
+// descriptors besides the viewers' sockets
+#define FILES_RESERVED 64
+
+static uint64_t thread_cpu_ns(pthread_t thread)
+{
+    clockid_t clock;
+    struct timespec ts;
+    if (pthread_getcpuclockid(thread, &clock) != 0 || clock_gettime(clock, &ts) != 0)
+        return 0;
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// numbers separated by commas
+static std::vector<int> parse_list(const char *list)
+{
+    std::vector<int> values;
+    for (const char *p = list; *p;)
+    {
+        values.push_back(atoi(p));
+        p = strchr(p, ',');
+        if (!p)
+            break;
+        p++;
+    }
+    return values;
+}
+
+// headless browsers: one thread keeps `target` viewers connected and counts the
+// messages they receive, server frames are never masked
+class Viewers
+{
+public:
+    Viewers(const struct sockaddr_in &server, std::string query)
+        : server_(server), query_(std::move(query))
+    {
+        epoll_fd_ = epoll_create1(0);
+    }
+
+    ~Viewers()
+    {
+        close_all();
+        if (epoll_fd_ >= 0)
+            close(epoll_fd_);
+    }
+
+    Viewers(const Viewers &) = delete;
+    Viewers &operator=(const Viewers &) = delete;
+
+    // viewers to keep connected, fewer closes the newest ones
+    void set_target(size_t n) { target_.store(n, std::memory_order_relaxed); }
+    void stop() { stop_.store(true, std::memory_order_relaxed); }
+    uint64_t messages() const { return messages_.load(std::memory_order_relaxed); }
+    uint64_t failures() const { return failures_.load(std::memory_order_relaxed); }
+
+    // after run() returned
+    void close_all()
+    {
+        for (auto &v : viewers_)
+            close(v.fd);
+        viewers_.clear();
+    }
+
+    void run()
+    {
+        struct epoll_event events[VIEWER_EVENTS];
+        while (!stop_.load(std::memory_order_relaxed))
+        {
+            size_t target = target_.load(std::memory_order_relaxed);
+            while (viewers_.size() > target)
+            {
+                close(viewers_.back().fd);
+                viewers_.pop_back();
+            }
+            while (viewers_.size() < target && connect_viewer())
+            {
+            }
+
+            int count = epoll_wait(epoll_fd_, events, VIEWER_EVENTS, 100);
+            for (int i = 0; i < count; i++)
+            {
+                if (events[i].data.u32 < viewers_.size() && !receive(viewers_[events[i].data.u32]))
+                {
+                    // the server hung up, reconnected on the next round
+                    failures_.fetch_add(1, std::memory_order_relaxed);
+                    close(viewers_[events[i].data.u32].fd);
+                    viewers_.erase(viewers_.begin() + events[i].data.u32);
+                    rebuild();
+                    break;
+                }
+            }
+        }
+    }
+
+private:
+    struct Viewer
+    {
+        int fd;
+        bool upgraded = false;
+        std::string in;
+    };
+
+    bool connect_viewer()
+    {
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd < 0)
+            return false;
+        std::string request = "GET /?" + query_ + " HTTP/1.1\r\nHost: localhost\r\nUpgrade: websocket\r\n"
+                                                  "Connection: Upgrade\r\nSec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+                                                  "Sec-WebSocket-Version: 13\r\n\r\n";
+        if (connect(fd, (const struct sockaddr *)&server_, sizeof(server_)) < 0 ||
+            send(fd, request.data(), request.size(), MSG_NOSIGNAL) != (ssize_t)request.size())
+        {
+            close(fd);
+            failures_.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        int flags = fcntl(fd, F_GETFL, 0);
+        fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN;
+        ev.data.u32 = viewers_.size();
+        if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev) < 0)
+        {
+            close(fd);
+            return false;
+        }
+        viewers_.emplace_back();
+        viewers_.back().fd = fd;
+        return true;
+    }
+
+    // epoll data holds the index, which moves when a viewer is removed
+    void rebuild()
+    {
+        for (size_t i = 0; i < viewers_.size(); i++)
+        {
+            struct epoll_event ev;
+            memset(&ev, 0, sizeof(ev));
+            ev.events = EPOLLIN;
+            ev.data.u32 = i;
+            epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, viewers_[i].fd, &ev);
+        }
+    }
+
+    // false when the connection is gone
+    bool receive(Viewer &viewer)
+    {
+        char buf[65536];
+        while (true)
+        {
+            ssize_t n = recv(viewer.fd, buf, sizeof(buf), 0);
+            if (n == 0)
+                return false;
+            if (n < 0)
+                return errno == EAGAIN || errno == EWOULDBLOCK;
+            viewer.in.append(buf, n);
+
+            size_t pos = 0;
+            if (!viewer.upgraded)
+            {
+                size_t end = viewer.in.find("\r\n\r\n");
+                if (end == std::string::npos)
+                    continue;
+                if (viewer.in.compare(0, 12, "HTTP/1.1 101") != 0)
+                    return false;
+                viewer.upgraded = true;
+                pos = end + 4;
+            }
+            while (viewer.in.size() - pos >= 2)
+            {
+                const uint8_t *p = (const uint8_t *)viewer.in.data() + pos;
+                size_t avail = viewer.in.size() - pos;
+                size_t header = 2;
+                uint64_t len = p[1] & 0x7f;
+                if (len == 126)
+                {
+                    header = 4;
+                    if (avail < header)
+                        break;
+                    len = ((uint64_t)p[2] << 8) | p[3];
+                }
+                else if (len == 127)
+                {
+                    header = 10;
+                    if (avail < header)
+                        break;
+                    len = 0;
+                    for (int i = 0; i < 8; i++)
+                        len = (len << 8) | p[2 + i];
+                }
+                if (avail < header + len)
+                    break;
+                if ((p[0] & 0x0f) == 0x1)
+                    messages_.fetch_add(1, std::memory_order_relaxed);
+                pos += header + len;
+            }
+            viewer.in.erase(0, pos);
+        }
+    }
+
+    struct sockaddr_in server_;
+    std::string query_;
+    int epoll_fd_ = -1;
+    std::vector<Viewer> viewers_;
+    std::atomic<size_t> target_{0};
+    std::atomic<bool> stop_{false};
+    std::atomic<uint64_t> messages_{0};
+    std::atomic<uint64_t> failures_{0};
+};
+
+struct StepResult
+{
+    bool connected;
+    double expected_s;
+    double messages_s;
+    double dropped_s;
+    double server_cpu_ms_s;
+    double viewer_cpu_ms_s;
+
+    bool kept_up() const { return connected && messages_s >= SUSTAINED * expected_s; }
+};
+
+// n viewers at rate for seconds, after they connected and got on their grid
+static StepResult measure(WebSocketServer &ws_server, std::thread &server_thread, Viewers &viewers,
+                          std::thread &viewer_thread, int n, int rate, double seconds)
+{
+    StepResult r = {};
+    viewers.set_target(n);
+    // a few thousand connections take a while on one core
+    auto deadline = Clock::now() + std::chrono::seconds(10) + std::chrono::milliseconds(n);
+    while (ws_server.viewers() != (size_t)n && Clock::now() < deadline)
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    if (ws_server.viewers() != (size_t)n)
+    {
+        printf("%6d %8d only %zu viewers connected\n", rate, n, ws_server.viewers());
+        return r;
+    }
+    r.connected = true;
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+
+    uint64_t messages0 = viewers.messages();
+    uint64_t dropped0 = ws_server.frames_dropped();
+    uint64_t server_cpu0 = thread_cpu_ns(server_thread.native_handle());
+    uint64_t viewer_cpu0 = thread_cpu_ns(viewer_thread.native_handle());
+    auto start = Clock::now();
+
+    std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+
+    uint64_t server_cpu1 = thread_cpu_ns(server_thread.native_handle());
+    uint64_t viewer_cpu1 = thread_cpu_ns(viewer_thread.native_handle());
+    double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+    r.expected_s = (double)n * rate;
+    r.messages_s = (viewers.messages() - messages0) / elapsed;
+    r.dropped_s = (ws_server.frames_dropped() - dropped0) / elapsed;
+    r.server_cpu_ms_s = (server_cpu1 - server_cpu0) / 1e6 / elapsed;
+    r.viewer_cpu_ms_s = (viewer_cpu1 - viewer_cpu0) / 1e6 / elapsed;
+    printf("%6d %8d %12.0f %12.0f %12.1f %14.2f %14.2f%s\n", rate, n, r.expected_s, r.messages_s, r.dropped_s,
+           r.server_cpu_ms_s, r.viewer_cpu_ms_s, r.kept_up() ? "" : "  behind");
+    return r;
+}
+
+int main(int argc, char **argv)
+{
+    double seconds = 5.0;
+    std::vector<int> rates = {10, 50};
+    int start_viewers = 64;
+    int max_viewers = 16384;
+    std::string fields;
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        if (!strcmp(argv[i], "--seconds"))
+            seconds = atof(argv[i + 1]);
+        else if (!strcmp(argv[i], "--rates"))
+            rates = parse_list(argv[i + 1]);
+        else if (!strcmp(argv[i], "--start"))
+            start_viewers = atoi(argv[i + 1]);
+        else if (!strcmp(argv[i], "--max-viewers"))
+            max_viewers = atoi(argv[i + 1]);
+        else if (!strcmp(argv[i], "--fields"))
+            fields = argv[i + 1];
+    }
+    bool valid = seconds > 0.0 && !rates.empty() && start_viewers > 0 && max_viewers >= start_viewers;
+    for (int rate : rates)
+        valid = valid && rate > 0 && rate <= WS_MAX_RATE;
+    if (!valid)
+    {
+        printf("usage: %s [--seconds S] [--rates 10,50] [--start N] [--max-viewers N] [--fields position,angles]\n", argv[0]);
+        printf("rates up to %d Hz\n", (int)WS_MAX_RATE);
+        return 1;
+    }
+
+    // every viewer takes a descriptor on both ends
+    struct rlimit files;
+    if (getrlimit(RLIMIT_NOFILE, &files) == 0)
+    {
+        files.rlim_cur = files.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &files);
+        if (files.rlim_cur != RLIM_INFINITY && (rlim_t)max_viewers * 2 + FILES_RESERVED > files.rlim_cur)
+        {
+            max_viewers = std::max(1, (int)((files.rlim_cur - FILES_RESERVED) / 2));
+            printf("open file limit %llu, at most %d viewers\n", (unsigned long long)files.rlim_cur, max_viewers);
+        }
+    }
+    start_viewers = std::min(start_viewers, max_viewers);
+
+    // a port the kernel hands out as free
+    struct sockaddr_in server = {};
+    server.sin_family = AF_INET;
+    server.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(server);
+    int probe = socket(AF_INET, SOCK_STREAM, 0);
+    bool bound = probe >= 0 && bind(probe, (struct sockaddr *)&server, sizeof(server)) == 0 &&
+                 getsockname(probe, (struct sockaddr *)&server, &len) == 0;
+    if (probe >= 0)
+        close(probe);
+
+    TelemPack pack;
+    WebSocketServer ws_server(pack, max_viewers);
+    if (!bound || !ws_server.listen(ntohs(server.sin_port)))
+    {
+        printf("websocket server failed to listen\n");
+        return 1;
+    }
+    std::thread server_thread([&ws_server]()
+                              { ws_server.run(); });
+
+    // a vehicle in flight, every sample differs from the one before
+    std::atomic<bool> stop{false};
+    std::thread feeder([&pack, &stop]()
+                       {
+                           auto next = Clock::now();
+                           for (int i = 0; !stop.load(std::memory_order_relaxed); i++)
+                           {
+                               pack.update([i](TelemData &d)
+                                           {
+                                               d.latitude = 47.397742 + i * 1e-7;
+                                               d.longitude = 8.545594;
+                                               d.abs_alt = 488.0f + i * 0.01f;
+                                               d.rel_alt = i * 0.01f;
+                                               d.isArmed = true;
+                                               d.isAllOk = true; });
+                               next += std::chrono::microseconds(1000000 / FEED_RATE);
+                               std::this_thread::sleep_until(next);
+                           } });
+
+    printf("%.1f s per step, telemetry updated at %d Hz, fields %s\n\n", seconds, FEED_RATE, fields.empty() ? "all" : fields.c_str());
+    printf("%6s %8s %12s %12s %12s %14s %14s\n", "rate", "viewers", "expected/s", "messages/s", "dropped/s", "server ms/s",
+           "viewers ms/s");
+
+    struct Saturation
+    {
+        int rate;
+        // most viewers that kept up and the fewest that did not, 0 when not found
+        int kept_up;
+        int behind;
+        StepResult at_kept_up;
+    };
+    std::vector<Saturation> found;
+    for (int rate : rates)
+    {
+        std::string query = "rate=" + std::to_string(rate);
+        if (!fields.empty())
+            query += "&fields=" + fields;
+        Viewers viewers(server, query);
+        std::thread viewer_thread([&viewers]()
+                                  { viewers.run(); });
+
+        Saturation sat = {rate, 0, 0, {}};
+        // double until the viewers fall behind, then bisect down to SATURATION_STEPS
+        for (int n = start_viewers; n > 0;)
+        {
+            StepResult r = measure(ws_server, server_thread, viewers, viewer_thread, n, rate, seconds);
+            if (!r.connected)
+                break;
+            if (r.kept_up())
+            {
+                sat.kept_up = n;
+                sat.at_kept_up = r;
+            }
+            else
+                sat.behind = n;
+
+            if (sat.behind == 0)
+                n = n < max_viewers ? std::min(n * 2, max_viewers) : 0;
+            else if (sat.behind - sat.kept_up > std::max(1, sat.kept_up / SATURATION_STEPS))
+                n = (sat.kept_up + sat.behind) / 2;
+            else
+                n = 0;
+        }
+        found.push_back(sat);
+        if (viewers.failures() > 0)
+            printf("%6d %llu viewer connections failed or were closed by the server\n", rate,
+                   (unsigned long long)viewers.failures());
+
+        viewers.stop();
+        viewer_thread.join();
+        viewers.close_all();
+        // the server sees the hang ups before the next rate starts counting
+        auto deadline = Clock::now() + std::chrono::seconds(10);
+        while (ws_server.viewers() > 0 && Clock::now() < deadline)
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+
+    printf("\n");
+    for (auto &sat : found)
+    {
+        if (sat.kept_up == 0)
+            printf("%d Hz: %d viewers already fell behind\n", sat.rate, start_viewers);
+        else if (sat.behind == 0)
+            printf("%d Hz: %d viewers kept up, no saturation below --max-viewers or the file limit (server %.0f ms/s)\n",
+                   sat.rate, sat.kept_up, sat.at_kept_up.server_cpu_ms_s);
+        else
+            printf("%d Hz: saturated between %d and %d viewers, at %d the server thread used %.0f ms/s and the viewers %.0f ms/s\n",
+                   sat.rate, sat.kept_up, sat.behind, sat.kept_up, sat.at_kept_up.server_cpu_ms_s,
+                   sat.at_kept_up.viewer_cpu_ms_s);
+    }
+
+    stop = true;
+    feeder.join();
+    ws_server.stop();
+    server_thread.join();
+    return 0;
+}
@@ -0,0 +1,562 @@
+#include "command_handler.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+#define ERROR_CONSOLE_TEXT "\033[31m"     // Turn text on console red
+#define TELEMETRY_CONSOLE_TEXT "\033[34m" // Turn text on console blue
+#define NORMAL_CONSOLE_TEXT "\033[0m"     // Restore normal console colour
+
+// replies carry the trailing '\0', existing clients compare against b'success\x00'
+static std::string to_reply(const char *msg)
+{
+    return std::string(msg, strlen(msg) + 1);
+}
+
+// a number of a history query, at least 0, parse error when it is not finite
+static double history_number(const nlohmann::json &command, const char *name)
+{
+    double value = (double)command[name];
+    if (!std::isfinite(value))
+        throw nlohmann::json::parse_error::create(101, 0, std::string(name) + " is not a finite number");
+    return std::max(0.0, value);
+}
+
+// seconds of a history query in microseconds, clamped to what fits
+static uint64_t history_us(const nlohmann::json &command, const char *name)
+{
+    double us = history_number(command, name) * 1e6;
+    return us >= 18446744073709551615.0 ? UINT64_MAX : (uint64_t)us;
+}
+
+// every type the protocol knows, "invalid" counts requests that do not parse, "unknown" the rest
+static const char *const COMMAND_TYPES[] = {
+    "get", "stats", "history", "add_udp", "renew_udp", "remove_udp", "add_uds", "renew_uds", "remove_uds",
+    "goto", "takeoff", "arm_takeoff", "rtl", "land", "hold", "actuator", "offboard_start", "offboard_cmd", "offboard_stop",
+    "invalid", "unknown"};
+
+CommandHandler::CommandHandler(const ServerConfig &config, TelemPack &pack, TelemHistory &history, SubscriberRegistry &subscribers,
+                               PublishStats &publish_stats, VehicleBackend &vehicle, OffboardWatchdog &watchdog, ControlExecutor &control,
+                               MetricsRegistry &metrics, FlightRecorder *recorder, bool unix_telemetry)
+    : config_(config), pack_(pack), history_(history), subscribers_(subscribers), publish_stats_(publish_stats), vehicle_(vehicle),
+      watchdog_(watchdog), control_(control), metrics_(metrics), recorder_(recorder), unix_telemetry_(unix_telemetry)
+{
+    for (const char *type : COMMAND_TYPES)
+    {
+        std::string label = metric_label("command", type);
+        auto outcome = [&](const char *name) -> Counter *
+        {
+            return &metrics.counter("commands_total", "Answered commands per type and outcome.", label + ',' + metric_label("outcome", name));
+        };
+        CommandMetrics m;
+        m.latency = &metrics.histogram("command_duration_seconds", "Time from request to reply per command type.", label);
+        m.success = outcome("success");
+        m.failed = outcome("failed");
+        m.error = outcome("error");
+        command_metrics_.emplace(type, m);
+    }
+}
+
+void CommandHandler::CommandMetrics::record(std::chrono::steady_clock::duration time, const std::string &response)
+{
+    latency->record(std::chrono::duration_cast<std::chrono::nanoseconds>(time));
+    if (response.empty() || response.compare(0, 5, "[json") == 0)
+        error->inc();
+    else if (response.compare(0, 6, "failed") == 0)
+        failed->inc();
+    else
+        success->inc();
+}
+
+CommandHandler::CommandMetrics &CommandHandler::command_metrics(const std::string &command_type)
+{
+    auto it = command_metrics_.find(command_type);
+    return it != command_metrics_.end() ? it->second : command_metrics_.at("unknown");
+}
+
+void CommandHandler::handle(const std::string &request, const struct sockaddr_in &peer, CommandServer::Reply reply)
+{
+    auto received = std::chrono::steady_clock::now();
+    if (recorder_)
+        recorder_->record_command(std::chrono::duration_cast<std::chrono::microseconds>(
+                                      std::chrono::system_clock::now().time_since_epoch())
+                                      .count(),
+                                  request);
+
+    if (request == "get")
+    {
+        // pack to json
+        json_.clear();
+        write_telem_json(json_, pack_.snapshot());
+        command_metrics("get").record(std::chrono::steady_clock::now() - received, json_.str());
+        reply(json_.str());
+        return;
+    }
+
+    nlohmann::json command;
+    std::string command_type;
+    try
+    {
+        command = nlohmann::json::parse(request);
+        command_type = (std::string)command["command"];
+    }
+    catch (nlohmann::json::exception &ex)
+    {
+        std::cout << ERROR_CONSOLE_TEXT << ex.what() << NORMAL_CONSOLE_TEXT << std::endl;
+        std::string error(ex.what());
+        command_metrics("invalid").record(std::chrono::steady_clock::now() - received, error);
+        reply(error);
+        return;
+    }
+
+    // counted once the reply is out, also when it comes from the control thread
+    CommandMetrics *metrics = &command_metrics(command_type);
+    reply = [metrics, received, inner = std::move(reply)](std::string response)
+    {
+        metrics->record(std::chrono::steady_clock::now() - received, response);
+        inner(std::move(response));
+    };
+
+    // "format": "prometheus" gives every metric in the text format the metrics port serves
+    if (command_type == "stats")
+    {
+        std::string format = command.contains("format") && command["format"].is_string() ? (std::string)command["format"] : "json";
+        if (format == "prometheus")
+            reply(metrics_.prometheus());
+        else if (format != "json")
+            reply(to_reply("failed format"));
+        else
+        {
+            json_.clear();
+            write_publish_stats(json_, publish_stats_, config_.publish);
+            reply(json_.str());
+        }
+        return;
+    }
+
+    // times are unix seconds, "last" is the range ending now
+    if (command_type == "history")
+    {
+        HistoryQuery query;
+        bool binary = false;
+        try
+        {
+            if (command.contains("last"))
+            {
+                uint64_t now_us = std::chrono::duration_cast<std::chrono::microseconds>(
+                                      std::chrono::system_clock::now().time_since_epoch())
+                                      .count();
+                uint64_t last_us = history_us(command, "last");
+                query.from_us = last_us < now_us ? now_us - last_us : 0;
+            }
+            if (command.contains("from"))
+                query.from_us = history_us(command, "from");
+            if (command.contains("to"))
+                query.to_us = history_us(command, "to");
+            if (command.contains("step"))
+                query.step_us = history_us(command, "step");
+            if (command.contains("max"))
+                query.max_samples = (size_t)std::min<double>(history_number(command, "max"), HISTORY_MAX_REPLY);
+            if (command.contains("format"))
+            {
+                if (command["format"] == "binary")
+                    binary = true;
+                else if (command["format"] != "json")
+                {
+                    reply(to_reply("failed format"));
+                    return;
+                }
+            }
+            if (command.contains("fields"))
+            {
+                query.sections = 0;
+                for (auto &field : command["fields"])
+                {
+                    uint8_t section = telem_section_by_name((std::string)field);
+                    if (section == 0)
+                    {
+                        reply(to_reply("failed fields"));
+                        return;
+                    }
+                    query.sections |= section;
+                }
+            }
+        }
+        catch (nlohmann::json::exception &ex)
+        {
+            std::cout << ERROR_CONSOLE_TEXT << ex.what() << NORMAL_CONSOLE_TEXT << std::endl;
+            std::string error(ex.what());
+            reply(error);
+            return;
+        }
+        if (history_.capacity() == 0 || query.sections == 0)
+        {
+            reply(to_reply("failed history"));
+            return;
+        }
+
+        if (binary)
+        {
+            std::string blob;
+            history_.query_binary(query, blob);
+            reply(blob);
+        }
+        else
+        {
+            json_.clear();
+            history_.query_json(query, json_);
+            reply(json_.str());
+        }
+        return;
+    }
+
+    bool udp_command = command_type == "add_udp" || command_type == "renew_udp" || command_type == "remove_udp";
+    bool uds_command = command_type == "add_uds" || command_type == "renew_uds" || command_type == "remove_uds";
+    if (udp_command || uds_command)
+    {
+        int port = 6969;
+        std::string path;
+        double lease_s = 0.0;
+        bool delta = false;
+        TelemProfile profile;
+        try
+        {
+            if (command.contains("port"))
+                port = (int)command["port"];
+            if (command.contains("path"))
+                path = (std::string)command["path"];
+            if (command.contains("lease"))
+                lease_s = (double)command["lease"];
+            if (command.contains("format"))
+            {
+                if (command["format"] == "binary")
+                    profile.format = TelemFormat::Binary;
+                else if (command["format"] != "json")
+                {
+                    reply(to_reply("failed format"));
+                    return;
+                }
+            }
+            if (command.contains("rate"))
+                profile.rate = (float)command["rate"];
+            if (command.contains("delta"))
+                delta = (bool)command["delta"];
+            if (delta)
+                profile.keyframe = command.contains("keyframe") ? (float)command["keyframe"] : DEFAULT_KEYFRAME_S;
+            if (command.contains("fields"))
+            {
+                profile.sections = 0;
+                for (auto &field : command["fields"])
+                {
+                    uint8_t section = telem_section_by_name((std::string)field);
+                    if (section == 0)
+                    {
+                        reply(to_reply("failed fields"));
+                        return;
+                    }
+                    profile.sections |= section;
+                }
+            }
+        }
+        catch (nlohmann::json::exception &ex)
+        {
+            std::cout << ERROR_CONSOLE_TEXT << ex.what() << NORMAL_CONSOLE_TEXT << std::endl;
+            std::string error(ex.what());
+            reply(error);
+            return;
+        }
+        if (!(lease_s >= 0.0 && lease_s <= MAX_LEASE_S))
+        {
+            reply(to_reply("failed lease"));
+            return;
+        }
+        if (port <= 0 || port > 65535 || profile.rate < 0.0f || profile.sections == 0 || (delta && profile.keyframe <= 0.0f))
+        {
+            reply(to_reply("failed profile"));
+            return;
+        }
+
+        // udp telemetry goes back to the ip the command came from, unix socket
+        // telemetry only to clients of the unix command socket, so both sides pass file permissions
+        TelemDest sub_addr;
+        if (udp_command && peer.sin_family == AF_INET)
+        {
+            struct sockaddr_in udp_addr = peer;
+            udp_addr.sin_port = htons(port);
+            sub_addr = TelemDest::inet(udp_addr);
+        }
+        else if (!(uds_command && peer.sin_family == AF_UNIX && unix_telemetry_ && TelemDest::unix_path(path, sub_addr)))
+        {
+            reply(to_reply("failed transport"));
+            return;
+        }
+        auto lease = std::chrono::milliseconds(std::llround(lease_s * 1000.0));
+
+        if (command_type == "remove_udp" || command_type == "remove_uds")
+        {
+            reply(to_reply(subscribers_.remove(sub_addr) ? "success" : "failed unknown"));
+            return;
+        }
+
+        bool add = command_type == "add_udp" || command_type == "add_uds";
+        auto result = add ? subscribers_.add(sub_addr, profile, lease)
+                          : subscribers_.renew(sub_addr, lease);
+        if (result == SubscriberRegistry::Result::Full)
+            reply(to_reply("failed full"));
+        else if (result == SubscriberRegistry::Result::NotFound)
+            reply(to_reply("failed unknown"));
+        else
+            reply(to_reply("success"));
+        return;
+    }
+
+    if (!vehicle_.controllable())
+    {
+        reply(to_reply("failed no vehicle"));
+        return;
+    }
+
+    // everything else waits for the autopilot, keep it off the network loop
+    control_.post([this, command = std::move(command), command_type, reply]() mutable
+                  { reply(run(command, command_type)); });
+}
+
+std::string CommandHandler::run(nlohmann::json &command, const std::string &command_type)
+{
+    if (command_type == "goto")
+    {
+        double lat, lon;
+        float alt, heading;
+        try
+        {
+            lat = (double)command["lat"];
+            lon = (double)command["lon"];
+            alt = (float)command["alt"];
+            heading = (float)command["heading"];
+        }
+        catch (nlohmann::json::exception &ex)
+        {
+            std::cout << ERROR_CONSOLE_TEXT << ex.what() << NORMAL_CONSOLE_TEXT << std::endl;
+            std::string error(ex.what());
+            return error;
+        }
+        auto pack = pack_.snapshot();
+        float alt_abs = pack.abs_alt + (alt - pack.rel_alt);
+        if (vehicle_.goto_location(lat, lon, alt_abs, heading))
+        {
+            return to_reply("success");
+        }
+        else
+        {
+            return to_reply("failed");
+        }
+    }
+
+    if (command_type == "takeoff")
+    {
+        float alt;
+        try
+        {
+            alt = (float)command["alt"];
+        }
+        catch (nlohmann::json::exception &ex)
+        {
+            std::cout << ERROR_CONSOLE_TEXT << ex.what() << NORMAL_CONSOLE_TEXT << std::endl;
+            std::string error(ex.what());
+            return error;
+        }
+        if (!vehicle_.set_takeoff_altitude(alt))
+        {
+            return to_reply("failed change_alt");
+        }
+
+        if (vehicle_.takeoff())
+        {
+            return to_reply("success");
+        }
+        else
+        {
+            return to_reply("failed takeoff");
+        }
+    }
+
+    if (command_type == "arm_takeoff")
+    {
+        float alt;
+        try
+        {
+            alt = (float)command["alt"];
+        }
+        catch (nlohmann::json::exception &ex)
+        {
+            std::cout << ERROR_CONSOLE_TEXT << ex.what() << NORMAL_CONSOLE_TEXT << std::endl;
+            std::string error(ex.what());
+            return error;
+        }
+
+        if (!vehicle_.set_takeoff_altitude(alt))
+        {
+            return to_reply("failed change_alt");
+        }
+
+        if (!vehicle_.arm())
+        {
+            return to_reply("failed arm");
+        }
+
+        if (vehicle_.takeoff())
+        {
+            return to_reply("success");
+        }
+        else
+        {
+            return to_reply("failed takeoff");
+        }
+    }
+
+    if (command_type == "rtl")
+    {
+        if (vehicle_.return_to_launch())
+        {
+            return to_reply("success");
+        }
+        else
+        {
+            return to_reply("failed");
+        }
+    }
+
+    if (command_type == "actuator")
+    {
+        int index;
+        float value;
+        try
+        {
+            index = (int)command["index"];
+            value = (float)command["value"];
+        }
+        catch (nlohmann::json::exception &ex)
+        {
+            std::cout << ERROR_CONSOLE_TEXT << ex.what() << NORMAL_CONSOLE_TEXT << std::endl;
+            std::string error(ex.what());
+            return error;
+        }
+        if (vehicle_.set_actuator(index, value))
+        {
+            return to_reply("success");
+        }
+        else
+        {
+            return to_reply("failed");
+        }
+    }
+
+    if (command_type == "offboard_start")
+    {
+        vehicle_.hold();
+        std::cout << TELEMETRY_CONSOLE_TEXT << "offboard start" << NORMAL_CONSOLE_TEXT  << std::endl;
+        bool result1 = vehicle_.set_velocity_body(0.0f, 0.0f, 0.0f, 0.0f);
+        bool result2 = vehicle_.offboard_start();
+        if (result1 && result2)
+        {
+            watchdog_.arm();
+            return to_reply("success");
+        }
+        else
+        {
+            return to_reply("failed");
+        }
+    }
+
+    if (command_type == "offboard_stop")
+    {
+        std::cout << TELEMETRY_CONSOLE_TEXT << "offboard stop" << NORMAL_CONSOLE_TEXT  << std::endl;
+        bool result1 = vehicle_.offboard_stop();
+        bool result2 = vehicle_.hold();
+        if (result1 && result2)
+        {
+            watchdog_.disarm();
+            return to_reply("success");
+        }
+        else
+        {
+            return to_reply("failed");
+        }
+    }
+
+    if (command_type == "offboard_cmd")
+    {
+        std::cout << TELEMETRY_CONSOLE_TEXT << "offboard cmd" << NORMAL_CONSOLE_TEXT  << std::endl;
+        float x = 0.0f, y = 0.0f, z = 0.0f;
+
+        try
+        {
+            x = (float)command["x"];
+            y = (float)command["y"];
+            z = (float)command["z"];
+        }
+        catch (nlohmann::json::exception &ex)
+        {
+            std::cout << ERROR_CONSOLE_TEXT << ex.what() << NORMAL_CONSOLE_TEXT << std::endl;
+            std::string error(ex.what());
+            return error;
+        }
+
+        if(watchdog_.armed() && !vehicle_.in_offboard())
+        {
+            bool res1 = vehicle_.set_velocity_body(0.0f, 0.0f, 0.0f, 0.0f);
+            bool res2 = vehicle_.offboard_start();
+            if (res1 && res2)
+                watchdog_.arm();
+        }
+            
+
+        if (std::fabs(z) > MAX_OFB_Z_SPEED)
+            z = (z / std::fabs(z)) * MAX_OFB_Z_SPEED;
+
+        float speed = sqrt(x * x + y * y);
+        if (speed > MAX_OFB_SPEED)
+        {
+            x = (x / speed) * MAX_OFB_SPEED;
+            y = (y / speed) * MAX_OFB_SPEED;
+        }
+
+        if (vehicle_.set_velocity_body(x, y, z, 0.0f))
+        {
+            watchdog_.feed();
+            return to_reply("success");
+        }
+        else
+        {
+            return to_reply("failed");
+        }
+    }
+
+    if (command_type == "hold")
+    {
+        if (vehicle_.hold())
+        {
+            return to_reply("success");
+        }
+        else
+        {
+            return to_reply("failed");
+        }
+    }
+
+    if (command_type == "land")
+    {
+        if (vehicle_.land())
+        {
+            return to_reply("success");
+        }
+        else
+        {
+            return to_reply("failed");
+        }
+    }
+
+    return "";
+}
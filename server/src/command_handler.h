@@ -0,0 +1,75 @@
+#pragma once
+
+#include <chrono>
+#include <string>
+#include <unordered_map>
+#include <netinet/in.h>
+#include "../lib/json.hpp"
+#include "command_server.h"
+#include "config.h"
+#include "control_executor.h"
+#include "flight_recorder.h"
+#include "metrics.h"
+#include "offboard_watchdog.h"
+#include "subscriber_registry.h"
+#include "telem_history.h"
+#include "telem_json.h"
+#include "telem_pack.h"
+#include "telem_publisher.h"
+#include "vehicle_backend.h"
+
+#define MAX_OFB_SPEED 2.0f   // 2 m/s
+#define MAX_OFB_Z_SPEED 1.0f // 1 m/s
+#define DEFAULT_KEYFRAME_S 1.0f
+#define MAX_LEASE_S 86400.0 // a day, 0 asks for no lease at all
+
+// The command protocol: parses requests and answers them.
+// get, stats, history and the subscriber commands are answered right away on the
+// calling thread; vehicle commands are posted to the control executor and answered
+// from there once the vehicle acknowledged them. handle() is called from the network
+// loop only, it reuses one json buffer.
+class CommandHandler
+{
+public:
+    // recorder is null when not recording, unix_telemetry tells whether add_uds can work
+    CommandHandler(const ServerConfig &config, TelemPack &pack, TelemHistory &history, SubscriberRegistry &subscribers,
+                   PublishStats &publish_stats, VehicleBackend &vehicle, OffboardWatchdog &watchdog, ControlExecutor &control,
+                   MetricsRegistry &metrics, FlightRecorder *recorder, bool unix_telemetry);
+
+    void handle(const std::string &request, const struct sockaddr_in &peer, CommandServer::Reply reply);
+
+private:
+    // latency and outcome of one command type
+    struct CommandMetrics
+    {
+        JitterHistogram *latency;
+        Counter *success;
+        // refused, the reply starts with "failed"
+        Counter *failed;
+        // unparsable arguments or no reply at all
+        Counter *error;
+
+        void record(std::chrono::steady_clock::duration time, const std::string &response);
+    };
+
+    // metrics of unknown types are shared, so clients cannot create series
+    CommandMetrics &command_metrics(const std::string &command_type);
+
+    // runs on the control thread, the only one talking to the vehicle
+    std::string run(nlohmann::json &command, const std::string &command_type);
+
+    const ServerConfig &config_;
+    TelemPack &pack_;
+    TelemHistory &history_;
+    SubscriberRegistry &subscribers_;
+    PublishStats &publish_stats_;
+    VehicleBackend &vehicle_;
+    OffboardWatchdog &watchdog_;
+    ControlExecutor &control_;
+    MetricsRegistry &metrics_;
+    FlightRecorder *recorder_;
+    bool unix_telemetry_;
+    JsonWriter json_;
+    // filled by the constructor, only read afterwards
+    std::unordered_map<std::string, CommandMetrics> command_metrics_;
+};
@@ -0,0 +1,568 @@
+#include "command_server.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <vector>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "../lib/json.hpp"
+
+#define ERROR_CONSOLE_TEXT "\033[31m"
+#define NORMAL_CONSOLE_TEXT "\033[0m"
+
+#define MAX_EVENTS 64
+
+static bool set_nonblocking(int fd)
+{
+    int flags = fcntl(fd, F_GETFL, 0);
+    return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) >= 0;
+}
+
+// legacy clients send one request per connection and wait for the reply,
+// so a request is done once it is "get", a complete json document or the buffer is full.
+// A document that is already broken before its end is done as well, the client gets the
+// parse error right away like from the old server instead of waiting for more bytes.
+static bool request_complete(const std::string &buf)
+{
+    if (buf == "get" || buf.size() >= BUFFER_SIZE)
+        return true;
+    if (nlohmann::json::accept(buf))
+        return true;
+    if (std::string("get").compare(0, buf.size(), buf) == 0)
+        return false;
+    try
+    {
+        (void)nlohmann::json::parse(buf);
+    }
+    catch (nlohmann::json::parse_error &ex)
+    {
+        // errors past the last byte only mean the rest is still on its way
+        return ex.byte <= buf.size();
+    }
+    return true;
+}
+
+CommandServer::CommandServer(Handler handler, size_t max_connections)
+    : handler_(std::move(handler)), max_connections_(max_connections)
+{
+}
+
+CommandServer::~CommandServer()
+{
+    for (auto &it : connections_)
+        close(it.first);
+    for (int fd : listen_fds_)
+        close(fd);
+    for (auto &path : unix_paths_)
+        unlink(path.c_str());
+    if (epoll_fd_ >= 0)
+        close(epoll_fd_);
+    if (wake_fd_ >= 0)
+        close(wake_fd_);
+}
+
+bool CommandServer::init_loop()
+{
+    if (epoll_fd_ >= 0)
+        return true;
+
+    if ((epoll_fd_ = epoll_create1(0)) < 0)
+    {
+        std::cout << ERROR_CONSOLE_TEXT << "epoll failed" << NORMAL_CONSOLE_TEXT << std::endl;
+        return false;
+    }
+
+    // replies finished on other threads wake the loop through this
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    wake_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    ev.data.fd = wake_fd_;
+    if (wake_fd_ < 0 || epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wake_fd_, &ev) < 0)
+    {
+        std::cout << ERROR_CONSOLE_TEXT << "eventfd failed" << NORMAL_CONSOLE_TEXT << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool CommandServer::add_listener(int fd)
+{
+    listen_fds_.push_back(fd);
+    if (::listen(fd, SOMAXCONN) < 0 || !set_nonblocking(fd))
+    {
+        std::cout << ERROR_CONSOLE_TEXT << "sock listen failed" << NORMAL_CONSOLE_TEXT << std::endl;
+        return false;
+    }
+
+    if (!init_loop())
+        return false;
+
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.fd = fd;
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev) < 0)
+    {
+        std::cout << ERROR_CONSOLE_TEXT << "epoll add failed" << NORMAL_CONSOLE_TEXT << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool CommandServer::listen(uint16_t port)
+{
+    int opt = 1;
+    int fd;
+    struct sockaddr_in address;
+
+    if ((fd = socket(AF_INET, SOCK_STREAM, 0)) < 0)
+    {
+        std::cout << ERROR_CONSOLE_TEXT << "sock failed" << NORMAL_CONSOLE_TEXT << std::endl;
+        return false;
+    }
+
+    if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR | SO_REUSEPORT, &opt, sizeof(opt)))
+    {
+        std::cout << ERROR_CONSOLE_TEXT << "setsockopt failed" << NORMAL_CONSOLE_TEXT << std::endl;
+        close(fd);
+        return false;
+    }
+
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = INADDR_ANY;
+    address.sin_port = htons(port);
+
+    if (bind(fd, (struct sockaddr *)&address, sizeof(address)) < 0)
+    {
+        std::cout << ERROR_CONSOLE_TEXT << "sock bind failed" << NORMAL_CONSOLE_TEXT << std::endl;
+        close(fd);
+        return false;
+    }
+
+    return add_listener(fd);
+}
+
+bool CommandServer::listen_unix(const std::string &path, mode_t mode)
+{
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (path.empty() || path.size() >= sizeof(address.sun_path))
+    {
+        std::cout << ERROR_CONSOLE_TEXT << "unix socket path too long" << NORMAL_CONSOLE_TEXT << std::endl;
+        return false;
+    }
+    memcpy(address.sun_path, path.data(), path.size());
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+    {
+        std::cout << ERROR_CONSOLE_TEXT << "unix sock failed" << NORMAL_CONSOLE_TEXT << std::endl;
+        return false;
+    }
+
+    // socket file left behind by a previous run
+    unlink(path.c_str());
+    if (bind(fd, (struct sockaddr *)&address, sizeof(address)) < 0 || chmod(path.c_str(), mode) < 0)
+    {
+        std::cout << ERROR_CONSOLE_TEXT << "unix sock bind failed" << NORMAL_CONSOLE_TEXT << std::endl;
+        close(fd);
+        return false;
+    }
+    unix_paths_.push_back(path);
+
+    return add_listener(fd);
+}
+
+void CommandServer::run()
+{
+    struct epoll_event events[MAX_EVENTS];
+    loop_thread_ = std::this_thread::get_id();
+
+    while (!stop_.load(std::memory_order_relaxed))
+    {
+        int count = epoll_wait(epoll_fd_, events, MAX_EVENTS, CONNECTION_TIMEOUT_MS / 4);
+        if (count < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            std::cout << ERROR_CONSOLE_TEXT << "epoll wait failed" << NORMAL_CONSOLE_TEXT << std::endl;
+            return;
+        }
+
+        for (int i = 0; i < count; i++)
+        {
+            int fd = events[i].data.fd;
+            if (std::find(listen_fds_.begin(), listen_fds_.end(), fd) != listen_fds_.end())
+            {
+                accept_all(fd);
+                continue;
+            }
+            if (fd == wake_fd_)
+            {
+                drain_completions();
+                continue;
+            }
+
+            auto it = connections_.find(fd);
+            if (it == connections_.end())
+                continue;
+
+            if (events[i].events & EPOLLOUT)
+                flush(it->second);
+            else if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+                on_readable(it->second);
+        }
+
+        expire_idle();
+    }
+}
+
+void CommandServer::accept_all(int listen_fd)
+{
+#ifdef __linux__
+    // for a listening tcp socket the kernel reports its accept queue in tcp_info, unix ones fail here
+    struct tcp_info info;
+    socklen_t info_len = sizeof(info);
+    if (getsockopt(listen_fd, IPPROTO_TCP, TCP_INFO, &info, &info_len) == 0)
+    {
+        accept_queue_.store(info.tcpi_unacked, std::memory_order_relaxed);
+        accept_backlog_.store(info.tcpi_sacked, std::memory_order_relaxed);
+        if (info.tcpi_unacked > accept_queue_peak_.load(std::memory_order_relaxed))
+            accept_queue_peak_.store(info.tcpi_unacked, std::memory_order_relaxed);
+    }
+#endif
+
+    while (true)
+    {
+        struct sockaddr_storage addr;
+        socklen_t addr_len = sizeof(addr);
+        int fd = accept(listen_fd, (struct sockaddr *)&addr, &addr_len);
+        if (fd < 0)
+        {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+                std::cout << ERROR_CONSOLE_TEXT << "accepting failed" << NORMAL_CONSOLE_TEXT << std::endl;
+            return;
+        }
+
+        if (connections_.size() >= max_connections_ || !set_nonblocking(fd))
+        {
+            rejected_.fetch_add(1, std::memory_order_relaxed);
+            close(fd);
+            continue;
+        }
+
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN;
+        ev.data.fd = fd;
+        if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev) < 0)
+        {
+            close(fd);
+            continue;
+        }
+
+        // handlers only look at ip peers, unix ones are marked by family
+        Connection conn;
+        conn.fd = fd;
+        conn.id = next_id_++;
+        memset(&conn.peer, 0, sizeof(conn.peer));
+        if (addr.ss_family == AF_INET)
+            memcpy(&conn.peer, &addr, sizeof(conn.peer));
+        else
+            conn.peer.sin_family = AF_UNIX;
+        conn.events = EPOLLIN;
+        conn.last_active = std::chrono::steady_clock::now();
+        connections_.emplace(fd, std::move(conn));
+        accepted_.fetch_add(1, std::memory_order_relaxed);
+        open_connections_.store(connections_.size(), std::memory_order_relaxed);
+    }
+}
+
+void CommandServer::on_readable(Connection &conn)
+{
+    char buffer[4096];
+    bool eof = false;
+    // one-shot requests never need more than BUFFER_SIZE, sessions read whatever is there
+    size_t limit = conn.session ? SESSION_MAX_FRAME + 4 : BUFFER_SIZE;
+
+    while (conn.in.size() < limit)
+    {
+        size_t want = std::min(sizeof(buffer), limit - conn.in.size());
+        ssize_t len = read(conn.fd, buffer, want);
+        if (len > 0)
+        {
+            conn.in.append(buffer, len);
+            continue;
+        }
+        if (len == 0)
+            eof = true;
+        else if (errno == EINTR)
+            continue;
+        else if (errno != EAGAIN && errno != EWOULDBLOCK)
+        {
+            close_connection(conn.fd);
+            return;
+        }
+        break;
+    }
+    conn.last_active = std::chrono::steady_clock::now();
+
+    if (eof && conn.in.empty() && conn.pending.empty() && conn.out.empty())
+    {
+        // peer left, nobody to answer to
+        close_connection(conn.fd);
+        return;
+    }
+
+    if (conn.session)
+    {
+        if (!handle_frames(conn))
+        {
+            close_connection(conn.fd);
+            return;
+        }
+        conn.done = conn.done || eof;
+        flush(conn);
+        return;
+    }
+
+    if (conn.done)
+    {
+        update_watch(conn);
+        return;
+    }
+
+    if (request_complete(conn.in) || eof)
+        handle_oneshot(conn);
+}
+
+void CommandServer::stop()
+{
+    stop_.store(true, std::memory_order_relaxed);
+    uint64_t one = 1;
+    if (wake_fd_ >= 0 && write(wake_fd_, &one, sizeof(one)) < 0)
+    {
+        // counter is only full when the loop is already due to wake up
+    }
+}
+
+void CommandServer::handle_oneshot(Connection &conn)
+{
+    std::string request;
+    request.swap(conn.in);
+
+    if (request.find("session") != std::string::npos)
+    {
+        auto command = nlohmann::json::parse(request, nullptr, false);
+        if (command.is_object() && command.contains("command") && command["command"] == "session")
+        {
+            conn.session = true;
+            conn.out.assign("success", 8);
+            flush(conn);
+            return;
+        }
+    }
+
+    conn.done = true;
+    dispatch(conn, std::move(request));
+    flush(conn);
+}
+
+// runs every complete frame in the input buffer, false if the peer broke framing
+bool CommandServer::handle_frames(Connection &conn)
+{
+    size_t pos = 0;
+    while (conn.in.size() - pos >= 4 && conn.pending.size() < SESSION_MAX_PENDING)
+    {
+        const unsigned char *head = (const unsigned char *)conn.in.data() + pos;
+        uint32_t len = ((uint32_t)head[0] << 24) | ((uint32_t)head[1] << 16) | ((uint32_t)head[2] << 8) | head[3];
+        if (len > SESSION_MAX_FRAME)
+            return false;
+        if (conn.in.size() - pos - 4 < len)
+            break;
+
+        dispatch(conn, conn.in.substr(pos + 4, len));
+        pos += 4 + len;
+    }
+    conn.in.erase(0, pos);
+    return true;
+}
+
+void CommandServer::dispatch(Connection &conn, std::string request)
+{
+    uint64_t slot = conn.first_slot + conn.pending.size();
+    conn.pending.emplace_back();
+
+    int fd = conn.fd;
+    uint64_t id = conn.id;
+    handler_(request, conn.peer, [this, fd, id, slot](std::string response)
+             { complete(fd, id, slot, std::move(response)); });
+}
+
+void CommandServer::complete(int fd, uint64_t id, uint64_t slot, std::string response)
+{
+    if (std::this_thread::get_id() != loop_thread_)
+    {
+        completions_.push(Completion{fd, id, slot, std::move(response)});
+        uint64_t one = 1;
+        if (write(wake_fd_, &one, sizeof(one)) < 0)
+        {
+            // counter is only full when the loop is already due to wake up
+        }
+        return;
+    }
+
+    // answered inline, the caller flushes
+    auto it = connections_.find(fd);
+    if (it == connections_.end() || it->second.id != id)
+        return;
+    Connection &conn = it->second;
+    conn.pending[slot - conn.first_slot].ready = true;
+    conn.pending[slot - conn.first_slot].response = std::move(response);
+    collect_ready(conn);
+}
+
+void CommandServer::drain_completions()
+{
+    uint64_t count;
+    if (read(wake_fd_, &count, sizeof(count)) < 0)
+    {
+        // nothing signalled, spurious wake up
+    }
+
+    Completion done;
+    while (completions_.pop(done))
+    {
+        auto it = connections_.find(done.fd);
+        if (it == connections_.end() || it->second.id != done.id)
+            continue;
+        Connection &conn = it->second;
+        conn.pending[done.slot - conn.first_slot].ready = true;
+        conn.pending[done.slot - conn.first_slot].response = std::move(done.response);
+        collect_ready(conn);
+        flush(conn);
+    }
+}
+
+// moves answered responses, in request order, to the output buffer
+void CommandServer::collect_ready(Connection &conn)
+{
+    while (!conn.pending.empty() && conn.pending.front().ready)
+    {
+        std::string &response = conn.pending.front().response;
+        if (conn.session)
+        {
+            uint32_t len = response.size();
+            char head[4] = {(char)(len >> 24), (char)(len >> 16), (char)(len >> 8), (char)len};
+            conn.out.append(head, 4);
+        }
+        conn.out.append(response);
+        conn.pending.pop_front();
+        conn.first_slot++;
+    }
+}
+
+void CommandServer::flush(Connection &conn)
+{
+    while (conn.out_pos < conn.out.size())
+    {
+        ssize_t len = send(conn.fd, conn.out.data() + conn.out_pos, conn.out.size() - conn.out_pos, MSG_NOSIGNAL);
+        if (len < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                break;
+            close_connection(conn.fd);
+            return;
+        }
+        conn.out_pos += len;
+        conn.last_active = std::chrono::steady_clock::now();
+    }
+
+    if (conn.out_pos == conn.out.size())
+    {
+        conn.out.clear();
+        conn.out_pos = 0;
+        if (conn.done && conn.pending.empty())
+        {
+            close_connection(conn.fd);
+            return;
+        }
+        // frames held back by SESSION_MAX_PENDING may fit now
+        if (conn.session && !conn.in.empty() && conn.pending.size() < SESSION_MAX_PENDING)
+        {
+            if (!handle_frames(conn))
+            {
+                close_connection(conn.fd);
+                return;
+            }
+            if (!conn.out.empty())
+            {
+                flush(conn);
+                return;
+            }
+        }
+    }
+    update_watch(conn);
+}
+
+// writes first, then reads while there is room for more requests
+void CommandServer::update_watch(Connection &conn)
+{
+    uint32_t events = 0;
+    if (!conn.out.empty())
+        events = EPOLLOUT;
+    else if (!conn.done && conn.pending.size() < SESSION_MAX_PENDING)
+        events = EPOLLIN;
+
+    if (conn.events == events)
+        return;
+
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = events;
+    ev.data.fd = conn.fd;
+    epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, conn.fd, &ev);
+    conn.events = events;
+}
+
+void CommandServer::close_connection(int fd)
+{
+    epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+    close(fd);
+    connections_.erase(fd);
+    open_connections_.store(connections_.size(), std::memory_order_relaxed);
+}
+
+void CommandServer::expire_idle()
+{
+    auto now = std::chrono::steady_clock::now();
+    if (now - last_sweep_ < std::chrono::milliseconds(CONNECTION_TIMEOUT_MS / 4))
+        return;
+    last_sweep_ = now;
+
+    std::vector<int> expired;
+    for (auto &it : connections_)
+    {
+        // connections waiting for a slow command are not idle
+        if (!it.second.pending.empty())
+            continue;
+        auto timeout = std::chrono::milliseconds(it.second.session ? SESSION_TIMEOUT_MS : CONNECTION_TIMEOUT_MS);
+        if (now - it.second.last_active > timeout)
+            expired.push_back(it.first);
+    }
+    for (int fd : expired)
+        close_connection(fd);
+}
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <netinet/in.h>
+#include <sys/types.h>
+#include "mpsc_queue.h"
+
+#define BUFFER_SIZE 256
+#define MAX_CONNECTIONS 512
+#define CONNECTION_TIMEOUT_MS 5000
+#define SESSION_TIMEOUT_MS 30000
+#define SESSION_MAX_FRAME 65536
+#define SESSION_MAX_PENDING 64
+
+// Non-blocking tcp server for the text command protocol, driven by epoll.
+// The same protocol can be served on a unix stream socket for local clients.
+//
+// By default a connection carries one request: once it is buffered the handler
+// is called, its response is written back and the connection is closed. A request is
+// buffered when it is "get" or a json document, when it is malformed before its last
+// byte (the handler answers with the parse error), when BUFFER_SIZE bytes came or
+// the client shut down its side.
+// A client which sends {"command": "session"} as its first request gets "success"
+// and the connection switches to session mode: requests and responses are then framed
+// as u32 big-endian length followed by that many bytes, and many of them (pipelined
+// or not) can go over the same connection. Responses keep the order of requests.
+//
+// Handlers answer through the Reply they get, right away or later from any thread,
+// so slow commands never stall the loop.
+class CommandServer
+{
+public:
+    // must be called exactly once, from any thread (empty response closes one-shot connections silently)
+    using Reply = std::function<void(std::string response)>;
+    // peer of unix socket clients has sin_family AF_UNIX and no address
+    using Handler = std::function<void(const std::string &request, const struct sockaddr_in &peer, Reply reply)>;
+
+    CommandServer(Handler handler, size_t max_connections = MAX_CONNECTIONS);
+    ~CommandServer();
+
+    CommandServer(const CommandServer &) = delete;
+    CommandServer &operator=(const CommandServer &) = delete;
+
+    // binds and listens, false on failure
+    bool listen(uint16_t port);
+    // replaces a stale socket file at path, access is controlled by mode
+    bool listen_unix(const std::string &path, mode_t mode);
+
+    // event loop, returns once stop() was called or on fatal error
+    void run();
+
+    // from any thread, open connections are closed by the destructor
+    void stop();
+
+    // for metrics, readable from any thread
+    size_t connections() const { return open_connections_.load(std::memory_order_relaxed); }
+    uint64_t accepted() const { return accepted_.load(std::memory_order_relaxed); }
+    // refused because MAX_CONNECTIONS were open
+    uint64_t rejected() const { return rejected_.load(std::memory_order_relaxed); }
+    // connections waiting in the tcp accept queue when the loop last got to it, and the most seen
+    uint32_t accept_queue() const { return accept_queue_.load(std::memory_order_relaxed); }
+    uint32_t accept_queue_peak() const { return accept_queue_peak_.load(std::memory_order_relaxed); }
+    // limit of that queue, 0 until the first connection came
+    uint32_t accept_backlog() const { return accept_backlog_.load(std::memory_order_relaxed); }
+
+private:
+    struct Pending
+    {
+        bool ready = false;
+        std::string response;
+    };
+
+    struct Connection
+    {
+        int fd;
+        uint64_t id;
+        struct sockaddr_in peer;
+        std::string in;
+        std::string out;
+        size_t out_pos = 0;
+        bool session = false;
+        bool done = false;
+        uint32_t events = 0;
+        // responses not written yet, first one belongs to request first_slot
+        std::deque<Pending> pending;
+        uint64_t first_slot = 0;
+        std::chrono::steady_clock::time_point last_active;
+    };
+
+    struct Completion
+    {
+        int fd;
+        uint64_t id;
+        uint64_t slot;
+        std::string response;
+    };
+
+    bool init_loop();
+    bool add_listener(int fd);
+    void accept_all(int listen_fd);
+    void on_readable(Connection &conn);
+    void handle_oneshot(Connection &conn);
+    bool handle_frames(Connection &conn);
+    void dispatch(Connection &conn, std::string request);
+    void complete(int fd, uint64_t id, uint64_t slot, std::string response);
+    void drain_completions();
+    void collect_ready(Connection &conn);
+    void flush(Connection &conn);
+    void update_watch(Connection &conn);
+    void close_connection(int fd);
+    void expire_idle();
+
+    Handler handler_;
+    size_t max_connections_;
+    std::vector<int> listen_fds_;
+    std::vector<std::string> unix_paths_;
+    int epoll_fd_ = -1;
+    int wake_fd_ = -1;
+    uint64_t next_id_ = 0;
+    std::thread::id loop_thread_;
+    MpscQueue<Completion> completions_;
+    std::chrono::steady_clock::time_point last_sweep_;
+    std::unordered_map<int, Connection> connections_;
+    std::atomic<size_t> open_connections_{0};
+    std::atomic<uint64_t> accepted_{0};
+    std::atomic<uint64_t> rejected_{0};
+    std::atomic<uint32_t> accept_queue_{0};
+    std::atomic<uint32_t> accept_queue_peak_{0};
+    std::atomic<uint32_t> accept_backlog_{0};
+    std::atomic<bool> stop_{false};
+};
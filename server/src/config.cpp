@@ -0,0 +1,224 @@
+#include "config.h"
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#define ERROR_CONSOLE_TEXT "\033[31m"
+#define NORMAL_CONSOLE_TEXT "\033[0m"
+
+static void print_usage(const char *name)
+{
+    std::cout << "usage: " << name << " [options]\n"
+              << "  --publish-mode periodic|event   udp publishing on fixed cadence or on telemetry change\n"
+              << "  --publish-overrun skip|catchup  periodic mode: drop or resend ticks missed by a slow send\n"
+              << "  --publish-min-interval MS       event mode: minimum time between two sends of a stream\n"
+              << "  --publish-max-interval MS       event mode: resend unchanged telemetry after this\n"
+              << "  --multicast-group ADDR          also publish telemetry to this multicast group\n"
+              << "  --multicast-port PORT           multicast destination port (default 6970)\n"
+              << "  --multicast-ttl N               multicast hop limit (default 1)\n"
+              << "  --multicast-interface ADDR|NAME interface multicast leaves through\n"
+              << "  --multicast-format json|binary  multicast payload format\n"
+              << "  --multicast-rate HZ             multicast rate, 0 is every publish tick\n"
+              << "  --shm NAME                      also write telemetry to a shared memory ring, e.g. /mavlink_telem\n"
+              << "  --shm-slots N                   frames kept in the ring (default 1024)\n"
+              << "  --record DIR                    append telemetry and commands to a flight log in DIR\n"
+              << "  --record-segment-mb N           flight log segment size in MiB (default 16)\n"
+              << "  --backend mavsdk|mock|replay    vehicle the server talks to (default mavsdk)\n"
+              << "  --mock-ack-ms MS                mock backend: how long every action call takes (default 20)\n"
+              << "  --mock-rate HZ                  mock backend: telemetry rate (default 50)\n"
+              << "  --replay DIR                    play telemetry from a flight log instead of an autopilot\n"
+              << "  --replay-speed X                replay speed factor, 0 is as fast as possible (default 1)\n"
+              << "  --replay-repeat N               passes over the log, 0 repeats forever (default 0)\n"
+              << "  --history-size N                telemetry samples kept for the history command, 0 disables (default 32768)\n"
+              << "  --ws-port PORT                  serve telemetry to browsers over websocket on this port\n"
+              << "  --metrics-port PORT             serve prometheus metrics over http on this port\n"
+              << "  --metrics-address ADDR          address the metrics port listens on (default 127.0.0.1)\n"
+              << "  --unix-socket PATH              also serve commands on a unix stream socket\n"
+              << "  --unix-socket-mode OCTAL        permissions of the unix socket (default 0660)\n"
+              << "  --offboard-timeout MS           stop offboard after this long without offboard_cmd (default 2000)\n"
+              << std::endl;
+}
+
+static bool parse_ms(const char *text, std::chrono::milliseconds &value)
+{
+    char *end;
+    long ms = strtol(text, &end, 10);
+    if (*text == '\0' || *end != '\0' || ms < 0)
+        return false;
+    value = std::chrono::milliseconds(ms);
+    return true;
+}
+
+static bool parse_int(const char *text, int &value)
+{
+    char *end;
+    long number = strtol(text, &end, 10);
+    if (*text == '\0' || *end != '\0' || number < INT_MIN || number > INT_MAX)
+        return false;
+    value = number;
+    return true;
+}
+
+bool parse_args(int argc, char **argv, ServerConfig &config)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "-h" || arg == "--help")
+        {
+            print_usage(argv[0]);
+            return false;
+        }
+
+        if (i + 1 >= argc)
+        {
+            std::cout << ERROR_CONSOLE_TEXT << "missing value for " << arg << NORMAL_CONSOLE_TEXT << std::endl;
+            print_usage(argv[0]);
+            return false;
+        }
+        std::string value = argv[++i];
+
+        bool ok = true;
+        if (arg == "--publish-mode")
+        {
+            if (value == "periodic")
+                config.publish.mode = PublishMode::Periodic;
+            else if (value == "event")
+                config.publish.mode = PublishMode::Event;
+            else
+                ok = false;
+        }
+        else if (arg == "--publish-overrun")
+        {
+            if (value == "skip")
+                config.publish.overrun = OverrunPolicy::Skip;
+            else if (value == "catchup")
+                config.publish.overrun = OverrunPolicy::CatchUp;
+            else
+                ok = false;
+        }
+        else if (arg == "--publish-min-interval")
+            ok = parse_ms(value.c_str(), config.publish.min_interval);
+        else if (arg == "--publish-max-interval")
+            ok = parse_ms(value.c_str(), config.publish.max_interval) && config.publish.max_interval.count() > 0;
+        else if (arg == "--multicast-group")
+            config.multicast.group = value;
+        else if (arg == "--multicast-port")
+            ok = parse_int(value.c_str(), config.multicast.port) && config.multicast.port > 0 && config.multicast.port <= 65535;
+        else if (arg == "--multicast-ttl")
+            ok = parse_int(value.c_str(), config.multicast.ttl) && config.multicast.ttl >= 0 && config.multicast.ttl <= 255;
+        else if (arg == "--multicast-interface")
+            config.multicast.interface = value;
+        else if (arg == "--multicast-format")
+        {
+            if (value == "json")
+                config.multicast.profile.format = TelemFormat::Json;
+            else if (value == "binary")
+                config.multicast.profile.format = TelemFormat::Binary;
+            else
+                ok = false;
+        }
+        else if (arg == "--multicast-rate")
+        {
+            char *end;
+            config.multicast.profile.rate = strtof(value.c_str(), &end);
+            ok = *end == '\0' && config.multicast.profile.rate >= 0.0f;
+        }
+        else if (arg == "--shm")
+        {
+            // posix shm names are "/name" without further slashes
+            config.shm.name = value;
+            ok = value.size() > 1 && value[0] == '/' && value.find('/', 1) == std::string::npos;
+        }
+        else if (arg == "--shm-slots")
+            ok = parse_int(value.c_str(), config.shm.slots) && config.shm.slots > 0 && config.shm.slots <= (1 << 24);
+        else if (arg == "--record")
+        {
+            config.record.dir = value;
+            ok = !value.empty();
+        }
+        else if (arg == "--record-segment-mb")
+            ok = parse_int(value.c_str(), config.record.segment_mb) && config.record.segment_mb > 0 && config.record.segment_mb <= 1024;
+        else if (arg == "--backend")
+        {
+            if (value == "mavsdk")
+                config.backend = BackendType::Mavsdk;
+            else if (value == "mock")
+                config.backend = BackendType::Mock;
+            else if (value == "replay")
+                config.backend = BackendType::Replay;
+            else
+                ok = false;
+        }
+        else if (arg == "--mock-ack-ms")
+            ok = parse_ms(value.c_str(), config.mock.ack_latency);
+        else if (arg == "--mock-rate")
+        {
+            char *end;
+            config.mock.rate = strtof(value.c_str(), &end);
+            ok = *end == '\0' && config.mock.rate > 0.0f && config.mock.rate <= 10000.0f;
+        }
+        else if (arg == "--replay")
+        {
+            // a log to replay implies the replay backend
+            config.replay.dir = value;
+            config.backend = BackendType::Replay;
+            ok = !value.empty();
+        }
+        else if (arg == "--replay-speed")
+        {
+            char *end;
+            config.replay.speed = strtod(value.c_str(), &end);
+            ok = *end == '\0' && config.replay.speed >= 0.0;
+        }
+        else if (arg == "--replay-repeat")
+            ok = parse_int(value.c_str(), config.replay.repeat) && config.replay.repeat >= 0;
+        else if (arg == "--history-size")
+            ok = parse_int(value.c_str(), config.history_size) && config.history_size >= 0 && config.history_size <= (1 << 22);
+        else if (arg == "--ws-port")
+            ok = parse_int(value.c_str(), config.ws_port) && config.ws_port > 0 && config.ws_port <= 65535;
+        else if (arg == "--metrics-port")
+            ok = parse_int(value.c_str(), config.metrics.port) && config.metrics.port > 0 && config.metrics.port <= 65535;
+        else if (arg == "--metrics-address")
+        {
+            config.metrics.address = value;
+            ok = !value.empty();
+        }
+        else if (arg == "--unix-socket")
+        {
+            config.unix_socket = value;
+            ok = !value.empty();
+        }
+        else if (arg == "--unix-socket-mode")
+        {
+            char *end;
+            long mode = strtol(value.c_str(), &end, 8);
+            config.unix_socket_mode = mode;
+            ok = !value.empty() && *end == '\0' && mode >= 0 && mode <= 0777;
+        }
+        else if (arg == "--offboard-timeout")
+            ok = parse_ms(value.c_str(), config.offboard_timeout) && config.offboard_timeout.count() > 0;
+        else
+        {
+            std::cout << ERROR_CONSOLE_TEXT << "unknown option " << arg << NORMAL_CONSOLE_TEXT << std::endl;
+            print_usage(argv[0]);
+            return false;
+        }
+
+        if (!ok)
+        {
+            std::cout << ERROR_CONSOLE_TEXT << "bad value for " << arg << ": " << value << NORMAL_CONSOLE_TEXT << std::endl;
+            print_usage(argv[0]);
+            return false;
+        }
+    }
+
+    if (config.backend == BackendType::Replay && config.replay.dir.empty())
+    {
+        std::cout << ERROR_CONSOLE_TEXT << "--backend replay needs --replay DIR" << NORMAL_CONSOLE_TEXT << std::endl;
+        print_usage(argv[0]);
+        return false;
+    }
+    return true;
+}
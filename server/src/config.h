@@ -0,0 +1,125 @@
+#pragma once
+
+#include <chrono>
+#include <string>
+#include <sys/types.h>
+#include "subscriber_registry.h"
+
+enum class PublishMode
+{
+    // every subscriber stream on its fixed cadence
+    Periodic,
+    // only when telemetry changed, limited by min/max interval
+    Event
+};
+
+enum class OverrunPolicy
+{
+    // drop ticks missed while sending took too long, stay on the grid
+    Skip,
+    // send the missed ticks back to back (at most PUBLISH_MAX_CATCHUP), then skip
+    CatchUp
+};
+
+struct PublishConfig
+{
+    PublishMode mode = PublishMode::Periodic;
+    // periodic mode: what to do when a tick deadline already passed
+    OverrunPolicy overrun = OverrunPolicy::Skip;
+    // event mode: no stream is sent more often than this on average
+    std::chrono::milliseconds min_interval{0};
+    // event mode: streams are resent after this even without changes
+    std::chrono::milliseconds max_interval{1000};
+};
+
+// telemetry sent to a multicast group next to the unicast subscribers
+struct MulticastConfig
+{
+    // empty disables multicast
+    std::string group;
+    int port = 6970;
+    // 1 keeps datagrams on the local network
+    int ttl = 1;
+    // local address or interface name, empty lets the kernel choose
+    std::string interface;
+    TelemProfile profile;
+};
+
+// shared memory ring for local readers, see telem_shm.h
+struct ShmConfig
+{
+    // empty disables the ring
+    std::string name;
+    int slots = 1024;
+};
+
+// flight log of telemetry and commands, see telem_log.h
+struct RecordConfig
+{
+    // empty disables recording
+    std::string dir;
+    int segment_mb = 16;
+};
+
+enum class BackendType
+{
+    // the autopilot through MAVSDK
+    Mavsdk,
+    // simulated vehicle in process, see mock_backend.h
+    Mock,
+    // telemetry of a flight log, no commands
+    Replay
+};
+
+// simulated vehicle for benchmarks and tests
+struct MockConfig
+{
+    // every action call blocks this long, like waiting for the autopilot's ACK
+    std::chrono::milliseconds ack_latency{20};
+    // position, velocity, attitude and airspeed updates per second, status updates come at 1 Hz
+    float rate = 50.0f;
+};
+
+// telemetry played from a flight log instead of an autopilot
+struct ReplayConfig
+{
+    // empty connects to the autopilot
+    std::string dir;
+    // 1 is real time, 0 as fast as possible
+    double speed = 1.0;
+    // passes over the log, 0 repeats forever
+    int repeat = 0;
+};
+
+// prometheus endpoint, see metrics_server.h
+struct MetricsConfig
+{
+    // 0 disables the http port, the stats command serves the metrics anyway
+    int port = 0;
+    // loopback keeps them local
+    std::string address = "127.0.0.1";
+};
+
+struct ServerConfig
+{
+    BackendType backend = BackendType::Mavsdk;
+    MockConfig mock;
+    PublishConfig publish;
+    MulticastConfig multicast;
+    ShmConfig shm;
+    RecordConfig record;
+    ReplayConfig replay;
+    // telemetry samples kept for the history command, 0 disables it
+    int history_size = 32768;
+    // websocket telemetry for browsers, 0 disables it
+    int ws_port = 0;
+    MetricsConfig metrics;
+    // unix stream socket serving the command protocol, empty disables it
+    std::string unix_socket;
+    mode_t unix_socket_mode = 0660;
+    // offboard is stopped when no offboard_cmd arrived for this long
+    std::chrono::milliseconds offboard_timeout{2000};
+};
+
+// fills config from command line, prints usage and returns false on bad arguments
+bool parse_args(int argc, char **argv, ServerConfig &config);
@@ -0,0 +1,51 @@
+#include "control_executor.h"
+#include <cstdint>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+ControlExecutor::ControlExecutor()
+    : wake_fd_(eventfd(0, EFD_CLOEXEC))
+{
+    thread_ = std::thread([this]()
+                          { loop(); });
+}
+
+ControlExecutor::~ControlExecutor()
+{
+    running_ = false;
+    wake();
+    thread_.join();
+    close(wake_fd_);
+}
+
+void ControlExecutor::post(Job job)
+{
+    queue_.push(std::move(job));
+    wake();
+}
+
+void ControlExecutor::wake()
+{
+    uint64_t one = 1;
+    if (write(wake_fd_, &one, sizeof(one)) < 0)
+    {
+        // counter is only full when the loop is already due to wake up
+    }
+}
+
+void ControlExecutor::loop()
+{
+    while (running_)
+    {
+        uint64_t count;
+        if (read(wake_fd_, &count, sizeof(count)) < 0)
+            continue;
+
+        Job job;
+        while (queue_.pop(job))
+        {
+            job();
+            job = nullptr;
+        }
+    }
+}
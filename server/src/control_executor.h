@@ -0,0 +1,32 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <thread>
+#include "mpsc_queue.h"
+
+// Single thread running every vehicle control call (mavsdk Action / Offboard).
+// Jobs are posted lock-free from any thread and run in order, so a slow autopilot
+// ACK only delays other control calls, never the network loop.
+class ControlExecutor
+{
+public:
+    using Job = std::function<void()>;
+
+    ControlExecutor();
+    ~ControlExecutor();
+
+    ControlExecutor(const ControlExecutor &) = delete;
+    ControlExecutor &operator=(const ControlExecutor &) = delete;
+
+    void post(Job job);
+
+private:
+    void loop();
+    void wake();
+
+    MpscQueue<Job> queue_;
+    int wake_fd_;
+    std::atomic<bool> running_{true};
+    std::thread thread_;
+};
@@ -0,0 +1,262 @@
+#include "flight_recorder.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+#include <iostream>
+#include <sys/stat.h>
+#include "telem_binary.h"
+
+#define ERROR_CONSOLE_TEXT "\033[31m"
+#define NORMAL_CONSOLE_TEXT "\033[0m"
+
+// glibc before 2.35 lacks it, older kernels answer EINVAL
+#ifndef MADV_POPULATE_WRITE
+#define MADV_POPULATE_WRITE 23
+#endif
+
+static size_t page_size()
+{
+    static const size_t size = sysconf(_SC_PAGESIZE);
+    return size;
+}
+
+// Write faults the pages from pos on (at most RECORDER_PREFAULT_BYTES) without changing
+// them, so appends find them mapped writable. Pages synced or written back by the kernel
+// get write protected again, hence run() repeats this ahead of the write position.
+// False where MADV_POPULATE_WRITE (linux 5.14) is not supported.
+static bool prefault(uint8_t *map, size_t size, size_t pos)
+{
+    pos &= ~(page_size() - 1);
+    if (pos >= size)
+        return true;
+    return madvise(map + pos, std::min<size_t>(size - pos, RECORDER_PREFAULT_BYTES), MADV_POPULATE_WRITE) == 0;
+}
+
+FlightRecorder::~FlightRecorder()
+{
+    stop();
+}
+
+bool FlightRecorder::open(const std::string &dir, size_t segment_size)
+{
+    if (mkdir(dir.c_str(), 0755) < 0 && errno != EEXIST)
+    {
+        std::cout << ERROR_CONSOLE_TEXT << "recorder mkdir failed" << NORMAL_CONSOLE_TEXT << std::endl;
+        return false;
+    }
+
+    segment_size_ = (segment_size + RECORDER_MIN_SEGMENT - 1) / RECORDER_MIN_SEGMENT * RECORDER_MIN_SEGMENT;
+    if (segment_size_ == 0)
+        segment_size_ = RECORDER_MIN_SEGMENT;
+    index_capacity_ = segment_size_ / TELEM_LOG_INDEX_BYTES + 1;
+
+    char stamp[32];
+    time_t now = time(nullptr);
+    struct tm utc;
+    gmtime_r(&now, &utc);
+    strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", &utc);
+    prefix_ = dir + "/flight-" + stamp + "-";
+    next_number_ = 0;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopped_ = false;
+    return create_segment(next_number_++, current_);
+}
+
+bool FlightRecorder::create_segment(uint32_t number, Segment &segment)
+{
+    char name[16];
+    snprintf(name, sizeof(name), "%04u", number);
+    std::string path = prefix_ + name + TELEM_LOG_SUFFIX;
+
+    int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    if (fd < 0)
+    {
+        std::cout << ERROR_CONSOLE_TEXT << "recorder segment open failed" << NORMAL_CONSOLE_TEXT << std::endl;
+        return false;
+    }
+
+    // allocated blocks up front, so filling the mapping never waits for the filesystem
+    // to find space, ftruncate alone is enough where fallocate is not supported
+    void *map = MAP_FAILED;
+    if (posix_fallocate(fd, 0, segment_size_) == 0 || ftruncate(fd, segment_size_) == 0)
+        map = mmap(nullptr, segment_size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED)
+    {
+        std::cout << ERROR_CONSOLE_TEXT << "recorder segment map failed" << NORMAL_CONSOLE_TEXT << std::endl;
+        ::close(fd);
+        unlink(path.c_str());
+        return false;
+    }
+
+    // nobody else sees the segment yet, so the fallback may write to it
+    if (!prefault(static_cast<uint8_t *>(map), segment_size_, 0))
+        for (size_t offset = 0; offset < segment_size_; offset += page_size())
+            static_cast<volatile uint8_t *>(map)[offset] = 0;
+
+    // the file is zero filled, so the index is empty and the first record size ends the segment
+    auto header = static_cast<TelemLogHeader *>(map);
+    header->version = TELEM_LOG_VERSION;
+    header->segment = number;
+    header->index_capacity = index_capacity_;
+    header->data_offset = telem_log_data_offset(index_capacity_);
+    header->magic = TELEM_LOG_MAGIC;
+
+    segment.path = path;
+    segment.fd = fd;
+    segment.map = static_cast<uint8_t *>(map);
+    segment.size = segment_size_;
+    segment.pos = header->data_offset;
+    segment.indexed = header->data_offset;
+    segment.synced = 0;
+    return true;
+}
+
+void FlightRecorder::close_segment(Segment &segment)
+{
+    if (!segment.map)
+        return;
+
+    auto header = reinterpret_cast<TelemLogHeader *>(segment.map);
+    bool empty = segment.pos == header->data_offset;
+    msync(segment.map, segment.pos, MS_SYNC);
+    munmap(segment.map, segment.size);
+    if (empty)
+        unlink(segment.path.c_str());
+    else if (ftruncate(segment.fd, segment.pos) < 0)
+        std::cout << ERROR_CONSOLE_TEXT << "recorder segment trim failed" << NORMAL_CONSOLE_TEXT << std::endl;
+    ::close(segment.fd);
+    segment = Segment();
+}
+
+void FlightRecorder::record_telem(uint64_t time_us, const TelemData &data)
+{
+    uint8_t frame[TELEM_BINARY_MAX_SIZE];
+    TelemBinaryHeader hdr;
+    hdr.time_us = time_us;
+    size_t size = encode_telem_binary(frame, hdr, data);
+    append(TELEM_LOG_TELEM, time_us, frame, size);
+}
+
+void FlightRecorder::record_command(uint64_t time_us, const std::string &request)
+{
+    append(TELEM_LOG_COMMAND, time_us, request.data(), request.size());
+}
+
+void FlightRecorder::append(uint8_t type, uint64_t time_us, const void *payload, size_t size)
+{
+    // size 0 ends a segment for readers, an empty record would hide every later one
+    if (size == 0)
+        return;
+
+    size_t total = telem_log_record_size(size);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!current_.map || total > segment_size_ - telem_log_data_offset(index_capacity_))
+            return;
+
+        if (current_.pos + total > current_.size)
+        {
+            if (!next_.map)
+            {
+                dropped_.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            full_.push_back(current_);
+            current_ = next_;
+            next_ = Segment();
+            wake_.notify_one();
+        }
+
+        auto header = reinterpret_cast<TelemLogHeader *>(current_.map);
+        auto index = reinterpret_cast<TelemLogIndexEntry *>(current_.map + sizeof(TelemLogHeader));
+        bool first = current_.pos == header->data_offset;
+        if (first)
+            header->first_time_us = time_us;
+        if ((first || current_.pos - current_.indexed >= TELEM_LOG_INDEX_BYTES) && header->index_count < index_capacity_)
+        {
+            index[header->index_count] = TelemLogIndexEntry{time_us, current_.pos};
+            reinterpret_cast<std::atomic<uint64_t> *>(&header->index_count)->store(header->index_count + 1, std::memory_order_release);
+            current_.indexed = current_.pos;
+        }
+
+        // size goes in last, a live reader stops at size 0
+        uint8_t *record = current_.map + current_.pos;
+        TelemLogRecordHeader rec = {0, type, {0, 0, 0}, time_us};
+        memcpy(record, &rec, sizeof(rec));
+        memcpy(record + sizeof(rec), payload, size);
+        reinterpret_cast<std::atomic<uint32_t> *>(record)->store(size, std::memory_order_release);
+        current_.pos += total;
+    }
+    records_.fetch_add(1, std::memory_order_relaxed);
+    bytes_.fetch_add(total, std::memory_order_relaxed);
+}
+
+void FlightRecorder::run()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    running_ = true;
+    while (!stopped_)
+    {
+        bool failed = false;
+        if (!next_.map)
+        {
+            uint32_t number = next_number_++;
+            lock.unlock();
+            Segment segment;
+            failed = !create_segment(number, segment);
+            lock.lock();
+            if (!failed)
+                next_ = segment;
+        }
+
+        std::vector<Segment> full;
+        full.swap(full_);
+        // only this thread unmaps, the current mapping stays valid after unlocking.
+        // Only complete pages are synced: a page under writeback is write protected
+        // and appending to it would wait for the disk.
+        uint8_t *map = current_.map;
+        size_t size = current_.size;
+        size_t pos = current_.pos;
+        size_t from = current_.synced;
+        size_t to = pos & ~(page_size() - 1);
+        if (to > from)
+            current_.synced = to;
+        lock.unlock();
+
+        for (auto &segment : full)
+            close_segment(segment);
+        if (map && to > from)
+            msync(map + from, to - from, MS_ASYNC);
+        if (map)
+            prefault(map, size, pos);
+
+        lock.lock();
+        wake_.wait_for(lock, std::chrono::milliseconds(RECORDER_SYNC_MS), [&]()
+                       { return stopped_ || !full_.empty() || (!next_.map && !failed); });
+    }
+    running_ = false;
+    done_.notify_all();
+}
+
+void FlightRecorder::stop()
+{
+    std::vector<Segment> segments;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        stopped_ = true;
+        wake_.notify_one();
+        // run() may still be syncing the current segment
+        done_.wait(lock, [this]()
+                   { return !running_; });
+        segments.swap(full_);
+        segments.push_back(current_);
+        segments.push_back(next_);
+        current_ = Segment();
+        next_ = Segment();
+    }
+    for (auto &segment : segments)
+        close_segment(segment);
+}
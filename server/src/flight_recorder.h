@@ -0,0 +1,87 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "telem_log.h"
+#include "telem_pack.h"
+
+#define RECORDER_DEFAULT_SEGMENT (16u << 20)
+#define RECORDER_MIN_SEGMENT (1u << 20)
+#define RECORDER_SYNC_MS 250
+// pages kept faulted in ahead of the write position
+#define RECORDER_PREFAULT_BYTES (256u << 10)
+
+// Appends telemetry updates and received commands to a segmented flight log
+// (format in telem_log.h).
+//
+// Appending is a memcpy into a preallocated shared mapping under a mutex held only
+// for that copy. Everything touching the disk runs on the run() thread: creating and
+// preallocating and prefaulting the next segment ahead of time, msync(MS_ASYNC) of
+// completed pages every RECORDER_SYNC_MS and syncing, unmapping and trimming full segments.
+// When the next segment is not ready yet a record is dropped instead of waiting.
+class FlightRecorder
+{
+public:
+    FlightRecorder() = default;
+    ~FlightRecorder();
+
+    FlightRecorder(const FlightRecorder &) = delete;
+    FlightRecorder &operator=(const FlightRecorder &) = delete;
+
+    // creates dir if needed and the first segment, segment_size is rounded up to
+    // RECORDER_MIN_SEGMENT, false on failure
+    bool open(const std::string &dir, size_t segment_size = RECORDER_DEFAULT_SEGMENT);
+
+    // any thread, never blocks on the disk, an empty request is not recorded
+    void record_telem(uint64_t time_us, const TelemData &data);
+    void record_command(uint64_t time_us, const std::string &request);
+
+    // segment preparation and syncing, returns after stop()
+    void run();
+    // stops run() and closes every segment, trimmed to its used size
+    void stop();
+
+    uint64_t records() const { return records_.load(std::memory_order_relaxed); }
+    uint64_t bytes() const { return bytes_.load(std::memory_order_relaxed); }
+    uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+private:
+    struct Segment
+    {
+        std::string path;
+        int fd = -1;
+        uint8_t *map = nullptr;
+        size_t size = 0;
+        size_t pos = 0;
+        // start of the span the last index entry covers
+        size_t indexed = 0;
+        // page aligned, bytes below were already handed to msync
+        size_t synced = 0;
+    };
+
+    bool create_segment(uint32_t number, Segment &segment);
+    void close_segment(Segment &segment);
+    void append(uint8_t type, uint64_t time_us, const void *payload, size_t size);
+
+    std::string prefix_;
+    size_t segment_size_ = 0;
+    uint32_t index_capacity_ = 0;
+    uint32_t next_number_ = 0;
+
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable done_;
+    bool stopped_ = false;
+    bool running_ = false;
+    Segment current_;
+    Segment next_;
+    std::vector<Segment> full_;
+
+    std::atomic<uint64_t> records_{0};
+    std::atomic<uint64_t> bytes_{0};
+    std::atomic<uint64_t> dropped_{0};
+};
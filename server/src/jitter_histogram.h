@@ -0,0 +1,69 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+// bucket 0 holds samples below 1 us, bucket i samples in [2^(i-1), 2^i) us,
+// the last one everything from ~1 s up
+#define JITTER_BUCKETS 22
+
+// Log2 histogram of time deviations or durations with relaxed atomic counters,
+// any thread records while others read it for the stats command and metrics.
+class JitterHistogram
+{
+public:
+    void record(std::chrono::nanoseconds deviation)
+    {
+        uint64_t us = std::chrono::duration_cast<std::chrono::microseconds>(deviation).count();
+        if (deviation < std::chrono::nanoseconds::zero())
+            us = std::chrono::duration_cast<std::chrono::microseconds>(-deviation).count();
+
+        size_t bucket = 0;
+        while (bucket < JITTER_BUCKETS - 1 && us >= (1ull << bucket))
+            bucket++;
+        buckets_[bucket].fetch_add(1, std::memory_order_relaxed);
+        count_.fetch_add(1, std::memory_order_relaxed);
+        sum_us_.fetch_add(us, std::memory_order_relaxed);
+        uint64_t max = max_us_.load(std::memory_order_relaxed);
+        while (us > max && !max_us_.compare_exchange_weak(max, us, std::memory_order_relaxed))
+            ;
+    }
+
+    uint64_t count() const { return count_.load(std::memory_order_relaxed); }
+    uint64_t max_us() const { return max_us_.load(std::memory_order_relaxed); }
+    uint64_t sum_us() const { return sum_us_.load(std::memory_order_relaxed); }
+    uint64_t bucket(size_t i) const { return buckets_[i].load(std::memory_order_relaxed); }
+
+    // exclusive upper bound of bucket i in us
+    static uint64_t bucket_limit_us(size_t i) { return 1ull << i; }
+
+    double mean_us() const
+    {
+        uint64_t n = count();
+        return n ? (double)sum_us_.load(std::memory_order_relaxed) / n : 0.0;
+    }
+
+    // upper bound of the bucket holding quantile q (0..1), 0 when empty
+    uint64_t quantile_us(double q) const
+    {
+        uint64_t n = count();
+        if (n == 0)
+            return 0;
+        uint64_t rank = (uint64_t)(q * n);
+        uint64_t seen = 0;
+        for (size_t i = 0; i < JITTER_BUCKETS; i++)
+        {
+            seen += bucket(i);
+            if (seen > rank)
+                return i == JITTER_BUCKETS - 1 ? max_us() : bucket_limit_us(i);
+        }
+        return max_us();
+    }
+
+private:
+    std::atomic<uint64_t> buckets_[JITTER_BUCKETS] = {};
+    std::atomic<uint64_t> count_{0};
+    std::atomic<uint64_t> sum_us_{0};
+    std::atomic<uint64_t> max_us_{0};
+};
@@ -0,0 +1,193 @@
+#include "mavsdk_backend.h"
+#include <chrono>
+#include <future>
+#include <iostream>
+#include <mavsdk/mavsdk.h>
+#include <mavsdk/plugins/telemetry/telemetry.h>
+#include <mavsdk/plugins/action/action.h>
+#include <mavsdk/plugins/offboard/offboard.h>
+
+using namespace mavsdk;
+
+#define ERROR_CONSOLE_TEXT "\033[31m"
+#define NORMAL_CONSOLE_TEXT "\033[0m"
+
+MavsdkBackend::MavsdkBackend(MetricsRegistry &metrics, const std::string &connection_url)
+    : metrics_(metrics), connection_url_(connection_url), mavsdk_(std::make_unique<Mavsdk>())
+{
+}
+
+MavsdkBackend::~MavsdkBackend() = default;
+
+bool MavsdkBackend::start(TelemUpdate update)
+{
+    update_ = std::move(update);
+
+    ConnectionResult connection_result = mavsdk_->add_any_connection(connection_url_);
+    if (connection_result != ConnectionResult::Success)
+    {
+        std::cout << ERROR_CONSOLE_TEXT << "Connection failed: " << connection_result
+                  << NORMAL_CONSOLE_TEXT << std::endl;
+        return false;
+    }
+
+    std::cout << "Waiting to discover system..." << std::endl;
+    auto prom = std::promise<std::shared_ptr<System>>{};
+    auto fut = prom.get_future();
+
+    Mavsdk &mavsdk = *mavsdk_;
+    mavsdk.subscribe_on_new_system([&mavsdk, &prom]()
+                                   {
+                                       auto system = mavsdk.systems().back();
+
+                                       if (system->has_autopilot())
+                                       {
+                                           std::cout << "Discovered autopilot" << std::endl;
+
+                                           // Unsubscribe again as we only want to find one system.
+                                           mavsdk.subscribe_on_new_system(nullptr);
+                                           prom.set_value(system);
+                                       } });
+
+    if (fut.wait_for(std::chrono::seconds(MAVSDK_DISCOVERY_S)) == std::future_status::timeout)
+    {
+        std::cout << ERROR_CONSOLE_TEXT << "No autopilot found, exiting." << NORMAL_CONSOLE_TEXT
+                  << std::endl;
+        return false;
+    }
+
+    system_ = fut.get();
+    telemetry_ = std::make_unique<Telemetry>(system_);
+    action_ = std::make_unique<Action>(system_);
+    offboard_ = std::make_unique<Offboard>(system_);
+
+    // lambdas for telemetry, each counts its calls so stream rates show in the metrics
+    TelemUpdate &update_telem = update_;
+    auto stream = [this](const char *name) -> Counter &
+    {
+        return metrics_.counter(BACKEND_CALLBACKS_METRIC, BACKEND_CALLBACKS_HELP, metric_label("stream", name));
+    };
+    telemetry_->subscribe_position([&update_telem, &calls = stream("position")](Telemetry::Position position)
+                                   {
+                                       calls.inc();
+                                       update_telem([&](TelemData &pack)
+                                                  {
+                                                      pack.latitude = position.latitude_deg;
+                                                      pack.longitude = position.longitude_deg;
+                                                      pack.abs_alt = position.absolute_altitude_m;
+                                                      pack.rel_alt = position.relative_altitude_m; }); });
+
+    telemetry_->subscribe_velocity_ned([&update_telem, &calls = stream("velocity_ned")](Telemetry::VelocityNed vel)
+                                       {
+                                           calls.inc();
+                                           update_telem([&](TelemData &pack)
+                                                      {
+                                                          pack.vel_down = vel.down_m_s;
+                                                          pack.vel_east = vel.east_m_s;
+                                                          pack.vel_north = vel.north_m_s; }); });
+
+    telemetry_->subscribe_fixedwing_metrics([&update_telem, &calls = stream("fixedwing_metrics")](Telemetry::FixedwingMetrics met)
+                                            {
+                                                calls.inc();
+                                                update_telem([&](TelemData &pack)
+                                                           {
+                                                               pack.airspeed = met.airspeed_m_s;
+                                                               pack.climb_rate = met.climb_rate_m_s; }); });
+
+    telemetry_->subscribe_attitude_euler([&update_telem, &calls = stream("attitude_euler")](Telemetry::EulerAngle ang)
+                                         {
+                                             calls.inc();
+                                             update_telem([&](TelemData &pack)
+                                                        {
+                                                            pack.pitch_deg = ang.pitch_deg;
+                                                            pack.roll_deg = ang.roll_deg;
+                                                            pack.yaw_deg = ang.yaw_deg; }); });
+
+    telemetry_->subscribe_battery([&update_telem, &calls = stream("battery")](Telemetry::Battery batt)
+                                  {
+                                      calls.inc();
+                                      update_telem([&](TelemData &pack)
+                                                 {
+                                                     pack.batt_percentage = batt.remaining_percent;
+                                                     pack.batt_voltage = batt.voltage_v; }); });
+
+    telemetry_->subscribe_health_all_ok([&update_telem, &calls = stream("health_all_ok")](bool health)
+                                        {
+                                            calls.inc();
+                                            update_telem([&](TelemData &pack)
+                                                       { pack.isAllOk = health; }); });
+
+    telemetry_->subscribe_armed([&update_telem, &calls = stream("armed")](bool armed)
+                                {
+                                    calls.inc();
+                                    update_telem([&](TelemData &pack)
+                                               { pack.isArmed = armed; }); });
+
+    telemetry_->subscribe_in_air([&update_telem, &calls = stream("in_air")](bool inAir)
+                                 {
+                                     calls.inc();
+                                     update_telem([&](TelemData &pack)
+                                                { pack.inAir = inAir; }); });
+
+    telemetry_->subscribe_flight_mode([this, &calls = stream("flight_mode")](Telemetry::FlightMode fm)
+                                      {
+                                          calls.inc();
+                                          in_offboard_.store(fm == Telemetry::FlightMode::Offboard, std::memory_order_relaxed); });
+    return true;
+}
+
+bool MavsdkBackend::arm()
+{
+    return action_->arm() == Action::Result::Success;
+}
+
+bool MavsdkBackend::set_takeoff_altitude(float alt_m)
+{
+    return action_->set_takeoff_altitude(alt_m) == Action::Result::Success;
+}
+
+bool MavsdkBackend::takeoff()
+{
+    return action_->takeoff() == Action::Result::Success;
+}
+
+bool MavsdkBackend::land()
+{
+    return action_->land() == Action::Result::Success;
+}
+
+bool MavsdkBackend::hold()
+{
+    return action_->hold() == Action::Result::Success;
+}
+
+bool MavsdkBackend::return_to_launch()
+{
+    return action_->return_to_launch() == Action::Result::Success;
+}
+
+bool MavsdkBackend::goto_location(double lat_deg, double lon_deg, float alt_abs_m, float yaw_deg)
+{
+    return action_->goto_location(lat_deg, lon_deg, alt_abs_m, yaw_deg) == Action::Result::Success;
+}
+
+bool MavsdkBackend::set_actuator(int index, float value)
+{
+    return action_->set_actuator(index, value) == Action::Result::Success;
+}
+
+bool MavsdkBackend::offboard_start()
+{
+    return offboard_->start() == Offboard::Result::Success;
+}
+
+bool MavsdkBackend::offboard_stop()
+{
+    return offboard_->stop() == Offboard::Result::Success;
+}
+
+bool MavsdkBackend::set_velocity_body(float forward_m_s, float right_m_s, float down_m_s, float yawspeed_deg_s)
+{
+    Offboard::VelocityBodyYawspeed cmd{forward_m_s, right_m_s, down_m_s, yawspeed_deg_s};
+    return offboard_->set_velocity_body(cmd) == Offboard::Result::Success;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include "metrics.h"
+#include "vehicle_backend.h"
+
+namespace mavsdk
+{
+    class Mavsdk;
+    class System;
+    class Telemetry;
+    class Action;
+    class Offboard;
+}
+
+#define MAVSDK_DEFAULT_URL "udp://:14540"
+#define MAVSDK_DISCOVERY_S 3
+
+// The autopilot through MAVSDK, the only part of the server including it.
+class MavsdkBackend : public VehicleBackend
+{
+public:
+    // counts telemetry callbacks per stream in metrics
+    explicit MavsdkBackend(MetricsRegistry &metrics, const std::string &connection_url = MAVSDK_DEFAULT_URL);
+    ~MavsdkBackend() override;
+
+    // waits up to MAVSDK_DISCOVERY_S for an autopilot
+    bool start(TelemUpdate update) override;
+
+    bool arm() override;
+    bool set_takeoff_altitude(float alt_m) override;
+    bool takeoff() override;
+    bool land() override;
+    bool hold() override;
+    bool return_to_launch() override;
+    bool goto_location(double lat_deg, double lon_deg, float alt_abs_m, float yaw_deg) override;
+    bool set_actuator(int index, float value) override;
+
+    bool offboard_start() override;
+    bool offboard_stop() override;
+    bool set_velocity_body(float forward_m_s, float right_m_s, float down_m_s, float yawspeed_deg_s) override;
+    bool in_offboard() const override { return in_offboard_.load(std::memory_order_relaxed); }
+
+private:
+    MetricsRegistry &metrics_;
+    std::string connection_url_;
+    std::unique_ptr<mavsdk::Mavsdk> mavsdk_;
+    std::shared_ptr<mavsdk::System> system_;
+    std::unique_ptr<mavsdk::Telemetry> telemetry_;
+    std::unique_ptr<mavsdk::Action> action_;
+    std::unique_ptr<mavsdk::Offboard> offboard_;
+    TelemUpdate update_;
+    std::atomic<bool> in_offboard_{false};
+};
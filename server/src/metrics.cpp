@@ -0,0 +1,164 @@
+#include "metrics.h"
+#include <cmath>
+#include <cstdio>
+
+std::string metric_label(const std::string &name, const std::string &value)
+{
+    std::string out = name + "=\"";
+    for (char c : value)
+    {
+        if (c == '\\' || c == '"')
+            out += '\\';
+        if (c == '\n')
+        {
+            out += "\\n";
+            continue;
+        }
+        out += c;
+    }
+    out += '"';
+    return out;
+}
+
+static const char *type_name(MetricsWriter::Type type)
+{
+    if (type == MetricsWriter::Type::Counter)
+        return "counter";
+    if (type == MetricsWriter::Type::Gauge)
+        return "gauge";
+    return "histogram";
+}
+
+void MetricsWriter::family(const std::string &name, const std::string &help, Type type)
+{
+    out_ += "# HELP " METRICS_PREFIX + name + ' ' + help + '\n';
+    out_ += "# TYPE " METRICS_PREFIX + name + ' ' + type_name(type) + '\n';
+}
+
+void MetricsWriter::line(const std::string &name, const char *suffix, const std::string &labels, double value, const char *le)
+{
+    out_ += METRICS_PREFIX;
+    out_ += name;
+    out_ += suffix;
+    if (!labels.empty() || le)
+    {
+        out_ += '{';
+        out_ += labels;
+        if (le)
+        {
+            out_ += labels.empty() ? "le=\"" : ",le=\"";
+            out_ += le;
+            out_ += '"';
+        }
+        out_ += '}';
+    }
+
+    // counts stay exact, %g would round them past 9 digits
+    char buf[32];
+    if (std::floor(value) == value && std::fabs(value) < 9007199254740992.0)
+        snprintf(buf, sizeof(buf), " %lld\n", (long long)value);
+    else
+        snprintf(buf, sizeof(buf), " %.9g\n", value);
+    out_ += buf;
+}
+
+void MetricsWriter::sample(const std::string &name, const std::string &labels, double value)
+{
+    line(name, "", labels, value);
+}
+
+void MetricsWriter::histogram(const std::string &name, const std::string &labels, const JitterHistogram &histogram)
+{
+    // cumulative buckets, the count is their sum so a concurrent record never makes them disagree
+    static const std::vector<std::string> limits = []()
+    {
+        std::vector<std::string> le;
+        char buf[32];
+        for (size_t i = 0; i < JITTER_BUCKETS - 1; i++)
+        {
+            snprintf(buf, sizeof(buf), "%.9g", JitterHistogram::bucket_limit_us(i) * 1e-6);
+            le.push_back(buf);
+        }
+        return le;
+    }();
+    uint64_t cumulative = 0;
+    for (size_t i = 0; i < JITTER_BUCKETS - 1; i++)
+    {
+        cumulative += histogram.bucket(i);
+        line(name, "_bucket", labels, cumulative, limits[i].c_str());
+    }
+    cumulative += histogram.bucket(JITTER_BUCKETS - 1);
+    line(name, "_bucket", labels, cumulative, "+Inf");
+    line(name, "_sum", labels, histogram.sum_us() * 1e-6);
+    line(name, "_count", labels, cumulative);
+}
+
+MetricsRegistry::Family &MetricsRegistry::family(const std::string &name, const std::string &help, MetricsWriter::Type type)
+{
+    auto it = families_.find(name);
+    if (it == families_.end())
+    {
+        it = families_.emplace(name, Family()).first;
+        it->second.help = help;
+        it->second.type = type;
+    }
+    return it->second;
+}
+
+Counter &MetricsRegistry::counter(const std::string &name, const std::string &help, const std::string &labels)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto &slot = family(name, help, MetricsWriter::Type::Counter).counters[labels];
+    if (!slot)
+        slot = std::make_unique<Counter>();
+    return *slot;
+}
+
+Gauge &MetricsRegistry::gauge(const std::string &name, const std::string &help, const std::string &labels)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto &slot = family(name, help, MetricsWriter::Type::Gauge).gauges[labels];
+    if (!slot)
+        slot = std::make_unique<Gauge>();
+    return *slot;
+}
+
+JitterHistogram &MetricsRegistry::histogram(const std::string &name, const std::string &help, const std::string &labels)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto &slot = family(name, help, MetricsWriter::Type::Histogram).histograms[labels];
+    if (!slot)
+        slot = std::make_unique<JitterHistogram>();
+    return *slot;
+}
+
+void MetricsRegistry::add_collector(Collector collector)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    collectors_.push_back(std::move(collector));
+}
+
+std::string MetricsRegistry::prometheus() const
+{
+    MetricsWriter w;
+    std::vector<Collector> collectors;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        collectors = collectors_;
+        for (auto &entry : families_)
+        {
+            const Family &f = entry.second;
+            w.family(entry.first, f.help, f.type);
+            for (auto &c : f.counters)
+                w.sample(entry.first, c.first, c.second->value());
+            for (auto &g : f.gauges)
+                w.sample(entry.first, g.first, g.second->value());
+            for (auto &h : f.histograms)
+                w.histogram(entry.first, h.first, *h.second);
+        }
+    }
+    // unlocked, a collector may register metrics, they show up from the next scrape on
+    for (auto &collector : collectors)
+        collector(w);
+    return w.str();
+}
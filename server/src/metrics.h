@@ -0,0 +1,105 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "jitter_histogram.h"
+
+// every exported name starts with this
+#define METRICS_PREFIX "mavtelem_"
+
+class Counter
+{
+public:
+    void inc(uint64_t n = 1) { value_.fetch_add(n, std::memory_order_relaxed); }
+    uint64_t value() const { return value_.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<uint64_t> value_{0};
+};
+
+class Gauge
+{
+public:
+    void set(int64_t value) { value_.store(value, std::memory_order_relaxed); }
+    void add(int64_t n) { value_.fetch_add(n, std::memory_order_relaxed); }
+    int64_t value() const { return value_.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<int64_t> value_{0};
+};
+
+// label="value" with the value escaped for the text format, labels are joined with ','
+std::string metric_label(const std::string &name, const std::string &value);
+
+// Prometheus text exposition (format 0.0.4) of one scrape.
+// Names get METRICS_PREFIX, histograms of microseconds are exported in seconds.
+class MetricsWriter
+{
+public:
+    enum class Type
+    {
+        Counter,
+        Gauge,
+        Histogram
+    };
+
+    // starts a family, all its samples have to follow before the next one
+    void family(const std::string &name, const std::string &help, Type type);
+    void sample(const std::string &name, const std::string &labels, double value);
+    void histogram(const std::string &name, const std::string &labels, const JitterHistogram &histogram);
+
+    const std::string &str() const { return out_; }
+
+private:
+    // le is the extra bucket label of histograms
+    void line(const std::string &name, const char *suffix, const std::string &labels, double value, const char *le = nullptr);
+
+    std::string out_;
+};
+
+// Server metrics, exported in the Prometheus text format.
+//
+// Counters, gauges and histograms are registered once by name and labels and then
+// updated through the returned reference with relaxed atomics, so hot paths never lock.
+// Registering the same name and labels again returns the same metric; references stay
+// valid as long as the registry. State that already lives elsewhere (publish stats,
+// subscribers, connections) is exported by collectors, called on every scrape.
+class MetricsRegistry
+{
+public:
+    using Collector = std::function<void(MetricsWriter &w)>;
+
+    Counter &counter(const std::string &name, const std::string &help, const std::string &labels = "");
+    Gauge &gauge(const std::string &name, const std::string &help, const std::string &labels = "");
+    // records microseconds, see JitterHistogram
+    JitterHistogram &histogram(const std::string &name, const std::string &help, const std::string &labels = "");
+
+    // collectors run without the registry lock, so they may register metrics too
+    void add_collector(Collector collector);
+
+    // text exposition of every metric, registered ones first, then the collectors'
+    std::string prometheus() const;
+
+private:
+    struct Family
+    {
+        std::string help;
+        MetricsWriter::Type type;
+        // by labels, sorted for a stable output
+        std::map<std::string, std::unique_ptr<Counter>> counters;
+        std::map<std::string, std::unique_ptr<Gauge>> gauges;
+        std::map<std::string, std::unique_ptr<JitterHistogram>> histograms;
+    };
+
+    Family &family(const std::string &name, const std::string &help, MetricsWriter::Type type);
+
+    mutable std::mutex mutex_;
+    std::map<std::string, Family> families_;
+    std::vector<Collector> collectors_;
+};
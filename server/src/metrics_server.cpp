@@ -0,0 +1,131 @@
+#include "metrics_server.h"
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define ERROR_CONSOLE_TEXT "\033[31m"
+#define NORMAL_CONSOLE_TEXT "\033[0m"
+
+MetricsServer::MetricsServer(const MetricsRegistry &metrics)
+    : metrics_(metrics)
+{
+}
+
+MetricsServer::~MetricsServer()
+{
+    if (listen_fd_ >= 0)
+        close(listen_fd_);
+}
+
+bool MetricsServer::listen(const std::string &address, uint16_t port)
+{
+    int opt = 1;
+    struct sockaddr_in addr;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, address.c_str(), &addr.sin_addr) != 1)
+    {
+        std::cout << ERROR_CONSOLE_TEXT << "metrics address invalid" << NORMAL_CONSOLE_TEXT << std::endl;
+        return false;
+    }
+
+    if ((listen_fd_ = socket(AF_INET, SOCK_STREAM, 0)) < 0 ||
+        setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)))
+    {
+        std::cout << ERROR_CONSOLE_TEXT << "metrics sock failed" << NORMAL_CONSOLE_TEXT << std::endl;
+        return false;
+    }
+
+    if (bind(listen_fd_, (struct sockaddr *)&addr, sizeof(addr)) < 0 || ::listen(listen_fd_, SOMAXCONN) < 0)
+    {
+        std::cout << ERROR_CONSOLE_TEXT << "metrics bind failed" << NORMAL_CONSOLE_TEXT << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void MetricsServer::run()
+{
+    while (true)
+    {
+        int fd = accept(listen_fd_, nullptr, nullptr);
+        if (stop_.load(std::memory_order_relaxed))
+        {
+            if (fd >= 0)
+                close(fd);
+            return;
+        }
+        if (fd < 0)
+        {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            std::cout << ERROR_CONSOLE_TEXT << "metrics accepting failed" << NORMAL_CONSOLE_TEXT << std::endl;
+            return;
+        }
+        serve(fd);
+        close(fd);
+    }
+}
+
+void MetricsServer::stop()
+{
+    stop_.store(true, std::memory_order_relaxed);
+    // wakes a blocked accept(), which then fails
+    if (listen_fd_ >= 0)
+        shutdown(listen_fd_, SHUT_RDWR);
+}
+
+static bool write_all(int fd, const std::string &data)
+{
+    size_t pos = 0;
+    while (pos < data.size())
+    {
+        ssize_t n = send(fd, data.data() + pos, data.size() - pos, MSG_NOSIGNAL);
+        if (n <= 0)
+            return false;
+        pos += n;
+    }
+    return true;
+}
+
+void MetricsServer::serve(int fd)
+{
+    struct timeval timeout = {METRICS_IO_TIMEOUT_MS / 1000, (METRICS_IO_TIMEOUT_MS % 1000) * 1000};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    // only the request line matters, headers are read up to their end and ignored
+    std::string request;
+    char buf[1024];
+    while (request.find("\r\n\r\n") == std::string::npos)
+    {
+        if (request.size() >= METRICS_MAX_REQUEST)
+            return;
+        ssize_t n = recv(fd, buf, sizeof(buf), 0);
+        if (n <= 0)
+            return;
+        request.append(buf, n);
+    }
+
+    std::string line = request.substr(0, request.find("\r\n"));
+    std::string status, body, type = "text/plain; charset=utf-8";
+    if (line.compare(0, 4, "GET ") != 0)
+        status = "405 Method Not Allowed";
+    else if (line.compare(4, 9, "/metrics ") != 0 && line.compare(4, 9, "/metrics?") != 0)
+        status = "404 Not Found";
+    else
+    {
+        status = "200 OK";
+        body = metrics_.prometheus();
+        type = "text/plain; version=0.0.4; charset=utf-8";
+    }
+
+    write_all(fd, "HTTP/1.1 " + status + "\r\nContent-Type: " + type + "\r\nContent-Length: " + std::to_string(body.size()) +
+                      "\r\nConnection: close\r\n\r\n" + body);
+}
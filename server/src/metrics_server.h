@@ -0,0 +1,38 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include "metrics.h"
+
+#define METRICS_MAX_REQUEST 4096
+// a scraper that stops reading or writing is dropped after this
+#define METRICS_IO_TIMEOUT_MS 1000
+
+// HTTP endpoint for Prometheus: GET /metrics answers with the registry's text exposition.
+// Scrapes come seconds apart, so one thread serves them one after another with
+// blocking sockets and an io timeout, nothing here touches the telemetry path.
+class MetricsServer
+{
+public:
+    explicit MetricsServer(const MetricsRegistry &metrics);
+    ~MetricsServer();
+
+    MetricsServer(const MetricsServer &) = delete;
+    MetricsServer &operator=(const MetricsServer &) = delete;
+
+    // binds and listens on address (an ipv4 address, 127.0.0.1 keeps it local), false on failure
+    bool listen(const std::string &address, uint16_t port);
+
+    // accept loop, returns once stop() was called or on fatal error
+    void run();
+    // makes run() return, a scrape being served is finished first
+    void stop();
+
+private:
+    void serve(int fd);
+
+    const MetricsRegistry &metrics_;
+    int listen_fd_ = -1;
+    std::atomic<bool> stop_{false};
+};
@@ -0,0 +1,311 @@
+#include "mock_backend.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#define MOCK_DEG_PER_M (1.0 / 111320.0)
+#define MOCK_TILT_DEG_PER_M_S 3.0f
+#define MOCK_BATTERY_DRAIN 0.02f // percent per second armed
+#define MOCK_STATUS_PERIOD_S 1.0
+
+static const float DEG_TO_RAD = (float)(M_PI / 180.0);
+
+MockBackend::MockBackend(MetricsRegistry &metrics, const MockConfig &config) : config_(config), metrics_(metrics)
+{
+}
+
+MockBackend::~MockBackend()
+{
+    stop_.store(true, std::memory_order_relaxed);
+    if (thread_.joinable())
+        thread_.join();
+}
+
+bool MockBackend::start(TelemUpdate update)
+{
+    update_ = std::move(update);
+    thread_ = std::thread([this]()
+                          { run(); });
+    return true;
+}
+
+template <typename F>
+bool MockBackend::action(F &&fn)
+{
+    actions_.fetch_add(1, std::memory_order_relaxed);
+    std::this_thread::sleep_for(config_.ack_latency);
+    std::lock_guard<std::mutex> lock(mutex_);
+    return fn(state_);
+}
+
+bool MockBackend::arm()
+{
+    return action([](State &s)
+                  { return s.armed = true; });
+}
+
+bool MockBackend::set_takeoff_altitude(float alt_m)
+{
+    return action([alt_m](State &s)
+                  {
+                      s.takeoff_alt = alt_m;
+                      return alt_m > 0.0f; });
+}
+
+bool MockBackend::takeoff()
+{
+    return action([](State &s)
+                  {
+                      if (!s.armed)
+                          return false;
+                      s.mode = Mode::Takeoff;
+                      s.in_air = true;
+                      return true; });
+}
+
+bool MockBackend::land()
+{
+    return action([](State &s)
+                  {
+                      s.mode = Mode::Land;
+                      return true; });
+}
+
+bool MockBackend::hold()
+{
+    return action([](State &s)
+                  {
+                      s.mode = Mode::Hold;
+                      return true; });
+}
+
+bool MockBackend::return_to_launch()
+{
+    return action([](State &s)
+                  {
+                      if (!s.in_air)
+                          return false;
+                      s.target_lat = MOCK_HOME_LAT;
+                      s.target_lon = MOCK_HOME_LON;
+                      s.target_alt = s.rel_alt;
+                      s.mode = Mode::ReturnToLaunch;
+                      return true; });
+}
+
+bool MockBackend::goto_location(double lat_deg, double lon_deg, float alt_abs_m, float yaw_deg)
+{
+    return action([=](State &s)
+                  {
+                      if (!s.in_air)
+                          return false;
+                      s.target_lat = lat_deg;
+                      s.target_lon = lon_deg;
+                      s.target_alt = alt_abs_m - MOCK_HOME_ALT;
+                      if (std::isfinite(yaw_deg))
+                          s.yaw_deg = yaw_deg;
+                      s.mode = Mode::Goto;
+                      return true; });
+}
+
+bool MockBackend::set_actuator(int, float)
+{
+    return action([](State &)
+                  { return true; });
+}
+
+bool MockBackend::offboard_start()
+{
+    return action([](State &s)
+                  {
+                      // PX4 rejects offboard before the first setpoint
+                      if (!s.has_setpoint)
+                          return false;
+                      s.mode = Mode::Offboard;
+                      return true; });
+}
+
+bool MockBackend::offboard_stop()
+{
+    return action([](State &s)
+                  {
+                      if (s.mode == Mode::Offboard)
+                          s.mode = Mode::Hold;
+                      return true; });
+}
+
+bool MockBackend::set_velocity_body(float forward_m_s, float right_m_s, float down_m_s, float yawspeed_deg_s)
+{
+    setpoints_.fetch_add(1, std::memory_order_relaxed);
+    std::lock_guard<std::mutex> lock(mutex_);
+    state_.has_setpoint = true;
+    state_.setpoint[0] = forward_m_s;
+    state_.setpoint[1] = right_m_s;
+    state_.setpoint[2] = down_m_s;
+    state_.setpoint[3] = yawspeed_deg_s;
+    return true;
+}
+
+bool MockBackend::in_offboard() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return state_.mode == Mode::Offboard;
+}
+
+// velocity toward a target at most speed, arrived when within one step
+static float approach(float distance, float speed, float dt, bool &arrived)
+{
+    arrived = std::fabs(distance) <= speed * dt;
+    return arrived ? distance / dt : std::copysign(speed, distance);
+}
+
+void MockBackend::step(float dt)
+{
+    State &s = state_;
+    float north = 0.0f, east = 0.0f, down = 0.0f;
+
+    switch (s.mode)
+    {
+    case Mode::Hold:
+        break;
+    case Mode::Takeoff:
+    {
+        bool arrived;
+        down = -approach(s.takeoff_alt - s.rel_alt, MOCK_CLIMB_SPEED, dt, arrived);
+        if (arrived)
+            s.mode = Mode::Hold;
+        break;
+    }
+    case Mode::Land:
+        down = MOCK_CLIMB_SPEED;
+        break;
+    case Mode::Goto:
+    case Mode::ReturnToLaunch:
+    {
+        float dn = (float)((s.target_lat - s.lat) / MOCK_DEG_PER_M);
+        float de = (float)((s.target_lon - s.lon) / MOCK_DEG_PER_M * std::cos(s.lat * DEG_TO_RAD));
+        float distance = std::sqrt(dn * dn + de * de);
+        bool arrived_h, arrived_v;
+        float speed = approach(distance, MOCK_CRUISE_SPEED, dt, arrived_h);
+        if (distance > 0.0f)
+        {
+            north = dn / distance * speed;
+            east = de / distance * speed;
+        }
+        down = -approach(s.target_alt - s.rel_alt, MOCK_CLIMB_SPEED, dt, arrived_v);
+        if (arrived_h && arrived_v)
+            s.mode = s.mode == Mode::ReturnToLaunch ? Mode::Land : Mode::Hold;
+        break;
+    }
+    case Mode::Offboard:
+    {
+        float yaw = s.yaw_deg * DEG_TO_RAD;
+        north = s.setpoint[0] * std::cos(yaw) - s.setpoint[1] * std::sin(yaw);
+        east = s.setpoint[0] * std::sin(yaw) + s.setpoint[1] * std::cos(yaw);
+        down = s.setpoint[2];
+        s.yaw_deg = std::fmod(s.yaw_deg + s.setpoint[3] * dt + 540.0f, 360.0f) - 180.0f;
+        break;
+    }
+    }
+
+    if (!s.in_air)
+        north = east = down = 0.0f;
+
+    s.lat += north * dt * MOCK_DEG_PER_M;
+    s.lon += east * dt * MOCK_DEG_PER_M / std::cos(s.lat * DEG_TO_RAD);
+    s.rel_alt -= down * dt;
+    if (s.in_air && s.rel_alt <= 0.0f && down > 0.0f)
+    {
+        // touchdown, PX4 disarms after landing
+        s.rel_alt = 0.0f;
+        s.in_air = false;
+        s.armed = false;
+        s.mode = Mode::Hold;
+        north = east = down = 0.0f;
+    }
+    s.vel[0] = north;
+    s.vel[1] = east;
+    s.vel[2] = down;
+    if (s.armed)
+        s.battery = std::max(0.0f, s.battery - MOCK_BATTERY_DRAIN * dt);
+}
+
+void MockBackend::run()
+{
+    auto period = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(1.0 / config_.rate));
+    auto status_period = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(MOCK_STATUS_PERIOD_S));
+    float dt = 1.0f / config_.rate;
+    auto next = std::chrono::steady_clock::now();
+    auto next_status = next;
+    bool armed = false, in_air = false;
+
+    auto stream = [this](const char *name) -> Counter &
+    {
+        return metrics_.counter(BACKEND_CALLBACKS_METRIC, BACKEND_CALLBACKS_HELP, metric_label("stream", name));
+    };
+    Counter &position = stream("position");
+    Counter &velocity = stream("velocity_ned");
+    Counter &fixedwing = stream("fixedwing_metrics");
+    Counter &attitude = stream("attitude_euler");
+    // the status update stands for these four callbacks
+    Counter *status[] = {&stream("battery"), &stream("health_all_ok"), &stream("armed"), &stream("in_air")};
+
+    while (!stop_.load(std::memory_order_relaxed))
+    {
+        next += period;
+        std::this_thread::sleep_until(next);
+
+        State s;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            step(dt);
+            s = state_;
+        }
+
+        // one update per mavsdk subscription, in the same groups
+        float yaw = s.yaw_deg * DEG_TO_RAD;
+        float forward = s.vel[0] * std::cos(yaw) + s.vel[1] * std::sin(yaw);
+        float right = -s.vel[0] * std::sin(yaw) + s.vel[1] * std::cos(yaw);
+        update_([&](TelemData &pack)
+                {
+                    pack.latitude = s.lat;
+                    pack.longitude = s.lon;
+                    pack.abs_alt = MOCK_HOME_ALT + s.rel_alt;
+                    pack.rel_alt = s.rel_alt; });
+        position.inc();
+        update_([&](TelemData &pack)
+                {
+                    pack.vel_north = s.vel[0];
+                    pack.vel_east = s.vel[1];
+                    pack.vel_down = s.vel[2]; });
+        velocity.inc();
+        update_([&](TelemData &pack)
+                {
+                    pack.airspeed = std::sqrt(forward * forward + right * right);
+                    pack.climb_rate = -s.vel[2]; });
+        fixedwing.inc();
+        update_([&](TelemData &pack)
+                {
+                    pack.roll_deg = right * MOCK_TILT_DEG_PER_M_S;
+                    pack.pitch_deg = -forward * MOCK_TILT_DEG_PER_M_S;
+                    pack.yaw_deg = s.yaw_deg; });
+        attitude.inc();
+
+        // status comes once a second and right away when armed or in air change
+        if (next >= next_status || s.armed != armed || s.in_air != in_air)
+        {
+            next_status = next + status_period;
+            armed = s.armed;
+            in_air = s.in_air;
+            update_([&](TelemData &pack)
+                    {
+                        // MAVSDK 0.x reports the remaining charge as a fraction
+                        pack.batt_percentage = s.battery / 100.0f;
+                        pack.batt_voltage = 12.6f - (100.0f - s.battery) * 0.024f;
+                        pack.isAllOk = true;
+                        pack.isArmed = s.armed;
+                        pack.inAir = s.in_air; });
+            for (Counter *c : status)
+                c->inc();
+        }
+    }
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include "config.h"
+#include "metrics.h"
+#include "vehicle_backend.h"
+
+// PX4 SITL's default home
+#define MOCK_HOME_LAT 47.397742
+#define MOCK_HOME_LON 8.545594
+#define MOCK_HOME_ALT 488.0f
+#define MOCK_CLIMB_SPEED 1.5f // m/s
+#define MOCK_CRUISE_SPEED 5.0f // m/s
+
+// Simulated multicopter in process, for benchmarking the server without MAVSDK or PX4.
+//
+// A thread integrates simple kinematics at config.rate and delivers position,
+// velocity, attitude and airspeed as separate updates, like the MAVSDK callbacks,
+// plus battery, health, armed and in air once a second. Action calls block for
+// config.ack_latency before they take effect, velocity setpoints apply at once.
+// Refuses what PX4 would: takeoff unarmed, goto on the ground, offboard without setpoint.
+class MockBackend : public VehicleBackend
+{
+public:
+    // counts its updates per stream in metrics, under the names of the MAVSDK streams they stand for
+    explicit MockBackend(MetricsRegistry &metrics, const MockConfig &config = MockConfig());
+    ~MockBackend() override;
+
+    bool start(TelemUpdate update) override;
+
+    bool arm() override;
+    bool set_takeoff_altitude(float alt_m) override;
+    bool takeoff() override;
+    bool land() override;
+    bool hold() override;
+    bool return_to_launch() override;
+    bool goto_location(double lat_deg, double lon_deg, float alt_abs_m, float yaw_deg) override;
+    bool set_actuator(int index, float value) override;
+
+    bool offboard_start() override;
+    bool offboard_stop() override;
+    bool set_velocity_body(float forward_m_s, float right_m_s, float down_m_s, float yawspeed_deg_s) override;
+    bool in_offboard() const override;
+
+    // action calls so far, for benchmarks
+    uint64_t actions() const { return actions_.load(std::memory_order_relaxed); }
+    uint64_t setpoints() const { return setpoints_.load(std::memory_order_relaxed); }
+
+private:
+    enum class Mode
+    {
+        Hold,
+        Takeoff,
+        Land,
+        Goto,
+        ReturnToLaunch,
+        Offboard
+    };
+
+    struct State
+    {
+        double lat = MOCK_HOME_LAT;
+        double lon = MOCK_HOME_LON;
+        float rel_alt = 0.0f;
+        // north, east, down in m/s
+        float vel[3] = {0.0f, 0.0f, 0.0f};
+        float yaw_deg = 0.0f;
+        float battery = 100.0f;
+        bool armed = false;
+        bool in_air = false;
+        Mode mode = Mode::Hold;
+        float takeoff_alt = 2.5f;
+        double target_lat = MOCK_HOME_LAT;
+        double target_lon = MOCK_HOME_LON;
+        float target_alt = 0.0f;
+        // offboard velocity setpoint, body frame
+        bool has_setpoint = false;
+        float setpoint[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+    };
+
+    // waits the ack latency, then applies fn to the state if allowed returns true
+    template <typename F>
+    bool action(F &&fn);
+    void run();
+    void step(float dt);
+
+    MockConfig config_;
+    MetricsRegistry &metrics_;
+    TelemUpdate update_;
+    mutable std::mutex mutex_;
+    State state_;
+    std::thread thread_;
+    std::atomic<bool> stop_{false};
+    std::atomic<uint64_t> actions_{0};
+    std::atomic<uint64_t> setpoints_{0};
+};
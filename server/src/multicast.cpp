@@ -0,0 +1,71 @@
+#include "multicast.h"
+#include <cstring>
+#include <arpa/inet.h>
+#include <net/if.h>
+#include <sys/socket.h>
+
+static bool parse_group(const std::string &group, struct in_addr &addr)
+{
+    return inet_pton(AF_INET, group.c_str(), &addr) == 1 && IN_MULTICAST(ntohl(addr.s_addr));
+}
+
+#ifdef __linux__
+// address or interface name into ip_mreqn, which takes both
+static bool parse_interface(const std::string &interface, struct ip_mreqn &mreq)
+{
+    if (interface.empty())
+        return true;
+    if (inet_pton(AF_INET, interface.c_str(), &mreq.imr_address) == 1)
+        return true;
+    mreq.imr_ifindex = if_nametoindex(interface.c_str());
+    return mreq.imr_ifindex != 0;
+}
+#else
+static bool parse_interface(const std::string &interface, struct in_addr &addr)
+{
+    addr.s_addr = htonl(INADDR_ANY);
+    return interface.empty() || inet_pton(AF_INET, interface.c_str(), &addr) == 1;
+}
+#endif
+
+bool multicast_setup_sender(int sockfd, const std::string &group, int port, int ttl,
+                            const std::string &interface, struct sockaddr_in &dest)
+{
+    memset(&dest, 0, sizeof(dest));
+    dest.sin_family = AF_INET;
+    dest.sin_port = htons(port);
+    if (!parse_group(group, dest.sin_addr) || port <= 0 || port > 65535 || ttl < 0 || ttl > 255)
+        return false;
+
+    unsigned char ttl_value = ttl;
+    if (setsockopt(sockfd, IPPROTO_IP, IP_MULTICAST_TTL, &ttl_value, sizeof(ttl_value)) < 0)
+        return false;
+
+#ifdef __linux__
+    struct ip_mreqn mreq;
+    memset(&mreq, 0, sizeof(mreq));
+    if (!parse_interface(interface, mreq))
+        return false;
+#else
+    struct in_addr mreq;
+    if (!parse_interface(interface, mreq))
+        return false;
+#endif
+    return interface.empty() || setsockopt(sockfd, IPPROTO_IP, IP_MULTICAST_IF, &mreq, sizeof(mreq)) == 0;
+}
+
+bool multicast_join(int sockfd, const std::string &group, const std::string &interface)
+{
+#ifdef __linux__
+    struct ip_mreqn mreq;
+    memset(&mreq, 0, sizeof(mreq));
+    if (!parse_group(group, mreq.imr_multiaddr) || !parse_interface(interface, mreq))
+        return false;
+#else
+    struct ip_mreq mreq;
+    memset(&mreq, 0, sizeof(mreq));
+    if (!parse_group(group, mreq.imr_multiaddr) || !parse_interface(interface, mreq.imr_interface))
+        return false;
+#endif
+    return setsockopt(sockfd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) == 0;
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <string>
+#include <netinet/in.h>
+
+// Multicast publishing: one datagram per tick reaches every LAN consumer that
+// joined the group, however many there are.
+
+// sets TTL and outgoing interface of sockfd and resolves the group destination,
+// interface is a local address or an interface name, empty lets the kernel choose
+bool multicast_setup_sender(int sockfd, const std::string &group, int port, int ttl,
+                            const std::string &interface, struct sockaddr_in &dest);
+
+// joins group on a receiving socket, same interface rules as above
+bool multicast_join(int sockfd, const std::string &group, const std::string &interface);
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+
+// Stops offboard when no command arrived for timeout.
+// It is armed by offboard_start and fed by every offboard_cmd; while disarmed the
+// thread in run() sleeps on a condition variable, while armed it sleeps until the
+// deadline. Feeding only moves the deadline, so it is lock-free and wakes nobody.
+// Clock is a template parameter so check() can be driven by a fake clock.
+template <typename Clock>
+class BasicOffboardWatchdog
+{
+public:
+    using OnTimeout = std::function<void()>;
+
+    explicit BasicOffboardWatchdog(typename Clock::duration timeout)
+        : timeout_(timeout)
+    {
+    }
+
+    BasicOffboardWatchdog(const BasicOffboardWatchdog &) = delete;
+    BasicOffboardWatchdog &operator=(const BasicOffboardWatchdog &) = delete;
+
+    // starts watching, deadline is now + timeout
+    void arm()
+    {
+        feed();
+        if (!armed_.exchange(true))
+        {
+            // run() checks armed_ under the mutex, taking it here closes the lost wakeup window
+            std::lock_guard<std::mutex> lock(mutex_);
+        }
+        cv_.notify_one();
+    }
+
+    // moves the deadline to now + timeout
+    void feed()
+    {
+        last_feed_.store(Clock::now().time_since_epoch().count(), std::memory_order_release);
+    }
+
+    void disarm()
+    {
+        armed_.store(false);
+    }
+
+    bool armed() const
+    {
+        return armed_.load();
+    }
+
+    typename Clock::time_point deadline() const
+    {
+        return typename Clock::time_point(typename Clock::duration(last_feed_.load(std::memory_order_acquire))) + timeout_;
+    }
+
+    // disarms and returns true when armed and the deadline passed at now
+    bool check(typename Clock::time_point now)
+    {
+        if (!armed_.load() || now < deadline())
+            return false;
+        bool expected = true;
+        return armed_.compare_exchange_strong(expected, false);
+    }
+
+    // watch loop, calls on_timeout from this thread on every expiry until stop()
+    void run(OnTimeout on_timeout)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (running_.load())
+        {
+            if (!armed_.load())
+            {
+                cv_.wait(lock);
+                continue;
+            }
+
+            auto deadline = this->deadline();
+            if (Clock::now() < deadline)
+            {
+                // feeds move the deadline meanwhile, it is read again after waking up
+                cv_.wait_until(lock, deadline);
+                continue;
+            }
+
+            lock.unlock();
+            if (check(Clock::now()))
+                on_timeout();
+            lock.lock();
+        }
+    }
+
+    void stop()
+    {
+        running_.store(false);
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+        }
+        cv_.notify_one();
+    }
+
+private:
+    typename Clock::duration timeout_;
+    std::atomic<bool> armed_{false};
+    std::atomic<bool> running_{true};
+    std::atomic<typename Clock::rep> last_feed_{0};
+    std::mutex mutex_;
+    std::condition_variable cv_;
+};
+
+using OffboardWatchdog = BasicOffboardWatchdog<std::chrono::steady_clock>;
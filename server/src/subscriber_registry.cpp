@@ -0,0 +1,92 @@
+#include "subscriber_registry.h"
+#include <algorithm>
+
+SubscriberRegistry::SubscriberRegistry(size_t max_size)
+    : max_size_(max_size), list_(std::make_shared<const List>())
+{
+}
+
+std::chrono::steady_clock::time_point SubscriberRegistry::lease_end(std::chrono::milliseconds lease)
+{
+    if (lease.count() == 0)
+        return std::chrono::steady_clock::time_point::max();
+    return std::chrono::steady_clock::now() + lease;
+}
+
+void SubscriberRegistry::publish(std::shared_ptr<const List> list)
+{
+    std::atomic_store_explicit(&list_, std::move(list), std::memory_order_release);
+    version_.fetch_add(1, std::memory_order_release);
+}
+
+SubscriberRegistry::Result SubscriberRegistry::add(const TelemDest &addr, const TelemProfile &profile, std::chrono::milliseconds lease)
+{
+    std::lock_guard<std::mutex> lock(write_mutex_);
+    auto list = std::make_shared<List>(*list_);
+
+    for (auto &sub : *list)
+    {
+        if (sub.addr == addr)
+        {
+            sub.profile = profile;
+            sub.expires = lease_end(lease);
+            publish(std::move(list));
+            return Result::Renewed;
+        }
+    }
+
+    if (list->size() >= max_size_)
+        return Result::Full;
+
+    list->push_back(UdpSubscriber{addr, profile, lease_end(lease), std::make_shared<SubscriberCounters>()});
+    publish(std::move(list));
+    return Result::Added;
+}
+
+SubscriberRegistry::Result SubscriberRegistry::renew(const TelemDest &addr, std::chrono::milliseconds lease)
+{
+    std::lock_guard<std::mutex> lock(write_mutex_);
+    auto now = std::chrono::steady_clock::now();
+    // expired leases stay listed until the sender prunes them, they cannot be renewed anymore
+    auto it = std::find_if(list_->begin(), list_->end(), [&addr, now](const UdpSubscriber &sub)
+                           { return sub.addr == addr && sub.expires > now; });
+    if (it == list_->end())
+        return Result::NotFound;
+
+    // the sender does not look at lease times, no need to wake it up with a new version
+    auto list = std::make_shared<List>(*list_);
+    (*list)[it - list_->begin()].expires = lease_end(lease);
+    std::atomic_store_explicit(&list_, std::shared_ptr<const List>(std::move(list)), std::memory_order_release);
+    return Result::Renewed;
+}
+
+bool SubscriberRegistry::remove(const TelemDest &addr)
+{
+    std::lock_guard<std::mutex> lock(write_mutex_);
+    auto list = std::make_shared<List>(*list_);
+    auto it = std::remove_if(list->begin(), list->end(), [&addr](const UdpSubscriber &sub)
+                             { return sub.addr == addr; });
+    if (it == list->end())
+        return false;
+    list->erase(it, list->end());
+    publish(std::move(list));
+    return true;
+}
+
+void SubscriberRegistry::expire(std::chrono::steady_clock::time_point now)
+{
+    std::unique_lock<std::mutex> lock(write_mutex_, std::try_to_lock);
+    if (!lock.owns_lock())
+        return;
+
+    bool any = std::any_of(list_->begin(), list_->end(), [now](const UdpSubscriber &sub)
+                           { return sub.expires <= now; });
+    if (!any)
+        return;
+
+    auto list = std::make_shared<List>(*list_);
+    list->erase(std::remove_if(list->begin(), list->end(), [now](const UdpSubscriber &sub)
+                               { return sub.expires <= now; }),
+                list->end());
+    publish(std::move(list));
+}
@@ -0,0 +1,143 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "telem_pack.h"
+
+#define MAX_UDP_SUBSCRIBERS 256
+
+enum class TelemFormat
+{
+    Json,
+    Binary
+};
+
+// what and how often a subscriber wants, equal profiles share one stream
+struct TelemProfile
+{
+    TelemFormat format = TelemFormat::Json;
+    // Hz, 0 means every publish tick
+    float rate = 0.0f;
+    uint8_t sections = TELEM_SECTION_ALL;
+    // seconds between full frames of a delta stream, 0 sends every frame full
+    float keyframe = 0.0f;
+
+    bool operator==(const TelemProfile &other) const
+    {
+        return format == other.format && rate == other.rate && sections == other.sections && keyframe == other.keyframe;
+    }
+};
+
+// where a subscriber's datagrams go, an ipv4 address or a unix datagram socket
+struct TelemDest
+{
+    struct sockaddr_storage addr;
+    socklen_t len = 0;
+
+    static TelemDest inet(const struct sockaddr_in &in)
+    {
+        TelemDest dest;
+        memset(&dest.addr, 0, sizeof(dest.addr));
+        struct sockaddr_in *addr = reinterpret_cast<struct sockaddr_in *>(&dest.addr);
+        addr->sin_family = AF_INET;
+        addr->sin_port = in.sin_port;
+        addr->sin_addr = in.sin_addr;
+        dest.len = sizeof(struct sockaddr_in);
+        return dest;
+    }
+
+    // false if path does not fit into sockaddr_un
+    static bool unix_path(const std::string &path, TelemDest &dest)
+    {
+        struct sockaddr_un *addr = reinterpret_cast<struct sockaddr_un *>(&dest.addr);
+        if (path.empty() || path.size() >= sizeof(addr->sun_path))
+            return false;
+        memset(&dest.addr, 0, sizeof(dest.addr));
+        addr->sun_family = AF_UNIX;
+        memcpy(addr->sun_path, path.data(), path.size());
+        dest.len = offsetof(struct sockaddr_un, sun_path) + path.size() + 1;
+        return true;
+    }
+
+    int family() const { return addr.ss_family; }
+
+    bool operator==(const TelemDest &other) const
+    {
+        return len == other.len && memcmp(&addr, &other.addr, len) == 0;
+    }
+};
+
+// what the sender delivered to one subscriber, written by the sender thread only
+struct SubscriberCounters
+{
+    std::atomic<uint64_t> packets{0};
+    std::atomic<uint64_t> bytes{0};
+    std::atomic<uint64_t> errors{0};
+};
+
+struct UdpSubscriber
+{
+    TelemDest addr;
+    TelemProfile profile;
+    // time_point::max() for subscribers without lease
+    std::chrono::steady_clock::time_point expires;
+    // shared by every copy of the list, so they survive renewals and stream rebuilds
+    std::shared_ptr<SubscriberCounters> counters;
+};
+
+// Datagram telemetry subscribers keyed by destination, (ip, port) or unix socket path.
+// Writers copy the list, change the copy and publish it, so the sender only
+// grabs the current immutable list and never waits for the command loop.
+class SubscriberRegistry
+{
+public:
+    using List = std::vector<UdpSubscriber>;
+
+    enum class Result
+    {
+        Added,
+        Renewed,
+        NotFound,
+        Full
+    };
+
+    explicit SubscriberRegistry(size_t max_size = MAX_UDP_SUBSCRIBERS);
+
+    // adds subscriber or renews it, lease 0 never expires and a negative one has already run out
+    Result add(const TelemDest &addr, const TelemProfile &profile, std::chrono::milliseconds lease);
+    // only extends the lease of a known subscriber whose lease has not run out yet
+    Result renew(const TelemDest &addr, std::chrono::milliseconds lease);
+    bool remove(const TelemDest &addr);
+
+    // drops expired leases, skipped if a writer is busy right now
+    void expire(std::chrono::steady_clock::time_point now);
+
+    std::shared_ptr<const List> snapshot() const
+    {
+        return std::atomic_load_explicit(&list_, std::memory_order_acquire);
+    }
+
+    // changes whenever the list changes
+    uint32_t version() const
+    {
+        return version_.load(std::memory_order_acquire);
+    }
+
+private:
+    void publish(std::shared_ptr<const List> list);
+    static std::chrono::steady_clock::time_point lease_end(std::chrono::milliseconds lease);
+
+    size_t max_size_;
+    std::mutex write_mutex_;
+    std::shared_ptr<const List> list_;
+    std::atomic<uint32_t> version_{0};
+};
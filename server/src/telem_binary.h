@@ -0,0 +1,340 @@
+#pragma once
+
+// Compact binary encoding of TelemData, shared by the server and by clients decoding it.
+//
+// All values are little-endian. Layout of schema 1:
+//
+//  header (20 bytes)
+//   u16 magic         0x4D54 ("TM")
+//   u8  version       TELEM_BINARY_VERSION
+//   u8  schema        TELEM_BINARY_SCHEMA
+//   u8  flags         TELEM_FLAG_*
+//   u8  sections      TELEM_SECTION_* present in the body, in this order
+//   u16 reserved
+//   u32 seq           incremented for every frame of a stream
+//   u64 time_us       unix time of the snapshot in microseconds
+//
+//  u32 fields        only with TELEM_FLAG_DELTA: TELEM_FIELD_* present in the body
+//
+//  body, every field of the selected sections (or of fields for deltas) in this order
+//   position  i32 lat 1e-7 deg, i32 lon 1e-7 deg, i32 alt_abs mm, i32 alt_rel mm
+//   velocity  i16 north, i16 east, i16 down            cm/s
+//   plane     i16 airspeed, i16 climbrate              cm/s
+//   angles    i16 pitch, i16 roll, i16 yaw             0.01 deg
+//   battery   f32 percent, u16 voltage                 mV
+//   misc      u8 bits: health, armed, inAir
+//
+// Delta frames only carry fields changed since the previous frame of the stream and
+// have to be applied on top of it; after a gap in seq wait for the next keyframe.
+//
+// Values which do not fit (NaN, out of range) are sent as the smallest value of the type
+// (0xFFFF for u16) and decode back to NaN.
+
+#include <bitset>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include "telem_pack.h"
+
+#define TELEM_BINARY_MAGIC 0x4D54
+#define TELEM_BINARY_VERSION 1
+#define TELEM_BINARY_SCHEMA 1
+#define TELEM_BINARY_HEADER_SIZE 20
+#define TELEM_BINARY_MAX_SIZE 68
+
+#define TELEM_FLAG_DELTA 0x01
+#define TELEM_FLAG_KEYFRAME 0x02
+
+#define TELEM_MISC_HEALTH 0x01
+#define TELEM_MISC_ARMED 0x02
+#define TELEM_MISC_IN_AIR 0x04
+
+struct TelemBinaryHeader
+{
+    uint8_t version = TELEM_BINARY_VERSION;
+    uint8_t schema = TELEM_BINARY_SCHEMA;
+    uint8_t flags = 0;
+    uint8_t sections = TELEM_SECTION_ALL;
+    uint32_t seq = 0;
+    uint64_t time_us = 0;
+    // fields present in a delta frame
+    uint32_t fields = TELEM_FIELD_ALL;
+};
+
+namespace telem_binary
+{
+    inline uint8_t *put_u8(uint8_t *p, uint8_t v)
+    {
+        *p = v;
+        return p + 1;
+    }
+
+    inline uint8_t *put_u16(uint8_t *p, uint16_t v)
+    {
+        p[0] = v & 0xFF;
+        p[1] = v >> 8;
+        return p + 2;
+    }
+
+    inline uint8_t *put_u32(uint8_t *p, uint32_t v)
+    {
+        for (int i = 0; i < 4; i++)
+            p[i] = (v >> (8 * i)) & 0xFF;
+        return p + 4;
+    }
+
+    inline uint8_t *put_u64(uint8_t *p, uint64_t v)
+    {
+        for (int i = 0; i < 8; i++)
+            p[i] = (v >> (8 * i)) & 0xFF;
+        return p + 8;
+    }
+
+    inline uint8_t *put_f32(uint8_t *p, float v)
+    {
+        uint32_t raw;
+        memcpy(&raw, &v, sizeof(raw));
+        return put_u32(p, raw);
+    }
+
+    inline uint16_t get_u16(const uint8_t *p)
+    {
+        return (uint16_t)(p[0] | (p[1] << 8));
+    }
+
+    inline uint32_t get_u32(const uint8_t *p)
+    {
+        uint32_t v = 0;
+        for (int i = 0; i < 4; i++)
+            v |= (uint32_t)p[i] << (8 * i);
+        return v;
+    }
+
+    inline uint64_t get_u64(const uint8_t *p)
+    {
+        uint64_t v = 0;
+        for (int i = 0; i < 8; i++)
+            v |= (uint64_t)p[i] << (8 * i);
+        return v;
+    }
+
+    inline float get_f32(const uint8_t *p)
+    {
+        uint32_t raw = get_u32(p);
+        float v;
+        memcpy(&v, &raw, sizeof(v));
+        return v;
+    }
+
+    template <typename T>
+    T quantize(double v, double scale)
+    {
+        double q = std::round(v * scale);
+        if (!(q > (double)std::numeric_limits<T>::min() && q <= (double)std::numeric_limits<T>::max()))
+            return std::numeric_limits<T>::min();
+        return (T)q;
+    }
+
+    template <typename T>
+    double dequantize(T v, double scale)
+    {
+        if (v == std::numeric_limits<T>::min())
+            return NAN;
+        return v / scale;
+    }
+
+    inline uint8_t *put_i16(uint8_t *p, double v, double scale)
+    {
+        return put_u16(p, (uint16_t)quantize<int16_t>(v, scale));
+    }
+
+    inline uint8_t *put_i32(uint8_t *p, double v, double scale)
+    {
+        return put_u32(p, (uint32_t)quantize<int32_t>(v, scale));
+    }
+
+    inline double get_i16(const uint8_t *p, double scale)
+    {
+        return dequantize<int16_t>((int16_t)get_u16(p), scale);
+    }
+
+    inline double get_i32(const uint8_t *p, double scale)
+    {
+        return dequantize<int32_t>((int32_t)get_u32(p), scale);
+    }
+
+    // portable popcount, clients may build this header with any compiler
+    inline size_t count_bits(uint32_t v)
+    {
+        return std::bitset<32>(v).count();
+    }
+
+    // yaw is sent in [-180, 180) so it fits into i16
+    inline float wrap_deg(float deg)
+    {
+        if (!std::isfinite(deg))
+            return deg;
+        float wrapped = std::fmod(deg + 180.0f, 360.0f);
+        if (wrapped < 0.0f)
+            wrapped += 360.0f;
+        return wrapped - 180.0f;
+    }
+}
+
+// fields carried in the body of a frame with this header
+inline uint32_t telem_binary_fields(const TelemBinaryHeader &hdr)
+{
+    uint32_t fields = telem_section_fields(hdr.sections);
+    if (hdr.flags & TELEM_FLAG_DELTA)
+        fields &= hdr.fields;
+    return fields;
+}
+
+// body size for given fields
+inline size_t telem_binary_body_size(uint32_t fields)
+{
+    using telem_binary::count_bits;
+    size_t size = 0;
+    size += 4 * count_bits(fields & (TELEM_FIELD_LAT | TELEM_FIELD_LON | TELEM_FIELD_ALT_ABS | TELEM_FIELD_ALT_REL | TELEM_FIELD_BATT_PERCENT));
+    size += 2 * count_bits(fields & (TELEM_FIELD_VEL_NORTH | TELEM_FIELD_VEL_EAST | TELEM_FIELD_VEL_DOWN | TELEM_FIELD_AIRSPEED | TELEM_FIELD_CLIMB_RATE | TELEM_FIELD_PITCH | TELEM_FIELD_ROLL | TELEM_FIELD_YAW | TELEM_FIELD_BATT_VOLTAGE));
+    if (fields & TELEM_FIELD_MISC)
+        size += 1;
+    return size;
+}
+
+// buf has to hold TELEM_BINARY_MAX_SIZE bytes, returns number of bytes written
+inline size_t encode_telem_binary(uint8_t *buf, const TelemBinaryHeader &hdr, const TelemData &pack)
+{
+    using namespace telem_binary;
+    uint32_t fields = telem_binary_fields(hdr);
+    uint8_t *p = buf;
+    p = put_u16(p, TELEM_BINARY_MAGIC);
+    p = put_u8(p, hdr.version);
+    p = put_u8(p, hdr.schema);
+    p = put_u8(p, hdr.flags);
+    p = put_u8(p, hdr.sections);
+    p = put_u16(p, 0);
+    p = put_u32(p, hdr.seq);
+    p = put_u64(p, hdr.time_us);
+    if (hdr.flags & TELEM_FLAG_DELTA)
+        p = put_u32(p, fields);
+
+    if (fields & TELEM_FIELD_LAT)
+        p = put_i32(p, pack.latitude, 1e7);
+    if (fields & TELEM_FIELD_LON)
+        p = put_i32(p, pack.longitude, 1e7);
+    if (fields & TELEM_FIELD_ALT_ABS)
+        p = put_i32(p, pack.abs_alt, 1e3);
+    if (fields & TELEM_FIELD_ALT_REL)
+        p = put_i32(p, pack.rel_alt, 1e3);
+    if (fields & TELEM_FIELD_VEL_NORTH)
+        p = put_i16(p, pack.vel_north, 1e2);
+    if (fields & TELEM_FIELD_VEL_EAST)
+        p = put_i16(p, pack.vel_east, 1e2);
+    if (fields & TELEM_FIELD_VEL_DOWN)
+        p = put_i16(p, pack.vel_down, 1e2);
+    if (fields & TELEM_FIELD_AIRSPEED)
+        p = put_i16(p, pack.airspeed, 1e2);
+    if (fields & TELEM_FIELD_CLIMB_RATE)
+        p = put_i16(p, pack.climb_rate, 1e2);
+    if (fields & TELEM_FIELD_PITCH)
+        p = put_i16(p, pack.pitch_deg, 1e2);
+    if (fields & TELEM_FIELD_ROLL)
+        p = put_i16(p, pack.roll_deg, 1e2);
+    if (fields & TELEM_FIELD_YAW)
+        p = put_i16(p, wrap_deg(pack.yaw_deg), 1e2);
+    if (fields & TELEM_FIELD_BATT_PERCENT)
+        p = put_f32(p, pack.batt_percentage);
+    if (fields & TELEM_FIELD_BATT_VOLTAGE)
+    {
+        double mv = std::round(pack.batt_voltage * 1e3);
+        p = put_u16(p, (mv >= 0.0 && mv < 65535.0) ? (uint16_t)mv : 0xFFFF);
+    }
+    if (fields & TELEM_FIELD_MISC)
+    {
+        uint8_t bits = 0;
+        if (pack.isAllOk)
+            bits |= TELEM_MISC_HEALTH;
+        if (pack.isArmed)
+            bits |= TELEM_MISC_ARMED;
+        if (pack.inAir)
+            bits |= TELEM_MISC_IN_AIR;
+        p = put_u8(p, bits);
+    }
+    return p - buf;
+}
+
+// returns false if buffer is not a valid frame of a known schema,
+// fields missing from the frame are left untouched in pack
+inline bool decode_telem_binary(const uint8_t *buf, size_t len, TelemBinaryHeader &hdr, TelemData &pack)
+{
+    using namespace telem_binary;
+    if (len < TELEM_BINARY_HEADER_SIZE || get_u16(buf) != TELEM_BINARY_MAGIC)
+        return false;
+
+    hdr.version = buf[2];
+    hdr.schema = buf[3];
+    hdr.flags = buf[4];
+    hdr.sections = buf[5];
+    hdr.seq = get_u32(buf + 8);
+    hdr.time_us = get_u64(buf + 12);
+    hdr.fields = TELEM_FIELD_ALL;
+
+    if (hdr.version != TELEM_BINARY_VERSION || hdr.schema != TELEM_BINARY_SCHEMA)
+        return false;
+
+    const uint8_t *p = buf + TELEM_BINARY_HEADER_SIZE;
+    if (hdr.flags & TELEM_FLAG_DELTA)
+    {
+        if (len < TELEM_BINARY_HEADER_SIZE + 4)
+            return false;
+        hdr.fields = get_u32(p);
+        p += 4;
+    }
+    uint32_t fields = telem_binary_fields(hdr);
+    if (len < (size_t)(p - buf) + telem_binary_body_size(fields))
+        return false;
+
+    if (fields & TELEM_FIELD_LAT)
+        pack.latitude = get_i32(p, 1e7), p += 4;
+    if (fields & TELEM_FIELD_LON)
+        pack.longitude = get_i32(p, 1e7), p += 4;
+    if (fields & TELEM_FIELD_ALT_ABS)
+        pack.abs_alt = get_i32(p, 1e3), p += 4;
+    if (fields & TELEM_FIELD_ALT_REL)
+        pack.rel_alt = get_i32(p, 1e3), p += 4;
+    if (fields & TELEM_FIELD_VEL_NORTH)
+        pack.vel_north = get_i16(p, 1e2), p += 2;
+    if (fields & TELEM_FIELD_VEL_EAST)
+        pack.vel_east = get_i16(p, 1e2), p += 2;
+    if (fields & TELEM_FIELD_VEL_DOWN)
+        pack.vel_down = get_i16(p, 1e2), p += 2;
+    if (fields & TELEM_FIELD_AIRSPEED)
+        pack.airspeed = get_i16(p, 1e2), p += 2;
+    if (fields & TELEM_FIELD_CLIMB_RATE)
+        pack.climb_rate = get_i16(p, 1e2), p += 2;
+    if (fields & TELEM_FIELD_PITCH)
+        pack.pitch_deg = get_i16(p, 1e2), p += 2;
+    if (fields & TELEM_FIELD_ROLL)
+        pack.roll_deg = get_i16(p, 1e2), p += 2;
+    if (fields & TELEM_FIELD_YAW)
+        pack.yaw_deg = get_i16(p, 1e2), p += 2;
+    if (fields & TELEM_FIELD_BATT_PERCENT)
+        pack.batt_percentage = get_f32(p), p += 4;
+    if (fields & TELEM_FIELD_BATT_VOLTAGE)
+    {
+        uint16_t mv = get_u16(p);
+        pack.batt_voltage = mv == 0xFFFF ? NAN : mv / 1e3;
+        p += 2;
+    }
+    if (fields & TELEM_FIELD_MISC)
+    {
+        pack.isAllOk = p[0] & TELEM_MISC_HEALTH;
+        pack.isArmed = p[0] & TELEM_MISC_ARMED;
+        pack.inAir = p[0] & TELEM_MISC_IN_AIR;
+        p += 1;
+    }
+    return true;
+}
@@ -0,0 +1,203 @@
+#include "telem_history.h"
+#include <algorithm>
+#include <cstring>
+#include "telem_binary.h"
+
+template <typename T, typename U>
+static T bit_cast(U value)
+{
+    static_assert(sizeof(T) == sizeof(U), "bit_cast size mismatch");
+    T out;
+    memcpy(&out, &value, sizeof(out));
+    return out;
+}
+
+TelemHistory::TelemHistory(size_t capacity)
+{
+    if (capacity == 0)
+        return;
+
+    size_t slots = HISTORY_MIN_SIZE;
+    while (slots < capacity)
+        slots <<= 1;
+    mask_ = slots - 1;
+
+    seq_.reset(new std::atomic<uint64_t>[slots]);
+    time_us_.reset(new std::atomic<uint64_t>[slots]);
+    latitude_.reset(new std::atomic<uint64_t>[slots]);
+    longitude_.reset(new std::atomic<uint64_t>[slots]);
+    for (auto &column : columns_)
+        column.reset(new std::atomic<uint32_t>[slots]);
+
+    // sample index i is complete when seq is 2 * i + 2, nothing matches 0
+    for (size_t i = 0; i < slots; i++)
+        seq_[i].store(0, std::memory_order_relaxed);
+}
+
+size_t TelemHistory::memory_bytes() const
+{
+    return capacity() * (4 * sizeof(uint64_t) + COLUMNS * sizeof(uint32_t));
+}
+
+void TelemHistory::record(uint64_t time_us, const TelemData &data)
+{
+    if (mask_ == 0)
+        return;
+
+    uint64_t index = head_.fetch_add(1, std::memory_order_relaxed);
+    size_t slot = index & mask_;
+
+    seq_[slot].store(2 * index + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    time_us_[slot].store(time_us, std::memory_order_relaxed);
+    latitude_[slot].store(bit_cast<uint64_t>(data.latitude), std::memory_order_relaxed);
+    longitude_[slot].store(bit_cast<uint64_t>(data.longitude), std::memory_order_relaxed);
+    columns_[ALT_ABS][slot].store(bit_cast<uint32_t>(data.abs_alt), std::memory_order_relaxed);
+    columns_[ALT_REL][slot].store(bit_cast<uint32_t>(data.rel_alt), std::memory_order_relaxed);
+    columns_[VEL_NORTH][slot].store(bit_cast<uint32_t>(data.vel_north), std::memory_order_relaxed);
+    columns_[VEL_EAST][slot].store(bit_cast<uint32_t>(data.vel_east), std::memory_order_relaxed);
+    columns_[VEL_DOWN][slot].store(bit_cast<uint32_t>(data.vel_down), std::memory_order_relaxed);
+    columns_[AIRSPEED][slot].store(bit_cast<uint32_t>(data.airspeed), std::memory_order_relaxed);
+    columns_[CLIMB_RATE][slot].store(bit_cast<uint32_t>(data.climb_rate), std::memory_order_relaxed);
+    columns_[ROLL][slot].store(bit_cast<uint32_t>(data.roll_deg), std::memory_order_relaxed);
+    columns_[PITCH][slot].store(bit_cast<uint32_t>(data.pitch_deg), std::memory_order_relaxed);
+    columns_[YAW][slot].store(bit_cast<uint32_t>(data.yaw_deg), std::memory_order_relaxed);
+    columns_[BATT_PERCENT][slot].store(bit_cast<uint32_t>(data.batt_percentage), std::memory_order_relaxed);
+    columns_[BATT_VOLTAGE][slot].store(bit_cast<uint32_t>(data.batt_voltage), std::memory_order_relaxed);
+    uint32_t misc = (data.isAllOk ? TELEM_MISC_HEALTH : 0) | (data.isArmed ? TELEM_MISC_ARMED : 0) | (data.inAir ? TELEM_MISC_IN_AIR : 0);
+    columns_[MISC][slot].store(misc, std::memory_order_relaxed);
+
+    seq_[slot].store(2 * index + 2, std::memory_order_release);
+}
+
+// false when sample index is not (or no longer) in its slot
+bool TelemHistory::read(uint64_t index, uint64_t &time_us, TelemData &data) const
+{
+    size_t slot = index & mask_;
+    uint64_t seq = seq_[slot].load(std::memory_order_acquire);
+    if (seq != 2 * index + 2)
+        return false;
+
+    time_us = time_us_[slot].load(std::memory_order_relaxed);
+    data.latitude = bit_cast<double>(latitude_[slot].load(std::memory_order_relaxed));
+    data.longitude = bit_cast<double>(longitude_[slot].load(std::memory_order_relaxed));
+    data.abs_alt = bit_cast<float>(columns_[ALT_ABS][slot].load(std::memory_order_relaxed));
+    data.rel_alt = bit_cast<float>(columns_[ALT_REL][slot].load(std::memory_order_relaxed));
+    data.vel_north = bit_cast<float>(columns_[VEL_NORTH][slot].load(std::memory_order_relaxed));
+    data.vel_east = bit_cast<float>(columns_[VEL_EAST][slot].load(std::memory_order_relaxed));
+    data.vel_down = bit_cast<float>(columns_[VEL_DOWN][slot].load(std::memory_order_relaxed));
+    data.airspeed = bit_cast<float>(columns_[AIRSPEED][slot].load(std::memory_order_relaxed));
+    data.climb_rate = bit_cast<float>(columns_[CLIMB_RATE][slot].load(std::memory_order_relaxed));
+    data.roll_deg = bit_cast<float>(columns_[ROLL][slot].load(std::memory_order_relaxed));
+    data.pitch_deg = bit_cast<float>(columns_[PITCH][slot].load(std::memory_order_relaxed));
+    data.yaw_deg = bit_cast<float>(columns_[YAW][slot].load(std::memory_order_relaxed));
+    data.batt_percentage = bit_cast<float>(columns_[BATT_PERCENT][slot].load(std::memory_order_relaxed));
+    data.batt_voltage = bit_cast<float>(columns_[BATT_VOLTAGE][slot].load(std::memory_order_relaxed));
+    uint32_t misc = columns_[MISC][slot].load(std::memory_order_relaxed);
+    data.isAllOk = misc & TELEM_MISC_HEALTH;
+    data.isArmed = misc & TELEM_MISC_ARMED;
+    data.inAir = misc & TELEM_MISC_IN_AIR;
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return seq_[slot].load(std::memory_order_relaxed) == seq;
+}
+
+// first index in [lo, hi) whose time is at least time_us, hi when there is none.
+// Times rise with the index, writers racing each other only swap neighbours by
+// microseconds. A slot being overwritten reads as a newer time, which only moves
+// the result towards older samples the scan then filters out.
+uint64_t TelemHistory::lower_bound(uint64_t lo, uint64_t hi, uint64_t time_us) const
+{
+    while (lo < hi)
+    {
+        uint64_t mid = lo + (hi - lo) / 2;
+        if (time_us_[mid & mask_].load(std::memory_order_relaxed) < time_us)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+template <typename F>
+size_t TelemHistory::scan(const HistoryQuery &query, F &&emit) const
+{
+    if (mask_ == 0 || query.max_samples == 0 || query.from_us > query.to_us)
+        return 0;
+
+    uint64_t head = head_.load(std::memory_order_acquire);
+    uint64_t first = head > capacity() ? head - capacity() : 0;
+    uint64_t begin = lower_bound(first, head, query.from_us);
+    uint64_t end = query.to_us == UINT64_MAX ? head : lower_bound(begin, head, query.to_us + 1);
+    if (begin >= end)
+        return 0;
+
+    // more samples than max: pick them evenly over the range, the oldest and the
+    // newest included, instead of cutting the range short
+    uint64_t span = end - begin;
+    uint64_t picks = span > query.max_samples ? query.max_samples : span;
+    auto pick = [&](uint64_t k)
+    { return picks == 1 ? end - 1 : begin + k * (span - 1) / (picks - 1); };
+    uint64_t next_us = query.from_us;
+    size_t count = 0;
+    for (uint64_t k = 0; k < picks;)
+    {
+        uint64_t index = pick(k);
+        // cheap look at the time column first, read() checks it again under the seqlock
+        uint64_t time_us = time_us_[index & mask_].load(std::memory_order_relaxed);
+        if (time_us < next_us && picks > 1)
+        {
+            // inside the step, go on at the first pick from the next one on
+            uint64_t target = lower_bound(index + 1, end, next_us);
+            k = std::max(k + 1, ((target - begin) * (picks - 1) + span - 2) / (span - 1));
+            continue;
+        }
+        k++;
+
+        TelemData data;
+        if (!read(index, time_us, data) || time_us < next_us || time_us > query.to_us)
+            continue;
+
+        emit(index, time_us, data);
+        count++;
+        if (query.step_us)
+        {
+            // a step past the end of time leaves this sample the only one
+            if (query.step_us > UINT64_MAX - time_us)
+                break;
+            next_us = time_us + query.step_us;
+        }
+    }
+    return count;
+}
+
+size_t TelemHistory::query_json(const HistoryQuery &query, JsonWriter &w) const
+{
+    w.begin_object();
+    w.key("samples");
+    w.begin_array();
+    size_t count = scan(query, [&](uint64_t, uint64_t time_us, const TelemData &data)
+                        {
+                            w.begin_object();
+                            w.field("t", time_us / 1e6);
+                            w.key("telem");
+                            write_telem_json(w, data, query.sections);
+                            w.end_object(); });
+    w.end_array();
+    w.end_object();
+    return count;
+}
+
+size_t TelemHistory::query_binary(const HistoryQuery &query, std::string &out) const
+{
+    uint8_t frame[TELEM_BINARY_MAX_SIZE];
+    return scan(query, [&](uint64_t index, uint64_t time_us, const TelemData &data)
+                {
+                    TelemBinaryHeader hdr;
+                    hdr.sections = query.sections;
+                    hdr.seq = (uint32_t)index;
+                    hdr.time_us = time_us;
+                    size_t size = encode_telem_binary(frame, hdr, data);
+                    out.append((const char *)frame, size); });
+}
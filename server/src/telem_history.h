@@ -0,0 +1,83 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include "telem_json.h"
+#include "telem_pack.h"
+
+#define HISTORY_MIN_SIZE 1024
+#define HISTORY_MAX_REPLY 10000
+
+// What a history command asks for, times in unix microseconds, both ends included.
+struct HistoryQuery
+{
+    uint64_t from_us = 0;
+    uint64_t to_us = UINT64_MAX;
+    // at most one sample per step, 0 returns all
+    uint64_t step_us = 0;
+    // a longer range is decimated evenly, its oldest and newest samples are kept
+    size_t max_samples = HISTORY_MAX_REPLY;
+    uint8_t sections = TELEM_SECTION_ALL;
+};
+
+// Ring of the last N telemetry snapshots with their time, as struct of arrays:
+// one column per field, so a time range scan only touches the time column.
+// record() is lock-free and may be called from any number of threads (the mavsdk
+// callbacks), every slot is a seqlock keyed by the sample index so readers skip
+// samples overwritten or still being written. Memory is fixed at construction.
+// Times are expected to rise with every record(), queries find their range by
+// binary search on the time column.
+class TelemHistory
+{
+public:
+    // capacity is rounded up to a power of two (at least HISTORY_MIN_SIZE), 0 disables recording
+    explicit TelemHistory(size_t capacity);
+
+    TelemHistory(const TelemHistory &) = delete;
+    TelemHistory &operator=(const TelemHistory &) = delete;
+
+    size_t capacity() const { return mask_ ? mask_ + 1 : 0; }
+    size_t memory_bytes() const;
+
+    void record(uint64_t time_us, const TelemData &data);
+
+    // matching samples oldest first as {"samples":[{"t":unix seconds,"telem":{...}},...]}
+    size_t query_json(const HistoryQuery &query, JsonWriter &w) const;
+    // matching samples oldest first as back to back binary frames (telem_binary.h),
+    // seq holds the sample index and every frame has the same size
+    size_t query_binary(const HistoryQuery &query, std::string &out) const;
+
+private:
+    enum Column
+    {
+        ALT_ABS,
+        ALT_REL,
+        VEL_NORTH,
+        VEL_EAST,
+        VEL_DOWN,
+        AIRSPEED,
+        CLIMB_RATE,
+        ROLL,
+        PITCH,
+        YAW,
+        BATT_PERCENT,
+        BATT_VOLTAGE,
+        MISC,
+        COLUMNS
+    };
+
+    bool read(uint64_t index, uint64_t &time_us, TelemData &data) const;
+    uint64_t lower_bound(uint64_t lo, uint64_t hi, uint64_t time_us) const;
+    template <typename F>
+    size_t scan(const HistoryQuery &query, F &&emit) const;
+
+    size_t mask_ = 0;
+    std::atomic<uint64_t> head_{0};
+    std::unique_ptr<std::atomic<uint64_t>[]> seq_;
+    std::unique_ptr<std::atomic<uint64_t>[]> time_us_;
+    std::unique_ptr<std::atomic<uint64_t>[]> latitude_;
+    std::unique_ptr<std::atomic<uint64_t>[]> longitude_;
+    std::unique_ptr<std::atomic<uint32_t>[]> columns_[COLUMNS];
+};
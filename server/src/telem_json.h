@@ -0,0 +1,221 @@
+#pragma once
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include "../lib/json.hpp"
+#include "telem_pack.h"
+
+#define JSON_WRITER_RESERVE 1024
+
+// Minimal json writer appending straight into a reused buffer.
+// Output matches nlohmann::json::dump() as long as keys are written in sorted order,
+// numbers are formatted with the same grisu2 routine nlohmann uses.
+class JsonWriter
+{
+public:
+    JsonWriter()
+    {
+        buf_.reserve(JSON_WRITER_RESERVE);
+    }
+
+    void clear()
+    {
+        buf_.clear();
+        first_ = true;
+    }
+
+    void begin_object()
+    {
+        separator();
+        buf_.push_back('{');
+        first_ = true;
+    }
+
+    void end_object()
+    {
+        buf_.push_back('}');
+        first_ = false;
+    }
+
+    void begin_array()
+    {
+        separator();
+        buf_.push_back('[');
+        first_ = true;
+    }
+
+    void end_array()
+    {
+        buf_.push_back(']');
+        first_ = false;
+    }
+
+    // key must not need escaping
+    void key(const char *name)
+    {
+        separator();
+        buf_.push_back('"');
+        buf_.append(name);
+        buf_.append("\":", 2);
+        first_ = true;
+    }
+
+    void value(double x)
+    {
+        separator();
+        if (!std::isfinite(x))
+        {
+            buf_.append("null", 4);
+            return;
+        }
+        char num[64];
+        char *end = nlohmann::detail::to_chars(num, num + sizeof(num), x);
+        buf_.append(num, end - num);
+    }
+
+    void value(float x)
+    {
+        // nlohmann stores every float as double
+        value((double)x);
+    }
+
+    void value(bool x)
+    {
+        separator();
+        if (x)
+            buf_.append("true", 4);
+        else
+            buf_.append("false", 5);
+    }
+
+    void value(uint64_t x)
+    {
+        separator();
+        char num[24];
+        int len = snprintf(num, sizeof(num), "%llu", (unsigned long long)x);
+        buf_.append(num, len);
+    }
+
+    // text must not need escaping
+    void value_string(const char *text)
+    {
+        separator();
+        buf_.push_back('"');
+        buf_.append(text);
+        buf_.push_back('"');
+    }
+
+    template <typename T>
+    void field(const char *name, T x)
+    {
+        key(name);
+        value(x);
+    }
+
+    const char *data() const { return buf_.data(); }
+    size_t size() const { return buf_.size(); }
+    const std::string &str() const { return buf_; }
+
+private:
+    void separator()
+    {
+        if (!first_)
+            buf_.push_back(',');
+        first_ = false;
+    }
+
+    std::string buf_;
+    bool first_ = true;
+};
+
+// sequence info written into frames of delta streams
+struct TelemFrameInfo
+{
+    uint32_t seq;
+    bool keyframe;
+};
+
+// same document pack_to_json used to build with nlohmann, without allocating per tick.
+// sections limits it to the selected objects, fields to the selected values (objects
+// without any are left out). frame adds "key" and "seq" for delta streams.
+inline void write_telem_json(JsonWriter &w, const TelemData &pack, uint8_t sections = TELEM_SECTION_ALL,
+                             uint32_t fields = TELEM_FIELD_ALL, const TelemFrameInfo *frame = nullptr)
+{
+    fields &= telem_section_fields(sections);
+
+    w.begin_object();
+    if (fields & (TELEM_FIELD_PITCH | TELEM_FIELD_ROLL | TELEM_FIELD_YAW))
+    {
+        w.key("angles");
+        w.begin_object();
+        if (fields & TELEM_FIELD_PITCH)
+            w.field("pitch", pack.pitch_deg);
+        if (fields & TELEM_FIELD_ROLL)
+            w.field("roll", pack.roll_deg);
+        if (fields & TELEM_FIELD_YAW)
+            w.field("yaw", pack.yaw_deg);
+        w.end_object();
+    }
+    if (fields & (TELEM_FIELD_BATT_PERCENT | TELEM_FIELD_BATT_VOLTAGE))
+    {
+        w.key("battery");
+        w.begin_object();
+        if (fields & TELEM_FIELD_BATT_PERCENT)
+            w.field("percent", pack.batt_percentage);
+        if (fields & TELEM_FIELD_BATT_VOLTAGE)
+            w.field("voltage", pack.batt_voltage);
+        w.end_object();
+    }
+    if (frame)
+        w.field("key", frame->keyframe);
+    if (fields & TELEM_FIELD_MISC)
+    {
+        w.key("misc");
+        w.begin_object();
+        w.field("armed", pack.isArmed);
+        w.field("health", pack.isAllOk);
+        w.field("inAir", pack.inAir);
+        w.end_object();
+    }
+    if (fields & (TELEM_FIELD_AIRSPEED | TELEM_FIELD_CLIMB_RATE))
+    {
+        w.key("plane");
+        w.begin_object();
+        if (fields & TELEM_FIELD_AIRSPEED)
+            w.field("airspeed", pack.airspeed);
+        if (fields & TELEM_FIELD_CLIMB_RATE)
+            w.field("climbrate", pack.climb_rate);
+        w.end_object();
+    }
+    if (fields & (TELEM_FIELD_LAT | TELEM_FIELD_LON | TELEM_FIELD_ALT_ABS | TELEM_FIELD_ALT_REL))
+    {
+        w.key("position");
+        w.begin_object();
+        if (fields & TELEM_FIELD_ALT_ABS)
+            w.field("alt_abs", pack.abs_alt);
+        if (fields & TELEM_FIELD_ALT_REL)
+            w.field("alt_rel", pack.rel_alt);
+        if (fields & TELEM_FIELD_LAT)
+            w.field("lat", pack.latitude);
+        if (fields & TELEM_FIELD_LON)
+            w.field("lon", pack.longitude);
+        w.end_object();
+    }
+    if (frame)
+        w.field("seq", (uint64_t)frame->seq);
+    if (fields & (TELEM_FIELD_VEL_NORTH | TELEM_FIELD_VEL_EAST | TELEM_FIELD_VEL_DOWN))
+    {
+        w.key("velocity");
+        w.begin_object();
+        if (fields & TELEM_FIELD_VEL_DOWN)
+            w.field("down", pack.vel_down);
+        if (fields & TELEM_FIELD_VEL_EAST)
+            w.field("east", pack.vel_east);
+        if (fields & TELEM_FIELD_VEL_NORTH)
+            w.field("north", pack.vel_north);
+        w.end_object();
+    }
+    w.end_object();
+}
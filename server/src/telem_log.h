@@ -0,0 +1,230 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "telem_binary.h"
+
+// Flight log written by FlightRecorder (flight_recorder.h).
+//
+// A recording is a directory of segment files named flight-<YYYYmmdd-HHMMSS>-<NNNN>.tlog,
+// so sorting the names gives time order. Every segment is preallocated, filled through
+// a shared mapping and trimmed to its used size once full or on a clean shutdown.
+//
+//  header (64 bytes)
+//   u32 magic, u16 version, u16 reserved, u32 segment number, u32 index capacity
+//   u64 first time_us     time of the first record
+//   u64 data offset       where records start
+//   u64 index count       valid index entries
+//  index[index capacity]  sparse time index, one entry per TELEM_LOG_INDEX_BYTES of records
+//   u64 time_us, u64 offset of the first record after every TELEM_LOG_INDEX_BYTES
+//  records from data offset, each 8 byte aligned
+//   u32 size              payload bytes, 0 ends the segment
+//   u8 type               TELEM_LOG_TELEM or TELEM_LOG_COMMAND
+//   u8 reserved[3]
+//   u64 time_us           unix microseconds
+//   payload               full binary telemetry frame (telem_binary.h) or the command text
+//
+// Records are appended in arrival order, times from different threads may be a few
+// microseconds out of order. All integers are little endian, like the binary frames.
+// This header is the reader library, include it together with telem_binary.h.
+
+#define TELEM_LOG_MAGIC 0x474F4C54 // "TLOG"
+#define TELEM_LOG_VERSION 1
+#define TELEM_LOG_SUFFIX ".tlog"
+#define TELEM_LOG_INDEX_BYTES 16384
+
+#define TELEM_LOG_TELEM 1
+#define TELEM_LOG_COMMAND 2
+
+struct TelemLogHeader
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t reserved;
+    uint32_t segment;
+    uint32_t index_capacity;
+    uint64_t first_time_us;
+    uint64_t data_offset;
+    uint64_t index_count;
+    uint8_t pad[24];
+};
+static_assert(sizeof(TelemLogHeader) == 64, "log header is 64 bytes");
+
+struct TelemLogIndexEntry
+{
+    uint64_t time_us;
+    uint64_t offset;
+};
+
+struct TelemLogRecordHeader
+{
+    uint32_t size;
+    uint8_t type;
+    uint8_t reserved[3];
+    uint64_t time_us;
+};
+static_assert(sizeof(TelemLogRecordHeader) == 16, "record header is 16 bytes");
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "record size is read as an atomic");
+
+inline size_t telem_log_record_size(size_t payload)
+{
+    return (sizeof(TelemLogRecordHeader) + payload + 7) & ~(size_t)7;
+}
+
+inline size_t telem_log_data_offset(uint32_t index_capacity)
+{
+    return sizeof(TelemLogHeader) + (size_t)index_capacity * sizeof(TelemLogIndexEntry);
+}
+
+// segment files of a recording directory in time order
+inline std::vector<std::string> telem_log_segments(const std::string &dir)
+{
+    std::vector<std::string> paths;
+    DIR *d = opendir(dir.c_str());
+    if (!d)
+        return paths;
+    while (struct dirent *entry = readdir(d))
+    {
+        std::string name = entry->d_name;
+        size_t suffix = strlen(TELEM_LOG_SUFFIX);
+        if (name.size() > suffix && name.compare(name.size() - suffix, suffix, TELEM_LOG_SUFFIX) == 0)
+            paths.push_back(dir + "/" + name);
+    }
+    closedir(d);
+    std::sort(paths.begin(), paths.end());
+    return paths;
+}
+
+struct TelemLogRecord
+{
+    uint8_t type;
+    uint64_t time_us;
+    const uint8_t *payload;
+    uint32_t size;
+};
+
+// Reads one segment, also while the server still writes it.
+class TelemLogReader
+{
+public:
+    TelemLogReader() = default;
+
+    ~TelemLogReader()
+    {
+        close();
+    }
+
+    TelemLogReader(const TelemLogReader &) = delete;
+    TelemLogReader &operator=(const TelemLogReader &) = delete;
+
+    // false when the file is missing or not a log segment
+    bool open(const std::string &path)
+    {
+        close();
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+
+        struct stat st;
+        void *map = MAP_FAILED;
+        if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(TelemLogHeader))
+            map = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (map == MAP_FAILED)
+            return false;
+
+        map_ = static_cast<const uint8_t *>(map);
+        map_size_ = st.st_size;
+        const TelemLogHeader &hdr = header();
+        if (hdr.magic != TELEM_LOG_MAGIC || hdr.version != TELEM_LOG_VERSION ||
+            hdr.data_offset != telem_log_data_offset(hdr.index_capacity) || hdr.data_offset > map_size_)
+        {
+            close();
+            return false;
+        }
+        pos_ = hdr.data_offset;
+        return true;
+    }
+
+    void close()
+    {
+        if (map_)
+            munmap(const_cast<uint8_t *>(map_), map_size_);
+        map_ = nullptr;
+        map_size_ = 0;
+        pos_ = 0;
+    }
+
+    bool is_open() const { return map_ != nullptr; }
+    const TelemLogHeader &header() const { return *reinterpret_cast<const TelemLogHeader *>(map_); }
+    uint64_t first_time_us() const { return header().first_time_us; }
+
+    // positions next() at the first record at or after time_us: binary search in the
+    // sparse index, then a scan of at most TELEM_LOG_INDEX_BYTES
+    void seek(uint64_t time_us)
+    {
+        const TelemLogHeader &hdr = header();
+        auto index = reinterpret_cast<const TelemLogIndexEntry *>(map_ + sizeof(TelemLogHeader));
+        // the writer fills an entry before counting it
+        uint64_t count = reinterpret_cast<const std::atomic<uint64_t> *>(&hdr.index_count)->load(std::memory_order_acquire);
+        count = std::min<uint64_t>(count, hdr.index_capacity);
+        auto it = std::upper_bound(index, index + count, time_us, [](uint64_t t, const TelemLogIndexEntry &entry)
+                                   { return t <= entry.time_us; });
+        pos_ = it == index ? hdr.data_offset : (it - 1)->offset;
+
+        while (true)
+        {
+            size_t pos = pos_;
+            TelemLogRecord record;
+            if (!next(record))
+                return;
+            if (record.time_us >= time_us)
+            {
+                pos_ = pos;
+                return;
+            }
+        }
+    }
+
+    // false at the end of what is written so far
+    bool next(TelemLogRecord &record)
+    {
+        if (pos_ + sizeof(TelemLogRecordHeader) > map_size_)
+            return false;
+        // the writer stores size last, a live segment ends at the first size 0
+        uint32_t size = reinterpret_cast<const std::atomic<uint32_t> *>(map_ + pos_)->load(std::memory_order_acquire);
+        TelemLogRecordHeader rec;
+        memcpy(&rec, map_ + pos_, sizeof(rec));
+        rec.size = size;
+        if (rec.size == 0 || pos_ + telem_log_record_size(rec.size) > map_size_)
+            return false;
+
+        record.type = rec.type;
+        record.time_us = rec.time_us;
+        record.payload = map_ + pos_ + sizeof(rec);
+        record.size = rec.size;
+        pos_ += telem_log_record_size(rec.size);
+        return true;
+    }
+
+    // decodes a TELEM_LOG_TELEM record
+    static bool decode(const TelemLogRecord &record, TelemBinaryHeader &hdr, TelemData &pack)
+    {
+        return record.type == TELEM_LOG_TELEM && decode_telem_binary(record.payload, record.size, hdr, pack);
+    }
+
+private:
+    const uint8_t *map_ = nullptr;
+    size_t map_size_ = 0;
+    size_t pos_ = 0;
+};
@@ -0,0 +1,284 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <type_traits>
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// groups of fields, matching the objects of the json document
+#define TELEM_SECTION_POSITION 0x01
+#define TELEM_SECTION_VELOCITY 0x02
+#define TELEM_SECTION_PLANE 0x04
+#define TELEM_SECTION_ANGLES 0x08
+#define TELEM_SECTION_BATTERY 0x10
+#define TELEM_SECTION_MISC 0x20
+#define TELEM_SECTION_ALL 0x3F
+
+// single fields, used by delta frames (misc flags travel together)
+#define TELEM_FIELD_LAT (1u << 0)
+#define TELEM_FIELD_LON (1u << 1)
+#define TELEM_FIELD_ALT_ABS (1u << 2)
+#define TELEM_FIELD_ALT_REL (1u << 3)
+#define TELEM_FIELD_VEL_NORTH (1u << 4)
+#define TELEM_FIELD_VEL_EAST (1u << 5)
+#define TELEM_FIELD_VEL_DOWN (1u << 6)
+#define TELEM_FIELD_AIRSPEED (1u << 7)
+#define TELEM_FIELD_CLIMB_RATE (1u << 8)
+#define TELEM_FIELD_PITCH (1u << 9)
+#define TELEM_FIELD_ROLL (1u << 10)
+#define TELEM_FIELD_YAW (1u << 11)
+#define TELEM_FIELD_BATT_PERCENT (1u << 12)
+#define TELEM_FIELD_BATT_VOLTAGE (1u << 13)
+#define TELEM_FIELD_MISC (1u << 14)
+#define TELEM_FIELD_ALL 0x7FFFu
+
+// section bit for a json object name, 0 if unknown
+inline uint8_t telem_section_by_name(const std::string &name)
+{
+    if (name == "position")
+        return TELEM_SECTION_POSITION;
+    if (name == "velocity")
+        return TELEM_SECTION_VELOCITY;
+    if (name == "plane")
+        return TELEM_SECTION_PLANE;
+    if (name == "angles")
+        return TELEM_SECTION_ANGLES;
+    if (name == "battery")
+        return TELEM_SECTION_BATTERY;
+    if (name == "misc")
+        return TELEM_SECTION_MISC;
+    return 0;
+}
+
+// plain copy of all telemetry fields, this is what readers get
+struct TelemData
+{
+    // position
+    double latitude = 0.0;
+    double longitude = 0.0;
+    float abs_alt = 0.0f;
+    float rel_alt = 0.0f;
+    // velocity
+    float vel_north = 0.0f;
+    float vel_east = 0.0f;
+    float vel_down = 0.0f;
+    // plane data
+    float airspeed = 0.0f;
+    float climb_rate = 0.0f;
+    // angle
+    float roll_deg = 0.0f;
+    float pitch_deg = 0.0f;
+    float yaw_deg = 0.0f;
+    // misc
+    bool isAllOk = false;
+    bool isArmed = false;
+    bool inAir = false;
+    float batt_percentage = 0.0f;
+    float batt_voltage = 0.0f;
+};
+
+static_assert(std::is_trivially_copyable<TelemData>::value, "TelemData must be trivially copyable");
+
+// all field bits belonging to the given sections
+inline uint32_t telem_section_fields(uint8_t sections)
+{
+    uint32_t fields = 0;
+    if (sections & TELEM_SECTION_POSITION)
+        fields |= TELEM_FIELD_LAT | TELEM_FIELD_LON | TELEM_FIELD_ALT_ABS | TELEM_FIELD_ALT_REL;
+    if (sections & TELEM_SECTION_VELOCITY)
+        fields |= TELEM_FIELD_VEL_NORTH | TELEM_FIELD_VEL_EAST | TELEM_FIELD_VEL_DOWN;
+    if (sections & TELEM_SECTION_PLANE)
+        fields |= TELEM_FIELD_AIRSPEED | TELEM_FIELD_CLIMB_RATE;
+    if (sections & TELEM_SECTION_ANGLES)
+        fields |= TELEM_FIELD_PITCH | TELEM_FIELD_ROLL | TELEM_FIELD_YAW;
+    if (sections & TELEM_SECTION_BATTERY)
+        fields |= TELEM_FIELD_BATT_PERCENT | TELEM_FIELD_BATT_VOLTAGE;
+    if (sections & TELEM_SECTION_MISC)
+        fields |= TELEM_FIELD_MISC;
+    return fields;
+}
+
+// field bits which differ between two snapshots, compared bitwise so NaN equals NaN
+inline uint32_t telem_changed_fields(const TelemData &a, const TelemData &b)
+{
+    auto differs = [](const auto &x, const auto &y)
+    { return memcmp(&x, &y, sizeof(x)) != 0; };
+
+    uint32_t fields = 0;
+    if (differs(a.latitude, b.latitude))
+        fields |= TELEM_FIELD_LAT;
+    if (differs(a.longitude, b.longitude))
+        fields |= TELEM_FIELD_LON;
+    if (differs(a.abs_alt, b.abs_alt))
+        fields |= TELEM_FIELD_ALT_ABS;
+    if (differs(a.rel_alt, b.rel_alt))
+        fields |= TELEM_FIELD_ALT_REL;
+    if (differs(a.vel_north, b.vel_north))
+        fields |= TELEM_FIELD_VEL_NORTH;
+    if (differs(a.vel_east, b.vel_east))
+        fields |= TELEM_FIELD_VEL_EAST;
+    if (differs(a.vel_down, b.vel_down))
+        fields |= TELEM_FIELD_VEL_DOWN;
+    if (differs(a.airspeed, b.airspeed))
+        fields |= TELEM_FIELD_AIRSPEED;
+    if (differs(a.climb_rate, b.climb_rate))
+        fields |= TELEM_FIELD_CLIMB_RATE;
+    if (differs(a.pitch_deg, b.pitch_deg))
+        fields |= TELEM_FIELD_PITCH;
+    if (differs(a.roll_deg, b.roll_deg))
+        fields |= TELEM_FIELD_ROLL;
+    if (differs(a.yaw_deg, b.yaw_deg))
+        fields |= TELEM_FIELD_YAW;
+    if (differs(a.batt_percentage, b.batt_percentage))
+        fields |= TELEM_FIELD_BATT_PERCENT;
+    if (differs(a.batt_voltage, b.batt_voltage))
+        fields |= TELEM_FIELD_BATT_VOLTAGE;
+    if (a.isAllOk != b.isAllOk || a.isArmed != b.isArmed || a.inAir != b.inAir)
+        fields |= TELEM_FIELD_MISC;
+    return fields;
+}
+
+// Seqlock protected TelemData.
+// Writers (mavsdk callbacks) update a group of fields under one version bump,
+// readers copy the whole struct and retry if a writer was active meanwhile.
+// Payload is kept in 32 bit atomic words, so it stays lock-free on 32 bit arm
+// where std::atomic<double> is not. The sequence word doubles as a futex, so
+// publishers can sleep until the next update.
+class TelemPack
+{
+public:
+    TelemPack()
+    {
+        store_words(TelemData{});
+    }
+
+    TelemPack(const TelemPack &) = delete;
+    TelemPack &operator=(const TelemPack &) = delete;
+
+    // fn gets current data by reference, everything it changes is published at once,
+    // returns the data as published
+    template <typename F>
+    TelemData update(F &&fn)
+    {
+        uint32_t seq = lock_write();
+        TelemData data;
+        load_words(data);
+        fn(data);
+        store_words(data);
+        seq_.store(seq + 2, std::memory_order_release);
+
+        // syscall only when somebody sleeps in wait_update()
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (waiters_.load(std::memory_order_relaxed) > 0)
+            wake_waiters();
+        return data;
+    }
+
+    // consistent copy of all fields, never torn
+    TelemData snapshot() const
+    {
+        TelemData data;
+        while (true)
+        {
+            uint32_t seq1 = seq_.load(std::memory_order_acquire);
+            if (seq1 & 1)
+            {
+                std::this_thread::yield();
+                continue;
+            }
+            load_words(data);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            uint32_t seq2 = seq_.load(std::memory_order_relaxed);
+            if (seq1 == seq2)
+                return data;
+        }
+    }
+
+    // number of completed updates so far
+    uint32_t generation() const
+    {
+        return seq_.load(std::memory_order_acquire) >> 1;
+    }
+
+    // sleeps until generation() moves past seen or timeout passes, returns generation()
+    uint32_t wait_update(uint32_t seen, std::chrono::nanoseconds timeout) const
+    {
+        auto deadline = std::chrono::steady_clock::now() + timeout;
+        waiters_.fetch_add(1, std::memory_order_seq_cst);
+        while (true)
+        {
+            uint32_t raw = seq_.load(std::memory_order_seq_cst);
+            auto left = deadline - std::chrono::steady_clock::now();
+            if ((raw >> 1) != seen || left <= std::chrono::nanoseconds::zero())
+                break;
+#ifdef __linux__
+            auto secs = std::chrono::duration_cast<std::chrono::seconds>(left);
+            struct timespec ts;
+            ts.tv_sec = secs.count();
+            ts.tv_nsec = std::chrono::duration_cast<std::chrono::nanoseconds>(left - secs).count();
+            syscall(SYS_futex, (uint32_t *)&seq_, FUTEX_WAIT_PRIVATE, raw, &ts, nullptr, 0);
+#else
+            std::this_thread::sleep_for(std::min<std::chrono::steady_clock::duration>(left, std::chrono::milliseconds(1)));
+#endif
+        }
+        waiters_.fetch_sub(1, std::memory_order_relaxed);
+        return generation();
+    }
+
+private:
+    static constexpr size_t WORDS = (sizeof(TelemData) + sizeof(uint32_t) - 1) / sizeof(uint32_t);
+
+    uint32_t lock_write()
+    {
+        uint32_t seq = seq_.load(std::memory_order_relaxed);
+        while (true)
+        {
+            if (!(seq & 1) && seq_.compare_exchange_weak(seq, seq + 1, std::memory_order_acquire, std::memory_order_relaxed))
+                break;
+            if (seq & 1)
+            {
+                std::this_thread::yield();
+                seq = seq_.load(std::memory_order_relaxed);
+            }
+        }
+        std::atomic_thread_fence(std::memory_order_release);
+        return seq;
+    }
+
+    void wake_waiters()
+    {
+#ifdef __linux__
+        syscall(SYS_futex, (uint32_t *)&seq_, FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0);
+#endif
+    }
+
+    void load_words(TelemData &data) const
+    {
+        uint32_t raw[WORDS];
+        for (size_t i = 0; i < WORDS; i++)
+            raw[i] = words_[i].load(std::memory_order_relaxed);
+        memcpy(&data, raw, sizeof(TelemData));
+    }
+
+    void store_words(const TelemData &data)
+    {
+        uint32_t raw[WORDS] = {0};
+        memcpy(raw, &data, sizeof(TelemData));
+        for (size_t i = 0; i < WORDS; i++)
+            words_[i].store(raw[i], std::memory_order_relaxed);
+    }
+
+    std::atomic<uint32_t> seq_{0};
+    mutable std::atomic<uint32_t> waiters_{0};
+    std::atomic<uint32_t> words_[WORDS];
+};
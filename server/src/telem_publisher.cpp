@@ -0,0 +1,442 @@
+#include "telem_publisher.h"
+#include <algorithm>
+#include <cerrno>
+#include <string>
+#include <arpa/inet.h>
+#include <sys/un.h>
+#include <thread>
+#include <time.h>
+
+#define EVENT_IDLE_WAIT_MS 100
+
+TelemPublisher::Stream::Stream(int sockfd, int family, const TelemProfile &profile, const PublishConfig &config)
+    : profile(profile), family(family), fanout(sockfd, family == AF_INET ? MSG_CONFIRM : 0)
+{
+    float rate = (profile.rate <= 0.0f || profile.rate > REFRESH_TELEM) ? REFRESH_TELEM : profile.rate;
+    period = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(1.0 / rate));
+    if (config.mode == PublishMode::Event && period < config.min_interval)
+        period = config.min_interval;
+}
+
+// sleeps to an absolute point of steady_clock, which is CLOCK_MONOTONIC on linux
+static void sleep_until(std::chrono::steady_clock::time_point deadline)
+{
+#ifdef __linux__
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(deadline.time_since_epoch()).count();
+    struct timespec ts;
+    ts.tv_sec = ns / 1000000000;
+    ts.tv_nsec = ns % 1000000000;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) == EINTR)
+        ;
+#else
+    std::this_thread::sleep_until(deadline);
+#endif
+}
+
+TelemPublisher::TelemPublisher(int sockfd, int unix_sockfd, TelemPack &pack, SubscriberRegistry &subscribers, PublishStats &stats,
+                               const PublishConfig &config)
+    : sockfd_(sockfd), unix_sockfd_(unix_sockfd), config_(config), pack_(pack), subscribers_(subscribers), stats_(stats)
+{
+}
+
+void TelemPublisher::run()
+{
+    if (config_.mode == PublishMode::Event)
+    {
+        while (!stop_.load(std::memory_order_relaxed))
+        {
+            auto now = std::chrono::steady_clock::now();
+            housekeeping(now);
+            publish(now, now);
+            stats_.ticks.fetch_add(1, std::memory_order_relaxed);
+            stats_.duration.record(std::chrono::steady_clock::now() - now);
+            wait_event(pack_.generation());
+        }
+        return;
+    }
+
+    auto period = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double>(1.0 / REFRESH_TELEM));
+    auto deadline = std::chrono::steady_clock::now();
+    std::chrono::steady_clock::time_point last_tick;
+    while (!stop_.load(std::memory_order_relaxed))
+    {
+        auto now = std::chrono::steady_clock::now();
+        stats_.lateness.record(now - deadline);
+        if (stats_.ticks.load(std::memory_order_relaxed) > 0)
+            stats_.jitter.record(now - last_tick - period);
+        last_tick = now;
+
+        housekeeping(now);
+        publish(now, deadline);
+        stats_.ticks.fetch_add(1, std::memory_order_relaxed);
+
+        deadline += period;
+        now = std::chrono::steady_clock::now();
+        stats_.duration.record(now - last_tick);
+        if (deadline <= now)
+        {
+            stats_.late_ticks.fetch_add(1, std::memory_order_relaxed);
+            stats_.skipped_ticks.fetch_add(on_overrun(deadline, period, now), std::memory_order_relaxed);
+        }
+        sleep_until(deadline);
+    }
+}
+
+uint64_t TelemPublisher::on_overrun(std::chrono::steady_clock::time_point &deadline, std::chrono::steady_clock::duration period,
+                                    std::chrono::steady_clock::time_point now) const
+{
+    if (deadline > now)
+        return 0;
+    // late ticks run back to back, unless they are too far behind
+    if (config_.overrun == OverrunPolicy::CatchUp && now - deadline < PUBLISH_MAX_CATCHUP * period)
+        return 0;
+
+    // next point of the grid after now
+    uint64_t missed = (now - deadline) / period + 1;
+    deadline += missed * period;
+    return missed;
+}
+
+void TelemPublisher::housekeeping(std::chrono::steady_clock::time_point now)
+{
+    if (now - last_expire_ > std::chrono::seconds(1))
+    {
+        subscribers_.expire(now);
+        last_expire_ = now;
+    }
+
+    // streams are only rebuilt when subscribers change
+    uint32_t version = subscribers_.version();
+    if (version != version_)
+    {
+        rebuild_streams();
+        version_ = version;
+    }
+}
+
+bool TelemPublisher::is_due(const Stream &stream, std::chrono::steady_clock::time_point now, uint32_t generation) const
+{
+    if (config_.mode == PublishMode::Periodic)
+        return stream.next_due <= now;
+    if (stream.sent_generation != generation && stream.next_due <= now)
+        return true;
+    return now - stream.last_sent >= config_.max_interval;
+}
+
+void TelemPublisher::wait_event(uint32_t generation)
+{
+    auto now = std::chrono::steady_clock::now();
+    if (streams_.empty())
+    {
+        // nothing to serialize, only look for new subscribers now and then
+        std::this_thread::sleep_for(std::chrono::milliseconds(EVENT_IDLE_WAIT_MS));
+        return;
+    }
+
+    // wake up for the next update or the earliest stream deadline
+    auto deadline = now + std::chrono::milliseconds(EVENT_IDLE_WAIT_MS);
+    for (auto &stream : streams_)
+    {
+        if (stream.sent_generation != generation)
+            // changed data waits only for the stream's rate limit
+            deadline = std::min(deadline, stream.next_due);
+        else
+            deadline = std::min(deadline, stream.last_sent + config_.max_interval);
+    }
+
+    if (deadline > now)
+        pack_.wait_update(generation, deadline - now);
+}
+
+void TelemPublisher::rebuild_streams()
+{
+    auto list = subscribers_.snapshot();
+    std::vector<Stream> streams;
+    streams.reserve(list->size());
+
+    for (auto &sub : *list)
+    {
+        int family = sub.addr.family();
+        if (family == AF_UNIX && unix_sockfd_ < 0)
+            continue;
+
+        auto same = [&sub, family](const Stream &stream)
+        { return stream.profile == sub.profile && stream.family == family; };
+        auto it = std::find_if(streams.begin(), streams.end(), same);
+        if (it == streams.end())
+        {
+            streams.emplace_back(family == AF_UNIX ? unix_sockfd_ : sockfd_, family, sub.profile, config_);
+            it = streams.end() - 1;
+
+            // keep cadence and sequence of streams that already existed
+            auto old = std::find_if(streams_.begin(), streams_.end(), same);
+            if (old != streams_.end())
+            {
+                it->next_due = old->next_due;
+                it->last_sent = old->last_sent;
+                it->sent_generation = old->sent_generation;
+                it->seq = old->seq;
+                it->last_frame = old->last_frame;
+                it->next_keyframe = old->next_keyframe;
+                it->has_keyframe = old->has_keyframe;
+            }
+        }
+        it->fanout.add(sub.addr, sub.counters);
+    }
+    streams_ = std::move(streams);
+}
+
+void TelemPublisher::publish(std::chrono::steady_clock::time_point now, std::chrono::steady_clock::time_point deadline)
+{
+    // generation is read before the snapshot, so a racing update only causes one extra send
+    uint32_t generation = pack_.generation();
+    due_.clear();
+    for (size_t i = 0; i < streams_.size(); i++)
+    {
+        if (is_due(streams_[i], now, generation))
+            due_.push_back(i);
+    }
+    if (due_.empty())
+        return;
+
+    auto pack = pack_.snapshot();
+    uint64_t time_us = std::chrono::duration_cast<std::chrono::microseconds>(
+                           std::chrono::system_clock::now().time_since_epoch())
+                           .count();
+
+    for (size_t n = 0; n < due_.size(); n++)
+    {
+        Stream &stream = streams_[due_[n]];
+        const void *payload;
+        size_t size;
+        if (stream.profile.keyframe > 0.0f)
+        {
+            // an unchanged delta stream still counts as sent, only its keyframe timer keeps running
+            if (build_delta(stream, now, pack, time_us, payload, size))
+                send(stream, payload, size);
+        }
+        else
+        {
+            build_payload(stream, n, pack, time_us, payload, size);
+            send(stream, payload, size);
+        }
+
+        stream.sent_generation = generation;
+        stream.last_sent = now;
+        if (config_.mode == PublishMode::Event)
+        {
+            // keep the stream's grid, so waking up late for an update does not lower its rate,
+            // but never send twice within half a period, also not after a pause
+            stream.next_due = std::max(stream.next_due + stream.period, now + stream.period / 2);
+            continue;
+        }
+
+        // stay on the stream's own grid, overruns are handled like the loop's,
+        // a new stream starts its grid on the tick's deadline, a start at the later
+        // wake-up would make it miss every tick that wakes up less late
+        if (stream.next_due == std::chrono::steady_clock::time_point())
+            stream.next_due = deadline;
+        stream.next_due += stream.period;
+        on_overrun(stream.next_due, stream.period, now);
+    }
+}
+
+void TelemPublisher::send(Stream &stream, const void *payload, size_t size)
+{
+    auto start = std::chrono::steady_clock::now();
+    size_t sent = stream.fanout.send(payload, size);
+    stats_.send_time.record(std::chrono::steady_clock::now() - start);
+    if (sent < stream.fanout.size())
+        stats_.send_errors.fetch_add(stream.fanout.size() - sent, std::memory_order_relaxed);
+}
+
+void TelemPublisher::build_payload(Stream &stream, size_t index, const TelemData &pack, uint64_t time_us,
+                                   const void *&payload, size_t &size)
+{
+    stream.seq++;
+    for (size_t n = 0; n < index; n++)
+    {
+        Stream &built = streams_[due_[n]];
+        if (built.profile.keyframe > 0.0f || built.profile.format != stream.profile.format || built.profile.sections != stream.profile.sections)
+            continue;
+
+        if (stream.profile.format == TelemFormat::Binary)
+        {
+            // same bytes apart from this stream's sequence number
+            memcpy(stream.binary, built.binary, built.binary_size);
+            stream.binary_size = built.binary_size;
+            telem_binary::put_u32(stream.binary + 8, stream.seq);
+            payload = stream.binary;
+            size = stream.binary_size;
+        }
+        else
+        {
+            payload = built.json.data();
+            size = built.json.size();
+        }
+        return;
+    }
+
+    if (stream.profile.format == TelemFormat::Binary)
+    {
+        TelemBinaryHeader hdr;
+        hdr.sections = stream.profile.sections;
+        hdr.seq = stream.seq;
+        hdr.time_us = time_us;
+        stream.binary_size = encode_telem_binary(stream.binary, hdr, pack);
+        payload = stream.binary;
+        size = stream.binary_size;
+    }
+    else
+    {
+        stream.json.clear();
+        write_telem_json(stream.json, pack, stream.profile.sections);
+        payload = stream.json.data();
+        size = stream.json.size();
+    }
+}
+
+bool TelemPublisher::build_delta(Stream &stream, std::chrono::steady_clock::time_point now, const TelemData &pack,
+                                 uint64_t time_us, const void *&payload, size_t &size)
+{
+    uint32_t all = telem_section_fields(stream.profile.sections);
+    bool keyframe = !stream.has_keyframe || now >= stream.next_keyframe;
+    uint32_t fields = keyframe ? all : telem_changed_fields(stream.last_frame, pack) & all;
+    if (fields == 0)
+        return false;
+
+    stream.seq++;
+    stream.last_frame = pack;
+    if (keyframe)
+    {
+        auto interval = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::duration<double>(stream.profile.keyframe));
+        stream.next_keyframe = stream.has_keyframe ? stream.next_keyframe + interval : now + interval;
+        if (stream.next_keyframe <= now)
+            stream.next_keyframe = now + interval;
+        stream.has_keyframe = true;
+    }
+
+    if (stream.profile.format == TelemFormat::Binary)
+    {
+        TelemBinaryHeader hdr;
+        hdr.flags = TELEM_FLAG_DELTA | (keyframe ? TELEM_FLAG_KEYFRAME : 0);
+        hdr.sections = stream.profile.sections;
+        hdr.seq = stream.seq;
+        hdr.time_us = time_us;
+        hdr.fields = fields;
+        stream.binary_size = encode_telem_binary(stream.binary, hdr, pack);
+        payload = stream.binary;
+        size = stream.binary_size;
+    }
+    else
+    {
+        TelemFrameInfo frame{stream.seq, keyframe};
+        stream.json.clear();
+        write_telem_json(stream.json, pack, stream.profile.sections, fields, &frame);
+        payload = stream.json.data();
+        size = stream.json.size();
+    }
+    return true;
+}
+
+static void write_histogram(JsonWriter &w, const JitterHistogram &histogram)
+{
+    w.begin_object();
+    w.field("count", histogram.count());
+    w.field("mean", histogram.mean_us());
+    w.field("p50", histogram.quantile_us(0.5));
+    w.field("p90", histogram.quantile_us(0.9));
+    w.field("p99", histogram.quantile_us(0.99));
+    w.field("max", histogram.max_us());
+    // [upper bound us, samples] of non empty buckets
+    w.key("buckets");
+    w.begin_array();
+    for (size_t i = 0; i < JITTER_BUCKETS; i++)
+    {
+        uint64_t n = histogram.bucket(i);
+        if (n == 0)
+            continue;
+        w.begin_array();
+        w.value(i == JITTER_BUCKETS - 1 ? histogram.max_us() : JitterHistogram::bucket_limit_us(i));
+        w.value(n);
+        w.end_array();
+    }
+    w.end_array();
+    w.end_object();
+}
+
+void write_publish_stats(JsonWriter &w, const PublishStats &stats, const PublishConfig &config)
+{
+    w.begin_object();
+    w.key("publish");
+    w.begin_object();
+    w.key("mode");
+    w.value_string(config.mode == PublishMode::Event ? "event" : "periodic");
+    w.key("overrun");
+    w.value_string(config.overrun == OverrunPolicy::CatchUp ? "catchup" : "skip");
+    w.field("ticks", stats.ticks.load(std::memory_order_relaxed));
+    w.field("late_ticks", stats.late_ticks.load(std::memory_order_relaxed));
+    w.field("skipped_ticks", stats.skipped_ticks.load(std::memory_order_relaxed));
+    w.field("send_errors", stats.send_errors.load(std::memory_order_relaxed));
+    w.key("jitter_us");
+    write_histogram(w, stats.jitter);
+    w.key("lateness_us");
+    write_histogram(w, stats.lateness);
+    w.key("duration_us");
+    write_histogram(w, stats.duration);
+    w.key("send_us");
+    write_histogram(w, stats.send_time);
+    w.end_object();
+    w.end_object();
+}
+
+static std::string subscriber_name(const TelemDest &dest)
+{
+    if (dest.family() == AF_UNIX)
+        return std::string("unix:") + reinterpret_cast<const struct sockaddr_un *>(&dest.addr)->sun_path;
+    auto *in = reinterpret_cast<const struct sockaddr_in *>(&dest.addr);
+    char ip[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &in->sin_addr, ip, sizeof(ip));
+    return std::string(ip) + ':' + std::to_string(ntohs(in->sin_port));
+}
+
+void write_publish_metrics(MetricsWriter &w, const PublishStats &stats, const SubscriberRegistry &subscribers)
+{
+    using Type = MetricsWriter::Type;
+    w.family("publish_ticks_total", "Publish loop ticks.", Type::Counter);
+    w.sample("publish_ticks_total", "", stats.ticks.load(std::memory_order_relaxed));
+    w.family("publish_overruns_total", "Ticks that finished after the next tick was due.", Type::Counter);
+    w.sample("publish_overruns_total", "", stats.late_ticks.load(std::memory_order_relaxed));
+    w.family("publish_skipped_ticks_total", "Ticks dropped by the overrun policy.", Type::Counter);
+    w.sample("publish_skipped_ticks_total", "", stats.skipped_ticks.load(std::memory_order_relaxed));
+    w.family("publish_send_errors_total", "Telemetry datagrams the kernel refused.", Type::Counter);
+    w.sample("publish_send_errors_total", "", stats.send_errors.load(std::memory_order_relaxed));
+    w.family("publish_tick_duration_seconds", "Work of one publish tick.", Type::Histogram);
+    w.histogram("publish_tick_duration_seconds", "", stats.duration);
+    w.family("publish_send_duration_seconds", "Fan-out of one stream to its subscribers.", Type::Histogram);
+    w.histogram("publish_send_duration_seconds", "", stats.send_time);
+    w.family("publish_lateness_seconds", "How late the sender woke up after a tick deadline.", Type::Histogram);
+    w.histogram("publish_lateness_seconds", "", stats.lateness);
+    w.family("publish_jitter_seconds", "Deviation of the tick interval from the period.", Type::Histogram);
+    w.histogram("publish_jitter_seconds", "", stats.jitter);
+
+    auto list = subscribers.snapshot();
+    w.family("subscribers", "Telemetry subscribers.", Type::Gauge);
+    w.sample("subscribers", "", list->size());
+    std::vector<std::string> labels;
+    labels.reserve(list->size());
+    for (auto &sub : *list)
+        labels.push_back(metric_label("subscriber", subscriber_name(sub.addr)));
+
+    w.family("subscriber_packets_total", "Telemetry datagrams sent to a subscriber.", Type::Counter);
+    for (size_t i = 0; i < list->size(); i++)
+        w.sample("subscriber_packets_total", labels[i], (*list)[i].counters->packets.load(std::memory_order_relaxed));
+    w.family("subscriber_bytes_total", "Telemetry bytes sent to a subscriber.", Type::Counter);
+    for (size_t i = 0; i < list->size(); i++)
+        w.sample("subscriber_bytes_total", labels[i], (*list)[i].counters->bytes.load(std::memory_order_relaxed));
+    w.family("subscriber_send_errors_total", "Telemetry datagrams to a subscriber the kernel refused.", Type::Counter);
+    for (size_t i = 0; i < list->size(); i++)
+        w.sample("subscriber_send_errors_total", labels[i], (*list)[i].counters->errors.load(std::memory_order_relaxed));
+}
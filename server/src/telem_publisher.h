@@ -0,0 +1,119 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+#include "config.h"
+#include "jitter_histogram.h"
+#include "metrics.h"
+#include "subscriber_registry.h"
+#include "telem_binary.h"
+#include "telem_json.h"
+#include "telem_pack.h"
+#include "udp_fanout.h"
+
+#define REFRESH_TELEM 90.0f
+// periodic mode: late ticks sent back to back before the rest is skipped
+#define PUBLISH_MAX_CATCHUP 10
+
+// publish loop counters, written by the sender thread and read by the stats command
+struct PublishStats
+{
+    std::atomic<uint64_t> ticks{0};
+    // ticks whose successor deadline had already passed when they finished
+    std::atomic<uint64_t> late_ticks{0};
+    // ticks dropped by the overrun policy
+    std::atomic<uint64_t> skipped_ticks{0};
+    // periodic mode: deviation of the interval between two ticks from the period
+    JitterHistogram jitter;
+    // periodic mode: how late the sender woke up after a tick deadline
+    JitterHistogram lateness;
+    // work of one tick, housekeeping, serializing and sending
+    JitterHistogram duration;
+    // fan-out of one stream to all its subscribers, every sendmmsg call of it
+    JitterHistogram send_time;
+    // datagrams the kernel refused
+    std::atomic<uint64_t> send_errors{0};
+};
+
+// stats command reply body
+void write_publish_stats(JsonWriter &w, const PublishStats &stats, const PublishConfig &config);
+// publish loop metrics and per subscriber traffic, for MetricsRegistry::add_collector
+void write_publish_metrics(MetricsWriter &w, const PublishStats &stats, const SubscriberRegistry &subscribers);
+
+// UDP telemetry sender.
+// Subscribers with equal profiles (and address family) are grouped into one stream with its own cadence;
+// every due stream is serialized once per tick and fanned out to all its subscribers.
+// In event mode a stream is only due when telemetry changed since its last send
+// (or max_interval passed), and the sender sleeps on the pack until the next update.
+// Periodic mode runs on absolute monotonic deadlines, so send time never adds drift,
+// and ticks missed by a slow send are skipped or caught up per config.overrun.
+// Delta streams send only fields changed since their previous frame, with a full
+// keyframe every profile.keyframe seconds so late joiners and lossy links resync.
+class TelemPublisher
+{
+public:
+    // unix_sockfd sends to unix socket subscribers, -1 if there are none
+    TelemPublisher(int sockfd, int unix_sockfd, TelemPack &pack, SubscriberRegistry &subscribers, PublishStats &stats,
+                   const PublishConfig &config = PublishConfig());
+
+    // publish loop, returns once stop() was called
+    void run();
+    // ends run() after its current tick, callable from any thread
+    void stop() { stop_.store(true, std::memory_order_relaxed); }
+
+private:
+    struct Stream
+    {
+        TelemProfile profile;
+        // AF_INET or AF_UNIX, each family has its own socket
+        int family;
+        UdpFanout fanout;
+        std::chrono::steady_clock::duration period;
+        std::chrono::steady_clock::time_point next_due;
+        std::chrono::steady_clock::time_point last_sent;
+        uint32_t sent_generation = 0;
+        JsonWriter json;
+        uint8_t binary[TELEM_BINARY_MAX_SIZE];
+        size_t binary_size = 0;
+        uint32_t seq = 0;
+        // delta streams: what the receivers got so far
+        TelemData last_frame;
+        std::chrono::steady_clock::time_point next_keyframe;
+        bool has_keyframe = false;
+
+        Stream(int sockfd, int family, const TelemProfile &profile, const PublishConfig &config);
+    };
+
+    void housekeeping(std::chrono::steady_clock::time_point now);
+    void rebuild_streams();
+    bool is_due(const Stream &stream, std::chrono::steady_clock::time_point now, uint32_t generation) const;
+    // deadline is the time the tick was due, new streams start their cadence on it
+    void publish(std::chrono::steady_clock::time_point now, std::chrono::steady_clock::time_point deadline);
+    // moves a passed deadline per overrun policy, returns number of dropped ticks
+    uint64_t on_overrun(std::chrono::steady_clock::time_point &deadline, std::chrono::steady_clock::duration period,
+                        std::chrono::steady_clock::time_point now) const;
+    // event mode: sleeps until a stream can become due
+    void wait_event(uint32_t generation);
+    // fans a payload out to the stream's subscribers, timing it and counting failures
+    void send(Stream &stream, const void *payload, size_t size);
+    // builds the payload of a due stream, reusing one built this tick for the same format and sections
+    void build_payload(Stream &stream, size_t index, const TelemData &pack, uint64_t time_us,
+                       const void *&payload, size_t &size);
+    // builds the next frame of a delta stream, false if nothing changed and no keyframe is due
+    bool build_delta(Stream &stream, std::chrono::steady_clock::time_point now, const TelemData &pack,
+                     uint64_t time_us, const void *&payload, size_t &size);
+
+    int sockfd_;
+    int unix_sockfd_;
+    PublishConfig config_;
+    TelemPack &pack_;
+    SubscriberRegistry &subscribers_;
+    PublishStats &stats_;
+    uint32_t version_ = 0;
+    std::chrono::steady_clock::time_point last_expire_;
+    std::vector<Stream> streams_;
+    std::vector<size_t> due_;
+    std::atomic<bool> stop_{false};
+};
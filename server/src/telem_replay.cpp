@@ -0,0 +1,101 @@
+#include "telem_replay.h"
+#include <chrono>
+#include <thread>
+
+bool TelemReplay::open(const std::string &dir)
+{
+    segments_.clear();
+    for (auto &path : telem_log_segments(dir))
+    {
+        TelemLogReader reader;
+        if (reader.open(path))
+            segments_.push_back(path);
+    }
+    return !segments_.empty();
+}
+
+void TelemReplay::stop()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopped_ = true;
+    wake_.notify_all();
+}
+
+void TelemReplay::run(double speed, int repeat, const Sink &sink)
+{
+    for (int pass = 0; repeat == 0 || pass < repeat; pass++)
+        if (!play(speed, sink))
+            return;
+}
+
+bool TelemReplay::play(double speed, const Sink &sink)
+{
+    bool played = false;
+    bool started = false;
+    uint64_t first_us = 0;
+    auto start = std::chrono::steady_clock::now();
+
+    for (auto &path : segments_)
+    {
+        TelemLogReader reader;
+        if (!reader.open(path))
+            continue;
+
+        TelemLogRecord record;
+        while (reader.next(record))
+        {
+            TelemBinaryHeader hdr;
+            TelemData data;
+            if (!TelemLogReader::decode(record, hdr, data))
+                continue;
+
+            if (!started)
+            {
+                started = true;
+                first_us = record.time_us;
+            }
+            // records of different threads may be slightly out of order, never wait backwards
+            auto due = start;
+            if (speed > 0.0 && record.time_us > first_us)
+                due += std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                    std::chrono::duration<double, std::micro>((record.time_us - first_us) / speed));
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                if (wake_.wait_until(lock, due, [this]()
+                                     { return stopped_; }))
+                    return false;
+            }
+
+            sink(data);
+            samples_++;
+            played = true;
+        }
+    }
+    return played;
+}
+
+ReplayBackend::ReplayBackend(const std::string &dir, double speed, int repeat)
+    : dir_(dir), speed_(speed), repeat_(repeat)
+{
+}
+
+ReplayBackend::~ReplayBackend()
+{
+    replay_.stop();
+    if (thread_.joinable())
+        thread_.join();
+}
+
+bool ReplayBackend::start(TelemUpdate update)
+{
+    if (!replay_.open(dir_))
+        return false;
+
+    // every sample replaces the whole pack, like one callback carrying everything
+    update_ = std::move(update);
+    thread_ = std::thread([this]()
+                          { replay_.run(speed_, repeat_, [this](const TelemData &data)
+                                        { update_([&](TelemData &pack)
+                                                  { pack = data; }); }); });
+    return true;
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "telem_log.h"
+#include "telem_pack.h"
+#include "vehicle_backend.h"
+
+// Plays the telemetry of a flight log (telem_log.h) back into the server.
+//
+// Every telemetry record is handed to the sink with the recorded gaps between them
+// divided by speed; speed 0 plays as fast as the sink takes it. Command records
+// are skipped. Every pass restarts the recorded clock, so repeats play back to back.
+class TelemReplay
+{
+public:
+    using Sink = std::function<void(const TelemData &)>;
+
+    // false when dir holds no readable segment
+    bool open(const std::string &dir);
+
+    // plays repeat passes (0 is forever), returns when done or stopped
+    void run(double speed, int repeat, const Sink &sink);
+    // makes run() return, also from the middle of a wait
+    void stop();
+
+    uint64_t samples() const { return samples_; }
+
+private:
+    // one pass over every segment, false when nothing was played or stopped
+    bool play(double speed, const Sink &sink);
+
+    std::vector<std::string> segments_;
+    uint64_t samples_ = 0;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    bool stopped_ = false;
+};
+
+// A flight log as vehicle: telemetry only, every command fails.
+class ReplayBackend : public VehicleBackend
+{
+public:
+    ReplayBackend(const std::string &dir, double speed, int repeat);
+    ~ReplayBackend() override;
+
+    // false when dir holds no flight log
+    bool start(TelemUpdate update) override;
+    bool controllable() const override { return false; }
+
+    bool arm() override { return false; }
+    bool set_takeoff_altitude(float) override { return false; }
+    bool takeoff() override { return false; }
+    bool land() override { return false; }
+    bool hold() override { return false; }
+    bool return_to_launch() override { return false; }
+    bool goto_location(double, double, float, float) override { return false; }
+    bool set_actuator(int, float) override { return false; }
+
+    bool offboard_start() override { return false; }
+    bool offboard_stop() override { return false; }
+    bool set_velocity_body(float, float, float, float) override { return false; }
+    bool in_offboard() const override { return false; }
+
+private:
+    std::string dir_;
+    double speed_;
+    int repeat_;
+    TelemReplay replay_;
+    TelemUpdate update_;
+    std::thread thread_;
+};
@@ -0,0 +1,201 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "telem_binary.h"
+
+// Shared memory telemetry ring for processes on the same machine.
+//
+// The server writes every telemetry snapshot as a full binary frame (telem_binary.h,
+// all sections, seq = pack generation) into the next slot of a ring in a POSIX shm
+// object. Each slot is a seqlock, head counts published frames, so any number of
+// readers get the latest frame or walk the history without syscalls or locks.
+//
+//  header (64 bytes)
+//   u32 magic, u16 version, u16 slot size, u32 capacity (power of two), u32 reserved
+//   u64 head              frames published so far, frame i lives in slot i % capacity
+//  slots[capacity]
+//   u32 seq               odd while the writer is inside
+//   u32 size              frame bytes
+//   u64 index             frame number held by the slot
+//   frame                 TELEM_BINARY_MAX_SIZE bytes
+//
+// Readers have to reopen the ring after a server restart.
+// This header is the reader library, include it together with telem_binary.h.
+
+#define TELEM_SHM_MAGIC 0x4D485354 // "TSHM"
+#define TELEM_SHM_VERSION 1
+#define TELEM_SHM_DEFAULT_NAME "/mavlink_telem"
+#define TELEM_SHM_DEFAULT_SLOTS 1024
+#define TELEM_SHM_FRAME_WORDS ((TELEM_BINARY_MAX_SIZE + 3) / 4)
+// attempts to copy a slot, a writer that died inside one leaves it odd for good.
+// Readers spin with a cpu pause in between, a frame copy takes the writer well under
+// a microsecond, so this is plenty for a live writer and cheap for a dead one.
+#define TELEM_SHM_READ_RETRIES 4096
+// times latest() starts over when the writer lapped the slot it was reading
+#define TELEM_SHM_LAP_RETRIES 8
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "shm ring needs lock-free 64 bit atomics");
+
+struct alignas(64) TelemShmHeader
+{
+    std::atomic<uint32_t> magic;
+    uint16_t version;
+    uint16_t slot_size;
+    uint32_t capacity;
+    uint32_t reserved;
+    std::atomic<uint64_t> head;
+};
+
+struct alignas(64) TelemShmSlot
+{
+    std::atomic<uint32_t> seq;
+    std::atomic<uint32_t> size;
+    std::atomic<uint64_t> index;
+    // frame bytes as atomic words, like TelemPack, so the copy is no data race
+    std::atomic<uint32_t> frame[TELEM_SHM_FRAME_WORDS];
+};
+
+// tells the cpu this is a spin wait, no syscall unlike sched_yield
+inline void telem_shm_pause()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+    asm volatile("yield");
+#endif
+}
+
+inline size_t telem_shm_size(uint32_t capacity)
+{
+    return sizeof(TelemShmHeader) + (size_t)capacity * sizeof(TelemShmSlot);
+}
+
+inline TelemShmSlot *telem_shm_slots(TelemShmHeader *header)
+{
+    return reinterpret_cast<TelemShmSlot *>(header + 1);
+}
+
+class TelemShmReader
+{
+public:
+    TelemShmReader() = default;
+
+    ~TelemShmReader()
+    {
+        close();
+    }
+
+    TelemShmReader(const TelemShmReader &) = delete;
+    TelemShmReader &operator=(const TelemShmReader &) = delete;
+
+    // false when the ring does not exist (yet) or has an unknown layout
+    bool open(const char *name = TELEM_SHM_DEFAULT_NAME)
+    {
+        close();
+        int fd = shm_open(name, O_RDONLY, 0);
+        if (fd < 0)
+            return false;
+
+        struct stat st;
+        void *map = MAP_FAILED;
+        if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(TelemShmHeader))
+            map = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (map == MAP_FAILED)
+            return false;
+
+        header_ = static_cast<TelemShmHeader *>(map);
+        map_size_ = st.st_size;
+        if (header_->magic.load(std::memory_order_acquire) != TELEM_SHM_MAGIC || header_->version != TELEM_SHM_VERSION ||
+            header_->slot_size != sizeof(TelemShmSlot) || header_->capacity == 0 ||
+            (header_->capacity & (header_->capacity - 1)) != 0 || map_size_ < telem_shm_size(header_->capacity))
+        {
+            close();
+            return false;
+        }
+        slots_ = telem_shm_slots(header_);
+        return true;
+    }
+
+    void close()
+    {
+        if (header_)
+            munmap(header_, map_size_);
+        header_ = nullptr;
+        slots_ = nullptr;
+        map_size_ = 0;
+    }
+
+    bool is_open() const { return header_ != nullptr; }
+    uint32_t capacity() const { return header_->capacity; }
+
+    // frames published so far, also the index the next one gets
+    uint64_t head() const
+    {
+        return header_->head.load(std::memory_order_acquire);
+    }
+
+    // copies frame index into buf (TELEM_BINARY_MAX_SIZE bytes), returns its size or 0
+    // when it is not written yet, already overwritten or the slot never settles
+    size_t read_frame(uint64_t index, uint8_t *buf) const
+    {
+        const TelemShmSlot &slot = slots_[index & (header_->capacity - 1)];
+        uint32_t words[TELEM_SHM_FRAME_WORDS];
+        for (int attempt = 0; attempt < TELEM_SHM_READ_RETRIES; attempt++)
+        {
+            uint32_t seq1 = slot.seq.load(std::memory_order_acquire);
+            if (seq1 & 1)
+            {
+                telem_shm_pause();
+                continue;
+            }
+            uint64_t slot_index = slot.index.load(std::memory_order_relaxed);
+            uint32_t size = slot.size.load(std::memory_order_relaxed);
+            for (size_t i = 0; i < TELEM_SHM_FRAME_WORDS; i++)
+                words[i] = slot.frame[i].load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (slot.seq.load(std::memory_order_relaxed) != seq1)
+                continue;
+
+            if (slot_index != index || size > TELEM_BINARY_MAX_SIZE)
+                return 0;
+            memcpy(buf, words, size);
+            return size;
+        }
+        return 0;
+    }
+
+    bool read(uint64_t index, TelemBinaryHeader &hdr, TelemData &pack) const
+    {
+        uint8_t buf[TELEM_SHM_FRAME_WORDS * 4];
+        size_t size = read_frame(index, buf);
+        return size > 0 && decode_telem_binary(buf, size, hdr, pack);
+    }
+
+    // most recent frame, false before the first one or when none could be read
+    bool latest(TelemBinaryHeader &hdr, TelemData &pack) const
+    {
+        for (int attempt = 0; attempt < TELEM_SHM_LAP_RETRIES; attempt++)
+        {
+            uint64_t head = this->head();
+            if (head == 0)
+                return false;
+            // the writer may lap the slot between reading head and the slot, just retry
+            if (read(head - 1, hdr, pack))
+                return true;
+        }
+        return false;
+    }
+
+private:
+    TelemShmHeader *header_ = nullptr;
+    TelemShmSlot *slots_ = nullptr;
+    size_t map_size_ = 0;
+};
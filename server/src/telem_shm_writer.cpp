@@ -0,0 +1,93 @@
+#include "telem_shm_writer.h"
+#include <chrono>
+
+#define SHM_IDLE_WAIT_MS 1000
+
+TelemShmWriter::~TelemShmWriter()
+{
+    if (header_)
+    {
+        munmap(header_, map_size_);
+        shm_unlink(name_.c_str());
+    }
+}
+
+bool TelemShmWriter::open(const std::string &name, uint32_t capacity)
+{
+    uint32_t slots = 1;
+    while (slots < capacity && slots < (1u << 31))
+        slots <<= 1;
+
+    // a fresh object, readers of a previous run keep their stale mapping
+    shm_unlink(name.c_str());
+    int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0)
+        return false;
+
+    size_t size = telem_shm_size(slots);
+    void *map = MAP_FAILED;
+    if (ftruncate(fd, size) == 0)
+        map = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+    {
+        shm_unlink(name.c_str());
+        return false;
+    }
+
+    // ftruncate zero fills, so every slot starts with seq 0 and no frame
+    name_ = name;
+    header_ = static_cast<TelemShmHeader *>(map);
+    map_size_ = size;
+    slots_ = telem_shm_slots(header_);
+    header_->version = TELEM_SHM_VERSION;
+    header_->slot_size = sizeof(TelemShmSlot);
+    header_->capacity = slots;
+    header_->head.store(0, std::memory_order_relaxed);
+    for (uint32_t i = 0; i < slots; i++)
+        slots_[i].index.store(UINT64_MAX, std::memory_order_relaxed);
+    header_->magic.store(TELEM_SHM_MAGIC, std::memory_order_release);
+    return true;
+}
+
+void TelemShmWriter::write(const uint8_t *frame, size_t size)
+{
+    uint64_t index = header_->head.load(std::memory_order_relaxed);
+    TelemShmSlot &slot = slots_[index & (header_->capacity - 1)];
+
+    uint32_t words[TELEM_SHM_FRAME_WORDS] = {0};
+    memcpy(words, frame, size);
+
+    uint32_t seq = slot.seq.load(std::memory_order_relaxed);
+    slot.seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.index.store(index, std::memory_order_relaxed);
+    slot.size.store(size, std::memory_order_relaxed);
+    for (size_t i = 0; i < TELEM_SHM_FRAME_WORDS; i++)
+        slot.frame[i].store(words[i], std::memory_order_relaxed);
+    slot.seq.store(seq + 2, std::memory_order_release);
+
+    header_->head.store(index + 1, std::memory_order_release);
+}
+
+void TelemShmWriter::run(TelemPack &pack)
+{
+    uint8_t frame[TELEM_BINARY_MAX_SIZE];
+    uint32_t generation = pack.generation();
+    while (true)
+    {
+        uint32_t seen = generation;
+        generation = pack.wait_update(seen, std::chrono::milliseconds(SHM_IDLE_WAIT_MS));
+        if (generation == seen)
+            continue;
+
+        // updates landing meanwhile are in the snapshot, the next wait returns at once for them
+        TelemBinaryHeader hdr;
+        hdr.seq = generation;
+        hdr.time_us = std::chrono::duration_cast<std::chrono::microseconds>(
+                          std::chrono::system_clock::now().time_since_epoch())
+                          .count();
+        size_t size = encode_telem_binary(frame, hdr, pack.snapshot());
+        write(frame, size);
+    }
+}
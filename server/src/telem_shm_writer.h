@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include "telem_pack.h"
+#include "telem_shm.h"
+
+// Server side of the shared memory ring (layout in telem_shm.h).
+class TelemShmWriter
+{
+public:
+    TelemShmWriter() = default;
+    ~TelemShmWriter();
+
+    TelemShmWriter(const TelemShmWriter &) = delete;
+    TelemShmWriter &operator=(const TelemShmWriter &) = delete;
+
+    // (re)creates the shm object, capacity is rounded up to a power of two
+    bool open(const std::string &name, uint32_t capacity);
+
+    // single writer only
+    void write(const uint8_t *frame, size_t size);
+
+    // writes a frame for every new pack generation, never returns
+    void run(TelemPack &pack);
+
+private:
+    std::string name_;
+    TelemShmHeader *header_ = nullptr;
+    TelemShmSlot *slots_ = nullptr;
+    size_t map_size_ = 0;
+};
@@ -0,0 +1,100 @@
+#include "udp_fanout.h"
+#include <algorithm>
+#include <cstring>
+#include <climits>
+
+#ifndef UIO_MAXIOV
+#define UIO_MAXIOV 1024
+#endif
+
+UdpFanout::UdpFanout(int sockfd, int flags)
+    : sockfd_(sockfd), flags_(flags)
+{
+    memset(&iov_, 0, sizeof(iov_));
+}
+
+void UdpFanout::clear()
+{
+    dests_.clear();
+    counters_.clear();
+}
+
+void UdpFanout::add(const TelemDest &addr, std::shared_ptr<SubscriberCounters> counters)
+{
+    dests_.push_back(addr);
+    counters_.push_back(std::move(counters));
+}
+
+static void count_sent(SubscriberCounters *counters, size_t size)
+{
+    if (!counters)
+        return;
+    counters->packets.fetch_add(1, std::memory_order_relaxed);
+    counters->bytes.fetch_add(size, std::memory_order_relaxed);
+}
+
+static void count_error(SubscriberCounters *counters)
+{
+    if (counters)
+        counters->errors.fetch_add(1, std::memory_order_relaxed);
+}
+
+size_t UdpFanout::send(const void *payload, size_t size)
+{
+    last_syscalls_ = 0;
+    if (dests_.empty())
+        return 0;
+
+    iov_.iov_base = const_cast<void *>(payload);
+    iov_.iov_len = size;
+
+#ifdef __linux__
+    // headers only point into dests_ and iov_, so they are rebuilt cheaply every call
+    if (msgs_.size() < dests_.size())
+        msgs_.resize(dests_.size());
+    for (size_t i = 0; i < dests_.size(); i++)
+    {
+        auto &hdr = msgs_[i].msg_hdr;
+        memset(&hdr, 0, sizeof(hdr));
+        hdr.msg_name = &dests_[i].addr;
+        hdr.msg_namelen = dests_[i].len;
+        hdr.msg_iov = &iov_;
+        hdr.msg_iovlen = 1;
+    }
+
+    size_t sent = 0, next = 0;
+    while (next < dests_.size())
+    {
+        unsigned int batch = std::min<size_t>(dests_.size() - next, UIO_MAXIOV);
+        int result = sendmmsg(sockfd_, &msgs_[next], batch, flags_);
+        last_syscalls_++;
+        if (result <= 0)
+        {
+            // first datagram of the batch failed, skip that destination
+            count_error(counters_[next].get());
+            next++;
+            continue;
+        }
+        // the kernel sends in order, the first result destinations got theirs
+        for (int i = 0; i < result; i++)
+            count_sent(counters_[next + i].get(), size);
+        sent += result;
+        next += result;
+    }
+    return sent;
+#else
+    size_t sent = 0;
+    for (size_t i = 0; i < dests_.size(); i++)
+    {
+        if (sendto(sockfd_, payload, size, flags_, (const struct sockaddr *)&dests_[i].addr, dests_[i].len) >= 0)
+        {
+            count_sent(counters_[i].get(), size);
+            sent++;
+        }
+        else
+            count_error(counters_[i].get());
+        last_syscalls_++;
+    }
+    return sent;
+#endif
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include "subscriber_registry.h"
+
+#ifdef __APPLE__
+#define MSG_CONFIRM 0
+#endif
+
+// Sends one payload to a table of pre-resolved destinations.
+// On linux all datagrams of a tick go out in a single sendmmsg call
+// (split in UIO_MAXIOV sized batches), elsewhere it falls back to sendto per destination.
+class UdpFanout
+{
+public:
+    explicit UdpFanout(int sockfd, int flags = 0);
+
+    void clear();
+    // destinations have to match the family of the socket, counters (if any) get what was sent to it
+    void add(const TelemDest &addr, std::shared_ptr<SubscriberCounters> counters = nullptr);
+    size_t size() const { return dests_.size(); }
+
+    // returns number of datagrams handed to the kernel, the rest failed
+    size_t send(const void *payload, size_t size);
+
+    // syscalls made by the last send(), for measuring
+    size_t last_syscalls() const { return last_syscalls_; }
+
+private:
+    int sockfd_;
+    int flags_;
+    std::vector<TelemDest> dests_;
+    std::vector<std::shared_ptr<SubscriberCounters>> counters_;
+#ifdef __linux__
+    std::vector<struct mmsghdr> msgs_;
+#endif
+    struct iovec iov_;
+    size_t last_syscalls_ = 0;
+};
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <functional>
+#include "telem_pack.h"
+
+// counter family backends count their telemetry callbacks in, labeled by stream
+#define BACKEND_CALLBACKS_METRIC "backend_callbacks_total"
+#define BACKEND_CALLBACKS_HELP "Telemetry callbacks of the vehicle backend per stream."
+
+// Where a backend delivers telemetry: fn gets the current data and changes the
+// fields one update carries. Callable from any thread.
+using TelemUpdate = std::function<void(const std::function<void(TelemData &)> &fn)>;
+
+// Everything the server needs from a vehicle: telemetry, action calls and offboard
+// velocity setpoints. Implemented by MavsdkBackend (the autopilot, mavsdk_backend.h),
+// MockBackend (simulated in process, mock_backend.h) and ReplayBackend (a flight log,
+// telem_replay.h), so everything above it runs without MAVSDK or PX4.
+//
+// Commands return true on success and may block until the vehicle acknowledged them,
+// the server calls them from its control thread only.
+class VehicleBackend
+{
+public:
+    virtual ~VehicleBackend() = default;
+
+    // connects and starts delivering telemetry, false when there is no vehicle
+    virtual bool start(TelemUpdate update) = 0;
+
+    // false when commands can never succeed, e.g. when replaying a log
+    virtual bool controllable() const { return true; }
+
+    virtual bool arm() = 0;
+    virtual bool set_takeoff_altitude(float alt_m) = 0;
+    virtual bool takeoff() = 0;
+    virtual bool land() = 0;
+    virtual bool hold() = 0;
+    virtual bool return_to_launch() = 0;
+    // alt_abs_m is amsl
+    virtual bool goto_location(double lat_deg, double lon_deg, float alt_abs_m, float yaw_deg) = 0;
+    virtual bool set_actuator(int index, float value) = 0;
+
+    virtual bool offboard_start() = 0;
+    virtual bool offboard_stop() = 0;
+    // body frame velocity setpoint, only sent, no acknowledgement
+    virtual bool set_velocity_body(float forward_m_s, float right_m_s, float down_m_s, float yawspeed_deg_s) = 0;
+    // the vehicle reports offboard flight mode
+    virtual bool in_offboard() const = 0;
+};
@@ -0,0 +1,694 @@
+#include "websocket_server.h"
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include "../lib/json.hpp"
+
+#define ERROR_CONSOLE_TEXT "\033[31m"
+#define NORMAL_CONSOLE_TEXT "\033[0m"
+
+#define MAX_EVENTS 64
+#define SWEEP_INTERVAL_MS 1000
+
+#define WS_OP_TEXT 0x1
+#define WS_OP_CLOSE 0x8
+#define WS_OP_PING 0x9
+#define WS_OP_PONG 0xA
+
+static bool set_nonblocking(int fd)
+{
+    int flags = fcntl(fd, F_GETFL, 0);
+    return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) >= 0;
+}
+
+static uint32_t rotl(uint32_t x, int n)
+{
+    return (x << n) | (x >> (32 - n));
+}
+
+// only ever hashes handshake keys, no need for speed
+static void sha1(const uint8_t *data, size_t len, uint8_t digest[20])
+{
+    uint32_t h[5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0};
+
+    std::string msg((const char *)data, len);
+    msg.push_back((char)0x80);
+    while (msg.size() % 64 != 56)
+        msg.push_back('\0');
+    uint64_t bits = (uint64_t)len * 8;
+    for (int i = 7; i >= 0; i--)
+        msg.push_back((char)(bits >> (i * 8)));
+
+    for (size_t chunk = 0; chunk < msg.size(); chunk += 64)
+    {
+        uint32_t w[80];
+        const uint8_t *p = (const uint8_t *)msg.data() + chunk;
+        for (int i = 0; i < 16; i++)
+            w[i] = ((uint32_t)p[i * 4] << 24) | ((uint32_t)p[i * 4 + 1] << 16) | ((uint32_t)p[i * 4 + 2] << 8) | p[i * 4 + 3];
+        for (int i = 16; i < 80; i++)
+            w[i] = rotl(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+
+        uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+        for (int i = 0; i < 80; i++)
+        {
+            uint32_t f, k;
+            if (i < 20)
+                f = (b & c) | (~b & d), k = 0x5A827999;
+            else if (i < 40)
+                f = b ^ c ^ d, k = 0x6ED9EBA1;
+            else if (i < 60)
+                f = (b & c) | (b & d) | (c & d), k = 0x8F1BBCDC;
+            else
+                f = b ^ c ^ d, k = 0xCA62C1D6;
+            uint32_t temp = rotl(a, 5) + f + e + k + w[i];
+            e = d;
+            d = c;
+            c = rotl(b, 30);
+            b = a;
+            a = temp;
+        }
+        h[0] += a;
+        h[1] += b;
+        h[2] += c;
+        h[3] += d;
+        h[4] += e;
+    }
+
+    for (int i = 0; i < 5; i++)
+    {
+        digest[i * 4] = h[i] >> 24;
+        digest[i * 4 + 1] = h[i] >> 16;
+        digest[i * 4 + 2] = h[i] >> 8;
+        digest[i * 4 + 3] = h[i];
+    }
+}
+
+static std::string base64(const uint8_t *data, size_t len)
+{
+    static const char table[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    std::string out;
+    for (size_t i = 0; i < len; i += 3)
+    {
+        uint32_t n = (uint32_t)data[i] << 16;
+        if (i + 1 < len)
+            n |= (uint32_t)data[i + 1] << 8;
+        if (i + 2 < len)
+            n |= data[i + 2];
+        out.push_back(table[(n >> 18) & 63]);
+        out.push_back(table[(n >> 12) & 63]);
+        out.push_back(i + 1 < len ? table[(n >> 6) & 63] : '=');
+        out.push_back(i + 2 < len ? table[n & 63] : '=');
+    }
+    return out;
+}
+
+std::string websocket_accept_key(const std::string &key)
+{
+    std::string input = key + "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+    uint8_t digest[20];
+    sha1((const uint8_t *)input.data(), input.size(), digest);
+    return base64(digest, sizeof(digest));
+}
+
+// value of a header in a raw request, name given in lower case, empty if missing
+static std::string header_value(const std::string &request, const char *name)
+{
+    size_t name_len = strlen(name);
+    size_t pos = request.find("\r\n");
+    while (pos != std::string::npos && pos + 2 < request.size())
+    {
+        size_t start = pos + 2;
+        size_t end = request.find("\r\n", start);
+        if (end == std::string::npos || end == start)
+            break;
+        if (end - start > name_len && request[start + name_len] == ':')
+        {
+            bool same = true;
+            for (size_t i = 0; i < name_len && same; i++)
+                same = tolower((unsigned char)request[start + i]) == name[i];
+            if (same)
+            {
+                size_t value = start + name_len + 1;
+                while (value < end && request[value] == ' ')
+                    value++;
+                return request.substr(value, end - value);
+            }
+        }
+        pos = end;
+    }
+    return "";
+}
+
+// value of a query parameter in the request target, false if missing
+static bool query_value(const std::string &target, const char *name, std::string &value)
+{
+    size_t query = target.find('?');
+    if (query == std::string::npos)
+        return false;
+    std::string key = std::string(name) + "=";
+    size_t pos = query + 1;
+    while (pos < target.size())
+    {
+        size_t end = target.find('&', pos);
+        if (end == std::string::npos)
+            end = target.size();
+        if (target.compare(pos, key.size(), key) == 0)
+        {
+            value = target.substr(pos + key.size(), end - pos - key.size());
+            return true;
+        }
+        pos = end + 1;
+    }
+    return false;
+}
+
+// comma separated section names, 0 if any is unknown
+static uint8_t parse_sections(const std::string &list)
+{
+    uint8_t sections = 0;
+    size_t pos = 0;
+    while (pos <= list.size())
+    {
+        size_t end = list.find(',', pos);
+        if (end == std::string::npos)
+            end = list.size();
+        uint8_t section = telem_section_by_name(list.substr(pos, end - pos));
+        if (section == 0)
+            return 0;
+        sections |= section;
+        pos = end + 1;
+    }
+    return sections;
+}
+
+WebSocketServer::WebSocketServer(TelemPack &pack, size_t max_connections)
+    : pack_(pack), max_connections_(max_connections)
+{
+}
+
+WebSocketServer::~WebSocketServer()
+{
+    for (auto &it : viewers_map_)
+        close(it.first);
+    if (listen_fd_ >= 0)
+        close(listen_fd_);
+    if (timer_fd_ >= 0)
+        close(timer_fd_);
+    if (epoll_fd_ >= 0)
+        close(epoll_fd_);
+}
+
+bool WebSocketServer::listen(uint16_t port)
+{
+    int opt = 1;
+    struct sockaddr_in address;
+
+    if ((listen_fd_ = socket(AF_INET, SOCK_STREAM, 0)) < 0 ||
+        setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)))
+    {
+        std::cout << ERROR_CONSOLE_TEXT << "websocket sock failed" << NORMAL_CONSOLE_TEXT << std::endl;
+        return false;
+    }
+
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = INADDR_ANY;
+    address.sin_port = htons(port);
+
+    if (bind(listen_fd_, (struct sockaddr *)&address, sizeof(address)) < 0 ||
+        ::listen(listen_fd_, SOMAXCONN) < 0 || !set_nonblocking(listen_fd_))
+    {
+        std::cout << ERROR_CONSOLE_TEXT << "websocket bind failed" << NORMAL_CONSOLE_TEXT << std::endl;
+        return false;
+    }
+
+    epoll_fd_ = epoll_create1(0);
+    timer_fd_ = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.fd = listen_fd_;
+    bool ok = epoll_fd_ >= 0 && timer_fd_ >= 0 && epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, listen_fd_, &ev) == 0;
+    ev.data.fd = timer_fd_;
+    if (!ok || epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, timer_fd_, &ev) < 0)
+    {
+        std::cout << ERROR_CONSOLE_TEXT << "websocket epoll failed" << NORMAL_CONSOLE_TEXT << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void WebSocketServer::run()
+{
+    struct epoll_event events[MAX_EVENTS];
+    auto last_sweep = std::chrono::steady_clock::now();
+
+    while (!stop_.load(std::memory_order_relaxed))
+    {
+        int count = epoll_wait(epoll_fd_, events, MAX_EVENTS, SWEEP_INTERVAL_MS);
+        if (count < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            std::cout << ERROR_CONSOLE_TEXT << "websocket epoll wait failed" << NORMAL_CONSOLE_TEXT << std::endl;
+            return;
+        }
+
+        bool due = false;
+        for (int i = 0; i < count; i++)
+        {
+            int fd = events[i].data.fd;
+            if (fd == listen_fd_)
+            {
+                accept_all();
+                continue;
+            }
+            if (fd == timer_fd_)
+            {
+                uint64_t expirations;
+                if (read(timer_fd_, &expirations, sizeof(expirations)) < 0)
+                {
+                    // already drained by an earlier rearm
+                }
+                due = true;
+                continue;
+            }
+
+            auto it = viewers_map_.find(fd);
+            if (it == viewers_map_.end())
+                continue;
+            if (events[i].events & EPOLLOUT)
+                flush(it->second);
+            else if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+                on_readable(it->second);
+        }
+
+        auto now = std::chrono::steady_clock::now();
+        if (due)
+            tick(now);
+
+        // browsers which never finished the handshake
+        if (now - last_sweep > std::chrono::milliseconds(SWEEP_INTERVAL_MS))
+        {
+            last_sweep = now;
+            std::vector<int> stale;
+            for (auto &it : viewers_map_)
+            {
+                if (!it.second.upgraded && now - it.second.accepted > std::chrono::milliseconds(WS_HANDSHAKE_TIMEOUT_MS))
+                    stale.push_back(it.first);
+            }
+            for (int fd : stale)
+                close_viewer(fd);
+        }
+        arm_timer(now);
+    }
+}
+
+void WebSocketServer::accept_all()
+{
+    while (true)
+    {
+        int fd = accept(listen_fd_, nullptr, nullptr);
+        if (fd < 0)
+            return;
+
+        int sndbuf = WS_SEND_BUFFER;
+        setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+        if (viewers_map_.size() >= max_connections_ || !set_nonblocking(fd))
+        {
+            close(fd);
+            continue;
+        }
+
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN;
+        ev.data.fd = fd;
+        if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev) < 0)
+        {
+            close(fd);
+            continue;
+        }
+
+        Viewer viewer;
+        viewer.fd = fd;
+        viewer.accepted = std::chrono::steady_clock::now();
+        set_rate(viewer, WS_DEFAULT_RATE);
+        viewers_map_.emplace(fd, std::move(viewer));
+    }
+}
+
+void WebSocketServer::on_readable(Viewer &viewer)
+{
+    char buffer[4096];
+    while (true)
+    {
+        ssize_t len = read(viewer.fd, buffer, sizeof(buffer));
+        if (len > 0)
+        {
+            viewer.in.append(buffer, len);
+            if (viewer.in.size() > WS_MAX_REQUEST + WS_MAX_MESSAGE)
+            {
+                close_viewer(viewer.fd);
+                return;
+            }
+            continue;
+        }
+        if (len < 0 && errno == EINTR)
+            continue;
+        if (len == 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+        {
+            close_viewer(viewer.fd);
+            return;
+        }
+        break;
+    }
+
+    int fd = viewer.fd;
+    if (!viewer.upgraded && !handle_handshake(viewer))
+    {
+        close_viewer(fd);
+        return;
+    }
+    if (viewer.upgraded && !handle_messages(viewer))
+    {
+        close_viewer(fd);
+        return;
+    }
+    flush(viewer);
+}
+
+// false if the request is no valid websocket upgrade
+bool WebSocketServer::handle_handshake(Viewer &viewer)
+{
+    size_t end = viewer.in.find("\r\n\r\n");
+    if (end == std::string::npos)
+        return viewer.in.size() < WS_MAX_REQUEST;
+
+    std::string request = viewer.in.substr(0, end + 2);
+    viewer.in.erase(0, end + 4);
+
+    std::string key = header_value(request, "sec-websocket-key");
+    size_t target_end = request.find(' ', 4);
+    if (request.compare(0, 4, "GET ") != 0 || target_end == std::string::npos || key.empty())
+    {
+        const char *bad = "HTTP/1.1 400 Bad Request\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+        viewer.out.append(bad);
+        viewer.closing = true;
+        return true;
+    }
+    std::string target = request.substr(4, target_end - 4);
+
+    std::string value;
+    float rate = WS_DEFAULT_RATE;
+    if (query_value(target, "rate", value))
+        rate = strtof(value.c_str(), nullptr);
+    if (query_value(target, "fields", value))
+        viewer.sections = parse_sections(value);
+    if (viewer.sections == 0)
+        viewer.sections = TELEM_SECTION_ALL;
+
+    viewer.out.append("HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\nSec-WebSocket-Accept: ");
+    viewer.out.append(websocket_accept_key(key));
+    viewer.out.append("\r\n\r\n");
+    viewer.upgraded = true;
+    viewers_.fetch_add(1, std::memory_order_relaxed);
+
+    set_rate(viewer, rate);
+    viewer.next_due = std::chrono::steady_clock::now();
+    return true;
+}
+
+// runs every complete client frame, false if the client broke the protocol
+bool WebSocketServer::handle_messages(Viewer &viewer)
+{
+    size_t pos = 0;
+    while (!viewer.closing)
+    {
+        const uint8_t *p = (const uint8_t *)viewer.in.data() + pos;
+        size_t avail = viewer.in.size() - pos;
+        if (avail < 2)
+            break;
+
+        bool fin = p[0] & 0x80;
+        uint8_t opcode = p[0] & 0x0F;
+        // clients always mask
+        if (!(p[1] & 0x80))
+            return false;
+        uint64_t len = p[1] & 0x7F;
+        size_t header = 2;
+        if (len == 126)
+        {
+            if (avail < 4)
+                break;
+            len = ((uint64_t)p[2] << 8) | p[3];
+            header = 4;
+        }
+        else if (len == 127)
+        {
+            if (avail < 10)
+                break;
+            len = 0;
+            for (int i = 0; i < 8; i++)
+                len = (len << 8) | p[2 + i];
+            header = 10;
+        }
+        if (!fin || len > WS_MAX_MESSAGE)
+            return false;
+        if (avail < header + 4 + len)
+            break;
+
+        const uint8_t *mask = p + header;
+        std::string payload((const char *)p + header + 4, len);
+        for (size_t i = 0; i < len; i++)
+            payload[i] ^= mask[i % 4];
+        pos += header + 4 + len;
+
+        if (opcode == WS_OP_TEXT)
+            negotiate(viewer, payload);
+        else if (opcode == WS_OP_PING)
+            queue_frame(viewer, WS_OP_PONG, payload.data(), payload.size());
+        else if (opcode == WS_OP_CLOSE)
+        {
+            // echo the status code and let flush() close it
+            queue_frame(viewer, WS_OP_CLOSE, payload.data(), std::min<size_t>(payload.size(), 2));
+            viewer.closing = true;
+        }
+    }
+    viewer.in.erase(0, pos);
+    return true;
+}
+
+void WebSocketServer::negotiate(Viewer &viewer, const std::string &message)
+{
+    auto request = nlohmann::json::parse(message, nullptr, false);
+    if (!request.is_object())
+        return;
+    try
+    {
+        if (request.contains("fields"))
+        {
+            uint8_t sections = 0;
+            for (auto &field : request["fields"])
+                sections |= telem_section_by_name((std::string)field);
+            if (sections != 0)
+                viewer.sections = sections;
+        }
+        if (request.contains("rate"))
+            set_rate(viewer, (float)request["rate"]);
+    }
+    catch (nlohmann::json::exception &)
+    {
+        return;
+    }
+
+    // granted rate goes back as the reply
+    JsonWriter reply;
+    reply.begin_object();
+    reply.field("rate", viewer.rate);
+    reply.end_object();
+    queue_frame(viewer, WS_OP_TEXT, reply.data(), reply.size());
+}
+
+void WebSocketServer::set_rate(Viewer &viewer, float rate)
+{
+    if (!(rate > 0.0f))
+        rate = WS_DEFAULT_RATE;
+    viewer.rate = std::min(rate, WS_MAX_RATE);
+    viewer.period = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double>(1.0 / viewer.rate));
+}
+
+void WebSocketServer::queue_frame(Viewer &viewer, uint8_t opcode, const char *payload, size_t size)
+{
+    if (viewer.out_pos == viewer.out.size())
+    {
+        viewer.out.clear();
+        viewer.out_pos = 0;
+    }
+
+    char header[10];
+    size_t header_len = 2;
+    header[0] = (char)(0x80 | opcode);
+    if (size < 126)
+        header[1] = (char)size;
+    else if (size < 65536)
+    {
+        header[1] = 126;
+        header[2] = (char)(size >> 8);
+        header[3] = (char)size;
+        header_len = 4;
+    }
+    else
+    {
+        header[1] = 127;
+        for (int i = 0; i < 8; i++)
+            header[2 + i] = (char)((uint64_t)size >> ((7 - i) * 8));
+        header_len = 10;
+    }
+    viewer.out.append(header, header_len);
+    viewer.out.append(payload, size);
+}
+
+void WebSocketServer::flush(Viewer &viewer)
+{
+    while (viewer.out_pos < viewer.out.size())
+    {
+        ssize_t len = send(viewer.fd, viewer.out.data() + viewer.out_pos, viewer.out.size() - viewer.out_pos, MSG_NOSIGNAL);
+        if (len > 0)
+        {
+            viewer.out_pos += len;
+            continue;
+        }
+        if (len < 0 && errno == EINTR)
+            continue;
+        if (len < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;
+        close_viewer(viewer.fd);
+        return;
+    }
+
+    bool pending = viewer.out_pos < viewer.out.size();
+    if (!pending)
+    {
+        viewer.out.clear();
+        viewer.out_pos = 0;
+        if (viewer.closing)
+        {
+            close_viewer(viewer.fd);
+            return;
+        }
+    }
+
+    // only watch for writability while something is stuck in the kernel buffer
+    if (pending != viewer.writing)
+    {
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = pending ? EPOLLIN | EPOLLOUT : EPOLLIN;
+        ev.data.fd = viewer.fd;
+        epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, viewer.fd, &ev);
+        viewer.writing = pending;
+    }
+}
+
+void WebSocketServer::close_viewer(int fd)
+{
+    auto it = viewers_map_.find(fd);
+    if (it == viewers_map_.end())
+        return;
+    if (it->second.upgraded)
+        viewers_.fetch_sub(1, std::memory_order_relaxed);
+    epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+    close(fd);
+    viewers_map_.erase(it);
+}
+
+void WebSocketServer::tick(std::chrono::steady_clock::time_point now)
+{
+    TelemData pack;
+    bool have_pack = false;
+    size_t built = 0;
+    due_.clear();
+
+    for (auto &it : viewers_map_)
+    {
+        Viewer &viewer = it.second;
+        if (!viewer.upgraded || viewer.closing || viewer.next_due > now)
+            continue;
+
+        // stay on the viewer's grid, skip ticks missed while the loop was busy
+        viewer.next_due += viewer.period;
+        if (viewer.next_due <= now)
+            viewer.next_due = now + viewer.period;
+
+        // backpressure: the previous sample is still queued, this one is dropped
+        if (viewer.out_pos < viewer.out.size())
+        {
+            frames_dropped_.fetch_add(1, std::memory_order_relaxed);
+            continue;
+        }
+
+        if (!have_pack)
+        {
+            pack = pack_.snapshot();
+            have_pack = true;
+        }
+
+        size_t n = 0;
+        while (n < built && frames_[n].first != viewer.sections)
+            n++;
+        if (n == built)
+        {
+            if (built == frames_.size())
+                frames_.emplace_back();
+            frames_[n].first = viewer.sections;
+            frames_[n].second.clear();
+            write_telem_json(frames_[n].second, pack, viewer.sections);
+            built++;
+        }
+
+        queue_frame(viewer, WS_OP_TEXT, frames_[n].second.data(), frames_[n].second.size());
+        frames_sent_.fetch_add(1, std::memory_order_relaxed);
+        due_.push_back(it.first);
+    }
+
+    // flushing may close viewers, so not while iterating the map
+    for (int fd : due_)
+    {
+        auto it = viewers_map_.find(fd);
+        if (it != viewers_map_.end())
+            flush(it->second);
+    }
+}
+
+void WebSocketServer::arm_timer(std::chrono::steady_clock::time_point now)
+{
+    auto next = std::chrono::steady_clock::time_point::max();
+    for (auto &it : viewers_map_)
+    {
+        if (it.second.upgraded && !it.second.closing)
+            next = std::min(next, it.second.next_due);
+    }
+
+    // zero disarms, a deadline already passed fires right away
+    struct itimerspec spec;
+    memset(&spec, 0, sizeof(spec));
+    if (next != std::chrono::steady_clock::time_point::max())
+    {
+        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::max(next, now).time_since_epoch()).count();
+        spec.it_value.tv_sec = ns / 1000000000;
+        spec.it_value.tv_nsec = ns % 1000000000;
+        if (spec.it_value.tv_sec == 0 && spec.it_value.tv_nsec == 0)
+            spec.it_value.tv_nsec = 1;
+    }
+    timerfd_settime(timer_fd_, TFD_TIMER_ABSTIME, &spec, nullptr);
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "telem_json.h"
+#include "telem_pack.h"
+
+#define WS_MAX_CONNECTIONS 256
+#define WS_MAX_REQUEST 4096
+#define WS_MAX_MESSAGE 4096
+#define WS_DEFAULT_RATE 10.0f
+#define WS_MAX_RATE 50.0f
+#define WS_HANDSHAKE_TIMEOUT_MS 5000
+// small kernel send buffer, so samples of a slow browser back up here and get dropped
+// instead of aging in the socket
+#define WS_SEND_BUFFER 16384
+
+// Sec-WebSocket-Accept value for a Sec-WebSocket-Key (RFC 6455 4.2.2)
+std::string websocket_accept_key(const std::string &key);
+
+// WebSocket endpoint pushing telemetry json to browsers.
+//
+// A browser opens ws://host:port/?rate=10&fields=position,angles and gets one text
+// message per sample at that rate (capped at WS_MAX_RATE). A text message like
+// {"rate": 20, "fields": ["position"]} renegotiates both, the server answers every
+// negotiation with {"rate": <granted>}.
+// Every viewer has at most one unsent message: when it is still queued at the next
+// tick the sample is dropped, so a slow browser only ever gets the latest one.
+// Runs its own epoll loop, one thread serves every viewer.
+class WebSocketServer
+{
+public:
+    // viewers beyond max_connections are turned away at accept
+    explicit WebSocketServer(TelemPack &pack, size_t max_connections = WS_MAX_CONNECTIONS);
+    ~WebSocketServer();
+
+    WebSocketServer(const WebSocketServer &) = delete;
+    WebSocketServer &operator=(const WebSocketServer &) = delete;
+
+    // binds and listens, false on failure
+    bool listen(uint16_t port);
+
+    // event loop, returns once stop() was called or on fatal error
+    void run();
+
+    // run() notices by the next tick, a second at most when nobody watches
+    void stop() { stop_.store(true, std::memory_order_relaxed); }
+
+    size_t viewers() const { return viewers_.load(std::memory_order_relaxed); }
+    uint64_t frames_sent() const { return frames_sent_.load(std::memory_order_relaxed); }
+    uint64_t frames_dropped() const { return frames_dropped_.load(std::memory_order_relaxed); }
+
+private:
+    struct Viewer
+    {
+        int fd;
+        bool upgraded = false;
+        std::string in;
+        std::string out;
+        size_t out_pos = 0;
+        bool writing = false;
+        bool closing = false;
+        float rate = WS_DEFAULT_RATE;
+        uint8_t sections = TELEM_SECTION_ALL;
+        std::chrono::steady_clock::duration period;
+        std::chrono::steady_clock::time_point next_due;
+        std::chrono::steady_clock::time_point accepted;
+    };
+
+    void accept_all();
+    void on_readable(Viewer &viewer);
+    bool handle_handshake(Viewer &viewer);
+    bool handle_messages(Viewer &viewer);
+    void negotiate(Viewer &viewer, const std::string &message);
+    void set_rate(Viewer &viewer, float rate);
+    void queue_frame(Viewer &viewer, uint8_t opcode, const char *payload, size_t size);
+    void flush(Viewer &viewer);
+    void close_viewer(int fd);
+    void tick(std::chrono::steady_clock::time_point now);
+    void arm_timer(std::chrono::steady_clock::time_point now);
+
+    TelemPack &pack_;
+    size_t max_connections_;
+    int listen_fd_ = -1;
+    int epoll_fd_ = -1;
+    int timer_fd_ = -1;
+    std::unordered_map<int, Viewer> viewers_map_;
+    // json built this tick per section mask, shared by viewers with equal fields
+    std::vector<std::pair<uint8_t, JsonWriter>> frames_;
+    std::vector<int> due_;
+    std::atomic<size_t> viewers_{0};
+    std::atomic<uint64_t> frames_sent_{0};
+    std::atomic<uint64_t> frames_dropped_{0};
+    std::atomic<bool> stop_{false};
+};
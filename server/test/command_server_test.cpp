@@ -0,0 +1,128 @@
+// One-shot requests on the command server: when a request counts as complete.
+
+#include <chrono>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <gtest/gtest.h>
+#include "../src/command_server.h"
+
+class CommandServerTest : public ::testing::Test
+{
+protected:
+    void SetUp() override
+    {
+        path = "/tmp/command_server_test_" + std::to_string(getpid()) + ".sock";
+        ASSERT_TRUE(server.listen_unix(path, 0600));
+        thread = std::thread([this]()
+                             { server.run(); });
+    }
+
+    void TearDown() override
+    {
+        server.stop();
+        if (thread.joinable())
+            thread.join();
+    }
+
+    int connect_client()
+    {
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        struct sockaddr_un addr = {};
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+        if (fd >= 0 && connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+        {
+            close(fd);
+            return -1;
+        }
+        return fd;
+    }
+
+    static bool send_all(int fd, const std::string &data)
+    {
+        return send(fd, data.data(), data.size(), MSG_NOSIGNAL) == (ssize_t)data.size();
+    }
+
+    // whatever arrives within timeout_ms, up to EOF
+    static std::string receive(int fd, int timeout_ms)
+    {
+        std::string reply;
+        struct pollfd pfd = {fd, POLLIN, 0};
+        while (poll(&pfd, 1, timeout_ms) == 1)
+        {
+            char buf[512];
+            ssize_t n = recv(fd, buf, sizeof(buf), 0);
+            if (n <= 0)
+                break;
+            reply.append(buf, n);
+        }
+        return reply;
+    }
+
+    std::string path;
+    // answers every request with what it got
+    CommandServer server{[](const std::string &request, const struct sockaddr_in &, CommandServer::Reply reply)
+                         { reply("got " + request); }};
+    std::thread thread;
+};
+
+TEST_F(CommandServerTest, CompleteRequestsAreAnsweredWithoutEof)
+{
+    for (const std::string request : {"get", R"({"command": "offboard_stop"})"})
+    {
+        int fd = connect_client();
+        ASSERT_GE(fd, 0);
+        ASSERT_TRUE(send_all(fd, request));
+        EXPECT_EQ(receive(fd, 2000), "got " + request);
+        close(fd);
+    }
+}
+
+// the old server answered malformed json with a parse error at once, a client that
+// keeps its socket open must not wait for the connection timeout
+TEST_F(CommandServerTest, MalformedJsonIsAnsweredWithoutEof)
+{
+    for (const std::string request : {"{bad", "not json at all", R"({"command": "get",})", R"({"a": 1}})"})
+    {
+        int fd = connect_client();
+        ASSERT_GE(fd, 0);
+        ASSERT_TRUE(send_all(fd, request));
+        auto start = std::chrono::steady_clock::now();
+        EXPECT_EQ(receive(fd, 2000), "got " + request);
+        EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(CONNECTION_TIMEOUT_MS));
+        close(fd);
+    }
+}
+
+// a request cut off in the middle waits for the rest
+TEST_F(CommandServerTest, PartialRequestWaitsForTheRest)
+{
+    for (auto parts : {std::make_pair(std::string("ge"), std::string("t")),
+                       std::make_pair(std::string(R"({"command": "off)"), std::string(R"(board_stop"})")),
+                       std::make_pair(std::string(R"({"command": tr)"), std::string("ue}"))})
+    {
+        int fd = connect_client();
+        ASSERT_GE(fd, 0);
+        ASSERT_TRUE(send_all(fd, parts.first));
+        EXPECT_EQ(receive(fd, 200), "") << parts.first;
+        ASSERT_TRUE(send_all(fd, parts.second));
+        EXPECT_EQ(receive(fd, 2000), "got " + parts.first + parts.second);
+        close(fd);
+    }
+}
+
+// without a complete document the client's EOF ends the request
+TEST_F(CommandServerTest, EofEndsAPartialRequest)
+{
+    int fd = connect_client();
+    ASSERT_GE(fd, 0);
+    ASSERT_TRUE(send_all(fd, R"({"command": )"));
+    shutdown(fd, SHUT_WR);
+    EXPECT_EQ(receive(fd, 2000), R"(got {"command": )");
+    close(fd);
+}
@@ -0,0 +1,217 @@
+// Prometheus text exposition of MetricsRegistry and its HTTP endpoint MetricsServer.
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <gtest/gtest.h>
+#include "../src/metrics.h"
+#include "../src/metrics_server.h"
+
+static std::vector<std::string> lines(const std::string &text)
+{
+    std::vector<std::string> out;
+    std::istringstream in(text);
+    for (std::string line; std::getline(in, line);)
+        out.push_back(line);
+    return out;
+}
+
+static size_t occurrences(const std::string &text, const std::string &what)
+{
+    size_t count = 0;
+    for (size_t pos = text.find(what); pos != std::string::npos; pos = text.find(what, pos + 1))
+        count++;
+    return count;
+}
+
+// the value after the last space of a sample line
+static double value(const std::string &line)
+{
+    return strtod(line.c_str() + line.rfind(' ') + 1, nullptr);
+}
+
+TEST(MetricsTest, LabelValuesAreEscaped)
+{
+    EXPECT_EQ(metric_label("cmd", "plain"), R"(cmd="plain")");
+    EXPECT_EQ(metric_label("cmd", "a\"b\\c\nd"), R"(cmd="a\"b\\c\nd")");
+
+    MetricsRegistry metrics;
+    metrics.counter("requests_total", "Requests.", metric_label("cmd", "say \"hi\"")).inc();
+    EXPECT_NE(metrics.prometheus().find("mavtelem_requests_total{cmd=\"say \\\"hi\\\"\"} 1\n"), std::string::npos);
+}
+
+// counts stay exact where %g would print 1.23456789e+10
+TEST(MetricsTest, IntegersPastNineDigitsAreExact)
+{
+    MetricsRegistry metrics;
+    metrics.counter("big_total", "Big.").inc(12345678901ull);
+    metrics.gauge("negative", "Negative.").set(-9876543210ll);
+    std::string text = metrics.prometheus();
+    EXPECT_NE(text.find("mavtelem_big_total 12345678901\n"), std::string::npos) << text;
+    EXPECT_NE(text.find("mavtelem_negative -9876543210\n"), std::string::npos) << text;
+
+    MetricsWriter w;
+    w.sample("ratio", "", 0.25);
+    EXPECT_EQ(w.str(), "mavtelem_ratio 0.25\n");
+}
+
+TEST(MetricsTest, HistogramBucketsAreCumulative)
+{
+    MetricsRegistry metrics;
+    auto &histogram = metrics.histogram("latency_seconds", "Latency.", metric_label("path", "udp"));
+    for (auto us : {0, 3, 3, 700, 50000, 5000000})
+        histogram.record(std::chrono::microseconds(us));
+
+    double previous = 0, inf = -1, count = -1, sum = -1;
+    size_t buckets = 0;
+    for (auto &line : lines(metrics.prometheus()))
+    {
+        if (line.compare(0, 33, "mavtelem_latency_seconds_bucket{p") == 0)
+        {
+            EXPECT_NE(line.find("{path=\"udp\",le=\""), std::string::npos) << line;
+            EXPECT_GE(value(line), previous) << line;
+            previous = value(line);
+            buckets++;
+            if (line.find("le=\"+Inf\"") != std::string::npos)
+                inf = value(line);
+        }
+        else if (line.compare(0, 30, "mavtelem_latency_seconds_count") == 0)
+            count = value(line);
+        else if (line.compare(0, 28, "mavtelem_latency_seconds_sum") == 0)
+            sum = value(line);
+    }
+    EXPECT_EQ(buckets, (size_t)JITTER_BUCKETS);
+    EXPECT_EQ(inf, 6.0);
+    EXPECT_EQ(count, 6.0);
+    EXPECT_NEAR(sum, 5.050706, 1e-9);
+}
+
+// several label sets and collectors still give every family one HELP and TYPE,
+// followed by all of its samples
+TEST(MetricsTest, OneHelpAndTypePerFamily)
+{
+    MetricsRegistry metrics;
+    metrics.counter("commands_total", "Commands.", metric_label("cmd", "arm")).inc();
+    metrics.counter("commands_total", "Commands.", metric_label("cmd", "land")).inc(2);
+    metrics.gauge("viewers", "Viewers.");
+    metrics.histogram("rtt_seconds", "Rtt.", metric_label("peer", "a"));
+    metrics.histogram("rtt_seconds", "Rtt.", metric_label("peer", "b"));
+    metrics.add_collector([](MetricsWriter &w)
+                          {
+                              w.family("subscribers", "Subscribers.", MetricsWriter::Type::Gauge);
+                              w.sample("subscribers", metric_label("proto", "udp"), 3);
+                              w.sample("subscribers", metric_label("proto", "ws"), 4); });
+
+    std::string text = metrics.prometheus();
+    for (const char *name : {"commands_total", "viewers", "rtt_seconds", "subscribers"})
+    {
+        EXPECT_EQ(occurrences(text, std::string("# HELP mavtelem_") + name + ' '), 1u) << name;
+        EXPECT_EQ(occurrences(text, std::string("# TYPE mavtelem_") + name + ' '), 1u) << name;
+    }
+
+    std::string family;
+    for (auto &line : lines(text))
+    {
+        if (line.compare(0, 7, "# TYPE ") == 0)
+            family = line.substr(7, line.find(' ', 7) - 7);
+        else if (line[0] != '#')
+        {
+            EXPECT_EQ(line.compare(0, family.size(), family), 0) << line << " after " << family;
+        }
+    }
+}
+
+// the registry lock is not held while collectors run
+TEST(MetricsTest, CollectorMayRegisterMetrics)
+{
+    MetricsRegistry metrics;
+    metrics.add_collector([&metrics](MetricsWriter &)
+                          { metrics.counter("scrapes_total", "Scrapes.").inc(); });
+    EXPECT_EQ(metrics.prometheus().find("scrapes_total"), std::string::npos);
+    EXPECT_NE(metrics.prometheus().find("mavtelem_scrapes_total 1\n"), std::string::npos);
+}
+
+class MetricsServerTest : public ::testing::Test
+{
+protected:
+    void SetUp() override
+    {
+        metrics.counter("up_total", "Up.").inc(7);
+
+        // a port the kernel just handed out is very likely still free
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        struct sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t len = sizeof(addr);
+        ASSERT_EQ(bind(fd, (struct sockaddr *)&addr, sizeof(addr)), 0);
+        ASSERT_EQ(getsockname(fd, (struct sockaddr *)&addr, &len), 0);
+        close(fd);
+        port = ntohs(addr.sin_port);
+
+        ASSERT_TRUE(server.listen("127.0.0.1", port));
+        thread = std::thread([this]()
+                             { server.run(); });
+    }
+
+    void TearDown() override
+    {
+        server.stop();
+        if (thread.joinable())
+            thread.join();
+    }
+
+    // the whole response, the server closes after one
+    std::string request(const std::string &text)
+    {
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        struct sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        std::string response;
+        if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0 &&
+            send(fd, text.data(), text.size(), MSG_NOSIGNAL) == (ssize_t)text.size())
+        {
+            char buf[4096];
+            ssize_t n;
+            while ((n = recv(fd, buf, sizeof(buf), 0)) > 0)
+                response.append(buf, n);
+        }
+        close(fd);
+        return response;
+    }
+
+    MetricsRegistry metrics;
+    MetricsServer server{metrics};
+    uint16_t port = 0;
+    std::thread thread;
+};
+
+TEST_F(MetricsServerTest, ServesTheExposition)
+{
+    std::string response = request("GET /metrics HTTP/1.1\r\nHost: localhost\r\n\r\n");
+    EXPECT_EQ(response.compare(0, 15, "HTTP/1.1 200 OK"), 0) << response;
+    EXPECT_NE(response.find("Content-Type: text/plain; version=0.0.4"), std::string::npos);
+
+    std::string body = metrics.prometheus();
+    EXPECT_NE(response.find("Content-Length: " + std::to_string(body.size()) + "\r\n"), std::string::npos);
+    EXPECT_EQ(response.substr(response.find("\r\n\r\n") + 4), body);
+
+    EXPECT_EQ(request("GET /metrics?name=x HTTP/1.1\r\n\r\n").compare(0, 15, "HTTP/1.1 200 OK"), 0);
+}
+
+TEST_F(MetricsServerTest, OtherRequestsFail)
+{
+    EXPECT_EQ(request("GET / HTTP/1.1\r\n\r\n").compare(0, 22, "HTTP/1.1 404 Not Found"), 0);
+    EXPECT_EQ(request("GET /metricsx HTTP/1.1\r\n\r\n").compare(0, 22, "HTTP/1.1 404 Not Found"), 0);
+    EXPECT_EQ(request("POST /metrics HTTP/1.1\r\n\r\n").compare(0, 31, "HTTP/1.1 405 Method Not Allowed"), 0);
+}
@@ -0,0 +1,158 @@
+// Multicast telemetry on the loopback interface, one datagram for several receivers.
+
+#include <arpa/inet.h>
+#include <chrono>
+#include <cstring>
+#include <poll.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+#include <gtest/gtest.h>
+#include "../src/multicast.h"
+#include "../src/telem_binary.h"
+#include "../src/telem_publisher.h"
+
+#define TEST_GROUP "239.255.77.77"
+#define TEST_RECEIVERS 4
+
+TEST(MulticastTest, SenderRejectsBadSettings)
+{
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    ASSERT_GE(fd, 0);
+    struct sockaddr_in dest;
+    EXPECT_FALSE(multicast_setup_sender(fd, "192.168.1.1", 6970, 1, "", dest));
+    EXPECT_FALSE(multicast_setup_sender(fd, "not an address", 6970, 1, "", dest));
+    EXPECT_FALSE(multicast_setup_sender(fd, TEST_GROUP, 0, 1, "", dest));
+    EXPECT_FALSE(multicast_setup_sender(fd, TEST_GROUP, 6970, 256, "", dest));
+    EXPECT_FALSE(multicast_setup_sender(fd, TEST_GROUP, 6970, 1, "no-such-interface0", dest));
+
+    ASSERT_TRUE(multicast_setup_sender(fd, TEST_GROUP, 6970, 1, "", dest));
+    char group[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &dest.sin_addr, group, sizeof(group));
+    EXPECT_STREQ(group, TEST_GROUP);
+    EXPECT_EQ(ntohs(dest.sin_port), 6970);
+    close(fd);
+}
+
+TEST(MulticastTest, JoinRejectsUnicastGroups)
+{
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    ASSERT_GE(fd, 0);
+    EXPECT_FALSE(multicast_join(fd, "127.0.0.1", ""));
+    EXPECT_FALSE(multicast_join(fd, TEST_GROUP, "no-such-interface0"));
+    close(fd);
+}
+
+// receivers sharing the group port, joined over loopback
+class MulticastLoopbackTest : public ::testing::Test
+{
+protected:
+    void SetUp() override
+    {
+        uint16_t port = 0;
+        for (int i = 0; i < TEST_RECEIVERS; i++)
+        {
+            int fd = socket(AF_INET, SOCK_DGRAM, 0);
+            ASSERT_GE(fd, 0);
+            receivers.push_back(fd);
+            int on = 1;
+            setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+            // the first receiver picks a free port, the others share it
+            struct sockaddr_in addr = {};
+            addr.sin_family = AF_INET;
+            addr.sin_addr.s_addr = htonl(INADDR_ANY);
+            addr.sin_port = htons(port);
+            socklen_t len = sizeof(addr);
+            ASSERT_EQ(bind(fd, (struct sockaddr *)&addr, len), 0);
+            ASSERT_EQ(getsockname(fd, (struct sockaddr *)&addr, &len), 0);
+            port = ntohs(addr.sin_port);
+
+            if (!multicast_join(fd, TEST_GROUP, "127.0.0.1"))
+                GTEST_SKIP() << "cannot join " << TEST_GROUP << " on loopback: " << strerror(errno);
+        }
+
+        sender = socket(AF_INET, SOCK_DGRAM, 0);
+        ASSERT_GE(sender, 0);
+        ASSERT_TRUE(multicast_setup_sender(sender, TEST_GROUP, port, 0, "127.0.0.1", group));
+        // a probe tells whether the kernel routes multicast over loopback at all
+        if (sendto(sender, "probe", 5, 0, (struct sockaddr *)&group, sizeof(group)) < 0 || !receive_all(nullptr, 0))
+            GTEST_SKIP() << "no multicast over loopback here";
+    }
+
+    void TearDown() override
+    {
+        for (int fd : receivers)
+            close(fd);
+        if (sender >= 0)
+            close(sender);
+    }
+
+    // one datagram on every receiver within a second, the first size bytes of each go to frames if given
+    bool receive_all(std::vector<std::vector<uint8_t>> *frames, size_t size)
+    {
+        for (size_t i = 0; i < receivers.size(); i++)
+        {
+            struct pollfd pfd = {receivers[i], POLLIN, 0};
+            if (poll(&pfd, 1, 1000) != 1)
+                return false;
+            uint8_t buf[2048];
+            ssize_t n = recv(receivers[i], buf, sizeof(buf), 0);
+            if (n <= 0)
+                return false;
+            if (frames)
+                (*frames)[i].assign(buf, buf + std::min((size_t)n, size));
+        }
+        return true;
+    }
+
+    std::vector<int> receivers;
+    int sender = -1;
+    struct sockaddr_in group = {};
+};
+
+// the publisher sends the group one datagram per tick, as for a single subscriber,
+// and every receiver gets the same frames in order
+TEST_F(MulticastLoopbackTest, EveryReceiverGetsEveryFrame)
+{
+    TelemPack pack;
+    pack.update([](TelemData &d)
+                { d.latitude = 47.397742; });
+    SubscriberRegistry registry;
+    PublishStats stats;
+    TelemProfile profile;
+    profile.format = TelemFormat::Binary;
+    registry.add(TelemDest::inet(group), profile, std::chrono::milliseconds(0));
+
+    TelemPublisher publisher(sender, -1, pack, registry, stats);
+    std::thread thread([&publisher]()
+                       { publisher.run(); });
+
+    // failures only break out, the publisher thread has to be joined either way
+    std::vector<std::vector<uint8_t>> frames(receivers.size());
+    uint32_t first_seq = 0;
+    for (int n = 0; n < 20; n++)
+    {
+        if (!receive_all(&frames, TELEM_BINARY_MAX_SIZE))
+        {
+            ADD_FAILURE() << "frame " << n << " did not reach every receiver";
+            break;
+        }
+        TelemBinaryHeader hdr;
+        TelemData data;
+        EXPECT_TRUE(decode_telem_binary(frames[0].data(), frames[0].size(), hdr, data));
+        for (size_t i = 1; i < frames.size(); i++)
+            EXPECT_EQ(frames[i], frames[0]) << "receiver " << i;
+        if (n == 0)
+            first_seq = hdr.seq;
+        EXPECT_EQ(hdr.seq, first_seq + n);
+        EXPECT_NEAR(data.latitude, 47.397742, 1e-6);
+    }
+
+    publisher.stop();
+    thread.join();
+    // one stream, one destination, whatever the number of receivers
+    auto list = registry.snapshot();
+    ASSERT_EQ(list->size(), 1u);
+    EXPECT_EQ(stats.send_errors.load(), 0u);
+    EXPECT_GE(list->at(0).counters->packets.load(), 20u);
+}
@@ -0,0 +1,158 @@
+// Offboard watchdog on a clock the test moves by hand.
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <gtest/gtest.h>
+#include "../src/offboard_watchdog.h"
+
+using std::chrono::milliseconds;
+
+// steady clock that only moves when told to
+struct FakeClock
+{
+    using duration = std::chrono::nanoseconds;
+    using rep = duration::rep;
+    using period = duration::period;
+    using time_point = std::chrono::time_point<FakeClock>;
+    static constexpr bool is_steady = true;
+
+    static std::atomic<rep> ticks;
+
+    static time_point now() { return time_point(duration(ticks.load())); }
+    static void advance(duration d) { ticks.fetch_add(d.count()); }
+};
+
+std::atomic<FakeClock::rep> FakeClock::ticks{0};
+
+using Watchdog = BasicOffboardWatchdog<FakeClock>;
+
+class OffboardWatchdogTest : public ::testing::Test
+{
+protected:
+    void SetUp() override
+    {
+        // time starts away from zero, which is also what a never fed watchdog holds
+        FakeClock::ticks = std::chrono::nanoseconds(std::chrono::hours(1)).count();
+    }
+};
+
+TEST_F(OffboardWatchdogTest, DisarmedNeverTimesOut)
+{
+    Watchdog watchdog(milliseconds(2000));
+    EXPECT_FALSE(watchdog.armed());
+    FakeClock::advance(std::chrono::hours(1));
+    EXPECT_FALSE(watchdog.check(FakeClock::now()));
+}
+
+TEST_F(OffboardWatchdogTest, TimesOutOnceAfterTheTimeout)
+{
+    Watchdog watchdog(milliseconds(2000));
+    watchdog.arm();
+    EXPECT_TRUE(watchdog.armed());
+    EXPECT_EQ(watchdog.deadline(), FakeClock::now() + milliseconds(2000));
+
+    FakeClock::advance(milliseconds(1999));
+    EXPECT_FALSE(watchdog.check(FakeClock::now()));
+    FakeClock::advance(milliseconds(1));
+    EXPECT_TRUE(watchdog.check(FakeClock::now()));
+
+    // expiry disarms, later checks stay quiet
+    EXPECT_FALSE(watchdog.armed());
+    FakeClock::advance(milliseconds(5000));
+    EXPECT_FALSE(watchdog.check(FakeClock::now()));
+}
+
+TEST_F(OffboardWatchdogTest, FeedingMovesTheDeadline)
+{
+    Watchdog watchdog(milliseconds(2000));
+    watchdog.arm();
+    // commands every 1.5 s keep it alive for as long as they come
+    for (int i = 0; i < 10; i++)
+    {
+        FakeClock::advance(milliseconds(1500));
+        EXPECT_FALSE(watchdog.check(FakeClock::now()));
+        watchdog.feed();
+    }
+    EXPECT_EQ(watchdog.deadline(), FakeClock::now() + milliseconds(2000));
+
+    FakeClock::advance(milliseconds(2000));
+    EXPECT_TRUE(watchdog.check(FakeClock::now()));
+}
+
+TEST_F(OffboardWatchdogTest, DisarmStopsWatching)
+{
+    Watchdog watchdog(milliseconds(2000));
+    watchdog.arm();
+    watchdog.disarm();
+    FakeClock::advance(milliseconds(3000));
+    EXPECT_FALSE(watchdog.check(FakeClock::now()));
+}
+
+TEST_F(OffboardWatchdogTest, RearmStartsAFreshTimeout)
+{
+    Watchdog watchdog(milliseconds(2000));
+    watchdog.arm();
+    FakeClock::advance(milliseconds(2500));
+    ASSERT_TRUE(watchdog.check(FakeClock::now()));
+
+    // the next offboard_start must not inherit the old, passed deadline
+    watchdog.arm();
+    EXPECT_TRUE(watchdog.armed());
+    EXPECT_FALSE(watchdog.check(FakeClock::now()));
+    FakeClock::advance(milliseconds(1999));
+    EXPECT_FALSE(watchdog.check(FakeClock::now()));
+    FakeClock::advance(milliseconds(1));
+    EXPECT_TRUE(watchdog.check(FakeClock::now()));
+
+    // arming an armed watchdog only feeds it
+    watchdog.arm();
+    FakeClock::advance(milliseconds(1000));
+    watchdog.arm();
+    FakeClock::advance(milliseconds(1500));
+    EXPECT_FALSE(watchdog.check(FakeClock::now()));
+}
+
+// run() calls on_timeout once per expiry, from its own thread, with the fake clock
+// deciding when the deadline passed
+TEST_F(OffboardWatchdogTest, RunReportsEveryExpiry)
+{
+    // short, run() sleeps for real until the fake deadline before looking at the clock again
+    Watchdog watchdog(milliseconds(20));
+    std::mutex mutex;
+    std::condition_variable cv;
+    int timeouts = 0;
+    std::thread thread([&]()
+                       { watchdog.run([&]()
+                                      {
+                                          std::lock_guard<std::mutex> lock(mutex);
+                                          timeouts++;
+                                          cv.notify_all(); }); });
+    auto wait_for = [&](int n)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        return cv.wait_for(lock, std::chrono::seconds(5), [&]()
+                           { return timeouts >= n; });
+    };
+
+    watchdog.arm();
+    // real time passing does not count, only the fake clock does
+    std::this_thread::sleep_for(milliseconds(100));
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        EXPECT_EQ(timeouts, 0);
+    }
+    FakeClock::advance(milliseconds(20));
+    EXPECT_TRUE(wait_for(1));
+    EXPECT_FALSE(watchdog.armed());
+
+    watchdog.arm();
+    FakeClock::advance(milliseconds(20));
+    EXPECT_TRUE(wait_for(2));
+
+    watchdog.stop();
+    thread.join();
+    EXPECT_EQ(timeouts, 2);
+}
@@ -0,0 +1,228 @@
+// Leases and limits of the subscriber registry, and writers racing the publish loop.
+
+#include <arpa/inet.h>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+#include <gtest/gtest.h>
+#include "../src/subscriber_registry.h"
+#include "../src/telem_publisher.h"
+
+using Result = SubscriberRegistry::Result;
+using std::chrono::milliseconds;
+
+static TelemDest dest(uint16_t port)
+{
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    return TelemDest::inet(addr);
+}
+
+TEST(SubscriberRegistryTest, AddingTwiceRenews)
+{
+    SubscriberRegistry registry;
+    TelemProfile json, binary;
+    binary.format = TelemFormat::Binary;
+
+    EXPECT_EQ(registry.add(dest(7000), json, milliseconds(0)), Result::Added);
+    auto counters = registry.snapshot()->at(0).counters;
+    EXPECT_EQ(registry.add(dest(7000), binary, milliseconds(0)), Result::Renewed);
+
+    auto list = registry.snapshot();
+    ASSERT_EQ(list->size(), 1u);
+    EXPECT_EQ(list->at(0).profile.format, TelemFormat::Binary);
+    EXPECT_EQ(list->at(0).counters, counters);
+}
+
+TEST(SubscriberRegistryTest, FullRegistryRefusesNewcomers)
+{
+    SubscriberRegistry registry(2);
+    TelemProfile profile;
+    EXPECT_EQ(registry.add(dest(7000), profile, milliseconds(0)), Result::Added);
+    EXPECT_EQ(registry.add(dest(7001), profile, milliseconds(0)), Result::Added);
+    EXPECT_EQ(registry.add(dest(7002), profile, milliseconds(0)), Result::Full);
+    // members still renew
+    EXPECT_EQ(registry.add(dest(7001), profile, milliseconds(0)), Result::Renewed);
+
+    EXPECT_TRUE(registry.remove(dest(7000)));
+    EXPECT_EQ(registry.add(dest(7002), profile, milliseconds(0)), Result::Added);
+}
+
+TEST(SubscriberRegistryTest, RemoveBumpsTheVersion)
+{
+    SubscriberRegistry registry;
+    registry.add(dest(7000), TelemProfile(), milliseconds(0));
+    uint32_t version = registry.version();
+
+    EXPECT_FALSE(registry.remove(dest(7001)));
+    EXPECT_EQ(registry.version(), version);
+    EXPECT_TRUE(registry.remove(dest(7000)));
+    EXPECT_NE(registry.version(), version);
+    EXPECT_TRUE(registry.snapshot()->empty());
+}
+
+TEST(SubscriberRegistryTest, RenewOnlyKnowsSubscribers)
+{
+    SubscriberRegistry registry;
+    EXPECT_EQ(registry.renew(dest(7000), milliseconds(1000)), Result::NotFound);
+    EXPECT_TRUE(registry.snapshot()->empty());
+
+    registry.add(dest(7000), TelemProfile(), milliseconds(1000));
+    uint32_t version = registry.version();
+    auto before = registry.snapshot()->at(0).expires;
+    EXPECT_EQ(registry.renew(dest(7000), milliseconds(60000)), Result::Renewed);
+    EXPECT_GT(registry.snapshot()->at(0).expires, before);
+    // the sender does not care about lease times
+    EXPECT_EQ(registry.version(), version);
+}
+
+TEST(SubscriberRegistryTest, ExpiredLeaseCannotBeRenewed)
+{
+    SubscriberRegistry registry;
+    registry.add(dest(7000), TelemProfile(), milliseconds(1));
+    std::this_thread::sleep_for(milliseconds(5));
+
+    // still listed, nobody pruned it yet
+    ASSERT_EQ(registry.snapshot()->size(), 1u);
+    EXPECT_EQ(registry.renew(dest(7000), milliseconds(60000)), Result::NotFound);
+
+    registry.expire(std::chrono::steady_clock::now());
+    EXPECT_TRUE(registry.snapshot()->empty());
+    // adding again is how a client comes back
+    EXPECT_EQ(registry.add(dest(7000), TelemProfile(), milliseconds(60000)), Result::Added);
+}
+
+TEST(SubscriberRegistryTest, ZeroLeaseNeverExpires)
+{
+    SubscriberRegistry registry;
+    registry.add(dest(7000), TelemProfile(), milliseconds(0));
+    registry.add(dest(7001), TelemProfile(), milliseconds(-1));
+
+    registry.expire(std::chrono::steady_clock::now() + std::chrono::hours(24 * 365));
+    auto list = registry.snapshot();
+    ASSERT_EQ(list->size(), 1u);
+    EXPECT_TRUE(list->at(0).addr == dest(7000));
+}
+
+// Writers add, renew and remove subscribers in a tight loop while the publisher
+// sends every pack update, rebuilding its streams on nearly every tick.
+TEST(SubscriberRegistryTest, WritersRaceTheSender)
+{
+    const int sink_count = 32;
+    const size_t max_size = 16;
+    std::vector<int> sinks;
+    std::vector<TelemDest> dests;
+    for (int i = 0; i < sink_count; i++)
+    {
+        int fd = socket(AF_INET, SOCK_DGRAM, 0);
+        ASSERT_GE(fd, 0);
+        struct sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t len = sizeof(addr);
+        ASSERT_EQ(bind(fd, (struct sockaddr *)&addr, len), 0);
+        getsockname(fd, (struct sockaddr *)&addr, &len);
+        sinks.push_back(fd);
+        dests.push_back(TelemDest::inet(addr));
+    }
+    int sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+    ASSERT_GE(sockfd, 0);
+
+    TelemPack pack;
+    SubscriberRegistry registry(max_size);
+    PublishStats stats;
+    PublishConfig config;
+    config.mode = PublishMode::Event;
+    TelemPublisher publisher(sockfd, -1, pack, registry, stats, config);
+    std::thread sender([&publisher]()
+                       { publisher.run(); });
+
+    std::atomic<bool> stop{false};
+    std::thread updater([&pack, &stop]()
+                        {
+                            for (double lat = 0.0; !stop.load(std::memory_order_relaxed); lat += 1e-6)
+                            {
+                                pack.update([lat](TelemData &d)
+                                            { d.latitude = lat; });
+                                std::this_thread::sleep_for(std::chrono::microseconds(200));
+                            } });
+
+    std::atomic<uint64_t> ops{0}, full{0};
+    std::vector<std::thread> writers;
+    for (int w = 0; w < 4; w++)
+    {
+        writers.emplace_back([&, w]()
+                             {
+                                 std::mt19937 rng(w);
+                                 while (!stop.load(std::memory_order_relaxed))
+                                 {
+                                     const TelemDest &addr = dests[rng() % dests.size()];
+                                     TelemProfile profile;
+                                     profile.format = rng() % 2 ? TelemFormat::Binary : TelemFormat::Json;
+                                     profile.rate = (float)(rng() % 4 * 30);
+                                     profile.sections = (uint8_t)(rng() % TELEM_SECTION_ALL + 1);
+                                     profile.keyframe = rng() % 3 == 0 ? 0.5f : 0.0f;
+                                     // leases of a few ms keep expire() busy too
+                                     milliseconds lease(rng() % 3 == 0 ? 0 : (int)(rng() % 20));
+                                     switch (rng() % 3)
+                                     {
+                                     case 0:
+                                         if (registry.add(addr, profile, lease) == Result::Full)
+                                             full.fetch_add(1, std::memory_order_relaxed);
+                                         break;
+                                     case 1:
+                                         registry.renew(addr, lease);
+                                         break;
+                                     default:
+                                         registry.remove(addr);
+                                     }
+                                     if (rng() % 64 == 0)
+                                         registry.expire(std::chrono::steady_clock::now());
+                                     ops.fetch_add(1, std::memory_order_relaxed);
+                                 } });
+    }
+
+    // every published list is within the cap and has each destination at most once
+    bool consistent = true;
+    auto end = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+    while (std::chrono::steady_clock::now() < end)
+    {
+        auto list = registry.snapshot();
+        if (list->size() > max_size)
+            consistent = false;
+        for (size_t i = 0; i < list->size(); i++)
+            for (size_t j = i + 1; j < list->size(); j++)
+                if ((*list)[i].addr == (*list)[j].addr)
+                    consistent = false;
+        std::this_thread::yield();
+    }
+
+    stop = true;
+    for (auto &t : writers)
+        t.join();
+    updater.join();
+    publisher.stop();
+    sender.join();
+
+    EXPECT_TRUE(consistent);
+    EXPECT_GT(ops.load(), 1000u);
+    EXPECT_GT(full.load(), 0u);
+    EXPECT_GT(stats.ticks.load(), 100u);
+
+    // the sender kept delivering through all of it
+    uint64_t received = 0;
+    char buf[TELEM_BINARY_MAX_SIZE + 1024];
+    for (int fd : sinks)
+    {
+        while (recv(fd, buf, sizeof(buf), MSG_DONTWAIT) > 0)
+            received++;
+        close(fd);
+    }
+    close(sockfd);
+    EXPECT_GT(received, 0u);
+}
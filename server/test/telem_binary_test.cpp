@@ -0,0 +1,249 @@
+// Binary frames encoded and decoded back, and decoding of damaged frames.
+
+#include <cmath>
+#include <cstring>
+#include <random>
+#include <gtest/gtest.h>
+#include "../src/telem_binary.h"
+
+static TelemData sample_data()
+{
+    TelemData d;
+    d.latitude = 47.3977419;
+    d.longitude = -122.0840575;
+    d.abs_alt = 493.251f;
+    d.rel_alt = -5.25f;
+    d.vel_north = 1.53f;
+    d.vel_east = -0.25f;
+    d.vel_down = 0.1f;
+    d.airspeed = 12.34f;
+    d.climb_rate = -0.1f;
+    d.pitch_deg = -4.5f;
+    d.roll_deg = 0.75f;
+    d.yaw_deg = 179.99f;
+    d.batt_percentage = 0.87f;
+    d.batt_voltage = 12.345f;
+    d.isAllOk = true;
+    d.isArmed = false;
+    d.inAir = true;
+    return d;
+}
+
+// decoded values are within half a quantization step of the encoded ones
+static void expect_near(const TelemData &a, const TelemData &b, uint32_t fields)
+{
+    auto near = [fields](uint32_t field, double x, double y, double step)
+    {
+        if (!(fields & field))
+            return;
+        // float rounding of the decoded value on top of the step
+        EXPECT_NEAR(x, y, step / 2 + std::fabs(x) * 1e-7) << "field " << field;
+    };
+    near(TELEM_FIELD_LAT, a.latitude, b.latitude, 1e-7);
+    near(TELEM_FIELD_LON, a.longitude, b.longitude, 1e-7);
+    near(TELEM_FIELD_ALT_ABS, a.abs_alt, b.abs_alt, 1e-3);
+    near(TELEM_FIELD_ALT_REL, a.rel_alt, b.rel_alt, 1e-3);
+    near(TELEM_FIELD_VEL_NORTH, a.vel_north, b.vel_north, 1e-2);
+    near(TELEM_FIELD_VEL_EAST, a.vel_east, b.vel_east, 1e-2);
+    near(TELEM_FIELD_VEL_DOWN, a.vel_down, b.vel_down, 1e-2);
+    near(TELEM_FIELD_AIRSPEED, a.airspeed, b.airspeed, 1e-2);
+    near(TELEM_FIELD_CLIMB_RATE, a.climb_rate, b.climb_rate, 1e-2);
+    near(TELEM_FIELD_PITCH, a.pitch_deg, b.pitch_deg, 1e-2);
+    near(TELEM_FIELD_ROLL, a.roll_deg, b.roll_deg, 1e-2);
+    near(TELEM_FIELD_YAW, a.yaw_deg, b.yaw_deg, 1e-2);
+    near(TELEM_FIELD_BATT_PERCENT, a.batt_percentage, b.batt_percentage, 0.0);
+    near(TELEM_FIELD_BATT_VOLTAGE, a.batt_voltage, b.batt_voltage, 1e-3);
+    if (!(fields & TELEM_FIELD_MISC))
+        return;
+    EXPECT_EQ(a.isAllOk, b.isAllOk);
+    EXPECT_EQ(a.isArmed, b.isArmed);
+    EXPECT_EQ(a.inAir, b.inAir);
+}
+
+TEST(TelemBinaryTest, FullFrameRoundTrip)
+{
+    TelemBinaryHeader hdr;
+    hdr.seq = 0xDEADBEEF;
+    hdr.time_us = 1700000000123456ull;
+    TelemData in = sample_data();
+
+    uint8_t buf[TELEM_BINARY_MAX_SIZE];
+    size_t len = encode_telem_binary(buf, hdr, in);
+    EXPECT_LE(len + 4, (size_t)TELEM_BINARY_MAX_SIZE);
+    EXPECT_EQ(len, TELEM_BINARY_HEADER_SIZE + telem_binary_body_size(TELEM_FIELD_ALL));
+
+    TelemBinaryHeader out_hdr;
+    TelemData out;
+    ASSERT_TRUE(decode_telem_binary(buf, len, out_hdr, out));
+    EXPECT_EQ(out_hdr.version, TELEM_BINARY_VERSION);
+    EXPECT_EQ(out_hdr.schema, TELEM_BINARY_SCHEMA);
+    EXPECT_EQ(out_hdr.flags, 0);
+    EXPECT_EQ(out_hdr.sections, TELEM_SECTION_ALL);
+    EXPECT_EQ(out_hdr.seq, hdr.seq);
+    EXPECT_EQ(out_hdr.time_us, hdr.time_us);
+    expect_near(in, out, TELEM_FIELD_ALL);
+}
+
+TEST(TelemBinaryTest, LayoutIsLittleEndian)
+{
+    TelemBinaryHeader hdr;
+    hdr.seq = 0x01020304;
+    TelemData in;
+    in.latitude = 1e-7;
+    uint8_t buf[TELEM_BINARY_MAX_SIZE];
+    encode_telem_binary(buf, hdr, in);
+    const uint8_t header[] = {0x54, 0x4D, TELEM_BINARY_VERSION, TELEM_BINARY_SCHEMA, 0, TELEM_SECTION_ALL, 0, 0, 4, 3, 2, 1};
+    EXPECT_EQ(memcmp(buf, header, sizeof(header)), 0);
+    const uint8_t lat[] = {1, 0, 0, 0};
+    EXPECT_EQ(memcmp(buf + TELEM_BINARY_HEADER_SIZE, lat, sizeof(lat)), 0);
+}
+
+TEST(TelemBinaryTest, EverySectionSelectionRoundTrips)
+{
+    TelemData in = sample_data();
+    for (uint8_t sections = 0; sections <= TELEM_SECTION_ALL; sections++)
+    {
+        TelemBinaryHeader hdr;
+        hdr.sections = sections;
+        uint8_t buf[TELEM_BINARY_MAX_SIZE];
+        size_t len = encode_telem_binary(buf, hdr, in);
+        uint32_t fields = telem_section_fields(sections);
+        ASSERT_EQ(len, TELEM_BINARY_HEADER_SIZE + telem_binary_body_size(fields));
+
+        TelemBinaryHeader out_hdr;
+        TelemData out;
+        ASSERT_TRUE(decode_telem_binary(buf, len, out_hdr, out)) << "sections " << (int)sections;
+        EXPECT_EQ(out_hdr.sections, sections);
+        expect_near(in, out, fields);
+        // the rest stays as it was
+        expect_near(TelemData(), out, TELEM_FIELD_ALL & ~fields);
+    }
+}
+
+TEST(TelemBinaryTest, DeltaFramesApplyOnTopOfThePrevious)
+{
+    std::mt19937 rng(7);
+    TelemData in = sample_data();
+    TelemData receiver;
+    uint8_t buf[TELEM_BINARY_MAX_SIZE];
+
+    TelemBinaryHeader key;
+    key.flags = TELEM_FLAG_DELTA | TELEM_FLAG_KEYFRAME;
+    TelemBinaryHeader out_hdr;
+    ASSERT_TRUE(decode_telem_binary(buf, encode_telem_binary(buf, key, in), out_hdr, receiver));
+    EXPECT_EQ(out_hdr.fields, (uint32_t)TELEM_FIELD_ALL);
+
+    for (int i = 0; i < 1000; i++)
+    {
+        TelemBinaryHeader hdr;
+        hdr.flags = TELEM_FLAG_DELTA;
+        hdr.seq = i + 1;
+        hdr.fields = rng() & TELEM_FIELD_ALL;
+        in.yaw_deg = (float)(i % 360) - 180.0f;
+        in.rel_alt = i * 0.01f;
+        in.isArmed = i & 1;
+        size_t len = encode_telem_binary(buf, hdr, in);
+        ASSERT_EQ(len, TELEM_BINARY_HEADER_SIZE + 4 + telem_binary_body_size(hdr.fields));
+        ASSERT_TRUE(decode_telem_binary(buf, len, out_hdr, receiver));
+        EXPECT_EQ(out_hdr.fields, hdr.fields);
+        // fields left out keep what an earlier frame carried
+        expect_near(in, receiver, hdr.fields);
+    }
+}
+
+TEST(TelemBinaryTest, UnrepresentableValuesDecodeToNaN)
+{
+    TelemData in;
+    in.latitude = NAN;
+    in.longitude = 1e10;
+    in.abs_alt = INFINITY;
+    in.vel_north = 400.0f;
+    in.climb_rate = -400.0f;
+    in.batt_voltage = -1.0f;
+    in.batt_percentage = NAN;
+
+    uint8_t buf[TELEM_BINARY_MAX_SIZE];
+    TelemBinaryHeader hdr;
+    TelemData out;
+    ASSERT_TRUE(decode_telem_binary(buf, encode_telem_binary(buf, TelemBinaryHeader(), in), hdr, out));
+    EXPECT_TRUE(std::isnan(out.latitude));
+    EXPECT_TRUE(std::isnan(out.longitude));
+    EXPECT_TRUE(std::isnan(out.abs_alt));
+    EXPECT_TRUE(std::isnan(out.vel_north));
+    EXPECT_TRUE(std::isnan(out.climb_rate));
+    EXPECT_TRUE(std::isnan(out.batt_voltage));
+    EXPECT_TRUE(std::isnan(out.batt_percentage));
+    EXPECT_EQ(out.rel_alt, 0.0f);
+}
+
+TEST(TelemBinaryTest, YawIsWrapped)
+{
+    const float cases[][2] = {{180.0f, -180.0f}, {270.0f, -90.0f}, {-190.0f, 170.0f}, {720.5f, 0.5f}};
+    for (auto &c : cases)
+    {
+        TelemData in;
+        in.yaw_deg = c[0];
+        uint8_t buf[TELEM_BINARY_MAX_SIZE];
+        TelemBinaryHeader hdr;
+        TelemData out;
+        ASSERT_TRUE(decode_telem_binary(buf, encode_telem_binary(buf, TelemBinaryHeader(), in), hdr, out));
+        EXPECT_NEAR(out.yaw_deg, c[1], 0.006) << "yaw " << c[0];
+    }
+}
+
+// every prefix of a valid frame is rejected without touching the output
+TEST(TelemBinaryTest, TruncatedFramesAreRejected)
+{
+    const uint8_t flags[] = {0, TELEM_FLAG_DELTA | TELEM_FLAG_KEYFRAME};
+    for (uint8_t f : flags)
+    {
+        TelemBinaryHeader hdr;
+        hdr.flags = f;
+        uint8_t buf[TELEM_BINARY_MAX_SIZE];
+        size_t len = encode_telem_binary(buf, hdr, sample_data());
+        for (size_t cut = 0; cut < len; cut++)
+        {
+            TelemBinaryHeader out_hdr;
+            TelemData out;
+            EXPECT_FALSE(decode_telem_binary(buf, cut, out_hdr, out)) << "length " << cut << " of " << len;
+            TelemData untouched;
+            EXPECT_EQ(memcmp(&out, &untouched, sizeof(out)), 0) << "length " << cut;
+        }
+    }
+}
+
+TEST(TelemBinaryTest, ForeignFramesAreRejected)
+{
+    uint8_t buf[TELEM_BINARY_MAX_SIZE];
+    size_t len = encode_telem_binary(buf, TelemBinaryHeader(), sample_data());
+    TelemBinaryHeader hdr;
+    TelemData out;
+
+    const size_t offsets[] = {0, 1, 2, 3};
+    for (size_t offset : offsets)
+    {
+        uint8_t bad[TELEM_BINARY_MAX_SIZE];
+        memcpy(bad, buf, len);
+        bad[offset] ^= 0xFF;
+        EXPECT_FALSE(decode_telem_binary(bad, len, hdr, out)) << "byte " << offset;
+    }
+
+    // a json datagram on the same port
+    const char json[] = "{\"angles\":{\"pitch\":0.0,\"roll\":0.0,\"yaw\":0.0}}";
+    EXPECT_FALSE(decode_telem_binary((const uint8_t *)json, sizeof(json) - 1, hdr, out));
+}
+
+// a delta frame whose field mask asks for more than the datagram holds
+TEST(TelemBinaryTest, DeltaFieldsBeyondTheFrameAreRejected)
+{
+    TelemBinaryHeader hdr;
+    hdr.flags = TELEM_FLAG_DELTA;
+    hdr.fields = TELEM_FIELD_YAW;
+    uint8_t buf[TELEM_BINARY_MAX_SIZE];
+    size_t len = encode_telem_binary(buf, hdr, sample_data());
+    telem_binary::put_u32(buf + TELEM_BINARY_HEADER_SIZE, TELEM_FIELD_ALL);
+
+    TelemBinaryHeader out_hdr;
+    TelemData out;
+    EXPECT_FALSE(decode_telem_binary(buf, len, out_hdr, out));
+}
@@ -0,0 +1,288 @@
+// Telemetry history ring: wraparound, time ranges, step and max, and the history command.
+
+#include <chrono>
+#include <string>
+#include <vector>
+#include <netinet/in.h>
+#include <gtest/gtest.h>
+#include "../lib/json.hpp"
+#include "../src/command_handler.h"
+#include "../src/mock_backend.h"
+#include "../src/telem_binary.h"
+#include "../src/telem_history.h"
+
+#define START_US 1700000000000000ull
+#define PERIOD_US 20000ull
+
+// every frame of a query has the same size
+static size_t frame_size(uint8_t sections)
+{
+    return TELEM_BINARY_HEADER_SIZE + telem_binary_body_size(telem_section_fields(sections));
+}
+
+struct Sample
+{
+    uint32_t index;
+    uint64_t time_us;
+    double latitude;
+};
+
+// samples every PERIOD_US from START_US on, latitude holds the sample number
+static void fill(TelemHistory &history, uint32_t count)
+{
+    for (uint32_t i = 0; i < count; i++)
+    {
+        TelemData data;
+        data.latitude = i * 1e-4;
+        history.record(START_US + i * PERIOD_US, data);
+    }
+}
+
+static std::vector<Sample> query(const TelemHistory &history, const HistoryQuery &q)
+{
+    std::string blob;
+    size_t count = history.query_binary(q, blob);
+    std::vector<Sample> samples;
+    for (size_t pos = 0; pos < blob.size();)
+    {
+        TelemBinaryHeader hdr;
+        TelemData data;
+        size_t size = frame_size(q.sections);
+        if (!decode_telem_binary((const uint8_t *)blob.data() + pos, size, hdr, data))
+        {
+            ADD_FAILURE() << "undecodable frame at " << pos;
+            break;
+        }
+        samples.push_back({hdr.seq, hdr.time_us, data.latitude});
+        pos += size;
+    }
+    EXPECT_EQ(count, samples.size());
+    return samples;
+}
+
+TEST(TelemHistoryTest, CapacityIsRoundedUp)
+{
+    EXPECT_EQ(TelemHistory(0).capacity(), 0u);
+    EXPECT_EQ(TelemHistory(1).capacity(), (size_t)HISTORY_MIN_SIZE);
+    EXPECT_EQ(TelemHistory(HISTORY_MIN_SIZE + 1).capacity(), (size_t)HISTORY_MIN_SIZE * 2);
+}
+
+TEST(TelemHistoryTest, DisabledHistoryIsEmpty)
+{
+    TelemHistory history(0);
+    fill(history, 10);
+    EXPECT_TRUE(query(history, HistoryQuery()).empty());
+}
+
+TEST(TelemHistoryTest, AllSamplesOldestFirst)
+{
+    TelemHistory history(HISTORY_MIN_SIZE);
+    fill(history, 100);
+    auto samples = query(history, HistoryQuery());
+    ASSERT_EQ(samples.size(), 100u);
+    for (uint32_t i = 0; i < 100; i++)
+    {
+        EXPECT_EQ(samples[i].index, i);
+        EXPECT_EQ(samples[i].time_us, START_US + i * PERIOD_US);
+        EXPECT_NEAR(samples[i].latitude, i * 1e-4, 1e-9);
+    }
+}
+
+TEST(TelemHistoryTest, WraparoundKeepsTheNewest)
+{
+    TelemHistory history(HISTORY_MIN_SIZE);
+    uint32_t total = HISTORY_MIN_SIZE * 3 + 17;
+    fill(history, total);
+    auto samples = query(history, HistoryQuery());
+    ASSERT_EQ(samples.size(), (size_t)HISTORY_MIN_SIZE);
+    EXPECT_EQ(samples.front().index, total - HISTORY_MIN_SIZE);
+    EXPECT_EQ(samples.back().index, total - 1);
+    for (size_t i = 1; i < samples.size(); i++)
+        EXPECT_EQ(samples[i].index, samples[i - 1].index + 1);
+
+    // a range that was overwritten is gone
+    HistoryQuery q;
+    q.to_us = START_US + 100 * PERIOD_US;
+    EXPECT_TRUE(query(history, q).empty());
+}
+
+TEST(TelemHistoryTest, RangeIncludesBothEnds)
+{
+    TelemHistory history(HISTORY_MIN_SIZE);
+    uint32_t total = HISTORY_MIN_SIZE + 500;
+    fill(history, total);
+
+    HistoryQuery q;
+    q.from_us = START_US + 1000 * PERIOD_US;
+    q.to_us = START_US + 1100 * PERIOD_US;
+    auto samples = query(history, q);
+    ASSERT_EQ(samples.size(), 101u);
+    EXPECT_EQ(samples.front().index, 1000u);
+    EXPECT_EQ(samples.back().index, 1100u);
+
+    // between two samples
+    q.from_us = START_US + 1000 * PERIOD_US + 1;
+    q.to_us = START_US + 1001 * PERIOD_US - 1;
+    EXPECT_TRUE(query(history, q).empty());
+
+    // after the newest, and upside down
+    q.from_us = START_US + total * PERIOD_US;
+    q.to_us = UINT64_MAX;
+    EXPECT_TRUE(query(history, q).empty());
+    q.from_us = START_US + 1100 * PERIOD_US;
+    q.to_us = START_US + 1000 * PERIOD_US;
+    EXPECT_TRUE(query(history, q).empty());
+
+    // before the oldest still kept starts at the oldest
+    q.from_us = 0;
+    q.to_us = START_US + (total - HISTORY_MIN_SIZE) * PERIOD_US;
+    samples = query(history, q);
+    ASSERT_EQ(samples.size(), 1u);
+    EXPECT_EQ(samples[0].index, total - HISTORY_MIN_SIZE);
+}
+
+TEST(TelemHistoryTest, StepKeepsOneSamplePerStep)
+{
+    TelemHistory history(HISTORY_MIN_SIZE);
+    fill(history, 500);
+    HistoryQuery q;
+    q.step_us = 5 * PERIOD_US;
+    auto samples = query(history, q);
+    ASSERT_EQ(samples.size(), 100u);
+    for (size_t i = 0; i < samples.size(); i++)
+        EXPECT_EQ(samples[i].index, i * 5);
+
+    // with max as well the step goes on at the next picked sample
+    TelemHistory longer(HISTORY_MIN_SIZE);
+    fill(longer, 1001);
+    q.max_samples = 101;
+    q.step_us = 25 * PERIOD_US;
+    samples = query(longer, q);
+    ASSERT_EQ(samples.size(), 34u);
+    for (size_t i = 0; i < samples.size(); i++)
+        EXPECT_EQ(samples[i].index, i * 30);
+}
+
+// max spreads the samples over the whole range, the newest is always there
+TEST(TelemHistoryTest, MaxDecimatesEvenly)
+{
+    TelemHistory history(HISTORY_MIN_SIZE);
+    fill(history, 1001);
+    HistoryQuery q;
+    q.max_samples = 11;
+    auto samples = query(history, q);
+    ASSERT_EQ(samples.size(), 11u);
+    for (size_t i = 0; i < samples.size(); i++)
+        EXPECT_EQ(samples[i].index, i * 100);
+
+    q.max_samples = 1;
+    samples = query(history, q);
+    ASSERT_EQ(samples.size(), 1u);
+    EXPECT_EQ(samples[0].index, 1000u);
+
+    q.max_samples = 0;
+    EXPECT_TRUE(query(history, q).empty());
+
+    // fewer samples than max are all returned
+    q.max_samples = 5000;
+    EXPECT_EQ(query(history, q).size(), 1001u);
+}
+
+TEST(TelemHistoryTest, JsonHasTimeAndTelemetry)
+{
+    TelemHistory history(HISTORY_MIN_SIZE);
+    fill(history, 3);
+    JsonWriter w;
+    HistoryQuery q;
+    q.sections = TELEM_SECTION_POSITION;
+    EXPECT_EQ(history.query_json(q, w), 3u);
+    auto doc = nlohmann::json::parse(w.str());
+    ASSERT_EQ(doc["samples"].size(), 3u);
+    EXPECT_NEAR((double)doc["samples"][2]["t"], (START_US + 2 * PERIOD_US) / 1e6, 1e-3);
+    EXPECT_NEAR((double)doc["samples"][2]["telem"]["position"]["lat"], 2e-4, 1e-9);
+    EXPECT_FALSE(doc["samples"][2]["telem"].contains("velocity"));
+}
+
+// the history command on a handler with a mock vehicle
+class HistoryCommandTest : public ::testing::Test
+{
+protected:
+    void SetUp() override
+    {
+        fill(history, 1000);
+    }
+
+    std::string call(const std::string &request)
+    {
+        std::string response;
+        struct sockaddr_in peer = {};
+        peer.sin_family = AF_INET;
+        handler.handle(request, peer, [&response](std::string r)
+                       { response = std::move(r); });
+        return response;
+    }
+
+    size_t samples(const std::string &request)
+    {
+        auto doc = nlohmann::json::parse(call(request), nullptr, false);
+        return doc.is_object() && doc.contains("samples") ? doc["samples"].size() : SIZE_MAX;
+    }
+
+    ServerConfig config;
+    TelemPack pack;
+    TelemHistory history{HISTORY_MIN_SIZE};
+    SubscriberRegistry subscribers;
+    PublishStats publish_stats;
+    MetricsRegistry metrics;
+    MockBackend vehicle{metrics};
+    OffboardWatchdog watchdog{std::chrono::milliseconds(2000)};
+    ControlExecutor control;
+    CommandHandler handler{config, pack, history, subscribers, publish_stats, vehicle, watchdog, control, metrics, nullptr, false};
+};
+
+TEST_F(HistoryCommandTest, RangeStepAndMax)
+{
+    double start_s = START_US / 1e6;
+    EXPECT_EQ(samples(R"({"command": "history"})"), 1000u);
+    EXPECT_EQ(samples(R"({"command": "history", "from": )" + std::to_string(start_s + 10.0) + "}"), 500u);
+    EXPECT_EQ(samples(R"({"command": "history", "step": 0.1})"), 200u);
+    EXPECT_EQ(samples(R"({"command": "history", "max": 10})"), 10u);
+    // the samples are years old
+    EXPECT_EQ(samples(R"({"command": "history", "last": 60})"), 0u);
+}
+
+TEST_F(HistoryCommandTest, BinaryFormat)
+{
+    std::string blob = call(R"({"command": "history", "format": "binary", "fields": ["position"], "max": 4})");
+    EXPECT_EQ(blob.size(), 4 * frame_size(TELEM_SECTION_POSITION));
+}
+
+// values past what the fields hold are clamped, not cast
+TEST_F(HistoryCommandTest, HugeValuesAreClamped)
+{
+    EXPECT_EQ(samples(R"({"command": "history", "max": 1e300})"), 1000u);
+    EXPECT_EQ(samples(R"({"command": "history", "max": -5})"), 0u);
+    EXPECT_EQ(samples(R"({"command": "history", "to": 1e300})"), 1000u);
+    EXPECT_EQ(samples(R"({"command": "history", "from": 1e300})"), 0u);
+    EXPECT_EQ(samples(R"({"command": "history", "from": -1e300})"), 1000u);
+    EXPECT_EQ(samples(R"({"command": "history", "step": 1e300})"), 1u);
+    EXPECT_EQ(samples(R"({"command": "history", "last": 1e300})"), 1000u);
+}
+
+// json has no infinity, numbers past a double already fail to parse, answered with the
+// parser's error like any other malformed request
+TEST_F(HistoryCommandTest, NonFiniteValuesAreErrors)
+{
+    for (const char *field : {"from", "to", "step", "max", "last"})
+    {
+        std::string response = call(std::string(R"({"command": "history", ")") + field + R"(": 1e400})");
+        EXPECT_EQ(response.compare(0, 16, "[json.exception."), 0) << field << ": " << response;
+    }
+    EXPECT_NE(call(R"({"command": "history", "max": "many"})").find("type_error"), std::string::npos);
+}
+
+TEST_F(HistoryCommandTest, BadFormatAndFields)
+{
+    EXPECT_EQ(call(R"({"command": "history", "format": "xml"})"), std::string("failed format", 14));
+    EXPECT_EQ(call(R"({"command": "history", "fields": ["nope"]})"), std::string("failed fields", 14));
+}
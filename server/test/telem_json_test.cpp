@@ -0,0 +1,191 @@
+// write_telem_json against the nlohmann document it replaced, byte for byte.
+
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <random>
+#include <gtest/gtest.h>
+#include "../bench/legacy_telem.h"
+#include "../src/telem_json.h"
+
+// values nlohmann and the writer have to agree on, besides plain random ones
+static const double SPECIAL_VALUES[] = {
+    0.0,
+    -0.0,
+    std::numeric_limits<double>::quiet_NaN(),
+    std::numeric_limits<double>::infinity(),
+    -std::numeric_limits<double>::infinity(),
+    std::numeric_limits<double>::denorm_min(),
+    std::numeric_limits<double>::max(),
+    std::numeric_limits<double>::lowest(),
+    1e-7,
+    47.397742,
+    -122.0,
+    1e21,
+    123456789.0,
+};
+
+// object and key of every field bit, misc covers its three flags
+struct FieldKey
+{
+    uint32_t field;
+    const char *object;
+    const char *key;
+};
+
+static const FieldKey FIELD_KEYS[] = {
+    {TELEM_FIELD_LAT, "position", "lat"},
+    {TELEM_FIELD_LON, "position", "lon"},
+    {TELEM_FIELD_ALT_ABS, "position", "alt_abs"},
+    {TELEM_FIELD_ALT_REL, "position", "alt_rel"},
+    {TELEM_FIELD_VEL_NORTH, "velocity", "north"},
+    {TELEM_FIELD_VEL_EAST, "velocity", "east"},
+    {TELEM_FIELD_VEL_DOWN, "velocity", "down"},
+    {TELEM_FIELD_AIRSPEED, "plane", "airspeed"},
+    {TELEM_FIELD_CLIMB_RATE, "plane", "climbrate"},
+    {TELEM_FIELD_PITCH, "angles", "pitch"},
+    {TELEM_FIELD_ROLL, "angles", "roll"},
+    {TELEM_FIELD_YAW, "angles", "yaw"},
+    {TELEM_FIELD_BATT_PERCENT, "battery", "percent"},
+    {TELEM_FIELD_BATT_VOLTAGE, "battery", "voltage"},
+};
+
+class TelemJsonTest : public ::testing::Test
+{
+protected:
+    double next_value()
+    {
+        std::uniform_int_distribution<size_t> pick(0, 3 * sizeof(SPECIAL_VALUES) / sizeof(SPECIAL_VALUES[0]));
+        size_t i = pick(rng_);
+        if (i < sizeof(SPECIAL_VALUES) / sizeof(SPECIAL_VALUES[0]))
+            return SPECIAL_VALUES[i];
+        // any bit pattern, NaN payloads and subnormals included
+        uint64_t bits = rng_();
+        double x;
+        memcpy(&x, &bits, sizeof(x));
+        return i & 1 ? x : std::uniform_real_distribution<double>(-1000.0, 1000.0)(rng_);
+    }
+
+    float next_float()
+    {
+        return (float)next_value();
+    }
+
+    TelemData random_pack()
+    {
+        TelemData d;
+        d.latitude = next_value();
+        d.longitude = next_value();
+        d.abs_alt = next_float();
+        d.rel_alt = next_float();
+        d.vel_north = next_float();
+        d.vel_east = next_float();
+        d.vel_down = next_float();
+        d.airspeed = next_float();
+        d.climb_rate = next_float();
+        d.roll_deg = next_float();
+        d.pitch_deg = next_float();
+        d.yaw_deg = next_float();
+        d.batt_percentage = next_float();
+        d.batt_voltage = next_float();
+        d.isAllOk = rng_() & 1;
+        d.isArmed = rng_() & 1;
+        d.inAir = rng_() & 1;
+        return d;
+    }
+
+    std::mt19937_64 rng_{20240517};
+};
+
+TEST_F(TelemJsonTest, FullDocumentMatchesNlohmann)
+{
+    JsonWriter w;
+    for (int i = 0; i < 20000; i++)
+    {
+        TelemData d = random_pack();
+        w.clear();
+        write_telem_json(w, d);
+        ASSERT_EQ(w.str(), legacy_pack_to_json(d)) << "pack " << i;
+    }
+}
+
+TEST_F(TelemJsonTest, SpecialValuesMatchNlohmann)
+{
+    JsonWriter w;
+    for (double x : SPECIAL_VALUES)
+    {
+        TelemData d;
+        d.latitude = x;
+        d.longitude = -x;
+        d.abs_alt = (float)x;
+        d.rel_alt = (float)-x;
+        d.yaw_deg = (float)x;
+        w.clear();
+        write_telem_json(w, d);
+        EXPECT_EQ(w.str(), legacy_pack_to_json(d)) << "value " << x;
+    }
+}
+
+TEST_F(TelemJsonTest, NegativeZeroKeepsItsSign)
+{
+    TelemData d;
+    d.latitude = -0.0;
+    d.rel_alt = -0.0f;
+    JsonWriter w;
+    write_telem_json(w, d);
+    EXPECT_NE(w.str().find("\"alt_rel\":-0.0"), std::string::npos) << w.str();
+    EXPECT_NE(w.str().find("\"lat\":-0.0"), std::string::npos) << w.str();
+}
+
+TEST_F(TelemJsonTest, NonFiniteValuesBecomeNull)
+{
+    TelemData d;
+    d.latitude = std::numeric_limits<double>::quiet_NaN();
+    d.abs_alt = std::numeric_limits<float>::infinity();
+    d.rel_alt = -std::numeric_limits<float>::infinity();
+    JsonWriter w;
+    write_telem_json(w, d);
+    EXPECT_NE(w.str().find("\"lat\":null"), std::string::npos) << w.str();
+    EXPECT_NE(w.str().find("\"alt_abs\":null"), std::string::npos) << w.str();
+    EXPECT_NE(w.str().find("\"alt_rel\":null"), std::string::npos) << w.str();
+}
+
+// a subscriber's profile is the full document with the other objects and values removed
+TEST_F(TelemJsonTest, SelectedFieldsMatchTrimmedDocument)
+{
+    JsonWriter w;
+    for (int i = 0; i < 20000; i++)
+    {
+        TelemData d = random_pack();
+        uint8_t sections = (uint8_t)(rng_() & TELEM_SECTION_ALL);
+        uint32_t fields = (uint32_t)(rng_() & TELEM_FIELD_ALL);
+
+        nlohmann::json expected = legacy_telem_tree(d);
+        uint32_t selected = fields & telem_section_fields(sections);
+        for (auto &f : FIELD_KEYS)
+            if (!(selected & f.field))
+                expected[f.object].erase(f.key);
+        if (!(selected & TELEM_FIELD_MISC))
+            expected.erase("misc");
+        for (auto it = expected.begin(); it != expected.end();)
+            it = it->empty() ? expected.erase(it) : std::next(it);
+
+        w.clear();
+        write_telem_json(w, d, sections, fields);
+        ASSERT_EQ(w.str(), expected.dump()) << "sections " << (int)sections << " fields " << fields;
+    }
+}
+
+TEST_F(TelemJsonTest, ClearReusesTheBuffer)
+{
+    JsonWriter w;
+    TelemData d = random_pack();
+    write_telem_json(w, d);
+    const char *data = w.data();
+    for (int i = 0; i < 100; i++)
+    {
+        w.clear();
+        write_telem_json(w, random_pack());
+    }
+    EXPECT_EQ(w.data(), data);
+}
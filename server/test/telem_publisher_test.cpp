@@ -0,0 +1,137 @@
+// Cadence of publisher streams, for subscribers that join a running loop.
+
+#include <arpa/inet.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <unistd.h>
+#include <gtest/gtest.h>
+#include "../src/telem_publisher.h"
+
+// a running publisher and one loopback socket to subscribe with
+class TelemPublisherTest : public ::testing::Test
+{
+protected:
+    void SetUp() override
+    {
+        send_fd = socket(AF_INET, SOCK_DGRAM, 0);
+        sink_fd = socket(AF_INET, SOCK_DGRAM, 0);
+        ASSERT_GE(send_fd, 0);
+        ASSERT_GE(sink_fd, 0);
+        int rcvbuf = 1 << 20;
+        setsockopt(sink_fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+        struct sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t len = sizeof(addr);
+        ASSERT_EQ(bind(sink_fd, (struct sockaddr *)&addr, len), 0);
+        ASSERT_EQ(getsockname(sink_fd, (struct sockaddr *)&addr, &len), 0);
+        sink = TelemDest::inet(addr);
+    }
+
+    void TearDown() override
+    {
+        stop();
+        close(send_fd);
+        close(sink_fd);
+    }
+
+    void start(const PublishConfig &config)
+    {
+        publisher.reset(new TelemPublisher(send_fd, -1, pack, registry, stats, config));
+        sender = std::thread([this]()
+                             { publisher->run(); });
+    }
+
+    void stop()
+    {
+        updating = false;
+        if (updater.joinable())
+            updater.join();
+        if (publisher)
+            publisher->stop();
+        if (sender.joinable())
+            sender.join();
+    }
+
+    // pack updates every interval, like mavsdk callbacks
+    void feed(std::chrono::microseconds interval)
+    {
+        updating = true;
+        updater = std::thread([this, interval]()
+                              {
+                                  for (double lat = 0.0; updating.load(); lat += 1e-6)
+                                  {
+                                      pack.update([lat](TelemData &d)
+                                                  { d.latitude = lat; });
+                                      std::this_thread::sleep_for(interval);
+                                  } });
+    }
+
+    size_t drain()
+    {
+        size_t n = 0;
+        char buf[2048];
+        while (recv(sink_fd, buf, sizeof(buf), MSG_DONTWAIT) > 0)
+            n++;
+        return n;
+    }
+
+    int send_fd = -1;
+    int sink_fd = -1;
+    TelemDest sink;
+    TelemPack pack;
+    SubscriberRegistry registry;
+    PublishStats stats;
+    std::unique_ptr<TelemPublisher> publisher;
+    std::thread sender;
+    std::thread updater;
+    std::atomic<bool> updating{false};
+};
+
+// a stream started between two ticks has to be due on the very next one
+TEST_F(TelemPublisherTest, PeriodicSubscriberAddedMidRunGetsEveryTick)
+{
+    start(PublishConfig());
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+
+    TelemProfile profile;
+    profile.format = TelemFormat::Binary;
+    registry.add(sink, profile, std::chrono::milliseconds(0));
+    // the first tick that sees the subscriber
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    drain();
+    uint64_t ticks = stats.ticks.load();
+    std::this_thread::sleep_for(std::chrono::seconds(2));
+    uint64_t elapsed_ticks = stats.ticks.load() - ticks;
+    size_t received = drain();
+
+    // one tick may straddle either end of the window
+    EXPECT_GE(received + 1, elapsed_ticks);
+    EXPECT_LE(received, elapsed_ticks + 1);
+}
+
+// updates come at 66 Hz, so the 50 Hz stream mostly sends on its own deadline,
+// waking up late for it must not stretch the next period
+TEST_F(TelemPublisherTest, EventStreamKeepsItsRate)
+{
+    PublishConfig config;
+    config.mode = PublishMode::Event;
+    feed(std::chrono::microseconds(15000));
+    start(config);
+
+    TelemProfile profile;
+    profile.format = TelemFormat::Binary;
+    profile.rate = 50.0f;
+    registry.add(sink, profile, std::chrono::milliseconds(0));
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    drain();
+    auto start = std::chrono::steady_clock::now();
+    std::this_thread::sleep_for(std::chrono::seconds(2));
+    size_t received = drain();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    // never more than the rate, and not a lot less either
+    EXPECT_LE(received, 50.0 * seconds + 2);
+    EXPECT_GE(received, 50.0 * seconds * 0.9);
+}
@@ -0,0 +1,105 @@
+// Playing a flight log recorded by FlightRecorder back through TelemReplay.
+
+#include <chrono>
+#include <cstdlib>
+#include <future>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include <gtest/gtest.h>
+#include "../src/flight_recorder.h"
+#include "../src/telem_replay.h"
+
+#define START_US 1700000000000000ull
+
+class TelemReplayTest : public ::testing::Test
+{
+protected:
+    void SetUp() override
+    {
+        char tmpl[] = "/tmp/telem_replay_test_XXXXXX";
+        ASSERT_NE(mkdtemp(tmpl), nullptr);
+        dir = tmpl;
+    }
+
+    void TearDown() override
+    {
+        for (auto &path : telem_log_segments(dir))
+            unlink(path.c_str());
+        rmdir(dir.c_str());
+    }
+
+    // count samples period_us apart, latitude holds the sample number, a command after each
+    void record(int count, uint64_t period_us)
+    {
+        FlightRecorder recorder;
+        ASSERT_TRUE(recorder.open(dir, RECORDER_MIN_SEGMENT));
+        for (int i = 0; i < count; i++)
+        {
+            TelemData data;
+            data.latitude = i;
+            recorder.record_telem(START_US + i * period_us, data);
+            recorder.record_command(START_US + i * period_us + 1, R"({"command": "hold"})");
+        }
+        recorder.stop();
+    }
+
+    std::string dir;
+    TelemReplay replay;
+};
+
+TEST_F(TelemReplayTest, EmptyDirDoesNotOpen)
+{
+    EXPECT_FALSE(replay.open(dir));
+}
+
+// speed 0 plays every sample in order at once, commands are skipped
+TEST_F(TelemReplayTest, FullSpeedPlaysEverySampleInOrder)
+{
+    // an hour between samples, waiting for any of them would not finish
+    record(50, 3600000000ull);
+    ASSERT_TRUE(replay.open(dir));
+
+    std::vector<double> played;
+    replay.run(0.0, 2, [&played](const TelemData &data)
+               { played.push_back(data.latitude); });
+
+    ASSERT_EQ(played.size(), 100u);
+    EXPECT_EQ(replay.samples(), 100u);
+    for (size_t i = 0; i < played.size(); i++)
+        EXPECT_EQ(played[i], (double)(i % 50));
+}
+
+// the recorded gaps divided by speed, a lower bound only as the machine may be slow
+TEST_F(TelemReplayTest, AcceleratedSpeedKeepsTheGaps)
+{
+    record(11, 100000);
+    ASSERT_TRUE(replay.open(dir));
+
+    std::vector<double> played;
+    auto start = std::chrono::steady_clock::now();
+    replay.run(10.0, 1, [&played](const TelemData &data)
+               { played.push_back(data.latitude); });
+    EXPECT_GE(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(100));
+
+    ASSERT_EQ(played.size(), 11u);
+    for (size_t i = 0; i < played.size(); i++)
+        EXPECT_EQ(played[i], (double)i);
+}
+
+// the second sample is due in an hour, stop() ends the wait for it
+TEST_F(TelemReplayTest, StopInterruptsAWait)
+{
+    record(2, 3600000000ull);
+    ASSERT_TRUE(replay.open(dir));
+
+    std::promise<void> first;
+    std::thread thread([this, &first]()
+                       { replay.run(1.0, 0, [&first](const TelemData &)
+                                    { first.set_value(); }); });
+    first.get_future().wait();
+    replay.stop();
+    thread.join();
+    EXPECT_EQ(replay.samples(), 1u);
+}